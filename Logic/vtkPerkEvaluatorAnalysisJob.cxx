@@ -0,0 +1,285 @@
+
+// PerkEvaluator Logic includes
+#include "vtkPerkEvaluatorAnalysisJob.h"
+
+// VTK includes
+#include <vtkObjectFactory.h>
+
+// STD includes
+#include <algorithm>
+
+
+//----------------------------------------------------------------------------
+
+vtkStandardNewMacro( vtkPerkEvaluatorAnalysisJob );
+
+
+// Constructors and Destructors ----------------------------------------------
+
+vtkPerkEvaluatorAnalysisJob
+::vtkPerkEvaluatorAnalysisJob()
+{
+  this->PerkEvaluatorNodeID = "";
+  this->Threader = vtkSmartPointer< vtkMultiThreader >::New();
+  this->ThreadID = -1;
+  this->Mutex = vtkSmartPointer< vtkSimpleMutexLock >::New();
+  this->State = Pending;
+  this->NumCompletedJobs = 0;
+  this->ScriptProgress = 0;
+  this->CanceledFlag = false;
+  this->LastPublishedProgress = -1;
+}
+
+
+vtkPerkEvaluatorAnalysisJob
+::~vtkPerkEvaluatorAnalysisJob()
+{
+  // The worker uses the jobs, so it must be done before they are destroyed
+  this->Cancel();
+  this->Wait();
+}
+
+
+void vtkPerkEvaluatorAnalysisJob
+::PrintSelf( ostream& os, vtkIndent indent )
+{
+  this->Superclass::PrintSelf( os, indent );
+
+  os << indent << "PerkEvaluatorNodeID: " << this->PerkEvaluatorNodeID << "\n";
+  os << indent << "NumberOfNativeMetricJobs: " << this->NativeMetricJobs.size() << "\n";
+  os << indent << "NumberOfScriptMetricInstances: " << this->ScriptMetricInstanceIDs.size() << "\n";
+  os << indent << "RangeBuild: " << this->GetRangeBuild() << "\n";
+  os << indent << "State: " << this->GetState() << "\n";
+  os << indent << "Progress: " << this->GetProgress() << "\n";
+}
+
+
+// Setup ----------------------------------------------
+
+void vtkPerkEvaluatorAnalysisJob
+::SetPerkEvaluatorNodeID( std::string newPerkEvaluatorNodeID )
+{
+  this->PerkEvaluatorNodeID = newPerkEvaluatorNodeID;
+}
+
+
+std::string vtkPerkEvaluatorAnalysisJob
+::GetPerkEvaluatorNodeID()
+{
+  return this->PerkEvaluatorNodeID;
+}
+
+
+std::vector< vtkSlicerPerkEvaluatorLogic::NativeMetricJob >& vtkPerkEvaluatorAnalysisJob
+::GetNativeMetricJobs()
+{
+  return this->NativeMetricJobs;
+}
+
+
+void vtkPerkEvaluatorAnalysisJob
+::SetScriptMetricInstanceIDs( std::vector< std::string > newScriptMetricInstanceIDs )
+{
+  this->ScriptMetricInstanceIDs = newScriptMetricInstanceIDs;
+}
+
+
+std::vector< std::string > vtkPerkEvaluatorAnalysisJob
+::GetScriptMetricInstanceIDs()
+{
+  return this->ScriptMetricInstanceIDs;
+}
+
+
+void vtkPerkEvaluatorAnalysisJob
+::SetRangeMetricKeys( std::vector< std::string > newRangeMetricKeys, std::vector< std::string > newRangeMetricSignatures )
+{
+  this->RangeMetricKeys = newRangeMetricKeys;
+  this->RangeMetricSignatures = newRangeMetricSignatures;
+}
+
+
+std::vector< std::string > vtkPerkEvaluatorAnalysisJob
+::GetRangeMetricKeys()
+{
+  return this->RangeMetricKeys;
+}
+
+
+std::vector< std::string > vtkPerkEvaluatorAnalysisJob
+::GetRangeMetricSignatures()
+{
+  return this->RangeMetricSignatures;
+}
+
+
+bool vtkPerkEvaluatorAnalysisJob
+::GetRangeBuild()
+{
+  return ! this->RangeMetricKeys.empty();
+}
+
+
+// Worker ----------------------------------------------
+
+VTK_THREAD_RETURN_TYPE vtkPerkEvaluatorAnalysisJob
+::WorkerThreadFunction( void* arg )
+{
+  vtkMultiThreader::ThreadInfo* threadInfo = static_cast< vtkMultiThreader::ThreadInfo* >( arg );
+  vtkPerkEvaluatorAnalysisJob* self = static_cast< vtkPerkEvaluatorAnalysisJob* >( threadInfo->UserData );
+
+  for ( unsigned int i = 0; i < self->NativeMetricJobs.size(); i++ )
+  {
+    if ( self->CanceledFlag )
+    {
+      break;
+    }
+    vtkSlicerPerkEvaluatorLogic::RunNativeMetricJob( self->NativeMetricJobs.at( i ), &self->CanceledFlag );
+
+    self->Mutex->Lock();
+    self->NumCompletedJobs++;
+    self->Mutex->Unlock();
+  }
+
+  self->Mutex->Lock();
+  if ( self->State == Running )
+  {
+    self->State = self->CanceledFlag ? Canceled : Computed;
+  }
+  self->Mutex->Unlock();
+
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+
+void vtkPerkEvaluatorAnalysisJob
+::Start()
+{
+  this->Mutex->Lock();
+  if ( this->State != Pending )
+  {
+    this->Mutex->Unlock();
+    return;
+  }
+  this->State = Running;
+  this->NumCompletedJobs = 0;
+  this->Mutex->Unlock();
+
+  // Nothing to wait for, the script metrics are computed when the results are applied
+  if ( this->NativeMetricJobs.empty() )
+  {
+    this->SetState( Computed );
+    return;
+  }
+
+  this->ThreadID = this->Threader->SpawnThread( ( vtkThreadFunctionType ) &vtkPerkEvaluatorAnalysisJob::WorkerThreadFunction, this );
+}
+
+
+void vtkPerkEvaluatorAnalysisJob
+::Cancel()
+{
+  this->Mutex->Lock();
+  this->CanceledFlag = true;
+  if ( this->State == Pending || this->State == Computed )
+  {
+    this->State = Canceled;
+  }
+  this->Mutex->Unlock();
+
+  // Only set while the script metrics are computed, on the main thread
+  if ( this->ScriptMetricsNode != NULL )
+  {
+    this->ScriptMetricsNode->SetAnalysisState( -1 ); // This will halt the Python metrics calculator
+  }
+}
+
+
+void vtkPerkEvaluatorAnalysisJob
+::Wait()
+{
+  if ( this->ThreadID < 0 )
+  {
+    return;
+  }
+
+  this->Threader->TerminateThread( this->ThreadID ); // Joins the thread
+  this->ThreadID = -1;
+}
+
+
+// State ----------------------------------------------
+
+vtkPerkEvaluatorAnalysisJob::StateEnum vtkPerkEvaluatorAnalysisJob
+::GetState()
+{
+  this->Mutex->Lock();
+  StateEnum state = this->State;
+  this->Mutex->Unlock();
+  return state;
+}
+
+
+void vtkPerkEvaluatorAnalysisJob
+::SetState( StateEnum newState )
+{
+  this->Mutex->Lock();
+  this->State = newState;
+  this->Mutex->Unlock();
+}
+
+
+int vtkPerkEvaluatorAnalysisJob
+::GetProgress()
+{
+  this->Mutex->Lock();
+  int numNativeJobs = this->NativeMetricJobs.size();
+  int numScriptMetrics = this->ScriptMetricInstanceIDs.size();
+  int progress = 100;
+  if ( numNativeJobs + numScriptMetrics > 0 )
+  {
+    progress = ( 100 * this->NumCompletedJobs + this->ScriptProgress * numScriptMetrics ) / ( numNativeJobs + numScriptMetrics );
+  }
+  this->Mutex->Unlock();
+  return progress;
+}
+
+
+bool vtkPerkEvaluatorAnalysisJob
+::GetCanceled()
+{
+  this->Mutex->Lock();
+  bool canceled = this->CanceledFlag;
+  this->Mutex->Unlock();
+  return canceled;
+}
+
+
+int vtkPerkEvaluatorAnalysisJob
+::GetLastPublishedProgress()
+{
+  return this->LastPublishedProgress;
+}
+
+
+void vtkPerkEvaluatorAnalysisJob
+::SetLastPublishedProgress( int newLastPublishedProgress )
+{
+  this->LastPublishedProgress = newLastPublishedProgress;
+}
+
+
+void vtkPerkEvaluatorAnalysisJob
+::SetScriptProgress( int newScriptProgress )
+{
+  this->Mutex->Lock();
+  this->ScriptProgress = std::max( 0, std::min( newScriptProgress, 100 ) );
+  this->Mutex->Unlock();
+}
+
+
+void vtkPerkEvaluatorAnalysisJob
+::SetScriptMetricsNode( vtkMRMLPerkEvaluatorNode* newScriptMetricsNode )
+{
+  this->ScriptMetricsNode = newScriptMetricsNode;
+}
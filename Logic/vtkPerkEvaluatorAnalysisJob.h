@@ -0,0 +1,130 @@
+// .NAME vtkPerkEvaluatorAnalysisJob - analysis of a Perk Evaluator node running on a worker thread
+// .SECTION Description
+// The logic prepares the native metrics of the node on the main thread (resolving everything from the scene, and
+// taking its own copies of the trajectories), then the job computes them on a worker thread. The progress and the
+// cancellation flag are guarded by a mutex, so they can be read and set from any thread. Events are only invoked
+// by the logic on the main thread (see vtkSlicerPerkEvaluatorLogic::ProcessAnalysisJobs), which also applies the
+// results to the metrics table in a single modification once the worker is done.
+// Only the native metrics are computed in the background. The script metrics are computed through Python on the
+// main thread when the results are applied, and their progress (as reported by the Python metrics calculator) is
+// part of the job's progress, so the job does not report 100% before they are done. The application is blocked
+// while they are computed, except for the events the Python metrics calculator processes; canceling the job then
+// halts the calculator (through the Perk Evaluator node's analysis state), and the results are not applied.
+// A job can also build the range metrics of a node (see vtkSlicerPerkEvaluatorLogic::ComputeMetricsOverMarkedRange),
+// then the native metrics are stored by the logic under their range keys rather than written to the metrics table.
+
+
+#ifndef __vtkPerkEvaluatorAnalysisJob_h
+#define __vtkPerkEvaluatorAnalysisJob_h
+
+// VTK includes
+#include "vtkCommand.h"
+#include "vtkMultiThreader.h"
+#include "vtkMutexLock.h"
+#include "vtkObject.h"
+#include "vtkSmartPointer.h"
+#include "vtkWeakPointer.h"
+
+// STD includes
+#include <string>
+#include <vector>
+
+// PerkEvaluator includes
+#include "vtkSlicerPerkEvaluatorLogic.h"
+
+#include "vtkSlicerPerkEvaluatorModuleLogicExport.h"
+
+
+
+class VTK_SLICER_PERKEVALUATOR_MODULE_LOGIC_EXPORT
+vtkPerkEvaluatorAnalysisJob
+ : public vtkObject
+{
+public:
+
+  enum
+  {
+    ProgressEvent = vtkCommand::UserEvent + 1, // Call data is the progress in percent (int*)
+    FinishedEvent // After the results were applied, or after the job was canceled
+  };
+
+  enum StateEnum
+  {
+    Pending,
+    Running,
+    Computed, // The worker is done, but the results have not been applied yet
+    Applied,
+    Canceled
+  };
+
+  static vtkPerkEvaluatorAnalysisJob* New();
+  vtkTypeMacro( vtkPerkEvaluatorAnalysisJob, vtkObject );
+  void PrintSelf( ostream& os, vtkIndent indent );
+
+  // Setup (before starting)
+  void SetPerkEvaluatorNodeID( std::string newPerkEvaluatorNodeID );
+  std::string GetPerkEvaluatorNodeID();
+  std::vector< vtkSlicerPerkEvaluatorLogic::NativeMetricJob >& GetNativeMetricJobs();
+  void SetScriptMetricInstanceIDs( std::vector< std::string > newScriptMetricInstanceIDs );
+  std::vector< std::string > GetScriptMetricInstanceIDs();
+  // One key and signature for each native metric job (empty unless the job builds range metrics)
+  void SetRangeMetricKeys( std::vector< std::string > newRangeMetricKeys, std::vector< std::string > newRangeMetricSignatures );
+  std::vector< std::string > GetRangeMetricKeys();
+  std::vector< std::string > GetRangeMetricSignatures();
+  bool GetRangeBuild();
+
+  // Run the native metrics on a worker thread
+  void Start();
+  // Stop as soon as possible (the results are never applied)
+  // While the script metrics are computed, this also halts the Python metrics calculator
+  void Cancel();
+  // Block until the worker is done
+  void Wait();
+
+  // Safe to call from any thread
+  StateEnum GetState();
+  int GetProgress(); // Percent of the metrics computed (native and script metrics, weighted by their number)
+  bool GetCanceled();
+
+  // Only for the logic, on the main thread
+  void SetState( StateEnum newState );
+  int GetLastPublishedProgress();
+  void SetLastPublishedProgress( int newLastPublishedProgress );
+  void SetScriptProgress( int newScriptProgress ); // Percent of the script metrics computed
+  void SetScriptMetricsNode( vtkMRMLPerkEvaluatorNode* newScriptMetricsNode ); // The node whose script metrics are being computed (or NULL)
+
+protected:
+
+  vtkPerkEvaluatorAnalysisJob();
+  virtual ~vtkPerkEvaluatorAnalysisJob();
+
+  static VTK_THREAD_RETURN_TYPE WorkerThreadFunction( void* arg );
+
+  std::string PerkEvaluatorNodeID;
+  std::vector< vtkSlicerPerkEvaluatorLogic::NativeMetricJob > NativeMetricJobs;
+  std::vector< std::string > ScriptMetricInstanceIDs;
+  std::vector< std::string > RangeMetricKeys;
+  std::vector< std::string > RangeMetricSignatures;
+
+  vtkSmartPointer< vtkMultiThreader > Threader;
+  int ThreadID; // -1 if no worker was spawned (or it was joined)
+
+  // Guarded by the mutex
+  vtkSmartPointer< vtkSimpleMutexLock > Mutex;
+  StateEnum State;
+  int NumCompletedJobs;
+  int ScriptProgress;
+  volatile bool CanceledFlag;
+
+  int LastPublishedProgress;
+  vtkWeakPointer< vtkMRMLPerkEvaluatorNode > ScriptMetricsNode;
+
+private:
+
+  vtkPerkEvaluatorAnalysisJob( const vtkPerkEvaluatorAnalysisJob& ); // Not implemented
+  void operator=( const vtkPerkEvaluatorAnalysisJob& );               // Not implemented
+
+};
+
+
+#endif
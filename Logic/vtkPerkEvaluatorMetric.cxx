@@ -0,0 +1,124 @@
+
+// PerkEvaluator Logic includes
+#include "vtkPerkEvaluatorMetric.h"
+
+
+// Constructors and Destructors ----------------------------------------------
+
+vtkPerkEvaluatorMetric
+::vtkPerkEvaluatorMetric()
+{
+  this->NeedleOrientation[ 0 ] = 0; this->NeedleOrientation[ 1 ] = 0; this->NeedleOrientation[ 2 ] = 1;
+}
+
+
+vtkPerkEvaluatorMetric
+::~vtkPerkEvaluatorMetric()
+{
+}
+
+
+void vtkPerkEvaluatorMetric
+::PrintSelf( ostream& os, vtkIndent indent )
+{
+  this->Superclass::PrintSelf( os, indent );
+
+  os << indent << "MetricName: " << this->GetMetricName() << "\n";
+  os << indent << "MetricUnit: " << this->GetMetricUnit() << "\n";
+}
+
+
+// Default properties ----------------------------------------------
+
+// By default, metrics are computed for every Perk Evaluator node
+bool vtkPerkEvaluatorMetric
+::GetMetricShared()
+{
+  return true;
+}
+
+
+// By default, metrics are not instantiated for every transform
+bool vtkPerkEvaluatorMetric
+::GetMetricPervasive()
+{
+  return false;
+}
+
+
+std::map< std::string, std::string > vtkPerkEvaluatorMetric
+::GetRequiredAnatomyRoles()
+{
+  return std::map< std::string, std::string >();
+}
+
+
+// Setup ----------------------------------------------
+
+void vtkPerkEvaluatorMetric
+::Initialize()
+{
+}
+
+
+bool vtkPerkEvaluatorMetric
+::AddAnatomyRole( std::string vtkNotUsed( role ), vtkMRMLNode* vtkNotUsed( node ) )
+{
+  // No anatomy is required by default
+  return true;
+}
+
+
+void vtkPerkEvaluatorMetric
+::SetNeedleOrientation( double needleOrientation[ 3 ] )
+{
+  this->NeedleOrientation[ 0 ] = needleOrientation[ 0 ];
+  this->NeedleOrientation[ 1 ] = needleOrientation[ 1 ];
+  this->NeedleOrientation[ 2 ] = needleOrientation[ 2 ];
+}
+
+
+// Sliding windows ----------------------------------------------
+
+// By default, metrics only accumulate samples
+bool vtkPerkEvaluatorMetric
+::RemoveTimestampsBefore( double vtkNotUsed( time ) )
+{
+  return false;
+}
+
+
+bool vtkPerkEvaluatorMetric
+::GetMetricOverRange( double vtkNotUsed( beginTime ), double vtkNotUsed( endTime ), double& vtkNotUsed( value ) )
+{
+  return false;
+}
+
+
+void vtkPerkEvaluatorMetric
+::UpdateRange()
+{
+}
+
+
+bool vtkPerkEvaluatorMetric
+::SetRangeSource( vtkPerkEvaluatorMetric* vtkNotUsed( source ) )
+{
+  return false;
+}
+
+
+bool vtkPerkEvaluatorMetric
+::GetRangeShareable()
+{
+  return false;
+}
+
+
+// Profiling ----------------------------------------------
+
+unsigned long vtkPerkEvaluatorMetric
+::GetActualMemorySize()
+{
+  return 0;
+}
@@ -0,0 +1,86 @@
+// .NAME vtkPerkEvaluatorMetric - abstract base class for metrics computed natively
+// .SECTION Description
+// This class exposes the same contract as the Python metric scripts, so that the
+// logic can compute native metrics directly without going through the Python metrics calculator.
+// Concrete metrics are made available through the vtkPerkEvaluatorMetricFactory.
+
+
+#ifndef __vtkPerkEvaluatorMetric_h
+#define __vtkPerkEvaluatorMetric_h
+
+// VTK includes
+#include "vtkObject.h"
+#include "vtkMatrix4x4.h"
+
+// MRML includes
+#include "vtkMRMLNode.h"
+
+// STD includes
+#include <map>
+#include <string>
+#include <vector>
+
+#include "vtkSlicerPerkEvaluatorModuleLogicExport.h"
+
+
+
+class VTK_SLICER_PERKEVALUATOR_MODULE_LOGIC_EXPORT
+vtkPerkEvaluatorMetric
+ : public vtkObject
+{
+public:
+
+  vtkTypeMacro( vtkPerkEvaluatorMetric, vtkObject );
+  void PrintSelf( ostream& os, vtkIndent indent );
+
+  // Properties of the metric (same meaning as for the Python metric scripts)
+  virtual std::string GetMetricName() = 0;
+  virtual std::string GetMetricUnit() = 0;
+  virtual bool GetMetricShared();
+  virtual bool GetMetricPervasive();
+
+  virtual std::vector< std::string > GetAcceptedTransformRoles() = 0;
+  virtual std::map< std::string, std::string > GetRequiredAnatomyRoles(); // From anatomy roles to class names
+
+  // Setup before the computation
+  virtual void Initialize(); // Reset the metric to its state before any timestamps were added
+  virtual bool AddAnatomyRole( std::string role, vtkMRMLNode* node );
+  virtual void SetNeedleOrientation( double needleOrientation[ 3 ] );
+
+  // Per-sample update and final value
+  virtual void AddTimestamp( double time, vtkMatrix4x4* matrix, double point[ 4 ], std::string role ) = 0;
+  virtual double GetMetric() = 0;
+
+  // Forget the samples before the given time, so the metric can be computed over a sliding window incrementally
+  // Returns false if the metric cannot forget samples (then, it must be initialized and given the window's samples again)
+  virtual bool RemoveTimestampsBefore( double time );
+
+  // The value the metric would have for only the samples between the given times (inclusive), without adding them again
+  // Returns false if the metric cannot be computed over a range (then, it must be initialized and given the range's samples)
+  virtual bool GetMetricOverRange( double beginTime, double endTime, double& value );
+  // Build whatever the range queries need now (e.g. on a worker thread), rather than on the first query
+  virtual void UpdateRange();
+  // Answer the range queries from another metric of the same class which was given the same samples, rather than holding the samples again
+  // Returns false if the metric cannot share (then, it must be given the samples itself)
+  virtual bool SetRangeSource( vtkPerkEvaluatorMetric* source );
+  virtual bool GetRangeShareable();
+
+  // Memory held for the samples, in kibibytes (as for VTK data objects), for profiling
+  virtual unsigned long GetActualMemorySize();
+
+protected:
+
+  vtkPerkEvaluatorMetric();
+  virtual ~vtkPerkEvaluatorMetric();
+
+  double NeedleOrientation[ 3 ];
+
+private:
+
+  vtkPerkEvaluatorMetric( const vtkPerkEvaluatorMetric& ); // Not implemented
+  void operator=( const vtkPerkEvaluatorMetric& );          // Not implemented
+
+};
+
+
+#endif
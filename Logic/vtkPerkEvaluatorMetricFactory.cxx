@@ -0,0 +1,171 @@
+
+// PerkEvaluator Logic includes
+#include "vtkPerkEvaluatorMetricFactory.h"
+
+// VTK includes
+#include <vtkObjectFactory.h>
+#include <vtkSmartPointer.h>
+
+#include <vtksys/Directory.hxx>
+#include <vtksys/DynamicLoader.hxx>
+#include <vtksys/SystemTools.hxx>
+
+
+// Constants ----------------------------------------------------------------------------
+
+static const char* REGISTER_METRICS_FUNCTION_NAME = "PerkEvaluatorRegisterMetrics";
+
+
+//----------------------------------------------------------------------------
+
+vtkStandardNewMacro( vtkPerkEvaluatorMetricFactory );
+
+
+// Constructors and Destructors ----------------------------------------------
+
+vtkPerkEvaluatorMetricFactory
+::vtkPerkEvaluatorMetricFactory()
+{
+}
+
+
+vtkPerkEvaluatorMetricFactory
+::~vtkPerkEvaluatorMetricFactory()
+{
+}
+
+
+void vtkPerkEvaluatorMetricFactory
+::PrintSelf( ostream& os, vtkIndent indent )
+{
+  this->Superclass::PrintSelf( os, indent );
+
+  for ( std::map< std::string, MetricCreatorType >::iterator itr = this->MetricCreators.begin(); itr != this->MetricCreators.end(); itr++ )
+  {
+    os << indent << "RegisteredMetric: " << itr->first << "\n";
+  }
+}
+
+
+vtkPerkEvaluatorMetricFactory* vtkPerkEvaluatorMetricFactory
+::GetInstance()
+{
+  static vtkSmartPointer< vtkPerkEvaluatorMetricFactory > instance;
+  if ( instance == NULL )
+  {
+    instance = vtkSmartPointer< vtkPerkEvaluatorMetricFactory >::New();
+  }
+  return instance;
+}
+
+
+// Registration ----------------------------------------------
+
+void vtkPerkEvaluatorMetricFactory
+::RegisterMetric( std::string metricName, MetricCreatorType metricCreator )
+{
+  if ( metricCreator == NULL )
+  {
+    return;
+  }
+
+  this->MetricCreators[ metricName ] = metricCreator;
+  this->Modified();
+}
+
+
+void vtkPerkEvaluatorMetricFactory
+::UnregisterMetric( std::string metricName )
+{
+  if ( this->MetricCreators.erase( metricName ) > 0 )
+  {
+    this->Modified();
+  }
+}
+
+
+bool vtkPerkEvaluatorMetricFactory
+::IsMetricRegistered( std::string metricName )
+{
+  return this->MetricCreators.find( metricName ) != this->MetricCreators.end();
+}
+
+
+std::vector< std::string > vtkPerkEvaluatorMetricFactory
+::GetRegisteredMetricNames()
+{
+  std::vector< std::string > metricNames;
+  for ( std::map< std::string, MetricCreatorType >::iterator itr = this->MetricCreators.begin(); itr != this->MetricCreators.end(); itr++ )
+  {
+    metricNames.push_back( itr->first );
+  }
+  return metricNames;
+}
+
+
+vtkPerkEvaluatorMetric* vtkPerkEvaluatorMetricFactory
+::CreateMetric( std::string metricName )
+{
+  std::map< std::string, MetricCreatorType >::iterator itr = this->MetricCreators.find( metricName );
+  if ( itr == this->MetricCreators.end() )
+  {
+    return NULL;
+  }
+
+  return ( itr->second )();
+}
+
+
+// Plugins ----------------------------------------------
+
+bool vtkPerkEvaluatorMetricFactory
+::LoadPlugin( std::string pluginFileName )
+{
+  vtksys::DynamicLoader::LibraryHandle pluginLibrary = vtksys::DynamicLoader::OpenLibrary( pluginFileName.c_str() );
+  if ( pluginLibrary == NULL )
+  {
+    vtkWarningMacro( "vtkPerkEvaluatorMetricFactory::LoadPlugin: Could not open plugin " << pluginFileName << "." );
+    return false;
+  }
+
+  // Note: A library which registered metrics is never closed, since the metrics must remain valid
+  RegisterMetricsFunctionType registerMetricsFunction = ( RegisterMetricsFunctionType ) vtksys::DynamicLoader::GetSymbolAddress( pluginLibrary, REGISTER_METRICS_FUNCTION_NAME );
+  if ( registerMetricsFunction == NULL )
+  {
+    vtkWarningMacro( "vtkPerkEvaluatorMetricFactory::LoadPlugin: Plugin " << pluginFileName << " does not export " << REGISTER_METRICS_FUNCTION_NAME << "." );
+    vtksys::DynamicLoader::CloseLibrary( pluginLibrary );
+    return false;
+  }
+
+  registerMetricsFunction( this );
+  return true;
+}
+
+
+int vtkPerkEvaluatorMetricFactory
+::LoadPluginsFromDirectory( std::string pluginDirectory )
+{
+  vtksys::Directory directory;
+  if ( ! directory.Load( pluginDirectory.c_str() ) )
+  {
+    return 0;
+  }
+
+  int numPluginsLoaded = 0;
+  for ( unsigned long i = 0; i < directory.GetNumberOfFiles(); i++ )
+  {
+    std::string fileName = directory.GetFile( i );
+    std::string extension = vtksys::SystemTools::LowerCase( vtksys::SystemTools::GetFilenameLastExtension( fileName ) );
+    if ( extension.compare( vtksys::DynamicLoader::LibExtension() ) != 0 )
+    {
+      continue;
+    }
+
+    if ( this->LoadPlugin( pluginDirectory + "/" + fileName ) )
+    {
+      numPluginsLoaded++;
+    }
+  }
+
+  return numPluginsLoaded;
+}
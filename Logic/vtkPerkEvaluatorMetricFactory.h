@@ -0,0 +1,69 @@
+// .NAME vtkPerkEvaluatorMetricFactory - registry of metrics computed natively
+// .SECTION Description
+// Native metrics are registered by name, together with a function creating new instances.
+// Metrics may be compiled into the module, or loaded from shared library plugins.
+// A plugin must export a C function named "PerkEvaluatorRegisterMetrics" with the
+// signature of RegisterMetricsFunctionType, which registers its metrics with the factory.
+
+
+#ifndef __vtkPerkEvaluatorMetricFactory_h
+#define __vtkPerkEvaluatorMetricFactory_h
+
+// VTK includes
+#include "vtkObject.h"
+
+// STD includes
+#include <map>
+#include <string>
+#include <vector>
+
+#include "vtkPerkEvaluatorMetric.h"
+#include "vtkSlicerPerkEvaluatorModuleLogicExport.h"
+
+
+
+class VTK_SLICER_PERKEVALUATOR_MODULE_LOGIC_EXPORT
+vtkPerkEvaluatorMetricFactory
+ : public vtkObject
+{
+public:
+
+  static vtkPerkEvaluatorMetricFactory* New();
+  vtkTypeMacro( vtkPerkEvaluatorMetricFactory, vtkObject );
+  void PrintSelf( ostream& os, vtkIndent indent );
+
+  // The factory shared by the whole application
+  static vtkPerkEvaluatorMetricFactory* GetInstance();
+
+  typedef vtkPerkEvaluatorMetric* ( *MetricCreatorType )();
+  typedef void ( *RegisterMetricsFunctionType )( vtkPerkEvaluatorMetricFactory* );
+
+  // Registration of metrics. The name should be the same as the metric's name.
+  void RegisterMetric( std::string metricName, MetricCreatorType metricCreator );
+  void UnregisterMetric( std::string metricName );
+  bool IsMetricRegistered( std::string metricName );
+  std::vector< std::string > GetRegisteredMetricNames();
+
+  // The caller is responsible for deleting the returned metric
+  vtkPerkEvaluatorMetric* CreateMetric( std::string metricName );
+
+  // Load metrics from shared library plugins
+  bool LoadPlugin( std::string pluginFileName );
+  int LoadPluginsFromDirectory( std::string pluginDirectory ); // Returns the number of plugins loaded
+
+protected:
+
+  vtkPerkEvaluatorMetricFactory();
+  virtual ~vtkPerkEvaluatorMetricFactory();
+
+  std::map< std::string, MetricCreatorType > MetricCreators;
+
+private:
+
+  vtkPerkEvaluatorMetricFactory( const vtkPerkEvaluatorMetricFactory& ); // Not implemented
+  void operator=( const vtkPerkEvaluatorMetricFactory& );                 // Not implemented
+
+};
+
+
+#endif
@@ -0,0 +1,836 @@
+
+// PerkEvaluator Logic includes
+#include "vtkPerkEvaluatorMotionMetric.h"
+#include "vtkPerkEvaluatorMetricFactory.h"
+
+// VTK includes
+#include <vtkMath.h>
+#include <vtkObjectFactory.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+
+
+// Constants ----------------------------------------------------------------------------
+
+const double vtkPerkEvaluatorMotionMetric::MOTION_VELOCITY_THRESHOLD = 20.0;
+
+static const char* MOTION_METRIC_NAMES[ vtkPerkEvaluatorMotionMetric::NumberOfMotionStatistics ] =
+{
+  "Elapsed Time",
+  "Path Length",
+  "Average Velocity",
+  "Peak Velocity",
+  "Average Acceleration",
+  "Average Jerk",
+  "Angular Path",
+  "Number of Motions"
+};
+
+static const char* MOTION_METRIC_UNITS[ vtkPerkEvaluatorMotionMetric::NumberOfMotionStatistics ] =
+{
+  "s",
+  "mm",
+  "mm/s",
+  "mm/s",
+  "mm/s^2",
+  "mm/s^3",
+  "deg",
+  "count"
+};
+
+
+//----------------------------------------------------------------------------
+
+vtkStandardNewMacro( vtkPerkEvaluatorMotionMetric );
+
+
+// Constructors and Destructors ----------------------------------------------
+
+vtkPerkEvaluatorMotionMetric
+::vtkPerkEvaluatorMotionMetric()
+{
+  this->MotionStatistic = vtkPerkEvaluatorMotionMetric::PathLength;
+  vtkPerkEvaluatorMotionMetric::InitializeMotionKernelState( this->KernelState );
+  this->Windowed = false;
+  this->InitializeMotionWindowState( this->WindowState, 0 );
+  this->InitializeMotionWindowState( this->RangeState, 0 );
+  for ( int i = 0; i < NumberOfRangeQuantities; i++ )
+  {
+    this->RangeTrees[ i ] = vtkSmartPointer< vtkPerkEvaluatorSegmentTree >::New();
+  }
+}
+
+
+vtkPerkEvaluatorMotionMetric
+::~vtkPerkEvaluatorMotionMetric()
+{
+}
+
+
+void vtkPerkEvaluatorMotionMetric
+::PrintSelf( ostream& os, vtkIndent indent )
+{
+  this->Superclass::PrintSelf( os, indent );
+
+  os << indent << "NumberOfSamples: " << this->Times.size() << "\n";
+}
+
+
+// Factory ----------------------------------------------
+
+vtkPerkEvaluatorMetric* vtkPerkEvaluatorMotionMetric
+::NewWithMotionStatistic( MotionStatisticEnum motionStatistic )
+{
+  vtkPerkEvaluatorMotionMetric* metric = vtkPerkEvaluatorMotionMetric::New();
+  metric->SetMotionStatistic( motionStatistic );
+  return metric;
+}
+
+
+vtkPerkEvaluatorMetric* vtkPerkEvaluatorMotionMetric
+::NewElapsedTime()
+{
+  return vtkPerkEvaluatorMotionMetric::NewWithMotionStatistic( vtkPerkEvaluatorMotionMetric::ElapsedTime );
+}
+
+
+vtkPerkEvaluatorMetric* vtkPerkEvaluatorMotionMetric
+::NewPathLength()
+{
+  return vtkPerkEvaluatorMotionMetric::NewWithMotionStatistic( vtkPerkEvaluatorMotionMetric::PathLength );
+}
+
+
+vtkPerkEvaluatorMetric* vtkPerkEvaluatorMotionMetric
+::NewAverageVelocity()
+{
+  return vtkPerkEvaluatorMotionMetric::NewWithMotionStatistic( vtkPerkEvaluatorMotionMetric::AverageVelocity );
+}
+
+
+vtkPerkEvaluatorMetric* vtkPerkEvaluatorMotionMetric
+::NewPeakVelocity()
+{
+  return vtkPerkEvaluatorMotionMetric::NewWithMotionStatistic( vtkPerkEvaluatorMotionMetric::PeakVelocity );
+}
+
+
+vtkPerkEvaluatorMetric* vtkPerkEvaluatorMotionMetric
+::NewAverageAcceleration()
+{
+  return vtkPerkEvaluatorMotionMetric::NewWithMotionStatistic( vtkPerkEvaluatorMotionMetric::AverageAcceleration );
+}
+
+
+vtkPerkEvaluatorMetric* vtkPerkEvaluatorMotionMetric
+::NewAverageJerk()
+{
+  return vtkPerkEvaluatorMotionMetric::NewWithMotionStatistic( vtkPerkEvaluatorMotionMetric::AverageJerk );
+}
+
+
+vtkPerkEvaluatorMetric* vtkPerkEvaluatorMotionMetric
+::NewAngularPath()
+{
+  return vtkPerkEvaluatorMotionMetric::NewWithMotionStatistic( vtkPerkEvaluatorMotionMetric::AngularPath );
+}
+
+
+vtkPerkEvaluatorMetric* vtkPerkEvaluatorMotionMetric
+::NewNumberOfMotions()
+{
+  return vtkPerkEvaluatorMotionMetric::NewWithMotionStatistic( vtkPerkEvaluatorMotionMetric::NumberOfMotions );
+}
+
+
+void vtkPerkEvaluatorMotionMetric
+::RegisterMetrics( vtkPerkEvaluatorMetricFactory* factory )
+{
+  if ( factory == NULL )
+  {
+    return;
+  }
+
+  factory->RegisterMetric( MOTION_METRIC_NAMES[ ElapsedTime ], vtkPerkEvaluatorMotionMetric::NewElapsedTime );
+  factory->RegisterMetric( MOTION_METRIC_NAMES[ PathLength ], vtkPerkEvaluatorMotionMetric::NewPathLength );
+  factory->RegisterMetric( MOTION_METRIC_NAMES[ AverageVelocity ], vtkPerkEvaluatorMotionMetric::NewAverageVelocity );
+  factory->RegisterMetric( MOTION_METRIC_NAMES[ PeakVelocity ], vtkPerkEvaluatorMotionMetric::NewPeakVelocity );
+  factory->RegisterMetric( MOTION_METRIC_NAMES[ AverageAcceleration ], vtkPerkEvaluatorMotionMetric::NewAverageAcceleration );
+  factory->RegisterMetric( MOTION_METRIC_NAMES[ AverageJerk ], vtkPerkEvaluatorMotionMetric::NewAverageJerk );
+  factory->RegisterMetric( MOTION_METRIC_NAMES[ AngularPath ], vtkPerkEvaluatorMotionMetric::NewAngularPath );
+  factory->RegisterMetric( MOTION_METRIC_NAMES[ NumberOfMotions ], vtkPerkEvaluatorMotionMetric::NewNumberOfMotions );
+}
+
+
+// Properties ----------------------------------------------
+
+void vtkPerkEvaluatorMotionMetric
+::SetMotionStatistic( MotionStatisticEnum newMotionStatistic )
+{
+  if ( newMotionStatistic < 0 || newMotionStatistic >= vtkPerkEvaluatorMotionMetric::NumberOfMotionStatistics )
+  {
+    return;
+  }
+  this->MotionStatistic = newMotionStatistic;
+}
+
+
+vtkPerkEvaluatorMotionMetric::MotionStatisticEnum vtkPerkEvaluatorMotionMetric
+::GetMotionStatistic()
+{
+  return this->MotionStatistic;
+}
+
+
+std::string vtkPerkEvaluatorMotionMetric
+::GetMetricName()
+{
+  // The standard Python metric scripts have the same names, so the rows of the metrics table are told apart
+  // (the metrics are still registered with the plain names, which saved scenes refer to)
+  return std::string( MOTION_METRIC_NAMES[ this->MotionStatistic ] ) + " (Native)";
+}
+
+
+std::string vtkPerkEvaluatorMotionMetric
+::GetMetricUnit()
+{
+  return MOTION_METRIC_UNITS[ this->MotionStatistic ];
+}
+
+
+bool vtkPerkEvaluatorMotionMetric
+::GetMetricPervasive()
+{
+  return true;
+}
+
+
+std::vector< std::string > vtkPerkEvaluatorMotionMetric
+::GetAcceptedTransformRoles()
+{
+  return std::vector< std::string >( 1, "Any" );
+}
+
+
+// Computation ----------------------------------------------
+
+void vtkPerkEvaluatorMotionMetric
+::Initialize()
+{
+  this->Times.clear();
+  this->X.clear();
+  this->Y.clear();
+  this->Z.clear();
+  this->DirectionX.clear();
+  this->DirectionY.clear();
+  this->DirectionZ.clear();
+  vtkPerkEvaluatorMotionMetric::InitializeMotionKernelState( this->KernelState );
+  this->Windowed = false;
+  this->InitializeMotionWindowState( this->WindowState, 0 );
+  this->InitializeMotionWindowState( this->RangeState, 0 );
+  for ( int i = 0; i < NumberOfRangeQuantities; i++ )
+  {
+    this->RangeTrees[ i ]->Clear();
+  }
+  this->RangeSource = NULL;
+}
+
+
+void vtkPerkEvaluatorMotionMetric
+::AddTimestamp( double time, vtkMatrix4x4* matrix, double point[ 4 ], std::string vtkNotUsed( role ) )
+{
+  this->Times.push_back( time );
+  this->X.push_back( point[ 0 ] );
+  this->Y.push_back( point[ 1 ] );
+  this->Z.push_back( point[ 2 ] );
+
+  // Only the rotation applies to the needle direction
+  double direction[ 3 ] = { 0, 0, 0 };
+  for ( int i = 0; i < 3; i++ )
+  {
+    for ( int j = 0; j < 3; j++ )
+    {
+      direction[ i ] += matrix->GetElement( i, j ) * this->NeedleOrientation[ j ];
+    }
+  }
+  this->DirectionX.push_back( direction[ 0 ] );
+  this->DirectionY.push_back( direction[ 1 ] );
+  this->DirectionZ.push_back( direction[ 2 ] );
+}
+
+
+double vtkPerkEvaluatorMotionMetric
+::GetMetric()
+{
+  if ( this->Times.empty() )
+  {
+    return 0;
+  }
+
+  MotionStatistics statistics;
+  if ( this->Windowed )
+  {
+    this->UpdateMotionWindowState( this->WindowState );
+    this->GetMotionWindowStatistics( statistics );
+    return vtkPerkEvaluatorMotionMetric::GetMotionStatistic( statistics, this->MotionStatistic );
+  }
+
+  // Only the samples added since the last call need to be processed (e.g. for real-time updates)
+  vtkPerkEvaluatorMotionMetric::UpdateMotionKernelState( this->Times.size(), &this->Times[ 0 ],
+    &this->X[ 0 ], &this->Y[ 0 ], &this->Z[ 0 ],
+    &this->DirectionX[ 0 ], &this->DirectionY[ 0 ], &this->DirectionZ[ 0 ],
+    this->KernelState );
+
+  vtkPerkEvaluatorMotionMetric::GetMotionStatistics( this->Times.size(), &this->Times[ 0 ], this->KernelState, statistics );
+  return vtkPerkEvaluatorMotionMetric::GetMotionStatistic( statistics, this->MotionStatistic );
+}
+
+
+// Sliding window ----------------------------------------------
+
+bool vtkPerkEvaluatorMotionMetric
+::RemoveTimestampsBefore( double time )
+{
+  int windowBegin = this->WindowState.WindowBegin;
+  while ( windowBegin < int( this->Times.size() ) && this->Times.at( windowBegin ) < time )
+  {
+    windowBegin++;
+  }
+  this->Windowed = true;
+
+  // Nothing computed so far is still valid, so skip the removed samples altogether
+  if ( this->WindowState.NumProcessedSamples <= windowBegin )
+  {
+    this->InitializeMotionWindowState( this->WindowState, windowBegin );
+    return true;
+  }
+
+  this->WindowState.WindowBegin = windowBegin;
+  vtkPerkEvaluatorMotionMetric::RemoveFromWindowedSum( this->WindowState.PathLength, windowBegin );
+  vtkPerkEvaluatorMotionMetric::RemoveFromWindowedSum( this->WindowState.TotalAngle, windowBegin );
+  vtkPerkEvaluatorMotionMetric::RemoveFromWindowedSum( this->WindowState.TotalAcceleration, windowBegin );
+  vtkPerkEvaluatorMotionMetric::RemoveFromWindowedSum( this->WindowState.TotalJerk, windowBegin );
+  vtkPerkEvaluatorMotionMetric::RemoveFromWindowedSum( this->WindowState.MotionStarts, windowBegin );
+  while ( ! this->WindowState.PeakSpeeds.empty() && this->WindowState.PeakSpeeds.front().first < windowBegin )
+  {
+    this->WindowState.PeakSpeeds.pop_front();
+  }
+  while ( ! this->WindowState.Speeds.empty() && this->WindowState.Speeds.front().FirstSample < windowBegin )
+  {
+    this->WindowState.Speeds.pop_front();
+  }
+  // The last velocity and acceleration stay, later contributions depending on removed samples are dropped as they are added
+
+  return true;
+}
+
+
+void vtkPerkEvaluatorMotionMetric
+::AddToWindowedSum( WindowedSum& windowedSum, int firstSample, int lastSample, double value )
+{
+  Contribution contribution;
+  contribution.FirstSample = firstSample;
+  contribution.LastSample = lastSample;
+  contribution.Value = value;
+  windowedSum.Contributions.push_back( contribution );
+  windowedSum.Sum += value;
+}
+
+
+void vtkPerkEvaluatorMotionMetric
+::RemoveFromWindowedSum( WindowedSum& windowedSum, int windowBegin )
+{
+  while ( ! windowedSum.Contributions.empty() && windowedSum.Contributions.front().FirstSample < windowBegin )
+  {
+    windowedSum.Sum -= windowedSum.Contributions.front().Value;
+    windowedSum.Contributions.pop_front();
+  }
+  if ( windowedSum.Contributions.empty() )
+  {
+    windowedSum.Sum = 0; // No rounding errors left over
+  }
+}
+
+
+void vtkPerkEvaluatorMotionMetric
+::InitializeMotionWindowState( MotionWindowState& state, int windowBegin )
+{
+  state.WindowBegin = windowBegin;
+  state.NumProcessedSamples = windowBegin;
+
+  WindowedSum* windowedSums[ 5 ] = { &state.PathLength, &state.TotalAngle, &state.TotalAcceleration, &state.TotalJerk, &state.MotionStarts };
+  for ( int i = 0; i < 5; i++ )
+  {
+    windowedSums[ i ]->Contributions.clear();
+    windowedSums[ i ]->Sum = 0;
+  }
+  state.PeakSpeeds.clear();
+  state.Speeds.clear();
+
+  state.HasVelocity = false;
+  state.VelocitySample = 0;
+  state.VelocityTime = 0;
+  state.Velocity[ 0 ] = 0; state.Velocity[ 1 ] = 0; state.Velocity[ 2 ] = 0;
+  state.HasAcceleration = false;
+  state.AccelerationSample = 0;
+  state.AccelerationTime = 0;
+  state.Acceleration[ 0 ] = 0; state.Acceleration[ 1 ] = 0; state.Acceleration[ 2 ] = 0;
+}
+
+
+// Same computations as UpdateMotionKernelState, but each contribution remembers the first sample it depends on
+void vtkPerkEvaluatorMotionMetric
+::UpdateMotionWindowState( MotionWindowState& state )
+{
+  int numSamples = this->Times.size();
+  const double* times = numSamples > 0 ? &this->Times[ 0 ] : NULL;
+  const double* x = numSamples > 0 ? &this->X[ 0 ] : NULL;
+  const double* y = numSamples > 0 ? &this->Y[ 0 ] : NULL;
+  const double* z = numSamples > 0 ? &this->Z[ 0 ] : NULL;
+  const double* dx = numSamples > 0 ? &this->DirectionX[ 0 ] : NULL;
+  const double* dy = numSamples > 0 ? &this->DirectionY[ 0 ] : NULL;
+  const double* dz = numSamples > 0 ? &this->DirectionZ[ 0 ] : NULL;
+
+  for ( int i = std::max( state.NumProcessedSamples, state.WindowBegin + 1 ); i < numSamples; i++ )
+  {
+    double deltaX = x[ i ] - x[ i - 1 ];
+    double deltaY = y[ i ] - y[ i - 1 ];
+    double deltaZ = z[ i ] - z[ i - 1 ];
+    double distance = sqrt( deltaX * deltaX + deltaY * deltaY + deltaZ * deltaZ );
+    vtkPerkEvaluatorMotionMetric::AddToWindowedSum( state.PathLength, i - 1, i, distance );
+
+    double crossX = dy[ i - 1 ] * dz[ i ] - dz[ i - 1 ] * dy[ i ];
+    double crossY = dz[ i - 1 ] * dx[ i ] - dx[ i - 1 ] * dz[ i ];
+    double crossZ = dx[ i - 1 ] * dy[ i ] - dy[ i - 1 ] * dx[ i ];
+    double dot = dx[ i - 1 ] * dx[ i ] + dy[ i - 1 ] * dy[ i ] + dz[ i - 1 ] * dz[ i ];
+    vtkPerkEvaluatorMotionMetric::AddToWindowedSum( state.TotalAngle, i - 1, i, atan2( sqrt( crossX * crossX + crossY * crossY + crossZ * crossZ ), dot ) );
+
+    double deltaTime = times[ i ] - times[ i - 1 ];
+    if ( deltaTime <= 0 )
+    {
+      continue;
+    }
+
+    double velocity[ 3 ] = { deltaX / deltaTime, deltaY / deltaTime, deltaZ / deltaTime };
+    double velocityTime = ( times[ i ] + times[ i - 1 ] ) / 2;
+    double speed = distance / deltaTime;
+
+    // Monotonic queue: a speed can never be the peak again once a later speed is at least as high
+    while ( ! state.PeakSpeeds.empty() && state.PeakSpeeds.back().second <= speed )
+    {
+      state.PeakSpeeds.pop_back();
+    }
+    state.PeakSpeeds.push_back( std::pair< int, double >( i - 1, speed ) );
+
+    bool moving = ( speed > MOTION_VELOCITY_THRESHOLD );
+    if ( moving && state.HasVelocity && ! state.Speeds.empty() && state.Speeds.back().Value <= MOTION_VELOCITY_THRESHOLD )
+    {
+      vtkPerkEvaluatorMotionMetric::AddToWindowedSum( state.MotionStarts, state.VelocitySample, i, 1 );
+    }
+    Contribution speedContribution;
+    speedContribution.FirstSample = i - 1;
+    speedContribution.LastSample = i;
+    speedContribution.Value = speed;
+    state.Speeds.push_back( speedContribution );
+
+    if ( state.HasVelocity && velocityTime > state.VelocityTime )
+    {
+      double deltaVelocityTime = velocityTime - state.VelocityTime;
+      double acceleration[ 3 ] = { ( velocity[ 0 ] - state.Velocity[ 0 ] ) / deltaVelocityTime,
+        ( velocity[ 1 ] - state.Velocity[ 1 ] ) / deltaVelocityTime,
+        ( velocity[ 2 ] - state.Velocity[ 2 ] ) / deltaVelocityTime };
+      double accelerationTime = ( velocityTime + state.VelocityTime ) / 2;
+      vtkPerkEvaluatorMotionMetric::AddToWindowedSum( state.TotalAcceleration, state.VelocitySample, i, vtkMath::Norm( acceleration ) );
+
+      if ( state.HasAcceleration && accelerationTime > state.AccelerationTime )
+      {
+        double deltaAccelerationTime = accelerationTime - state.AccelerationTime;
+        double jerk[ 3 ] = { ( acceleration[ 0 ] - state.Acceleration[ 0 ] ) / deltaAccelerationTime,
+          ( acceleration[ 1 ] - state.Acceleration[ 1 ] ) / deltaAccelerationTime,
+          ( acceleration[ 2 ] - state.Acceleration[ 2 ] ) / deltaAccelerationTime };
+        vtkPerkEvaluatorMotionMetric::AddToWindowedSum( state.TotalJerk, state.AccelerationSample, i, vtkMath::Norm( jerk ) );
+      }
+
+      state.Acceleration[ 0 ] = acceleration[ 0 ]; state.Acceleration[ 1 ] = acceleration[ 1 ]; state.Acceleration[ 2 ] = acceleration[ 2 ];
+      state.AccelerationTime = accelerationTime;
+      state.AccelerationSample = state.VelocitySample;
+      state.HasAcceleration = true;
+    }
+
+    state.Velocity[ 0 ] = velocity[ 0 ]; state.Velocity[ 1 ] = velocity[ 1 ]; state.Velocity[ 2 ] = velocity[ 2 ];
+    state.VelocityTime = velocityTime;
+    state.VelocitySample = i - 1;
+    state.HasVelocity = true;
+  }
+  state.NumProcessedSamples = std::max( state.NumProcessedSamples, numSamples );
+
+  // Drop anything which depends on samples before the window (i.e. from the last velocity or acceleration before the window moved)
+  vtkPerkEvaluatorMotionMetric::RemoveFromWindowedSum( state.TotalAcceleration, state.WindowBegin );
+  vtkPerkEvaluatorMotionMetric::RemoveFromWindowedSum( state.TotalJerk, state.WindowBegin );
+  vtkPerkEvaluatorMotionMetric::RemoveFromWindowedSum( state.MotionStarts, state.WindowBegin );
+}
+
+
+void vtkPerkEvaluatorMotionMetric
+::GetMotionWindowStatistics( MotionStatistics& statistics )
+{
+  const MotionWindowState& state = this->WindowState;
+  int numSamples = this->Times.size() - state.WindowBegin;
+
+  statistics.ElapsedTime = ( numSamples > 0 ) ? this->Times.back() - this->Times.at( state.WindowBegin ) : 0;
+  statistics.PathLength = state.PathLength.Sum;
+  statistics.AverageVelocity = ( statistics.ElapsedTime > 0 ) ? statistics.PathLength / statistics.ElapsedTime : 0;
+  statistics.PeakVelocity = state.PeakSpeeds.empty() ? 0 : state.PeakSpeeds.front().second;
+  statistics.AverageAcceleration = state.TotalAcceleration.Contributions.empty() ? 0 : state.TotalAcceleration.Sum / state.TotalAcceleration.Contributions.size();
+  statistics.AverageJerk = state.TotalJerk.Contributions.empty() ? 0 : state.TotalJerk.Sum / state.TotalJerk.Contributions.size();
+  statistics.AngularPath = vtkMath::DegreesFromRadians( state.TotalAngle.Sum );
+
+  // The first velocity in the window starts a motion if it is above the threshold (the tool is assumed to be at rest before)
+  statistics.NumberOfMotions = state.MotionStarts.Contributions.size();
+  if ( ! state.Speeds.empty() && state.Speeds.front().Value > MOTION_VELOCITY_THRESHOLD )
+  {
+    statistics.NumberOfMotions++;
+  }
+}
+
+
+// Range queries ----------------------------------------------
+
+bool vtkPerkEvaluatorMotionMetric
+::GetMetricOverRange( double beginTime, double endTime, double& value )
+{
+  if ( this->RangeSource != NULL )
+  {
+    return this->RangeSource->GetMotionStatisticOverRange( beginTime, endTime, this->MotionStatistic, value );
+  }
+  return this->GetMotionStatisticOverRange( beginTime, endTime, this->MotionStatistic, value );
+}
+
+
+void vtkPerkEvaluatorMotionMetric
+::UpdateRange()
+{
+  // Only the samples added since the last update need to be processed
+  this->UpdateMotionWindowState( this->RangeState );
+  this->UpdateRangeTrees();
+
+  // The peak speeds come from the tree, so the monotonic queue is not needed (it is never pruned for the range)
+  this->RangeState.PeakSpeeds.clear();
+}
+
+
+bool vtkPerkEvaluatorMotionMetric
+::SetRangeSource( vtkPerkEvaluatorMetric* source )
+{
+  vtkPerkEvaluatorMotionMetric* motionSource = vtkPerkEvaluatorMotionMetric::SafeDownCast( source );
+  if ( motionSource == NULL )
+  {
+    return false;
+  }
+  this->RangeSource = ( motionSource == this ) ? NULL : motionSource;
+  return true;
+}
+
+
+bool vtkPerkEvaluatorMotionMetric
+::GetRangeShareable()
+{
+  return true;
+}
+
+
+bool vtkPerkEvaluatorMotionMetric
+::GetMotionStatisticOverRange( double beginTime, double endTime, MotionStatisticEnum motionStatistic, double& value )
+{
+  // The samples within the range (the samples are added in chronological order)
+  int firstSample = std::lower_bound( this->Times.begin(), this->Times.end(), beginTime ) - this->Times.begin();
+  int lastSample = std::upper_bound( this->Times.begin(), this->Times.end(), endTime ) - this->Times.begin() - 1;
+  if ( firstSample > lastSample )
+  {
+    value = 0;
+    return true;
+  }
+
+  this->UpdateRange();
+
+  int firstContribution = 0;
+  MotionStatistics statistics;
+  statistics.ElapsedTime = this->Times.at( lastSample ) - this->Times.at( firstSample );
+  statistics.PathLength = this->QueryRange( RangePathLength, firstSample, lastSample, firstContribution ).Sum;
+  statistics.AverageVelocity = ( statistics.ElapsedTime > 0 ) ? statistics.PathLength / statistics.ElapsedTime : 0;
+  int firstSpeed = 0;
+  vtkPerkEvaluatorSegmentTree::Aggregate speeds = this->QueryRange( RangeSpeeds, firstSample, lastSample, firstSpeed );
+  statistics.PeakVelocity = ( speeds.Count > 0 ) ? speeds.Maximum : 0;
+  vtkPerkEvaluatorSegmentTree::Aggregate accelerations = this->QueryRange( RangeTotalAcceleration, firstSample, lastSample, firstContribution );
+  statistics.AverageAcceleration = ( accelerations.Count > 0 ) ? accelerations.Sum / accelerations.Count : 0;
+  vtkPerkEvaluatorSegmentTree::Aggregate jerks = this->QueryRange( RangeTotalJerk, firstSample, lastSample, firstContribution );
+  statistics.AverageJerk = ( jerks.Count > 0 ) ? jerks.Sum / jerks.Count : 0;
+  statistics.AngularPath = vtkMath::DegreesFromRadians( this->QueryRange( RangeTotalAngle, firstSample, lastSample, firstContribution ).Sum );
+
+  // As for a window, the first velocity in the range starts a motion if it is above the threshold
+  statistics.NumberOfMotions = this->QueryRange( RangeMotionStarts, firstSample, lastSample, firstContribution ).Count;
+  if ( speeds.Count > 0 && this->RangeState.Speeds.at( firstSpeed ).Value > MOTION_VELOCITY_THRESHOLD )
+  {
+    statistics.NumberOfMotions++;
+  }
+
+  value = vtkPerkEvaluatorMotionMetric::GetMotionStatistic( statistics, motionStatistic );
+  return true;
+}
+
+
+const std::deque< vtkPerkEvaluatorMotionMetric::Contribution >& vtkPerkEvaluatorMotionMetric
+::GetRangeContributions( RangeQuantityEnum quantity )
+{
+  switch ( quantity )
+  {
+    case RangePathLength: return this->RangeState.PathLength.Contributions;
+    case RangeTotalAngle: return this->RangeState.TotalAngle.Contributions;
+    case RangeTotalAcceleration: return this->RangeState.TotalAcceleration.Contributions;
+    case RangeTotalJerk: return this->RangeState.TotalJerk.Contributions;
+    case RangeMotionStarts: return this->RangeState.MotionStarts.Contributions;
+    default: return this->RangeState.Speeds;
+  }
+}
+
+
+void vtkPerkEvaluatorMotionMetric
+::UpdateRangeTrees()
+{
+  for ( int i = 0; i < NumberOfRangeQuantities; i++ )
+  {
+    const std::deque< Contribution >& contributions = this->GetRangeContributions( RangeQuantityEnum( i ) );
+    vtkPerkEvaluatorSegmentTree* tree = this->RangeTrees[ i ];
+
+    // Build from scratch the first time, then append the new contributions
+    if ( tree->GetNumberOfValues() == 0 )
+    {
+      std::vector< double > values( contributions.size() );
+      for ( unsigned int j = 0; j < contributions.size(); j++ )
+      {
+        values.at( j ) = contributions.at( j ).Value;
+      }
+      tree->Build( values );
+      continue;
+    }
+    for ( unsigned int j = tree->GetNumberOfValues(); j < contributions.size(); j++ )
+    {
+      tree->Append( contributions.at( j ).Value );
+    }
+  }
+}
+
+
+bool vtkPerkEvaluatorMotionMetric
+::CompareContributionFirstSample( const Contribution& contribution, int sample )
+{
+  return contribution.FirstSample < sample;
+}
+
+
+bool vtkPerkEvaluatorMotionMetric
+::CompareContributionLastSample( int sample, const Contribution& contribution )
+{
+  return sample < contribution.LastSample;
+}
+
+
+// The first and last samples both increase along the contributions, so the contributions within the range are contiguous
+vtkPerkEvaluatorSegmentTree::Aggregate vtkPerkEvaluatorMotionMetric
+::QueryRange( RangeQuantityEnum quantity, int firstSample, int lastSample, int& firstContribution )
+{
+  const std::deque< Contribution >& contributions = this->GetRangeContributions( quantity );
+  firstContribution = std::lower_bound( contributions.begin(), contributions.end(), firstSample, vtkPerkEvaluatorMotionMetric::CompareContributionFirstSample ) - contributions.begin();
+  int lastContribution = std::upper_bound( contributions.begin(), contributions.end(), lastSample, vtkPerkEvaluatorMotionMetric::CompareContributionLastSample ) - contributions.begin() - 1;
+  return this->RangeTrees[ quantity ]->Query( firstContribution, lastContribution );
+}
+
+
+// Profiling ----------------------------------------------
+
+unsigned long vtkPerkEvaluatorMotionMetric
+::GetActualMemorySize()
+{
+  unsigned long size = 0;
+  size += ( this->Times.capacity() + this->X.capacity() + this->Y.capacity() + this->Z.capacity() ) * sizeof( double );
+  size += ( this->DirectionX.capacity() + this->DirectionY.capacity() + this->DirectionZ.capacity() ) * sizeof( double );
+
+  // The window states hold one contribution per sample and quantity at most
+  const MotionWindowState* states[ 2 ] = { &this->WindowState, &this->RangeState };
+  for ( int i = 0; i < 2; i++ )
+  {
+    size += ( states[ i ]->PathLength.Contributions.size() + states[ i ]->TotalAngle.Contributions.size() ) * sizeof( Contribution );
+    size += ( states[ i ]->TotalAcceleration.Contributions.size() + states[ i ]->TotalJerk.Contributions.size() ) * sizeof( Contribution );
+    size += ( states[ i ]->MotionStarts.Contributions.size() + states[ i ]->Speeds.size() ) * sizeof( Contribution );
+    size += states[ i ]->PeakSpeeds.size() * sizeof( std::pair< int, double > );
+  }
+
+  size = size / 1024;
+  for ( int i = 0; i < NumberOfRangeQuantities; i++ )
+  {
+    size += this->RangeTrees[ i ]->GetActualMemorySize();
+  }
+  return size;
+}
+
+
+// Kernel ----------------------------------------------
+
+void vtkPerkEvaluatorMotionMetric
+::InitializeMotionKernelState( MotionKernelState& state )
+{
+  state.NumProcessedSamples = 0;
+  state.PathLength = 0;
+  state.PeakVelocity = 0;
+  state.TotalAcceleration = 0;
+  state.NumAccelerations = 0;
+  state.TotalJerk = 0;
+  state.NumJerks = 0;
+  state.TotalAngle = 0;
+  state.NumberOfMotions = 0;
+  state.Moving = false;
+  state.HasVelocity = false;
+  state.VelocityTime = 0;
+  state.Velocity[ 0 ] = 0; state.Velocity[ 1 ] = 0; state.Velocity[ 2 ] = 0;
+  state.HasAcceleration = false;
+  state.AccelerationTime = 0;
+  state.Acceleration[ 0 ] = 0; state.Acceleration[ 1 ] = 0; state.Acceleration[ 2 ] = 0;
+}
+
+
+// Velocities, accelerations and jerks are finite differences, located at the midpoints of the samples they are computed from
+void vtkPerkEvaluatorMotionMetric
+::UpdateMotionKernelState( int numSamples, const double* times,
+  const double* x, const double* y, const double* z,
+  const double* dx, const double* dy, const double* dz,
+  MotionKernelState& state )
+{
+  for ( int i = std::max( state.NumProcessedSamples, 1 ); i < numSamples; i++ )
+  {
+    double deltaX = x[ i ] - x[ i - 1 ];
+    double deltaY = y[ i ] - y[ i - 1 ];
+    double deltaZ = z[ i ] - z[ i - 1 ];
+    double distance = sqrt( deltaX * deltaX + deltaY * deltaY + deltaZ * deltaZ );
+    state.PathLength += distance;
+
+    // The angle between consecutive directions (atan2 does not require normalized directions)
+    double crossX = dy[ i - 1 ] * dz[ i ] - dz[ i - 1 ] * dy[ i ];
+    double crossY = dz[ i - 1 ] * dx[ i ] - dx[ i - 1 ] * dz[ i ];
+    double crossZ = dx[ i - 1 ] * dy[ i ] - dy[ i - 1 ] * dx[ i ];
+    double dot = dx[ i - 1 ] * dx[ i ] + dy[ i - 1 ] * dy[ i ] + dz[ i - 1 ] * dz[ i ];
+    state.TotalAngle += atan2( sqrt( crossX * crossX + crossY * crossY + crossZ * crossZ ), dot );
+
+    double deltaTime = times[ i ] - times[ i - 1 ];
+    if ( deltaTime <= 0 )
+    {
+      continue; // Duplicate timestamps contribute to the path, but not to the derivatives
+    }
+
+    double velocity[ 3 ] = { deltaX / deltaTime, deltaY / deltaTime, deltaZ / deltaTime };
+    double velocityTime = ( times[ i ] + times[ i - 1 ] ) / 2;
+    double speed = distance / deltaTime;
+    state.PeakVelocity = std::max( state.PeakVelocity, speed );
+
+    // A motion starts whenever the tool goes from rest to above the threshold speed
+    if ( speed > MOTION_VELOCITY_THRESHOLD && ! state.Moving )
+    {
+      state.NumberOfMotions++;
+    }
+    state.Moving = ( speed > MOTION_VELOCITY_THRESHOLD );
+
+    if ( state.HasVelocity && velocityTime > state.VelocityTime )
+    {
+      double deltaVelocityTime = velocityTime - state.VelocityTime;
+      double acceleration[ 3 ] = { ( velocity[ 0 ] - state.Velocity[ 0 ] ) / deltaVelocityTime,
+        ( velocity[ 1 ] - state.Velocity[ 1 ] ) / deltaVelocityTime,
+        ( velocity[ 2 ] - state.Velocity[ 2 ] ) / deltaVelocityTime };
+      double accelerationTime = ( velocityTime + state.VelocityTime ) / 2;
+      state.TotalAcceleration += vtkMath::Norm( acceleration );
+      state.NumAccelerations++;
+
+      if ( state.HasAcceleration && accelerationTime > state.AccelerationTime )
+      {
+        double deltaAccelerationTime = accelerationTime - state.AccelerationTime;
+        double jerk[ 3 ] = { ( acceleration[ 0 ] - state.Acceleration[ 0 ] ) / deltaAccelerationTime,
+          ( acceleration[ 1 ] - state.Acceleration[ 1 ] ) / deltaAccelerationTime,
+          ( acceleration[ 2 ] - state.Acceleration[ 2 ] ) / deltaAccelerationTime };
+        state.TotalJerk += vtkMath::Norm( jerk );
+        state.NumJerks++;
+      }
+
+      state.Acceleration[ 0 ] = acceleration[ 0 ]; state.Acceleration[ 1 ] = acceleration[ 1 ]; state.Acceleration[ 2 ] = acceleration[ 2 ];
+      state.AccelerationTime = accelerationTime;
+      state.HasAcceleration = true;
+    }
+
+    state.Velocity[ 0 ] = velocity[ 0 ]; state.Velocity[ 1 ] = velocity[ 1 ]; state.Velocity[ 2 ] = velocity[ 2 ];
+    state.VelocityTime = velocityTime;
+    state.HasVelocity = true;
+  }
+
+  state.NumProcessedSamples = std::max( state.NumProcessedSamples, numSamples );
+}
+
+
+void vtkPerkEvaluatorMotionMetric
+::GetMotionStatistics( int numSamples, const double* times, const MotionKernelState& state, MotionStatistics& statistics )
+{
+  statistics.ElapsedTime = 0;
+  statistics.PathLength = state.PathLength;
+  statistics.AverageVelocity = 0;
+  statistics.PeakVelocity = state.PeakVelocity;
+  statistics.AverageAcceleration = 0;
+  statistics.AverageJerk = 0;
+  statistics.AngularPath = vtkMath::DegreesFromRadians( state.TotalAngle );
+  statistics.NumberOfMotions = state.NumberOfMotions;
+
+  if ( numSamples > 0 )
+  {
+    statistics.ElapsedTime = times[ numSamples - 1 ] - times[ 0 ];
+  }
+  if ( statistics.ElapsedTime > 0 )
+  {
+    statistics.AverageVelocity = statistics.PathLength / statistics.ElapsedTime;
+  }
+  if ( state.NumAccelerations > 0 )
+  {
+    statistics.AverageAcceleration = state.TotalAcceleration / state.NumAccelerations;
+  }
+  if ( state.NumJerks > 0 )
+  {
+    statistics.AverageJerk = state.TotalJerk / state.NumJerks;
+  }
+}
+
+
+void vtkPerkEvaluatorMotionMetric
+::ComputeMotionStatistics( int numSamples, const double* times,
+  const double* x, const double* y, const double* z,
+  const double* dx, const double* dy, const double* dz,
+  MotionStatistics& statistics )
+{
+  MotionKernelState state;
+  vtkPerkEvaluatorMotionMetric::InitializeMotionKernelState( state );
+  vtkPerkEvaluatorMotionMetric::UpdateMotionKernelState( numSamples, times, x, y, z, dx, dy, dz, state );
+  vtkPerkEvaluatorMotionMetric::GetMotionStatistics( numSamples, times, state, statistics );
+}
+
+
+double vtkPerkEvaluatorMotionMetric
+::GetMotionStatistic( const MotionStatistics& statistics, MotionStatisticEnum motionStatistic )
+{
+  switch ( motionStatistic )
+  {
+  case vtkPerkEvaluatorMotionMetric::ElapsedTime: return statistics.ElapsedTime;
+  case vtkPerkEvaluatorMotionMetric::PathLength: return statistics.PathLength;
+  case vtkPerkEvaluatorMotionMetric::AverageVelocity: return statistics.AverageVelocity;
+  case vtkPerkEvaluatorMotionMetric::PeakVelocity: return statistics.PeakVelocity;
+  case vtkPerkEvaluatorMotionMetric::AverageAcceleration: return statistics.AverageAcceleration;
+  case vtkPerkEvaluatorMotionMetric::AverageJerk: return statistics.AverageJerk;
+  case vtkPerkEvaluatorMotionMetric::AngularPath: return statistics.AngularPath;
+  case vtkPerkEvaluatorMotionMetric::NumberOfMotions: return statistics.NumberOfMotions;
+  default: return 0;
+  }
+}
@@ -0,0 +1,237 @@
+// .NAME vtkPerkEvaluatorMotionMetric - built-in native metrics describing the motion of a tool
+// .SECTION Description
+// The samples are stored as contiguous arrays of times, positions and needle directions.
+// All of the statistics are computed in a single pass over these arrays (see ComputeMotionStatistics),
+// and each registered metric reports one of these statistics.
+// The metrics are pervasive, so every transform gets its own instance.
+// Over a sliding window, every statistic is kept as a running aggregate of per-sample contributions, each tagged with
+// the first sample it depends on. Adding samples appends contributions, moving the window start drops them from the front.
+// Over an arbitrary range (e.g. between the marks), the same contributions for all samples are kept in segment trees.
+// The contributions depending only on samples in the range are contiguous, so every statistic takes O(log N) per range.
+// The range structures hold every statistic, so the metrics for the other statistics of the same transform share them.
+
+
+#ifndef __vtkPerkEvaluatorMotionMetric_h
+#define __vtkPerkEvaluatorMotionMetric_h
+
+// VTK includes
+#include "vtkSmartPointer.h"
+
+// STD includes
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "vtkPerkEvaluatorMetric.h"
+#include "vtkPerkEvaluatorSegmentTree.h"
+#include "vtkSlicerPerkEvaluatorModuleLogicExport.h"
+
+class vtkPerkEvaluatorMetricFactory;
+
+
+
+class VTK_SLICER_PERKEVALUATOR_MODULE_LOGIC_EXPORT
+vtkPerkEvaluatorMotionMetric
+ : public vtkPerkEvaluatorMetric
+{
+public:
+
+  enum MotionStatisticEnum
+  {
+    ElapsedTime,
+    PathLength,
+    AverageVelocity,
+    PeakVelocity,
+    AverageAcceleration,
+    AverageJerk,
+    AngularPath,
+    NumberOfMotions,
+    NumberOfMotionStatistics
+  };
+
+  // Everything carried from one sample to the next by the kernel, so it can resume when samples are appended
+  struct MotionKernelState
+  {
+    int NumProcessedSamples;
+    double PathLength;
+    double PeakVelocity;
+    double TotalAcceleration;
+    int NumAccelerations;
+    double TotalJerk;
+    int NumJerks;
+    double TotalAngle;
+    int NumberOfMotions;
+    bool Moving;
+    bool HasVelocity;
+    double VelocityTime;
+    double Velocity[ 3 ];
+    bool HasAcceleration;
+    double AccelerationTime;
+    double Acceleration[ 3 ];
+  };
+
+  struct MotionStatistics
+  {
+    double ElapsedTime;         // s
+    double PathLength;          // mm
+    double AverageVelocity;     // mm/s
+    double PeakVelocity;        // mm/s
+    double AverageAcceleration; // mm/s^2
+    double AverageJerk;         // mm/s^3
+    double AngularPath;         // deg
+    double NumberOfMotions;     // count
+  };
+
+  // Speed above which the tool is considered to be in motion (in mm/s)
+  static const double MOTION_VELOCITY_THRESHOLD;
+
+  static vtkPerkEvaluatorMotionMetric* New();
+  vtkTypeMacro( vtkPerkEvaluatorMotionMetric, vtkPerkEvaluatorMetric );
+  void PrintSelf( ostream& os, vtkIndent indent );
+
+  // Creators for the factory, one for each statistic
+  static vtkPerkEvaluatorMetric* NewElapsedTime();
+  static vtkPerkEvaluatorMetric* NewPathLength();
+  static vtkPerkEvaluatorMetric* NewAverageVelocity();
+  static vtkPerkEvaluatorMetric* NewPeakVelocity();
+  static vtkPerkEvaluatorMetric* NewAverageAcceleration();
+  static vtkPerkEvaluatorMetric* NewAverageJerk();
+  static vtkPerkEvaluatorMetric* NewAngularPath();
+  static vtkPerkEvaluatorMetric* NewNumberOfMotions();
+
+  // Same signature as plugins, so the built-in metrics are registered the same way
+  static void RegisterMetrics( vtkPerkEvaluatorMetricFactory* factory );
+
+  void SetMotionStatistic( MotionStatisticEnum newMotionStatistic );
+  MotionStatisticEnum GetMotionStatistic();
+
+  std::string GetMetricName();
+  std::string GetMetricUnit();
+  bool GetMetricPervasive();
+  std::vector< std::string > GetAcceptedTransformRoles();
+
+  void Initialize();
+  void AddTimestamp( double time, vtkMatrix4x4* matrix, double point[ 4 ], std::string role );
+  double GetMetric();
+  bool RemoveTimestampsBefore( double time );
+  bool GetMetricOverRange( double beginTime, double endTime, double& value );
+  void UpdateRange();
+  bool SetRangeSource( vtkPerkEvaluatorMetric* source );
+  bool GetRangeShareable();
+  unsigned long GetActualMemorySize();
+
+  // The fused kernel: positions and directions are given component-wise, the directions need not be normalized.
+  // Only the samples which the state has not yet seen are processed.
+  static void InitializeMotionKernelState( MotionKernelState& state );
+  static void UpdateMotionKernelState( int numSamples, const double* times,
+    const double* x, const double* y, const double* z,
+    const double* dx, const double* dy, const double* dz,
+    MotionKernelState& state );
+  static void GetMotionStatistics( int numSamples, const double* times, const MotionKernelState& state, MotionStatistics& statistics );
+
+  // Convenience for computing all of the statistics of complete arrays at once
+  static void ComputeMotionStatistics( int numSamples, const double* times,
+    const double* x, const double* y, const double* z,
+    const double* dx, const double* dy, const double* dz,
+    MotionStatistics& statistics );
+  static double GetMotionStatistic( const MotionStatistics& statistics, MotionStatisticEnum motionStatistic );
+
+protected:
+
+  vtkPerkEvaluatorMotionMetric();
+  virtual ~vtkPerkEvaluatorMotionMetric();
+
+  static vtkPerkEvaluatorMetric* NewWithMotionStatistic( MotionStatisticEnum motionStatistic );
+
+  MotionStatisticEnum MotionStatistic;
+
+  // Structure of arrays, so the kernel runs over contiguous memory
+  std::vector< double > Times;
+  std::vector< double > X;
+  std::vector< double > Y;
+  std::vector< double > Z;
+  std::vector< double > DirectionX;
+  std::vector< double > DirectionY;
+  std::vector< double > DirectionZ;
+
+  MotionKernelState KernelState;
+
+  // A value computed from the samples between its first and last sample
+  struct Contribution
+  {
+    int FirstSample;
+    int LastSample;
+    double Value;
+  };
+
+  // Sum of contributions, each valid as long as the window begins at or before the first sample it depends on
+  // Contributions are added in order of their first (and last) samples, so invalid ones are always at the front
+  struct WindowedSum
+  {
+    std::deque< Contribution > Contributions;
+    double Sum;
+  };
+  static void AddToWindowedSum( WindowedSum& windowedSum, int firstSample, int lastSample, double value );
+  static void RemoveFromWindowedSum( WindowedSum& windowedSum, int windowBegin );
+
+  // Same quantities as the kernel, but for the samples from WindowBegin on
+  struct MotionWindowState
+  {
+    int WindowBegin;
+    int NumProcessedSamples;
+    WindowedSum PathLength;
+    WindowedSum TotalAngle;
+    WindowedSum TotalAcceleration;
+    WindowedSum TotalJerk;
+    WindowedSum MotionStarts; // Velocities above the threshold following one below it
+    std::deque< std::pair< int, double > > PeakSpeeds; // Decreasing speeds (a monotonic queue), with their first samples
+    std::deque< Contribution > Speeds; // Every speed in the window
+    bool HasVelocity;
+    int VelocitySample; // First sample of the last velocity
+    double VelocityTime;
+    double Velocity[ 3 ];
+    bool HasAcceleration;
+    int AccelerationSample; // First sample of the last acceleration
+    double AccelerationTime;
+    double Acceleration[ 3 ];
+  };
+  void InitializeMotionWindowState( MotionWindowState& state, int windowBegin );
+  void UpdateMotionWindowState( MotionWindowState& state );
+  void GetMotionWindowStatistics( MotionStatistics& statistics );
+
+  bool Windowed; // True once samples were removed, then the window state is used instead of the kernel state
+  MotionWindowState WindowState;
+
+  // Window state for all samples (it is never moved), with the contributions of each quantity in a segment tree
+  enum RangeQuantityEnum
+  {
+    RangePathLength,
+    RangeTotalAngle,
+    RangeTotalAcceleration,
+    RangeTotalJerk,
+    RangeMotionStarts,
+    RangeSpeeds,
+    NumberOfRangeQuantities
+  };
+  MotionWindowState RangeState;
+  vtkSmartPointer< vtkPerkEvaluatorSegmentTree > RangeTrees[ NumberOfRangeQuantities ];
+  vtkSmartPointer< vtkPerkEvaluatorMotionMetric > RangeSource; // If set, the range queries are answered from its samples instead
+
+  bool GetMotionStatisticOverRange( double beginTime, double endTime, MotionStatisticEnum motionStatistic, double& value );
+
+  const std::deque< Contribution >& GetRangeContributions( RangeQuantityEnum quantity );
+  void UpdateRangeTrees();
+  static bool CompareContributionFirstSample( const Contribution& contribution, int sample );
+  static bool CompareContributionLastSample( int sample, const Contribution& contribution );
+  // Aggregate of the contributions depending only on the samples from the first to the last (inclusive)
+  vtkPerkEvaluatorSegmentTree::Aggregate QueryRange( RangeQuantityEnum quantity, int firstSample, int lastSample, int& firstContribution );
+
+private:
+
+  vtkPerkEvaluatorMotionMetric( const vtkPerkEvaluatorMotionMetric& ); // Not implemented
+  void operator=( const vtkPerkEvaluatorMotionMetric& );                // Not implemented
+
+};
+
+
+#endif
@@ -0,0 +1,255 @@
+
+// PerkEvaluator Logic includes
+#include "vtkPerkEvaluatorPlaybackEngine.h"
+
+// VTK includes
+#include <vtkObjectFactory.h>
+
+
+// Constants ----------------------------------------------------------------------------
+
+// Further than this, a binary search is cheaper than stepping through the records
+static const int MAXIMUM_ADVANCE_RECORDS = 16;
+
+
+//----------------------------------------------------------------------------
+
+vtkStandardNewMacro( vtkPerkEvaluatorPlaybackEngine );
+
+
+// Constructors and Destructors ----------------------------------------------
+
+vtkPerkEvaluatorPlaybackEngine
+::vtkPerkEvaluatorPlaybackEngine()
+{
+  this->Interpolation = false;
+  this->Matrix = vtkSmartPointer< vtkMatrix4x4 >::New();
+  this->ResetStatistics();
+}
+
+
+vtkPerkEvaluatorPlaybackEngine
+::~vtkPerkEvaluatorPlaybackEngine()
+{
+}
+
+
+void vtkPerkEvaluatorPlaybackEngine
+::PrintSelf( ostream& os, vtkIndent indent )
+{
+  this->Superclass::PrintSelf( os, indent );
+
+  os << indent << "Interpolation: " << this->Interpolation << "\n";
+  os << indent << "NumberOfBindings: " << this->Bindings.size() << "\n";
+  os << indent << "NumberOfAdvances: " << this->NumberOfAdvances << "\n";
+  os << indent << "NumberOfSeeks: " << this->NumberOfSeeks << "\n";
+  os << indent << "NumberOfTransformsSet: " << this->NumberOfTransformsSet << "\n";
+}
+
+
+// Bindings ----------------------------------------------
+
+void vtkPerkEvaluatorPlaybackEngine
+::ClearBindings( vtkMRMLTransformBufferNode* transformBuffer )
+{
+  this->Bindings.clear();
+  this->TransformBuffer = transformBuffer;
+  this->BoundTransformNames.clear();
+  if ( transformBuffer != NULL )
+  {
+    this->BoundTransformNames = transformBuffer->GetAllRecordedTransformNames();
+  }
+}
+
+
+void vtkPerkEvaluatorPlaybackEngine
+::AddBinding( vtkMRMLLinearTransformNode* transformNode, vtkPerkEvaluatorTrajectory* trajectory )
+{
+  if ( transformNode == NULL || trajectory == NULL )
+  {
+    return;
+  }
+
+  Binding binding;
+  binding.TransformName = trajectory->GetTransformName();
+  binding.TransformNode = transformNode;
+  binding.Trajectory = trajectory;
+  binding.Cursor = -1;
+  binding.AppliedRecord = -1;
+  binding.AppliedMTime = 0;
+  binding.AppliedTime = 0.0;
+  this->Bindings.push_back( binding );
+}
+
+
+bool vtkPerkEvaluatorPlaybackEngine
+::IsBound( vtkMRMLTransformBufferNode* transformBuffer )
+{
+  if ( transformBuffer == NULL || this->TransformBuffer.GetPointer() != transformBuffer )
+  {
+    return false;
+  }
+  if ( transformBuffer->GetAllRecordedTransformNames() != this->BoundTransformNames )
+  {
+    return false;
+  }
+
+  // Removed or renamed nodes would no longer be found by name
+  for ( unsigned int i = 0; i < this->Bindings.size(); i++ )
+  {
+    vtkMRMLLinearTransformNode* transformNode = this->Bindings.at( i ).TransformNode;
+    if ( transformNode == NULL || transformNode->GetScene() == NULL || transformNode->GetName() == NULL
+      || this->Bindings.at( i ).TransformName.compare( transformNode->GetName() ) != 0 )
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+// Playback ----------------------------------------------
+
+void vtkPerkEvaluatorPlaybackEngine
+::SetInterpolation( bool interpolation )
+{
+  if ( interpolation == this->Interpolation )
+  {
+    return;
+  }
+
+  // Every node must be set again
+  this->Interpolation = interpolation;
+  for ( unsigned int i = 0; i < this->Bindings.size(); i++ )
+  {
+    this->Bindings.at( i ).AppliedMTime = 0;
+  }
+}
+
+
+bool vtkPerkEvaluatorPlaybackEngine
+::GetInterpolation()
+{
+  return this->Interpolation;
+}
+
+
+int vtkPerkEvaluatorPlaybackEngine
+::MoveCursor( Binding& binding, double time )
+{
+  int numRecords = binding.Trajectory->GetNumberOfRecords();
+  if ( numRecords == 0 )
+  {
+    return -1;
+  }
+
+  // Sequential playback: the record is the current one, or a few records later
+  double* times = binding.Trajectory->GetTimes()->GetPointer( 0 );
+  int cursor = binding.Cursor;
+  if ( cursor >= 0 && cursor < numRecords && times[ cursor ] <= time )
+  {
+    for ( int i = 0; i < MAXIMUM_ADVANCE_RECORDS; i++ )
+    {
+      if ( cursor + 1 >= numRecords || times[ cursor + 1 ] > time )
+      {
+        this->NumberOfAdvances++;
+        return cursor;
+      }
+      cursor++;
+    }
+  }
+
+  // Scrubbing: search for the record
+  this->NumberOfSeeks++;
+  return binding.Trajectory->FindRecord( time );
+}
+
+
+void vtkPerkEvaluatorPlaybackEngine
+::UpdateToTime( double time, std::string transformName )
+{
+  for ( unsigned int i = 0; i < this->Bindings.size(); i++ )
+  {
+    Binding& binding = this->Bindings.at( i );
+    if ( ! transformName.empty() && binding.TransformName.compare( transformName ) != 0 )
+    {
+      continue;
+    }
+    if ( binding.TransformNode == NULL )
+    {
+      continue;
+    }
+
+    // Pick up any records added since the last update (e.g. while recording)
+    int previousNumberOfRecords = binding.Trajectory->GetNumberOfRecords();
+    binding.Trajectory->Update( this->TransformBuffer, binding.TransformName );
+    if ( binding.Trajectory->GetNumberOfRecords() < previousNumberOfRecords )
+    {
+      binding.Cursor = -1;
+    }
+
+    int record = this->MoveCursor( binding, time );
+    if ( record < 0 )
+    {
+      continue;
+    }
+
+    binding.Cursor = record;
+
+    // Nothing to do if the node still shows this record (or, when interpolating, this time)
+    int nearestRecord = binding.Trajectory->GetNearestRecord( record, time );
+    if ( binding.TransformNode->GetMTime() == binding.AppliedMTime
+      && ( this->Interpolation ? time == binding.AppliedTime : nearestRecord == binding.AppliedRecord ) )
+    {
+      continue;
+    }
+
+    if ( this->Interpolation )
+    {
+      binding.Trajectory->GetInterpolatedMatrix( record, time, this->Matrix );
+      binding.AppliedRecord = -1;
+    }
+    else
+    {
+      binding.Trajectory->GetMatrix( nearestRecord, this->Matrix );
+      binding.AppliedRecord = nearestRecord;
+    }
+    binding.TransformNode->SetMatrixTransformToParent( this->Matrix );
+    binding.AppliedMTime = binding.TransformNode->GetMTime();
+    binding.AppliedTime = time;
+    this->NumberOfTransformsSet++;
+  }
+}
+
+
+// Statistics ----------------------------------------------
+
+int vtkPerkEvaluatorPlaybackEngine
+::GetNumberOfAdvances()
+{
+  return this->NumberOfAdvances;
+}
+
+
+int vtkPerkEvaluatorPlaybackEngine
+::GetNumberOfSeeks()
+{
+  return this->NumberOfSeeks;
+}
+
+
+int vtkPerkEvaluatorPlaybackEngine
+::GetNumberOfTransformsSet()
+{
+  return this->NumberOfTransformsSet;
+}
+
+
+void vtkPerkEvaluatorPlaybackEngine
+::ResetStatistics()
+{
+  this->NumberOfAdvances = 0;
+  this->NumberOfSeeks = 0;
+  this->NumberOfTransformsSet = 0;
+}
@@ -0,0 +1,103 @@
+// .NAME vtkPerkEvaluatorPlaybackEngine - moves the transforms in the scene to a playback time
+// .SECTION Description
+// Each recorded transform is bound once to its transform node and to its trajectory, and keeps a cursor on the
+// last record at or before the time shown last. Sequential playback advances the cursors by a few records at most
+// (amortized constant time), anything else (scrubbing, going backwards) seeks with a binary search. Without
+// interpolation, a node shows the record nearest to the time (the cursor's record or the next one), and it is
+// only set if it needs to show a different record than last time (or it was changed by something else since). With interpolation, nodes
+// show the pose between the cursor's record and the next one instead, so they are set whenever the time changes.
+
+
+#ifndef __vtkPerkEvaluatorPlaybackEngine_h
+#define __vtkPerkEvaluatorPlaybackEngine_h
+
+// VTK includes
+#include "vtkObject.h"
+#include "vtkMatrix4x4.h"
+#include "vtkSmartPointer.h"
+#include "vtkWeakPointer.h"
+
+// MRML includes
+#include "vtkMRMLLinearTransformNode.h"
+
+// TransformRecorder includes
+#include "vtkMRMLTransformBufferNode.h"
+
+// PerkEvaluator includes
+#include "vtkPerkEvaluatorTrajectory.h"
+
+// STD includes
+#include <string>
+#include <vector>
+
+#include "vtkSlicerPerkEvaluatorModuleLogicExport.h"
+
+
+
+class VTK_SLICER_PERKEVALUATOR_MODULE_LOGIC_EXPORT
+vtkPerkEvaluatorPlaybackEngine
+ : public vtkObject
+{
+public:
+
+  static vtkPerkEvaluatorPlaybackEngine* New();
+  vtkTypeMacro( vtkPerkEvaluatorPlaybackEngine, vtkObject );
+  void PrintSelf( ostream& os, vtkIndent indent );
+
+  // Bindings
+  void ClearBindings( vtkMRMLTransformBufferNode* transformBuffer = NULL );
+  void AddBinding( vtkMRMLLinearTransformNode* transformNode, vtkPerkEvaluatorTrajectory* trajectory );
+  // The bindings must be rebuilt if the buffer, its recorded transforms, or any bound node changed
+  bool IsBound( vtkMRMLTransformBufferNode* transformBuffer );
+
+  // Interpolate between records (linearly for positions, SLERP for orientations), or show the record nearest to the time
+  void SetInterpolation( bool interpolation );
+  bool GetInterpolation();
+
+  // Show the records at the given (absolute) time, for all transforms or only the named one
+  void UpdateToTime( double time, std::string transformName = "" );
+
+  // Statistics
+  int GetNumberOfAdvances(); // Cursor moved forward by a few records
+  int GetNumberOfSeeks(); // Cursor found by binary search
+  int GetNumberOfTransformsSet();
+  void ResetStatistics();
+
+protected:
+
+  vtkPerkEvaluatorPlaybackEngine();
+  virtual ~vtkPerkEvaluatorPlaybackEngine();
+
+  struct Binding
+  {
+    std::string TransformName;
+    vtkWeakPointer< vtkMRMLLinearTransformNode > TransformNode;
+    vtkSmartPointer< vtkPerkEvaluatorTrajectory > Trajectory;
+    int Cursor; // The last record at or before the time shown last (-1 if none)
+    int AppliedRecord; // The record shown last, without interpolation (the cursor's record or the next one)
+    unsigned long AppliedMTime; // Modified time of the transform node after the record was shown
+    double AppliedTime;
+  };
+
+  int MoveCursor( Binding& binding, double time );
+
+  vtkWeakPointer< vtkMRMLTransformBufferNode > TransformBuffer;
+  std::vector< std::string > BoundTransformNames; // All recorded transform names when the bindings were made
+  std::vector< Binding > Bindings;
+
+  bool Interpolation;
+  vtkSmartPointer< vtkMatrix4x4 > Matrix; // Reused for every update
+
+  int NumberOfAdvances;
+  int NumberOfSeeks;
+  int NumberOfTransformsSet;
+
+private:
+
+  vtkPerkEvaluatorPlaybackEngine( const vtkPerkEvaluatorPlaybackEngine& ); // Not implemented
+  void operator=( const vtkPerkEvaluatorPlaybackEngine& );                  // Not implemented
+
+};
+
+
+#endif
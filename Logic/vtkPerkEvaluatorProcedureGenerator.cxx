@@ -0,0 +1,313 @@
+
+// PerkEvaluator Logic includes
+#include "vtkPerkEvaluatorProcedureGenerator.h"
+
+// MRML includes
+#include "vtkMRMLLinearTransformNode.h"
+
+// VTK includes
+#include <vtkMath.h>
+#include <vtkObjectFactory.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+
+// Constants ----------------------------------------------------------------------------
+
+static const double ROOT_WORKSPACE_SIZE = 200.0; // mm, tools relative to the reference move in a cube of this size
+static const double CHILD_WORKSPACE_SIZE = 40.0; // mm, tools relative to other tools stay close to them
+static const double REACHING_PROBABILITY = 0.5; // Otherwise the tool holds still
+static const double MINIMUM_SEGMENT_DURATION = 0.5; // s
+static const double MAXIMUM_SEGMENT_DURATION = 2.5; // s
+static const double MAXIMUM_ROTATION_ANGLE = 30.0; // Degrees, per reaching motion
+static const double MAXIMUM_TIME_JITTER = 0.45; // Fraction of the sampling period, so the samples stay in order
+
+
+//----------------------------------------------------------------------------
+
+vtkStandardNewMacro( vtkPerkEvaluatorProcedureGenerator );
+
+
+// Constructors and Destructors ----------------------------------------------
+
+vtkPerkEvaluatorProcedureGenerator
+::vtkPerkEvaluatorProcedureGenerator()
+{
+  this->NumberOfTools = 3;
+  this->HierarchyDepth = 1;
+  this->SamplingRate = 30.0;
+  this->Duration = 60.0;
+  this->TimeJitter = 0.05;
+  this->PositionJitter = 0.2;
+  this->DropoutRate = 1.0;
+  this->DropoutDuration = 0.5;
+  this->NumberOfMessages = 5;
+  this->Seed = 1;
+
+  this->RandomSequence = vtkSmartPointer< vtkMinimalStandardRandomSequence >::New();
+  this->Transform = vtkSmartPointer< vtkTransform >::New();
+  this->Transform->PostMultiply();
+}
+
+
+vtkPerkEvaluatorProcedureGenerator
+::~vtkPerkEvaluatorProcedureGenerator()
+{
+}
+
+
+void vtkPerkEvaluatorProcedureGenerator
+::PrintSelf( ostream& os, vtkIndent indent )
+{
+  this->Superclass::PrintSelf( os, indent );
+
+  os << indent << "NumberOfTools: " << this->NumberOfTools << "\n";
+  os << indent << "HierarchyDepth: " << this->HierarchyDepth << "\n";
+  os << indent << "SamplingRate: " << this->SamplingRate << "\n";
+  os << indent << "Duration: " << this->Duration << "\n";
+  os << indent << "TimeJitter: " << this->TimeJitter << "\n";
+  os << indent << "PositionJitter: " << this->PositionJitter << "\n";
+  os << indent << "DropoutRate: " << this->DropoutRate << "\n";
+  os << indent << "DropoutDuration: " << this->DropoutDuration << "\n";
+  os << indent << "NumberOfMessages: " << this->NumberOfMessages << "\n";
+  os << indent << "Seed: " << this->Seed << "\n";
+}
+
+
+// Tools ----------------------------------------------
+
+int vtkPerkEvaluatorProcedureGenerator
+::GetParentTool( int tool )
+{
+  if ( this->HierarchyDepth <= 1 || tool % this->HierarchyDepth == 0 )
+  {
+    return -1;
+  }
+  return tool - 1;
+}
+
+
+std::string vtkPerkEvaluatorProcedureGenerator
+::GetToolName( int tool )
+{
+  std::stringstream toolName;
+  toolName << "Tool" << tool << "To";
+  if ( this->GetParentTool( tool ) < 0 )
+  {
+    toolName << "Reference";
+  }
+  else
+  {
+    toolName << "Tool" << this->GetParentTool( tool );
+  }
+  return toolName.str();
+}
+
+
+void vtkPerkEvaluatorProcedureGenerator
+::CreateToolNodes( vtkMRMLScene* scene )
+{
+  if ( scene == NULL )
+  {
+    return;
+  }
+
+  // Parents come first, so they are always in the scene before their children
+  for ( int i = 0; i < this->NumberOfTools; i++ )
+  {
+    if ( scene->GetFirstNodeByName( this->GetToolName( i ).c_str() ) != NULL )
+    {
+      continue;
+    }
+
+    vtkSmartPointer< vtkMRMLLinearTransformNode > transformNode = vtkSmartPointer< vtkMRMLLinearTransformNode >::New();
+    transformNode->SetName( this->GetToolName( i ).c_str() );
+    scene->AddNode( transformNode );
+
+    if ( this->GetParentTool( i ) >= 0 )
+    {
+      vtkMRMLNode* parentNode = scene->GetFirstNodeByName( this->GetToolName( this->GetParentTool( i ) ).c_str() );
+      transformNode->SetAndObserveTransformNodeID( ( parentNode != NULL ) ? parentNode->GetID() : NULL );
+    }
+  }
+}
+
+
+// Random values ----------------------------------------------
+
+double vtkPerkEvaluatorProcedureGenerator
+::GetUniformValue( double minimum, double maximum )
+{
+  this->RandomSequence->Next();
+  return this->RandomSequence->GetRangeValue( minimum, maximum );
+}
+
+
+double vtkPerkEvaluatorProcedureGenerator
+::GetGaussianValue( double standardDeviation )
+{
+  // Box-Muller transform
+  double u1 = std::max( this->GetUniformValue( 0.0, 1.0 ), 1e-12 );
+  double u2 = this->GetUniformValue( 0.0, 1.0 );
+  return standardDeviation * sqrt( -2.0 * log( u1 ) ) * cos( 2.0 * vtkMath::Pi() * u2 );
+}
+
+
+void vtkPerkEvaluatorProcedureGenerator
+::GetRandomPosition( int tool, double position[ 3 ] )
+{
+  double workspaceSize = ( this->GetParentTool( tool ) < 0 ) ? ROOT_WORKSPACE_SIZE : CHILD_WORKSPACE_SIZE;
+  for ( int i = 0; i < 3; i++ )
+  {
+    position[ i ] = this->GetUniformValue( -0.5 * workspaceSize, 0.5 * workspaceSize );
+  }
+}
+
+
+// Motion ----------------------------------------------
+
+void vtkPerkEvaluatorProcedureGenerator
+::InitializeToolState( int tool, ToolState& state )
+{
+  this->GetRandomPosition( tool, state.StartPosition );
+  state.StartOrientation = vtkSmartPointer< vtkMatrix4x4 >::New();
+  state.SegmentStartTime = 0.0;
+  state.DropoutEndTime = - 1.0;
+  this->StartSegment( tool, state );
+}
+
+
+void vtkPerkEvaluatorProcedureGenerator
+::StartSegment( int tool, ToolState& state )
+{
+  state.SegmentDuration = this->GetUniformValue( MINIMUM_SEGMENT_DURATION, MAXIMUM_SEGMENT_DURATION );
+
+  bool reaching = this->GetUniformValue( 0.0, 1.0 ) < REACHING_PROBABILITY;
+  if ( ! reaching )
+  {
+    std::copy( state.StartPosition, state.StartPosition + 3, state.TargetPosition );
+    state.RotationAxis[ 0 ] = 0.0;
+    state.RotationAxis[ 1 ] = 0.0;
+    state.RotationAxis[ 2 ] = 1.0;
+    state.RotationAngle = 0.0;
+    return;
+  }
+
+  this->GetRandomPosition( tool, state.TargetPosition );
+  for ( int i = 0; i < 3; i++ )
+  {
+    state.RotationAxis[ i ] = this->GetGaussianValue( 1.0 );
+  }
+  if ( vtkMath::Normalize( state.RotationAxis ) == 0.0 )
+  {
+    state.RotationAxis[ 2 ] = 1.0;
+  }
+  state.RotationAngle = this->GetUniformValue( - MAXIMUM_ROTATION_ANGLE, MAXIMUM_ROTATION_ANGLE );
+}
+
+
+void vtkPerkEvaluatorProcedureGenerator
+::GetPose( ToolState& state, double time, vtkMatrix4x4* pose )
+{
+  // Minimum-jerk profile over the segment
+  double tau = ( state.SegmentDuration > 0.0 ) ? ( time - state.SegmentStartTime ) / state.SegmentDuration : 1.0;
+  tau = std::max( 0.0, std::min( tau, 1.0 ) );
+  double progress = tau * tau * tau * ( 10.0 - 15.0 * tau + 6.0 * tau * tau );
+
+  this->Transform->Identity();
+  this->Transform->Concatenate( state.StartOrientation );
+  this->Transform->RotateWXYZ( progress * state.RotationAngle, state.RotationAxis );
+  pose->DeepCopy( this->Transform->GetMatrix() );
+  for ( int i = 0; i < 3; i++ )
+  {
+    pose->SetElement( i, 3, state.StartPosition[ i ] + progress * ( state.TargetPosition[ i ] - state.StartPosition[ i ] ) );
+  }
+}
+
+
+// Generation ----------------------------------------------
+
+void vtkPerkEvaluatorProcedureGenerator
+::Generate( vtkMRMLTransformBufferNode* transformBuffer )
+{
+  if ( transformBuffer == NULL || this->NumberOfTools <= 0 || this->SamplingRate <= 0.0 )
+  {
+    return;
+  }
+
+  this->RandomSequence->SetSeed( this->Seed );
+
+  std::vector< ToolState > toolStates( this->NumberOfTools );
+  for ( int i = 0; i < this->NumberOfTools; i++ )
+  {
+    this->InitializeToolState( i, toolStates.at( i ) );
+  }
+
+  double samplingPeriod = 1.0 / this->SamplingRate;
+  double dropoutProbability = this->DropoutRate * samplingPeriod / 60.0; // Per sample
+  int numSamples = int( floor( this->Duration * this->SamplingRate + 0.5 ) ); // Per tool
+  vtkSmartPointer< vtkMatrix4x4 > pose = vtkSmartPointer< vtkMatrix4x4 >::New();
+
+  // All tools are sampled together, like a tracker would
+  for ( int k = 0; k < numSamples; k++ )
+  {
+    for ( int i = 0; i < this->NumberOfTools; i++ )
+    {
+      ToolState& state = toolStates.at( i );
+      double jitter = std::max( - MAXIMUM_TIME_JITTER, std::min( this->GetGaussianValue( this->TimeJitter ), MAXIMUM_TIME_JITTER ) );
+      double time = ( k + 0.5 + jitter ) * samplingPeriod;
+
+      // Finish the segments which ended before this sample
+      while ( time >= state.SegmentStartTime + state.SegmentDuration )
+      {
+        this->GetPose( state, state.SegmentStartTime + state.SegmentDuration, pose );
+        state.StartOrientation->DeepCopy( pose );
+        for ( int j = 0; j < 3; j++ )
+        {
+          state.StartOrientation->SetElement( j, 3, 0.0 );
+        }
+        std::copy( state.TargetPosition, state.TargetPosition + 3, state.StartPosition );
+        state.SegmentStartTime += state.SegmentDuration;
+        this->StartSegment( i, state );
+      }
+
+      // The tool keeps moving while the tracker cannot see it
+      if ( time < state.DropoutEndTime )
+      {
+        continue;
+      }
+      if ( this->GetUniformValue( 0.0, 1.0 ) < dropoutProbability )
+      {
+        state.DropoutEndTime = time - this->DropoutDuration * log( 1.0 - this->GetUniformValue( 0.0, 1.0 ) );
+        continue;
+      }
+
+      this->GetPose( state, time, pose );
+      for ( int j = 0; j < 3; j++ )
+      {
+        pose->SetElement( j, 3, pose->GetElement( j, 3 ) + this->GetGaussianValue( this->PositionJitter ) );
+      }
+
+      vtkSmartPointer< vtkTransformRecord > record = vtkSmartPointer< vtkTransformRecord >::New();
+      record->SetTransformName( this->GetToolName( i ) );
+      record->SetTransformMatrix( pose );
+      record->SetTime( time );
+      transformBuffer->AddTransform( record );
+    }
+  }
+
+  // One marker in each equal part of the procedure
+  for ( int i = 0; i < this->NumberOfMessages; i++ )
+  {
+    std::stringstream messageString;
+    messageString << "Marker" << ( i + 1 );
+
+    vtkSmartPointer< vtkMessageRecord > message = vtkSmartPointer< vtkMessageRecord >::New();
+    message->SetMessageString( messageString.str() );
+    message->SetTime( this->Duration * ( i + this->GetUniformValue( 0.25, 0.75 ) ) / this->NumberOfMessages );
+    transformBuffer->AddMessage( message );
+  }
+}
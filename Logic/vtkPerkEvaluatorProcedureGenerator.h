@@ -0,0 +1,125 @@
+// .NAME vtkPerkEvaluatorProcedureGenerator - fills a transform buffer with synthetic tracking data
+// .SECTION Description
+// Each tool alternates between holding still and reaching for a new pose (with a minimum-jerk profile, like hand
+// motions), and all tools are sampled together at the sampling rate, like a tracker would. On top of the motion
+// come jitter on the sample times and positions, dropouts (the tracker loses a tool for a while), and message
+// markers spread over the procedure. The tools form chains of the given depth (each tool is recorded relative to
+// its parent), so CreateToolNodes must be called to build the same hierarchy in the scene. The same seed always
+// generates the same procedure.
+
+
+#ifndef __vtkPerkEvaluatorProcedureGenerator_h
+#define __vtkPerkEvaluatorProcedureGenerator_h
+
+// VTK includes
+#include "vtkObject.h"
+#include "vtkMatrix4x4.h"
+#include "vtkMinimalStandardRandomSequence.h"
+#include "vtkSmartPointer.h"
+#include "vtkTransform.h"
+
+// MRML includes
+#include "vtkMRMLScene.h"
+
+// TransformRecorder includes
+#include "vtkMRMLTransformBufferNode.h"
+
+// STD includes
+#include <string>
+#include <vector>
+
+#include "vtkSlicerPerkEvaluatorModuleLogicExport.h"
+
+
+
+class VTK_SLICER_PERKEVALUATOR_MODULE_LOGIC_EXPORT
+vtkPerkEvaluatorProcedureGenerator
+ : public vtkObject
+{
+public:
+
+  static vtkPerkEvaluatorProcedureGenerator* New();
+  vtkTypeMacro( vtkPerkEvaluatorProcedureGenerator, vtkObject );
+  void PrintSelf( ostream& os, vtkIndent indent );
+
+  // Parameters
+  vtkGetMacro( NumberOfTools, int );
+  vtkSetMacro( NumberOfTools, int );
+  vtkGetMacro( HierarchyDepth, int ); // One means all tools are relative to the reference
+  vtkSetMacro( HierarchyDepth, int );
+  vtkGetMacro( SamplingRate, double ); // Hz
+  vtkSetMacro( SamplingRate, double );
+  vtkGetMacro( Duration, double ); // s
+  vtkSetMacro( Duration, double );
+  vtkGetMacro( TimeJitter, double ); // Standard deviation, as a fraction of the sampling period
+  vtkSetMacro( TimeJitter, double );
+  vtkGetMacro( PositionJitter, double ); // Standard deviation, mm
+  vtkSetMacro( PositionJitter, double );
+  vtkGetMacro( DropoutRate, double ); // Average number of dropouts per tool per minute
+  vtkSetMacro( DropoutRate, double );
+  vtkGetMacro( DropoutDuration, double ); // Average, s
+  vtkSetMacro( DropoutDuration, double );
+  vtkGetMacro( NumberOfMessages, int );
+  vtkSetMacro( NumberOfMessages, int );
+  vtkGetMacro( Seed, int );
+  vtkSetMacro( Seed, int );
+
+  // Tools are named after their parents, e.g. Tool1ToTool0 or Tool0ToReference
+  std::string GetToolName( int tool );
+  int GetParentTool( int tool ); // -1 if the tool is relative to the reference
+
+  // Add a linear transform node for each tool (unless there is one with its name already), in the tools' hierarchy
+  void CreateToolNodes( vtkMRMLScene* scene );
+
+  // Add the records and messages to the buffer (without removing any that are already there)
+  void Generate( vtkMRMLTransformBufferNode* transformBuffer );
+
+protected:
+
+  vtkPerkEvaluatorProcedureGenerator();
+  virtual ~vtkPerkEvaluatorProcedureGenerator();
+
+  // Motion of a tool relative to its parent, one segment (holding still or reaching) at a time
+  struct ToolState
+  {
+    double StartPosition[ 3 ];
+    double TargetPosition[ 3 ];
+    vtkSmartPointer< vtkMatrix4x4 > StartOrientation;
+    double RotationAxis[ 3 ];
+    double RotationAngle; // Degrees, over the segment
+    double SegmentStartTime;
+    double SegmentDuration;
+    double DropoutEndTime;
+  };
+
+  double GetUniformValue( double minimum, double maximum );
+  double GetGaussianValue( double standardDeviation );
+  void GetRandomPosition( int tool, double position[ 3 ] );
+
+  void InitializeToolState( int tool, ToolState& state );
+  void StartSegment( int tool, ToolState& state );
+  void GetPose( ToolState& state, double time, vtkMatrix4x4* pose );
+
+  int NumberOfTools;
+  int HierarchyDepth;
+  double SamplingRate;
+  double Duration;
+  double TimeJitter;
+  double PositionJitter;
+  double DropoutRate;
+  double DropoutDuration;
+  int NumberOfMessages;
+  int Seed;
+
+  vtkSmartPointer< vtkMinimalStandardRandomSequence > RandomSequence;
+  vtkSmartPointer< vtkTransform > Transform; // Reused for every pose
+
+private:
+
+  vtkPerkEvaluatorProcedureGenerator( const vtkPerkEvaluatorProcedureGenerator& ); // Not implemented
+  void operator=( const vtkPerkEvaluatorProcedureGenerator& );                      // Not implemented
+
+};
+
+
+#endif
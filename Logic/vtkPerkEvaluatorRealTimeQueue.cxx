@@ -0,0 +1,249 @@
+
+// PerkEvaluator Logic includes
+#include "vtkPerkEvaluatorRealTimeQueue.h"
+
+// VTK includes
+#include <vtkObjectFactory.h>
+
+// STD includes
+#include <algorithm>
+
+
+// Constants ----------------------------------------------------------------------------
+
+static const int DEFAULT_CAPACITY = 256;
+
+
+//----------------------------------------------------------------------------
+
+vtkStandardNewMacro( vtkPerkEvaluatorRealTimeQueue );
+
+
+// Constructors and Destructors ----------------------------------------------
+
+vtkPerkEvaluatorRealTimeQueue
+::vtkPerkEvaluatorRealTimeQueue()
+{
+  this->Mutex = vtkSimpleMutexLock::New();
+  this->BackpressurePolicy = vtkPerkEvaluatorRealTimeQueue::CoalescePerTransform;
+  this->Buffer.resize( DEFAULT_CAPACITY );
+  this->Head = 0;
+  this->Depth = 0;
+  this->ResetStatistics();
+}
+
+
+vtkPerkEvaluatorRealTimeQueue
+::~vtkPerkEvaluatorRealTimeQueue()
+{
+  this->Mutex->Delete();
+}
+
+
+void vtkPerkEvaluatorRealTimeQueue
+::PrintSelf( ostream& os, vtkIndent indent )
+{
+  this->Superclass::PrintSelf( os, indent );
+
+  os << indent << "Capacity: " << this->Buffer.size() << "\n";
+  os << indent << "BackpressurePolicy: " << this->BackpressurePolicy << "\n";
+  os << indent << "Depth: " << this->Depth << "\n";
+  os << indent << "MaximumDepth: " << this->MaximumDepth << "\n";
+  os << indent << "NumberOfDroppedSamples: " << this->NumberOfDroppedSamples << "\n";
+  os << indent << "NumberOfCoalescedSamples: " << this->NumberOfCoalescedSamples << "\n";
+  os << indent << "NumberOfRefusedSamples: " << this->NumberOfRefusedSamples << "\n";
+}
+
+
+// Configuration ----------------------------------------------
+
+void vtkPerkEvaluatorRealTimeQueue
+::SetCapacity( int newCapacity )
+{
+  if ( newCapacity < 1 )
+  {
+    return;
+  }
+
+  this->Mutex->Lock();
+  this->Buffer.clear();
+  this->Buffer.resize( newCapacity );
+  this->Head = 0;
+  this->Depth = 0;
+  this->QueuedSlots.clear();
+  this->Mutex->Unlock();
+  this->Modified();
+}
+
+
+int vtkPerkEvaluatorRealTimeQueue
+::GetCapacity()
+{
+  return this->Buffer.size();
+}
+
+
+void vtkPerkEvaluatorRealTimeQueue
+::SetBackpressurePolicy( BackpressurePolicyEnum newBackpressurePolicy )
+{
+  if ( this->BackpressurePolicy == newBackpressurePolicy )
+  {
+    return;
+  }
+
+  this->Mutex->Lock();
+  this->BackpressurePolicy = newBackpressurePolicy;
+  this->Mutex->Unlock();
+  this->Modified();
+}
+
+
+vtkPerkEvaluatorRealTimeQueue::BackpressurePolicyEnum vtkPerkEvaluatorRealTimeQueue
+::GetBackpressurePolicy()
+{
+  return this->BackpressurePolicy;
+}
+
+
+// Queue operations ----------------------------------------------
+
+std::string vtkPerkEvaluatorRealTimeQueue
+::GetCoalesceKey( const Sample& sample )
+{
+  return sample.PerkEvaluatorNodeID + "\n" + sample.TransformName;
+}
+
+
+void vtkPerkEvaluatorRealTimeQueue
+::RemoveOldest()
+{
+  std::map< std::string, int >::iterator slotItr = this->QueuedSlots.find( this->GetCoalesceKey( this->Buffer.at( this->Head ) ) );
+  if ( slotItr != this->QueuedSlots.end() && slotItr->second == this->Head )
+  {
+    this->QueuedSlots.erase( slotItr );
+  }
+
+  this->Head = ( this->Head + 1 ) % this->Buffer.size();
+  this->Depth--;
+}
+
+
+bool vtkPerkEvaluatorRealTimeQueue
+::Push( const Sample& sample )
+{
+  this->Mutex->Lock();
+
+  std::string coalesceKey = this->GetCoalesceKey( sample );
+
+  if ( this->Depth == this->GetCapacity() )
+  {
+    if ( this->BackpressurePolicy == vtkPerkEvaluatorRealTimeQueue::Block )
+    {
+      this->NumberOfRefusedSamples++;
+      this->Mutex->Unlock();
+      return false;
+    }
+
+    // Only the most recent time of the transform is evaluated, if it already has a sample waiting
+    std::map< std::string, int >::iterator slotItr = this->QueuedSlots.find( coalesceKey );
+    if ( this->BackpressurePolicy == vtkPerkEvaluatorRealTimeQueue::CoalescePerTransform && slotItr != this->QueuedSlots.end() )
+    {
+      this->Buffer.at( slotItr->second ) = sample;
+      this->NumberOfCoalescedSamples++;
+      this->Mutex->Unlock();
+      return true;
+    }
+
+    this->RemoveOldest();
+    this->NumberOfDroppedSamples++;
+  }
+
+  int tail = ( this->Head + this->Depth ) % this->Buffer.size();
+  this->Buffer.at( tail ) = sample;
+  this->QueuedSlots[ coalesceKey ] = tail;
+  this->Depth++;
+  this->MaximumDepth = std::max( this->MaximumDepth, this->Depth );
+
+  this->Mutex->Unlock();
+  return true;
+}
+
+
+bool vtkPerkEvaluatorRealTimeQueue
+::Pop( Sample& sample )
+{
+  this->Mutex->Lock();
+
+  if ( this->Depth == 0 )
+  {
+    this->Mutex->Unlock();
+    return false;
+  }
+
+  sample = this->Buffer.at( this->Head );
+  this->RemoveOldest();
+
+  this->Mutex->Unlock();
+  return true;
+}
+
+
+void vtkPerkEvaluatorRealTimeQueue
+::Clear()
+{
+  this->Mutex->Lock();
+  this->Head = 0;
+  this->Depth = 0;
+  this->QueuedSlots.clear();
+  this->Mutex->Unlock();
+}
+
+
+// Statistics ----------------------------------------------
+
+int vtkPerkEvaluatorRealTimeQueue
+::GetDepth()
+{
+  this->Mutex->Lock();
+  int depth = this->Depth;
+  this->Mutex->Unlock();
+  return depth;
+}
+
+
+int vtkPerkEvaluatorRealTimeQueue
+::GetMaximumDepth()
+{
+  return this->MaximumDepth;
+}
+
+
+int vtkPerkEvaluatorRealTimeQueue
+::GetNumberOfDroppedSamples()
+{
+  return this->NumberOfDroppedSamples;
+}
+
+
+int vtkPerkEvaluatorRealTimeQueue
+::GetNumberOfCoalescedSamples()
+{
+  return this->NumberOfCoalescedSamples;
+}
+
+
+int vtkPerkEvaluatorRealTimeQueue
+::GetNumberOfRefusedSamples()
+{
+  return this->NumberOfRefusedSamples;
+}
+
+
+void vtkPerkEvaluatorRealTimeQueue
+::ResetStatistics()
+{
+  this->MaximumDepth = 0;
+  this->NumberOfDroppedSamples = 0;
+  this->NumberOfCoalescedSamples = 0;
+  this->NumberOfRefusedSamples = 0;
+}
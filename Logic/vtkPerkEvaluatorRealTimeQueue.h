@@ -0,0 +1,100 @@
+// .NAME vtkPerkEvaluatorRealTimeQueue - bounded queue of real-time samples waiting for metric evaluation
+// .SECTION Description
+// Samples are stored in a fixed-size ring buffer, and every sample is kept in order until the buffer is full.
+// Only then does the backpressure policy decide what happens to a new sample: the oldest sample is dropped,
+// or the newest queued sample of the same transform is replaced (so only its most recent time is evaluated),
+// or the push is refused until the queue is drained.
+// Pushing and popping are protected by a mutex, so producers and the evaluation stage may be on different threads.
+
+
+#ifndef __vtkPerkEvaluatorRealTimeQueue_h
+#define __vtkPerkEvaluatorRealTimeQueue_h
+
+// VTK includes
+#include "vtkObject.h"
+#include "vtkMutexLock.h"
+
+// STD includes
+#include <map>
+#include <string>
+#include <vector>
+
+#include "vtkSlicerPerkEvaluatorModuleLogicExport.h"
+
+
+
+class VTK_SLICER_PERKEVALUATOR_MODULE_LOGIC_EXPORT
+vtkPerkEvaluatorRealTimeQueue
+ : public vtkObject
+{
+public:
+
+  enum BackpressurePolicyEnum
+  {
+    DropOldest,
+    CoalescePerTransform,
+    Block
+  };
+
+  struct Sample
+  {
+    std::string PerkEvaluatorNodeID;
+    std::string TransformName;
+    double Time;
+  };
+
+  static vtkPerkEvaluatorRealTimeQueue* New();
+  vtkTypeMacro( vtkPerkEvaluatorRealTimeQueue, vtkObject );
+  void PrintSelf( ostream& os, vtkIndent indent );
+
+  // Changing the capacity clears the queue
+  void SetCapacity( int newCapacity );
+  int GetCapacity();
+
+  void SetBackpressurePolicy( BackpressurePolicyEnum newBackpressurePolicy );
+  BackpressurePolicyEnum GetBackpressurePolicy();
+
+  // Returns false if the sample was refused (only with the Block policy, when the queue is full)
+  bool Push( const Sample& sample );
+  bool Pop( Sample& sample ); // Returns false if the queue is empty
+  void Clear();
+
+  // Statistics for monitoring the queue
+  int GetDepth();
+  int GetMaximumDepth(); // Largest depth since the statistics were reset
+  int GetNumberOfDroppedSamples();
+  int GetNumberOfCoalescedSamples();
+  int GetNumberOfRefusedSamples();
+  void ResetStatistics();
+
+protected:
+
+  vtkPerkEvaluatorRealTimeQueue();
+  virtual ~vtkPerkEvaluatorRealTimeQueue();
+
+  std::string GetCoalesceKey( const Sample& sample );
+  void RemoveOldest(); // The mutex must already be locked
+
+  std::vector< Sample > Buffer;
+  int Head; // Index of the oldest sample
+  int Depth;
+  BackpressurePolicyEnum BackpressurePolicy;
+
+  std::map< std::string, int > QueuedSlots; // From Perk Evaluator node and transform to the slot of its queued sample
+
+  int MaximumDepth;
+  int NumberOfDroppedSamples;
+  int NumberOfCoalescedSamples;
+  int NumberOfRefusedSamples;
+
+  vtkSimpleMutexLock* Mutex;
+
+private:
+
+  vtkPerkEvaluatorRealTimeQueue( const vtkPerkEvaluatorRealTimeQueue& ); // Not implemented
+  void operator=( const vtkPerkEvaluatorRealTimeQueue& );                 // Not implemented
+
+};
+
+
+#endif
@@ -0,0 +1,235 @@
+
+// PerkEvaluator Logic includes
+#include "vtkPerkEvaluatorSegmentTree.h"
+
+// VTK includes
+#include <vtkObjectFactory.h>
+
+// STD includes
+#include <algorithm>
+
+
+//----------------------------------------------------------------------------
+
+vtkStandardNewMacro( vtkPerkEvaluatorSegmentTree );
+
+const int vtkPerkEvaluatorSegmentTree::BLOCK_SIZE = 64;
+
+
+// Constructors and Destructors ----------------------------------------------
+
+vtkPerkEvaluatorSegmentTree
+::vtkPerkEvaluatorSegmentTree()
+{
+  this->Clear();
+}
+
+
+vtkPerkEvaluatorSegmentTree
+::~vtkPerkEvaluatorSegmentTree()
+{
+}
+
+
+void vtkPerkEvaluatorSegmentTree
+::PrintSelf( ostream& os, vtkIndent indent )
+{
+  this->Superclass::PrintSelf( os, indent );
+
+  os << indent << "NumberOfValues: " << this->Values.size() << "\n";
+  os << indent << "Capacity: " << this->Capacity << "\n";
+}
+
+
+// Aggregates ----------------------------------------------
+
+void vtkPerkEvaluatorSegmentTree
+::InitializeAggregate( Aggregate& aggregate )
+{
+  aggregate.Sum = 0;
+  aggregate.Minimum = 0;
+  aggregate.Maximum = 0;
+  aggregate.Count = 0;
+}
+
+
+void vtkPerkEvaluatorSegmentTree
+::CombineAggregates( const Aggregate& left, const Aggregate& right, Aggregate& combined )
+{
+  if ( left.Count == 0 )
+  {
+    combined = right;
+    return;
+  }
+  if ( right.Count == 0 )
+  {
+    combined = left;
+    return;
+  }
+
+  combined.Sum = left.Sum + right.Sum;
+  combined.Minimum = std::min( left.Minimum, right.Minimum );
+  combined.Maximum = std::max( left.Maximum, right.Maximum );
+  combined.Count = left.Count + right.Count;
+}
+
+
+// Building ----------------------------------------------
+
+void vtkPerkEvaluatorSegmentTree
+::Clear()
+{
+  Aggregate emptyAggregate;
+  vtkPerkEvaluatorSegmentTree::InitializeAggregate( emptyAggregate );
+  this->Capacity = 1;
+  this->Values.clear();
+  this->Nodes.assign( 2 * this->Capacity, emptyAggregate );
+}
+
+
+int vtkPerkEvaluatorSegmentTree
+::GetNumberOfValues()
+{
+  return this->Values.size();
+}
+
+
+void vtkPerkEvaluatorSegmentTree
+::Resize( int capacity )
+{
+  Aggregate emptyAggregate;
+  vtkPerkEvaluatorSegmentTree::InitializeAggregate( emptyAggregate );
+  this->Capacity = capacity;
+  this->Nodes.assign( 2 * this->Capacity, emptyAggregate );
+  for ( int block = 0; block * BLOCK_SIZE < this->GetNumberOfValues(); block++ )
+  {
+    this->Nodes.at( this->Capacity + block ) = this->ScanValues( block * BLOCK_SIZE, ( block + 1 ) * BLOCK_SIZE - 1 );
+  }
+
+  // Bottom-up, so every node is combined once
+  for ( int i = this->Capacity - 1; i > 0; i-- )
+  {
+    vtkPerkEvaluatorSegmentTree::CombineAggregates( this->Nodes.at( 2 * i ), this->Nodes.at( 2 * i + 1 ), this->Nodes.at( i ) );
+  }
+}
+
+
+void vtkPerkEvaluatorSegmentTree
+::Build( const std::vector< double >& values )
+{
+  this->Values = values;
+
+  int numBlocks = ( this->GetNumberOfValues() + BLOCK_SIZE - 1 ) / BLOCK_SIZE;
+  int capacity = 1;
+  while ( capacity < numBlocks )
+  {
+    capacity *= 2;
+  }
+  this->Resize( capacity );
+}
+
+
+void vtkPerkEvaluatorSegmentTree
+::Append( double value )
+{
+  this->Values.push_back( value );
+
+  int block = ( this->GetNumberOfValues() - 1 ) / BLOCK_SIZE;
+  if ( block >= this->Capacity )
+  {
+    this->Resize( 2 * this->Capacity );
+    return;
+  }
+  this->UpdateBlock( block );
+}
+
+
+void vtkPerkEvaluatorSegmentTree
+::UpdateBlock( int block )
+{
+  int node = this->Capacity + block;
+  this->Nodes.at( node ) = this->ScanValues( block * BLOCK_SIZE, ( block + 1 ) * BLOCK_SIZE - 1 );
+
+  // Only the nodes containing the block change
+  for ( node = node / 2; node > 0; node = node / 2 )
+  {
+    vtkPerkEvaluatorSegmentTree::CombineAggregates( this->Nodes.at( 2 * node ), this->Nodes.at( 2 * node + 1 ), this->Nodes.at( node ) );
+  }
+}
+
+
+unsigned long vtkPerkEvaluatorSegmentTree
+::GetActualMemorySize()
+{
+  return ( this->Values.capacity() * sizeof( double ) + this->Nodes.capacity() * sizeof( Aggregate ) ) / 1024;
+}
+
+
+// Queries ----------------------------------------------
+
+vtkPerkEvaluatorSegmentTree::Aggregate vtkPerkEvaluatorSegmentTree
+::ScanValues( int begin, int end )
+{
+  Aggregate aggregate;
+  vtkPerkEvaluatorSegmentTree::InitializeAggregate( aggregate );
+
+  end = std::min( end, this->GetNumberOfValues() - 1 );
+  for ( int i = begin; i <= end; i++ )
+  {
+    double value = this->Values.at( i );
+    aggregate.Sum += value;
+    aggregate.Minimum = ( aggregate.Count == 0 ) ? value : std::min( aggregate.Minimum, value );
+    aggregate.Maximum = ( aggregate.Count == 0 ) ? value : std::max( aggregate.Maximum, value );
+    aggregate.Count++;
+  }
+  return aggregate;
+}
+
+
+vtkPerkEvaluatorSegmentTree::Aggregate vtkPerkEvaluatorSegmentTree
+::Query( int begin, int end )
+{
+  begin = std::max( begin, 0 );
+  end = std::min( end, this->GetNumberOfValues() - 1 );
+  if ( end < begin )
+  {
+    Aggregate emptyAggregate;
+    vtkPerkEvaluatorSegmentTree::InitializeAggregate( emptyAggregate );
+    return emptyAggregate;
+  }
+
+  // Within a single block, the values are scanned directly
+  int beginBlock = begin / BLOCK_SIZE;
+  int endBlock = end / BLOCK_SIZE;
+  if ( beginBlock == endBlock )
+  {
+    return this->ScanValues( begin, end );
+  }
+
+  // Otherwise, the partial blocks at both ends are scanned, and the whole blocks between them come from the tree
+  Aggregate leftAggregate = this->ScanValues( begin, ( beginBlock + 1 ) * BLOCK_SIZE - 1 );
+  Aggregate rightAggregate = this->ScanValues( endBlock * BLOCK_SIZE, end );
+
+  // Climb from both ends of the blocks, taking the nodes which are entirely inside them (the order is kept, though the aggregates do not need it)
+  int left = beginBlock + 1 + this->Capacity;
+  int right = endBlock + this->Capacity; // Exclusive
+  while ( left < right )
+  {
+    if ( left % 2 == 1 )
+    {
+      vtkPerkEvaluatorSegmentTree::CombineAggregates( leftAggregate, this->Nodes.at( left ), leftAggregate );
+      left++;
+    }
+    if ( right % 2 == 1 )
+    {
+      right--;
+      vtkPerkEvaluatorSegmentTree::CombineAggregates( this->Nodes.at( right ), rightAggregate, rightAggregate );
+    }
+    left = left / 2;
+    right = right / 2;
+  }
+
+  Aggregate aggregate;
+  vtkPerkEvaluatorSegmentTree::CombineAggregates( leftAggregate, rightAggregate, aggregate );
+  return aggregate;
+}
@@ -0,0 +1,78 @@
+// .NAME vtkPerkEvaluatorSegmentTree - partial aggregates over blocks of a sequence of values
+// .SECTION Description
+// The values are grouped into fixed blocks of BLOCK_SIZE values, and the leaves of the tree are the blocks.
+// Each node of the tree holds the sum, minimum, maximum and count of the values in its blocks, so the aggregates
+// of any contiguous range of values are combined from O(log N) nodes, plus the values at both ends which only
+// cover part of a block. Only 2N/BLOCK_SIZE aggregates are kept besides the values themselves.
+// The tree is built once from the values, and values can be appended afterwards (the tree grows by doubling).
+
+
+#ifndef __vtkPerkEvaluatorSegmentTree_h
+#define __vtkPerkEvaluatorSegmentTree_h
+
+// VTK includes
+#include "vtkObject.h"
+
+// STD includes
+#include <vector>
+
+#include "vtkSlicerPerkEvaluatorModuleLogicExport.h"
+
+
+
+class VTK_SLICER_PERKEVALUATOR_MODULE_LOGIC_EXPORT
+vtkPerkEvaluatorSegmentTree
+ : public vtkObject
+{
+public:
+
+  struct Aggregate
+  {
+    double Sum;
+    double Minimum;
+    double Maximum;
+    int Count;
+  };
+
+  // Values in each leaf of the tree
+  static const int BLOCK_SIZE;
+
+  static vtkPerkEvaluatorSegmentTree* New();
+  vtkTypeMacro( vtkPerkEvaluatorSegmentTree, vtkObject );
+  void PrintSelf( ostream& os, vtkIndent indent );
+
+  void Build( const std::vector< double >& values );
+  void Append( double value );
+  void Clear();
+  int GetNumberOfValues();
+  unsigned long GetActualMemorySize(); // Kibibytes
+
+  // The aggregate of the values from begin to end (inclusive), which is empty (zero count) if end < begin
+  Aggregate Query( int begin, int end );
+
+  static void InitializeAggregate( Aggregate& aggregate );
+  static void CombineAggregates( const Aggregate& left, const Aggregate& right, Aggregate& combined );
+
+protected:
+
+  vtkPerkEvaluatorSegmentTree();
+  virtual ~vtkPerkEvaluatorSegmentTree();
+
+  void Resize( int capacity );
+  void UpdateBlock( int block ); // Recompute the block's leaf from its values, and the nodes above it
+  Aggregate ScanValues( int begin, int end ); // Aggregate of the values themselves, for part of a block
+
+  // Implicit binary tree: node i has children 2i and 2i+1, the leaves start at Capacity (one per block)
+  int Capacity;
+  std::vector< double > Values;
+  std::vector< Aggregate > Nodes;
+
+private:
+
+  vtkPerkEvaluatorSegmentTree( const vtkPerkEvaluatorSegmentTree& ); // Not implemented
+  void operator=( const vtkPerkEvaluatorSegmentTree& );               // Not implemented
+
+};
+
+
+#endif
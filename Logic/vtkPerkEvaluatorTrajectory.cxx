@@ -0,0 +1,535 @@
+
+// PerkEvaluator Logic includes
+#include "vtkPerkEvaluatorTrajectory.h"
+
+// VTK includes
+#include <vtkMath.h>
+#include <vtkObjectFactory.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+
+//----------------------------------------------------------------------------
+
+vtkStandardNewMacro( vtkPerkEvaluatorTrajectory );
+
+
+// Constructors and Destructors ----------------------------------------------
+
+vtkPerkEvaluatorTrajectory
+::vtkPerkEvaluatorTrajectory()
+{
+  this->AffineComponentsOnly = false;
+
+  this->Times = vtkSmartPointer< vtkDoubleArray >::New();
+  this->Times->SetName( "Time" );
+  for ( int i = 0; i < 16; i++ )
+  {
+    std::stringstream componentName;
+    componentName << "M" << i / 4 << i % 4;
+    this->MatrixComponents[ i ] = vtkSmartPointer< vtkDoubleArray >::New();
+    this->MatrixComponents[ i ]->SetName( componentName.str().c_str() );
+  }
+  const char* ORIENTATION_COMPONENT_NAMES[ 4 ] = { "QW", "QX", "QY", "QZ" };
+  for ( int i = 0; i < 4; i++ )
+  {
+    this->OrientationComponents[ i ] = vtkSmartPointer< vtkDoubleArray >::New();
+    this->OrientationComponents[ i ]->SetName( ORIENTATION_COMPONENT_NAMES[ i ] );
+  }
+
+  this->Table = vtkSmartPointer< vtkTable >::New();
+  this->Clear();
+}
+
+
+vtkPerkEvaluatorTrajectory
+::~vtkPerkEvaluatorTrajectory()
+{
+}
+
+
+void vtkPerkEvaluatorTrajectory
+::PrintSelf( ostream& os, vtkIndent indent )
+{
+  this->Superclass::PrintSelf( os, indent );
+
+  os << indent << "TransformName: " << this->TransformName << "\n";
+  os << indent << "AffineComponentsOnly: " << this->AffineComponentsOnly << "\n";
+  os << indent << "NumberOfRecords: " << this->GetNumberOfRecords() << "\n";
+}
+
+
+// Configuration ----------------------------------------------
+
+void vtkPerkEvaluatorTrajectory
+::SetAffineComponentsOnly( bool affineOnly )
+{
+  if ( this->AffineComponentsOnly == affineOnly )
+  {
+    return;
+  }
+
+  this->AffineComponentsOnly = affineOnly;
+  this->Clear();
+}
+
+
+bool vtkPerkEvaluatorTrajectory
+::GetAffineComponentsOnly()
+{
+  return this->AffineComponentsOnly;
+}
+
+
+int vtkPerkEvaluatorTrajectory
+::GetNumberOfMatrixRows()
+{
+  return this->AffineComponentsOnly ? 3 : 4;
+}
+
+
+// Conversion from the record buffer ----------------------------------------------
+
+void vtkPerkEvaluatorTrajectory
+::Clear()
+{
+  this->TransformName = "";
+  this->TransformBufferID = "";
+
+  this->Times->Initialize();
+  this->Times->SetName( "Time" );
+  for ( int i = 0; i < 16; i++ )
+  {
+    std::string componentName = this->MatrixComponents[ i ]->GetName();
+    this->MatrixComponents[ i ]->Initialize();
+    this->MatrixComponents[ i ]->SetName( componentName.c_str() );
+  }
+  for ( int i = 0; i < 4; i++ )
+  {
+    std::string componentName = this->OrientationComponents[ i ]->GetName();
+    this->OrientationComponents[ i ]->Initialize();
+    this->OrientationComponents[ i ]->SetName( componentName.c_str() );
+  }
+
+  // The table shares the arrays, it does not copy them
+  this->Table->Initialize();
+  this->Table->AddColumn( this->Times );
+  for ( int i = 0; i < 4 * this->GetNumberOfMatrixRows(); i++ )
+  {
+    this->Table->AddColumn( this->MatrixComponents[ i ] );
+  }
+
+  this->Modified();
+}
+
+
+void vtkPerkEvaluatorTrajectory
+::DeepCopy( vtkPerkEvaluatorTrajectory* source )
+{
+  if ( source == NULL || source == this )
+  {
+    return;
+  }
+
+  // The arrays keep their names, and the table keeps sharing them
+  this->AffineComponentsOnly = source->AffineComponentsOnly;
+  this->Clear();
+  this->TransformName = source->TransformName;
+  this->TransformBufferID = source->TransformBufferID;
+
+  this->Times->DeepCopy( source->Times );
+  this->Times->SetName( "Time" );
+  for ( int i = 0; i < 16; i++ )
+  {
+    std::string componentName = this->MatrixComponents[ i ]->GetName();
+    this->MatrixComponents[ i ]->DeepCopy( source->MatrixComponents[ i ] );
+    this->MatrixComponents[ i ]->SetName( componentName.c_str() );
+  }
+  for ( int i = 0; i < 4; i++ )
+  {
+    std::string componentName = this->OrientationComponents[ i ]->GetName();
+    this->OrientationComponents[ i ]->DeepCopy( source->OrientationComponents[ i ] );
+    this->OrientationComponents[ i ]->SetName( componentName.c_str() );
+  }
+
+  this->Modified();
+}
+
+
+bool vtkPerkEvaluatorTrajectory
+::Update( vtkMRMLTransformBufferNode* transformBuffer, std::string transformName )
+{
+  if ( transformBuffer == NULL || transformBuffer->GetID() == NULL )
+  {
+    this->Clear();
+    return false;
+  }
+
+  vtkTransformRecordBuffer* recordBuffer = transformBuffer->GetTransformRecordBuffer( transformName );
+  if ( recordBuffer == NULL )
+  {
+    this->Clear();
+    return false;
+  }
+
+  // Start over if this is a different transform, or records were removed
+  if ( this->TransformName.compare( transformName ) != 0 || this->TransformBufferID.compare( transformBuffer->GetID() ) != 0
+    || recordBuffer->GetNumRecords() < this->GetNumberOfRecords() )
+  {
+    this->Clear();
+    this->TransformName = transformName;
+    this->TransformBufferID = transformBuffer->GetID();
+  }
+
+  if ( recordBuffer->GetNumRecords() > this->GetNumberOfRecords() )
+  {
+    this->AppendRecords( recordBuffer, this->GetNumberOfRecords() );
+    this->Modified();
+  }
+  return true;
+}
+
+
+void vtkPerkEvaluatorTrajectory
+::AppendRecords( vtkTransformRecordBuffer* recordBuffer, int beginRecord )
+{
+  // Each record is converted to a matrix only once
+  vtkSmartPointer< vtkMatrix4x4 > matrix = vtkSmartPointer< vtkMatrix4x4 >::New();
+  for ( int i = beginRecord; i < recordBuffer->GetNumRecords(); i++ )
+  {
+    vtkTransformRecord* record = recordBuffer->GetTransformRecord( i );
+    matrix->Identity();
+    if ( record != NULL )
+    {
+      record->GetTransformMatrix( matrix );
+    }
+    this->AppendMatrix( ( record != NULL ) ? record->GetTime() : 0.0, *matrix->Element );
+  }
+}
+
+
+void vtkPerkEvaluatorTrajectory
+::AppendMatrix( double time, const double elements[ 16 ] )
+{
+  this->Times->InsertNextValue( time );
+  for ( int j = 0; j < 4 * this->GetNumberOfMatrixRows(); j++ )
+  {
+    this->MatrixComponents[ j ]->InsertNextValue( elements[ j ] );
+  }
+
+  // The quaternion of the rotation part (any scaling is removed first)
+  double rotation[ 3 ][ 3 ];
+  for ( int row = 0; row < 3; row++ )
+  {
+    for ( int column = 0; column < 3; column++ )
+    {
+      rotation[ row ][ column ] = elements[ 4 * row + column ];
+    }
+  }
+  vtkMath::Orthogonalize3x3( rotation, rotation );
+  double quaternion[ 4 ];
+  vtkMath::Matrix3x3ToQuaternion( rotation, quaternion );
+
+  // q and -q are the same orientation, pick the one closest to the previous record so interpolation takes the short way
+  int numRecords = this->OrientationComponents[ 0 ]->GetNumberOfTuples();
+  if ( numRecords > 0 )
+  {
+    double dot = 0.0;
+    for ( int k = 0; k < 4; k++ )
+    {
+      dot += quaternion[ k ] * this->OrientationComponents[ k ]->GetValue( numRecords - 1 );
+    }
+    if ( dot < 0 )
+    {
+      for ( int k = 0; k < 4; k++ )
+      {
+        quaternion[ k ] = - quaternion[ k ];
+      }
+    }
+  }
+  for ( int k = 0; k < 4; k++ )
+  {
+    this->OrientationComponents[ k ]->InsertNextValue( quaternion[ k ] );
+  }
+}
+
+
+// Access ----------------------------------------------
+
+std::string vtkPerkEvaluatorTrajectory
+::GetTransformName()
+{
+  return this->TransformName;
+}
+
+
+int vtkPerkEvaluatorTrajectory
+::GetNumberOfRecords()
+{
+  return this->Times->GetNumberOfTuples();
+}
+
+
+vtkDoubleArray* vtkPerkEvaluatorTrajectory
+::GetTimes()
+{
+  return this->Times;
+}
+
+
+vtkDoubleArray* vtkPerkEvaluatorTrajectory
+::GetMatrixComponent( int row, int column )
+{
+  if ( row < 0 || row >= this->GetNumberOfMatrixRows() || column < 0 || column >= 4 )
+  {
+    return NULL;
+  }
+  return this->MatrixComponents[ 4 * row + column ];
+}
+
+
+vtkDoubleArray* vtkPerkEvaluatorTrajectory
+::GetOrientationComponent( int component )
+{
+  if ( component < 0 || component >= 4 )
+  {
+    return NULL;
+  }
+  return this->OrientationComponents[ component ];
+}
+
+
+vtkTable* vtkPerkEvaluatorTrajectory
+::GetTable()
+{
+  return this->Table;
+}
+
+
+void vtkPerkEvaluatorTrajectory
+::GetMatrix( int record, double elements[ 16 ] )
+{
+  vtkMatrix4x4::Identity( elements );
+  if ( record < 0 || record >= this->GetNumberOfRecords() )
+  {
+    return;
+  }
+
+  for ( int j = 0; j < 4 * this->GetNumberOfMatrixRows(); j++ )
+  {
+    elements[ j ] = this->MatrixComponents[ j ]->GetValue( record );
+  }
+}
+
+
+void vtkPerkEvaluatorTrajectory
+::GetMatrix( int record, vtkMatrix4x4* matrix )
+{
+  double elements[ 16 ];
+  this->GetMatrix( record, elements );
+  matrix->DeepCopy( elements );
+}
+
+
+void vtkPerkEvaluatorTrajectory
+::GetInterpolatedMatrix( int record, double time, double elements[ 16 ] )
+{
+  this->GetMatrix( record, elements );
+  if ( record < 0 || record + 1 >= this->GetNumberOfRecords() )
+  {
+    return;
+  }
+
+  double beginTime = this->Times->GetValue( record );
+  double endTime = this->Times->GetValue( record + 1 );
+  if ( time <= beginTime || endTime <= beginTime )
+  {
+    return;
+  }
+  double fraction = std::min( ( time - beginTime ) / ( endTime - beginTime ), 1.0 );
+
+  // SLERP the orientation (the quaternions are on the same hemisphere already)
+  double beginQuaternion[ 4 ];
+  double endQuaternion[ 4 ];
+  double dot = 0.0;
+  for ( int k = 0; k < 4; k++ )
+  {
+    beginQuaternion[ k ] = this->OrientationComponents[ k ]->GetValue( record );
+    endQuaternion[ k ] = this->OrientationComponents[ k ]->GetValue( record + 1 );
+    dot += beginQuaternion[ k ] * endQuaternion[ k ];
+  }
+  dot = std::min( dot, 1.0 );
+
+  double beginWeight = 1.0 - fraction;
+  double endWeight = fraction;
+  double angle = acos( dot );
+  if ( sin( angle ) > 1e-6 ) // Otherwise, the orientations are (almost) the same, and linear interpolation is accurate
+  {
+    beginWeight = sin( ( 1.0 - fraction ) * angle ) / sin( angle );
+    endWeight = sin( fraction * angle ) / sin( angle );
+  }
+  double quaternion[ 4 ];
+  double norm = 0.0;
+  for ( int k = 0; k < 4; k++ )
+  {
+    quaternion[ k ] = beginWeight * beginQuaternion[ k ] + endWeight * endQuaternion[ k ];
+    norm += quaternion[ k ] * quaternion[ k ];
+  }
+  norm = sqrt( norm );
+  for ( int k = 0; k < 4; k++ )
+  {
+    quaternion[ k ] = quaternion[ k ] / norm;
+  }
+
+  // The matrices may also scale or shear (M = R * S, with the rotation R of the quaternion)
+  // Only the rotation is SLERPed, the rest (S = R^T * M) is interpolated linearly and applied again
+  double beginRotation[ 3 ][ 3 ];
+  double endRotation[ 3 ][ 3 ];
+  vtkMath::QuaternionToMatrix3x3( beginQuaternion, beginRotation );
+  vtkMath::QuaternionToMatrix3x3( endQuaternion, endRotation );
+  double stretch[ 3 ][ 3 ];
+  for ( int row = 0; row < 3; row++ )
+  {
+    for ( int column = 0; column < 3; column++ )
+    {
+      double beginStretch = 0.0;
+      double endStretch = 0.0;
+      for ( int k = 0; k < 3; k++ )
+      {
+        beginStretch += beginRotation[ k ][ row ] * elements[ 4 * k + column ];
+        endStretch += endRotation[ k ][ row ] * this->MatrixComponents[ 4 * k + column ]->GetValue( record + 1 );
+      }
+      stretch[ row ][ column ] = ( 1.0 - fraction ) * beginStretch + fraction * endStretch;
+    }
+  }
+
+  double rotation[ 3 ][ 3 ];
+  vtkMath::QuaternionToMatrix3x3( quaternion, rotation );
+  double linear[ 3 ][ 3 ];
+  vtkMath::Multiply3x3( rotation, stretch, linear );
+  for ( int row = 0; row < 3; row++ )
+  {
+    for ( int column = 0; column < 3; column++ )
+    {
+      elements[ 4 * row + column ] = linear[ row ][ column ];
+    }
+    // Linear interpolation of the position
+    elements[ 4 * row + 3 ] += fraction * ( this->MatrixComponents[ 4 * row + 3 ]->GetValue( record + 1 ) - elements[ 4 * row + 3 ] );
+  }
+}
+
+
+void vtkPerkEvaluatorTrajectory
+::GetInterpolatedMatrix( int record, double time, vtkMatrix4x4* matrix )
+{
+  double elements[ 16 ];
+  this->GetInterpolatedMatrix( record, time, elements );
+  matrix->DeepCopy( elements );
+}
+
+
+void vtkPerkEvaluatorTrajectory
+::GetInterpolatedMatrix( double time, double elements[ 16 ] )
+{
+  this->GetInterpolatedMatrix( this->FindRecord( time ), time, elements );
+}
+
+
+void vtkPerkEvaluatorTrajectory
+::Resample( vtkDoubleArray* times, vtkPerkEvaluatorTrajectory* resampled, bool interpolate )
+{
+  if ( times == NULL || resampled == NULL || resampled == this )
+  {
+    return;
+  }
+
+  resampled->SetAffineComponentsOnly( this->AffineComponentsOnly );
+  resampled->Clear();
+  resampled->TransformName = this->TransformName;
+  if ( this->GetNumberOfRecords() == 0 )
+  {
+    return;
+  }
+
+  // The times are increasing, so the record is found by searching forward from the previous one
+  int record = 0;
+  double elements[ 16 ];
+  for ( int i = 0; i < times->GetNumberOfTuples(); i++ )
+  {
+    double time = times->GetValue( i );
+    record = this->FindRecordFrom( time, record );
+    if ( interpolate )
+    {
+      this->GetInterpolatedMatrix( record, time, elements );
+    }
+    else
+    {
+      this->GetMatrix( this->GetNearestRecord( record, time ), elements );
+    }
+    resampled->AppendMatrix( time, elements );
+  }
+  resampled->Modified();
+}
+
+
+int vtkPerkEvaluatorTrajectory
+::FindRecord( double time )
+{
+  if ( this->GetNumberOfRecords() == 0 )
+  {
+    return -1;
+  }
+
+  // The times are sorted, so binary search for the first record after the time
+  double* times = this->Times->GetPointer( 0 );
+  double* upper = std::upper_bound( times, times + this->GetNumberOfRecords(), time );
+  return std::max< int >( upper - times - 1, 0 );
+}
+
+
+int vtkPerkEvaluatorTrajectory
+::FindRecordFrom( double time, int guessRecord )
+{
+  int numRecords = this->GetNumberOfRecords();
+  if ( numRecords == 0 )
+  {
+    return -1;
+  }
+  if ( guessRecord < 0 || guessRecord >= numRecords || this->Times->GetValue( guessRecord ) > time )
+  {
+    return this->FindRecord( time );
+  }
+
+  int record = guessRecord;
+  while ( record + 1 < numRecords && this->Times->GetValue( record + 1 ) <= time )
+  {
+    record++;
+  }
+  return record;
+}
+
+
+int vtkPerkEvaluatorTrajectory
+::GetNearestRecord( int record, double time )
+{
+  if ( record < 0 || record + 1 >= this->GetNumberOfRecords() )
+  {
+    return record;
+  }
+
+  if ( this->Times->GetValue( record + 1 ) - time < time - this->Times->GetValue( record ) )
+  {
+    return record + 1;
+  }
+  return record;
+}
+
+
+int vtkPerkEvaluatorTrajectory
+::FindNearestRecord( double time )
+{
+  return this->GetNearestRecord( this->FindRecord( time ), time );
+}
@@ -0,0 +1,114 @@
+// .NAME vtkPerkEvaluatorTrajectory - columnar view of a recorded transform
+// .SECTION Description
+// The records of one transform in a transform buffer are converted once into contiguous arrays: the times,
+// and one array for each component of the transform matrices (12 components if only the affine part is kept).
+// The arrays are exposed directly (also as the columns of a table), so native code can loop over them and
+// Python metric scripts can view them as numpy arrays (vtk.util.numpy_support.vtk_to_numpy) without copying.
+// Updating the trajectory only converts the records added since the last update.
+// The orientations are also kept as quaternions (on the same hemisphere from one record to the next), so poses
+// between records can be interpolated (linearly for the position, SLERP for the orientation). Any scale or shear in the
+// matrices is kept: it is interpolated linearly and applied on top of the interpolated orientation.
+
+
+#ifndef __vtkPerkEvaluatorTrajectory_h
+#define __vtkPerkEvaluatorTrajectory_h
+
+// VTK includes
+#include "vtkObject.h"
+#include "vtkDoubleArray.h"
+#include "vtkMatrix4x4.h"
+#include "vtkSmartPointer.h"
+#include "vtkTable.h"
+
+// TransformRecorder includes
+#include "vtkMRMLTransformBufferNode.h"
+
+// STD includes
+#include <string>
+
+#include "vtkSlicerPerkEvaluatorModuleLogicExport.h"
+
+
+
+class VTK_SLICER_PERKEVALUATOR_MODULE_LOGIC_EXPORT
+vtkPerkEvaluatorTrajectory
+ : public vtkObject
+{
+public:
+
+  static vtkPerkEvaluatorTrajectory* New();
+  vtkTypeMacro( vtkPerkEvaluatorTrajectory, vtkObject );
+  void PrintSelf( ostream& os, vtkIndent indent );
+
+  // Only keep the top three rows of the matrices (changing this clears the trajectory)
+  void SetAffineComponentsOnly( bool affineOnly );
+  bool GetAffineComponentsOnly();
+
+  // Catch up with the records of the transform in the buffer
+  // Returns false if the transform is not recorded in the buffer (then, the trajectory is empty)
+  bool Update( vtkMRMLTransformBufferNode* transformBuffer, std::string transformName );
+  void Clear();
+  // Independent copy of the arrays, e.g. for a worker thread while this trajectory keeps being updated
+  void DeepCopy( vtkPerkEvaluatorTrajectory* source );
+
+  std::string GetTransformName();
+  int GetNumberOfRecords();
+
+  // The arrays are owned by the trajectory, and are valid until the next update
+  vtkDoubleArray* GetTimes();
+  vtkDoubleArray* GetMatrixComponent( int row, int column ); // NULL for the bottom row if only affine components are kept
+  vtkTable* GetTable(); // Columns "Time", then "M00", "M01", ..., sharing the arrays
+
+  // The matrix of the given record
+  void GetMatrix( int record, vtkMatrix4x4* matrix );
+  void GetMatrix( int record, double elements[ 16 ] );
+
+  // The pose at the given time, interpolated between the record (found by FindRecord or FindRecordFrom) and the next one
+  // At the record times, and before the first or after the last record, this is the record's matrix
+  void GetInterpolatedMatrix( int record, double time, vtkMatrix4x4* matrix );
+  void GetInterpolatedMatrix( int record, double time, double elements[ 16 ] );
+  void GetInterpolatedMatrix( double time, double elements[ 16 ] );
+
+  // Sample this trajectory at the given (increasing) times into another trajectory, interpolated or from the nearest records
+  // e.g. so metric scripts can work on evenly sampled arrays without resampling in Python
+  void Resample( vtkDoubleArray* times, vtkPerkEvaluatorTrajectory* resampled, bool interpolate );
+
+  // Unit quaternion (w, x, y, z) of the orientation at each record
+  vtkDoubleArray* GetOrientationComponent( int component );
+
+  // The last record at or before the given time (or the first record if the time precedes the trajectory), -1 if there are no records
+  int FindRecord( double time );
+  // Same as FindRecord, but searches forward from a guess (e.g. the result for an earlier time), which is amortized constant time for increasing times
+  int FindRecordFrom( double time, int guessRecord );
+  // Of the record (found by FindRecord or FindRecordFrom) and the next one, the one nearest to the time (the earlier one on a tie)
+  // This is the record shown without interpolation, as the transform buffer's lookup by time does
+  int GetNearestRecord( int record, double time );
+  int FindNearestRecord( double time ); // -1 if there are no records
+
+protected:
+
+  vtkPerkEvaluatorTrajectory();
+  virtual ~vtkPerkEvaluatorTrajectory();
+
+  int GetNumberOfMatrixRows();
+  void AppendRecords( vtkTransformRecordBuffer* recordBuffer, int beginRecord );
+  void AppendMatrix( double time, const double elements[ 16 ] );
+
+  std::string TransformName;
+  std::string TransformBufferID;
+  bool AffineComponentsOnly;
+
+  vtkSmartPointer< vtkDoubleArray > Times;
+  vtkSmartPointer< vtkDoubleArray > MatrixComponents[ 16 ]; // Row-major
+  vtkSmartPointer< vtkDoubleArray > OrientationComponents[ 4 ]; // Quaternions (w, x, y, z), not part of the table
+  vtkSmartPointer< vtkTable > Table;
+
+private:
+
+  vtkPerkEvaluatorTrajectory( const vtkPerkEvaluatorTrajectory& ); // Not implemented
+  void operator=( const vtkPerkEvaluatorTrajectory& );              // Not implemented
+
+};
+
+
+#endif
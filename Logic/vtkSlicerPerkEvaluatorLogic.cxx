@@ -1,33 +1,51 @@
 
 // PerkEvaluator Logic includes
 #include "vtkSlicerPerkEvaluatorLogic.h"
+#include "vtkPerkEvaluatorMetricFactory.h"
+#include "vtkPerkEvaluatorMotionMetric.h"
+#include "vtkPerkEvaluatorAnalysisJob.h"
 
 // MRML includes
 #include "vtkMRMLLinearTransformNode.h"
 #include "vtkMRMLTransformNode.h"
 #include "vtkMRMLTableNode.h"
 
+// Python includes
+#include <vtkPython.h>
+
 // VTK includes
 #include <vtkDataArray.h>
+#include <vtkDataSetAttributes.h>
 #include <vtkIntArray.h>
 #include <vtkMath.h>
 #include <vtkMatrix4x4.h>
 #include <vtkModifiedBSPTree.h>
+#include <vtkMultiThreader.h>
+#include <vtkMutexLock.h>
 #include <vtkNew.h>
 #include <vtkPointData.h>
 #include <vtkPoints.h>
 #include <vtkPolyData.h>
 #include <vtkSelectEnclosedPoints.h>
 #include <vtkSmartPointer.h>
+#include <vtkStringArray.h>
 #include <vtkTable.h>
+#include <vtkTimerLog.h>
 #include <vtkCollection.h>
 #include <vtkCollectionIterator.h>
 
+#include <vtksys/SystemInformation.hxx>
+#include <vtksys/SystemTools.hxx>
+
 // STD includes
+#include <algorithm>
 #include <cassert>
+#include <functional>
+#include <queue>
 #include <ctime>
 #include <iostream>
 #include <limits>
+#include <set>
 #include <sstream>
 
 
@@ -36,6 +54,14 @@
 vtkStandardNewMacro( vtkSlicerPerkEvaluatorLogic );
 
 
+// Constants ----------------------------------------------------------------------------
+
+static const int BATCH_PROGRESS_INTERVAL_MSEC = 50;
+static const double PROFILING_TABLE_UPDATE_INTERVAL_SEC = 1.0; // During real-time processing
+static const char* SCRIPT_METRICS_PROFILE_ID = ""; // Profile of all script metrics together in real time, in place of a metric instance ID
+static const char* METRICS_TABLE_COLUMN_NAMES[ 4 ] = { "MetricName", "MetricRoles", "MetricUnit", "MetricValue" };
+
+
 // Helper for converting QVariants holding string lists to std::vectors of std::strings
 std::vector< std::string > QVariantToVector( QVariant variant )
 {
@@ -55,11 +81,128 @@ std::vector< std::string > QVariantToVector( QVariant variant )
 }
 
 
+// Helper for writing a string as a Python string literal (native metrics from plugins may have any names)
+std::string ToPythonString( std::string string )
+{
+  std::stringstream pythonStringStream;
+  pythonStringStream << "\"";
+  for ( unsigned int i = 0; i < string.size(); i++ )
+  {
+    switch ( string.at( i ) )
+    {
+    case '\\':
+      pythonStringStream << "\\\\";
+      break;
+    case '"':
+      pythonStringStream << "\\\"";
+      break;
+    case '\n':
+      pythonStringStream << "\\n";
+      break;
+    case '\r':
+      pythonStringStream << "\\r";
+      break;
+    default:
+      pythonStringStream << string.at( i );
+    }
+  }
+  pythonStringStream << "\"";
+  return pythonStringStream.str();
+}
+
+
+// Helper for writing a list of strings as a Python list literal
+std::string VectorToPythonList( std::vector< std::string > vector )
+{
+  std::stringstream pythonListStream;
+  pythonListStream << "[ ";
+  for ( unsigned int i = 0; i < vector.size(); i++ )
+  {
+    pythonListStream << ToPythonString( vector.at( i ) );
+    if ( i < vector.size() - 1 )
+    {
+      pythonListStream << ", ";
+    }
+  }
+  pythonListStream << " ]";
+  return pythonListStream.str();
+}
+
+
+// Helper for creating the Python script standing in for a native metric
+// The Python metrics calculator can still load it (e.g. for listing the metrics), but it is never used for the computation
+std::string GetNativeMetricPythonStub( vtkPerkEvaluatorMetric* metric )
+{
+  std::map< std::string, std::string > anatomyRoles = metric->GetRequiredAnatomyRoles();
+  std::stringstream anatomyRolesStream;
+  anatomyRolesStream << "{ ";
+  for ( std::map< std::string, std::string >::iterator itr = anatomyRoles.begin(); itr != anatomyRoles.end(); itr++ )
+  {
+    anatomyRolesStream << ToPythonString( itr->first ) << ": " << ToPythonString( itr->second ) << ", ";
+  }
+  anatomyRolesStream << "}";
+
+  std::stringstream stubStream;
+  stubStream << "# Native metric: this metric is computed by the Perk Evaluator logic, not by this script" << std::endl;
+  stubStream << "class PerkEvaluatorMetric:" << std::endl;
+  stubStream << std::endl;
+  stubStream << "  @staticmethod" << std::endl;
+  stubStream << "  def GetMetricName():" << std::endl;
+  stubStream << "    return " << ToPythonString( metric->GetMetricName() ) << std::endl;
+  stubStream << std::endl;
+  stubStream << "  @staticmethod" << std::endl;
+  stubStream << "  def GetMetricUnit():" << std::endl;
+  stubStream << "    return " << ToPythonString( metric->GetMetricUnit() ) << std::endl;
+  stubStream << std::endl;
+  stubStream << "  @staticmethod" << std::endl;
+  stubStream << "  def GetMetricShared():" << std::endl;
+  stubStream << "    return " << ( metric->GetMetricShared() ? "True" : "False" ) << std::endl;
+  stubStream << std::endl;
+  stubStream << "  @staticmethod" << std::endl;
+  stubStream << "  def GetMetricPervasive():" << std::endl;
+  stubStream << "    return " << ( metric->GetMetricPervasive() ? "True" : "False" ) << std::endl;
+  stubStream << std::endl;
+  stubStream << "  @staticmethod" << std::endl;
+  stubStream << "  def GetAcceptedTransformRoles():" << std::endl;
+  stubStream << "    return " << VectorToPythonList( metric->GetAcceptedTransformRoles() ) << std::endl;
+  stubStream << std::endl;
+  stubStream << "  @staticmethod" << std::endl;
+  stubStream << "  def GetRequiredAnatomyRoles():" << std::endl;
+  stubStream << "    return " << anatomyRolesStream.str() << std::endl;
+  stubStream << std::endl;
+  stubStream << "  def __init__( self ):" << std::endl;
+  stubStream << "    pass" << std::endl;
+  stubStream << std::endl;
+  stubStream << "  def AddAnatomyRole( self, role, node ):" << std::endl;
+  stubStream << "    return True" << std::endl;
+  stubStream << std::endl;
+  stubStream << "  def AddTimestamp( self, time, matrix, point, role ):" << std::endl;
+  stubStream << "    pass" << std::endl;
+  stubStream << std::endl;
+  stubStream << "  def GetMetric( self ):" << std::endl;
+  stubStream << "    return 0" << std::endl;
+  return stubStream.str();
+}
+
+
 // Constructors and Desctructors ----------------------------------------------
 
 vtkSlicerPerkEvaluatorLogic
 ::vtkSlicerPerkEvaluatorLogic()
 {
+  this->PythonManager = NULL;
+  this->RealTimeUpdateCallable = NULL;
+  this->UseRealTimeUpdateCallable = true;
+  this->RealTimeQueue = vtkSmartPointer< vtkPerkEvaluatorRealTimeQueue >::New();
+  this->NumberOfBatchThreads = 0;
+  this->MetricsBatchRunning = false;
+  this->ApplyingAnalysisJob = NULL;
+  this->MetricsBatchCanceled = false;
+  this->MetricsBatchProgress = 0;
+  this->PervasiveMetricIndexValid = false;
+  this->MetricScriptMergeIndexValid = false;
+  this->ReconcilingDeferredNodes = false;
+  this->ResetRealTimeUpdateLatency();
 }
 
 
@@ -67,6 +210,15 @@ vtkSlicerPerkEvaluatorLogic
 vtkSlicerPerkEvaluatorLogic::
 ~vtkSlicerPerkEvaluatorLogic()
 {
+  this->ReleaseRealTimeUpdateCallable();
+  this->CancelAnalysisJobs();
+  this->AnalysisJobs.clear(); // Joins the workers
+  this->MetricsTableIndices.clear();
+  this->PendingMetricsTableNotifications.clear();
+  this->SelfAndParentTimeIndices.clear();
+  this->Trajectories.clear();
+  this->PlaybackEngines.clear();
+  this->RangeMetrics.clear();
 }
 
 
@@ -79,6 +231,10 @@ void vtkSlicerPerkEvaluatorLogic
   this->Superclass::PrintSelf(os, indent);
   
   os << indent << "vtkSlicerPerkEvaluatorLogic: " << this->GetClassName() << "\n";
+  os << indent << "UseRealTimeUpdateCallable: " << this->UseRealTimeUpdateCallable << "\n";
+  os << indent << "RealTimeUpdateCount: " << this->RealTimeUpdateCount << "\n";
+  os << indent << "AverageRealTimeUpdateLatency: " << this->GetAverageRealTimeUpdateLatency() << "\n";
+  os << indent << "MaximumRealTimeUpdateLatency: " << this->RealTimeUpdateMaximumLatency << "\n";
 }
 
 
@@ -86,6 +242,25 @@ void vtkSlicerPerkEvaluatorLogic
 void vtkSlicerPerkEvaluatorLogic
 ::OnMRMLSceneEndClose()
 {
+  this->InvalidateAllMetricScriptDescriptors();
+  this->NativeRealTimeMetrics.clear();
+  this->RealTimeScriptMetricInstanceIDs.clear();
+  this->RealTimeQueue->Clear();
+  this->ReleaseRealTimeUpdateCallable();
+  if ( ! this->RealTimeProcessingNodeIDs.empty() )
+  {
+    this->RealTimeProcessingNodeIDs.clear();
+    this->InvokeEvent( RealTimeProcessingChangedEvent );
+  }
+  this->CancelAnalysisJobs();
+  this->MetricProfiles.clear();
+  this->LastProfilingTableUpdateTimes.clear();
+  this->PervasiveMetricIndexValid = false;
+  this->MetricScriptMergeIndexValid = false;
+  this->DeferredTransformNodeIDs.clear();
+  this->DeferredMetricScriptIDs.clear();
+  this->DeferredMetricInstanceIDs.clear();
+  this->DeferredPerkEvaluatorNodeIDs.clear();
 }
 
 
@@ -125,9 +300,18 @@ void vtkSlicerPerkEvaluatorLogic
   this->GetMRMLScene()->RegisterNodeClass( miNode );
   miNode->Delete();
 
-  this->PythonManager = qSlicerApplication::application()->pythonManager();
-  this->PythonManager->executeString( "import PythonMetricsCalculator" );
-  this->PythonManager->executeString( "PythonMetricsCalculator.PythonMetricsCalculatorLogic.Initialize()" );
+  // Without the application (e.g. in command-line tools) there is no Python, so only native metrics are available
+  this->PythonManager = ( qSlicerApplication::application() != NULL ) ? qSlicerApplication::application()->pythonManager() : NULL;
+  this->ExecutePythonString( "import PythonMetricsCalculator" );
+  this->ExecutePythonString( "PythonMetricsCalculator.PythonMetricsCalculatorLogic.Initialize()" );
+
+  // The built-in native metrics, then any native metric plugins
+  vtkPerkEvaluatorMotionMetric::RegisterMetrics( vtkPerkEvaluatorMetricFactory::GetInstance() );
+  const char* pluginDirectory = getenv( "PERKEVALUATOR_METRIC_PLUGIN_DIR" );
+  if ( pluginDirectory != NULL )
+  {
+    vtkPerkEvaluatorMetricFactory::GetInstance()->LoadPluginsFromDirectory( pluginDirectory );
+  }
 
 
 }
@@ -169,462 +353,3055 @@ void vtkSlicerPerkEvaluatorLogic
   {
     return;
   }
+  if ( peNode->GetMetricsTableNode() == NULL )
+  {
+    return;
+  }
+
+  // Native metrics are computed directly, the Python metrics calculator only needs to see the script metrics
+  std::vector< std::string > scriptMetricInstanceIDs;
+  std::vector< std::string > nativeMetricInstanceIDs;
+  this->SplitMetricInstanceIDs( peNode, scriptMetricInstanceIDs, nativeMetricInstanceIDs );
 
-  // Use the python metrics calculator module
-  this->PythonManager->executeString( QString( "PythonMetricsCalculator.PythonMetricsCalculatorLogic.CalculateAllMetrics( '%1' )" ).arg( peNode->GetID() ) );
+  this->ComputeScriptMetrics( peNode, scriptMetricInstanceIDs );
+
+  for ( unsigned int i = 0; i < nativeMetricInstanceIDs.size(); i++ )
+  {
+    vtkMRMLMetricInstanceNode* miNode = vtkMRMLMetricInstanceNode::SafeDownCast( this->GetMRMLScene()->GetNodeByID( nativeMetricInstanceIDs.at( i ) ) );
+    double metricValue = 0;
+    if ( this->ComputeNativeMetric( peNode, miNode, metricValue ) )
+    {
+      this->SetMetricsTableValue( peNode->GetMetricsTableNode(), miNode, metricValue );
+    }
+  }
 
   peNode->GetMetricsTableNode()->Modified(); // Table has been modified
   peNode->GetMetricsTableNode()->StorableModified(); // Make sure the metrics table is saved by default
+  this->UpdateProfilingTable( peNode );
 }
 
-std::string vtkSlicerPerkEvaluatorLogic
-::GetMetricValue( vtkMRMLMetricInstanceNode* miNode, vtkMRMLPerkEvaluatorNode* peNode )
+
+void vtkSlicerPerkEvaluatorLogic
+::ComputeScriptMetrics( vtkMRMLPerkEvaluatorNode* peNode, std::vector< std::string > scriptMetricInstanceIDs )
 {
-  // Verify that the table node exists
-  if ( peNode == NULL )
+  if ( scriptMetricInstanceIDs.empty() || this->PythonManager == NULL )
   {
-    return "";
+    this->InitializeMetricsTable( peNode->GetMetricsTableNode() );
+    return;
+  }
+
+  QString calculateCode = QString( "PythonMetricsCalculator.PythonMetricsCalculatorLogic.CalculateAllMetrics( '%1' )" ).arg( peNode->GetID() );
+
+  // Without profiling, all the script metrics are computed in a single call
+  if ( peNode->GetProfilingTableNode() == NULL )
+  {
+    this->ExecuteMetricsCalculatorString( peNode, scriptMetricInstanceIDs, calculateCode );
+    return;
   }
+
+  // Otherwise, the calculator is given one metric instance at a time, and its rows are collected after each call
+  // Each call goes over every record between the marks
   vtkMRMLTableNode* metricsTableNode = peNode->GetMetricsTableNode();
-  if ( metricsTableNode == NULL )
+  int numRecords = this->GetNumberOfRecordsBetweenMarks( peNode );
+  vtksys::SystemInformation systemInformation;
+  std::vector< std::vector< std::string > > scriptRows;
+  for ( unsigned int i = 0; i < scriptMetricInstanceIDs.size(); i++ )
   {
-    return "";
+    if ( this->ApplyingAnalysisJob != NULL && this->ApplyingAnalysisJob->GetCanceled() )
+    {
+      break;
+    }
+    this->InitializeMetricsTable( metricsTableNode );
+    long startMemory = long( systemInformation.GetProcMemoryUsed() );
+    double startTime = vtkTimerLog::GetUniversalTime();
+    this->ExecuteMetricsCalculatorString( peNode, std::vector< std::string >( 1, scriptMetricInstanceIDs.at( i ) ), calculateCode );
+    double wallTime = vtkTimerLog::GetUniversalTime() - startTime;
+    long retainedMemory = std::max( long( systemInformation.GetProcMemoryUsed() ) - startMemory, 0L );
+    this->AddToMetricProfile( peNode->GetID(), scriptMetricInstanceIDs.at( i ), OfflineEvaluation, wallTime, numRecords, 1, retainedMemory );
+
+    vtkTable* metricsTable = metricsTableNode->GetTable();
+    for ( int row = 0; row < metricsTable->GetNumberOfRows(); row++ )
+    {
+      std::vector< std::string > scriptRow;
+      for ( int column = 0; column < 4; column++ )
+      {
+        scriptRow.push_back( metricsTable->GetValueByName( row, METRICS_TABLE_COLUMN_NAMES[ column ] ).ToString() );
+      }
+      scriptRows.push_back( scriptRow );
+    }
+  }
+
+  this->InitializeMetricsTable( metricsTableNode );
+  vtkTable* metricsTable = metricsTableNode->GetTable();
+  for ( unsigned int i = 0; i < scriptRows.size(); i++ )
+  {
+    int row = metricsTable->InsertNextBlankRow();
+    for ( int column = 0; column < 4; column++ )
+    {
+      metricsTable->SetValueByName( row, METRICS_TABLE_COLUMN_NAMES[ column ], vtkVariant( scriptRows.at( i ).at( column ) ) );
+    }
   }
+}
 
-  std::string miName = this->GetMetricName( miNode->GetAssociatedMetricScriptID() );
-  std::string miUnit = this->GetMetricUnit( miNode->GetAssociatedMetricScriptID() );
-  std::string miRoles = miNode->GetCombinedRoleString();
 
-  // Simply iterate through all entries in the table, and check if they correspond to the given metric instance node
-  for ( int i = 0; i < metricsTableNode->GetTable()->GetNumberOfRows(); i++ )
-  {    
-    bool namesMatch = miName.compare( metricsTableNode->GetTable()->GetValueByName( i, "MetricName" ).ToString() ) == 0;
-    bool unitsMatch = miUnit.compare( metricsTableNode->GetTable()->GetValueByName( i, "MetricUnit" ).ToString() ) == 0;
-    bool rolesMatch = miRoles.compare( metricsTableNode->GetTable()->GetValueByName( i, "MetricRoles" ).ToString() ) == 0;
+// Background analysis ----------------------------------------------------------------
+
+vtkPerkEvaluatorAnalysisJob* vtkSlicerPerkEvaluatorLogic
+::StartAnalysisJob( vtkMRMLPerkEvaluatorNode* peNode )
+{
+  // Check conditions (same as for ComputeMetrics)
+  if ( peNode == NULL || this->GetMRMLScene()->GetNodeByID( peNode->GetID() ) == NULL || peNode->GetMetricsTableNode() == NULL )
+  {
+    return NULL;
+  }
+  if ( peNode->GetMarkBegin() > peNode->GetMarkEnd() )
+  {
+    return NULL;
+  }
+
+  // Only the latest analysis of a node is worth finishing
+  for ( unsigned int i = 0; i < this->AnalysisJobs.size(); i++ )
+  {
+    if ( this->AnalysisJobs.at( i )->GetPerkEvaluatorNodeID().compare( peNode->GetID() ) == 0 )
+    {
+      this->AnalysisJobs.at( i )->Cancel();
+    }
+  }
+
+  vtkSmartPointer< vtkPerkEvaluatorAnalysisJob > job = vtkSmartPointer< vtkPerkEvaluatorAnalysisJob >::New();
+  job->SetPerkEvaluatorNodeID( peNode->GetID() );
 
-    if ( namesMatch && unitsMatch && rolesMatch )
+  std::vector< std::string > scriptMetricInstanceIDs;
+  std::vector< std::string > nativeMetricInstanceIDs;
+  this->SplitMetricInstanceIDs( peNode, scriptMetricInstanceIDs, nativeMetricInstanceIDs );
+  job->SetScriptMetricInstanceIDs( scriptMetricInstanceIDs );
+
+  // Everything is resolved from the scene now, on the main thread
+  for ( unsigned int i = 0; i < nativeMetricInstanceIDs.size(); i++ )
+  {
+    vtkMRMLMetricInstanceNode* miNode = vtkMRMLMetricInstanceNode::SafeDownCast( this->GetMRMLScene()->GetNodeByID( nativeMetricInstanceIDs.at( i ) ) );
+    NativeMetricJob nativeJob;
+    if ( this->PrepareNativeMetricJob( peNode, miNode, nativeJob ) )
     {
-      return metricsTableNode->GetTable()->GetValueByName( i, "MetricValue" ).ToString(); // Note: returning a string here
+      job->GetNativeMetricJobs().push_back( nativeJob );
     }
   }
+  vtkSlicerPerkEvaluatorLogic::SnapshotNativeMetricJobTrajectories( job->GetNativeMetricJobs() );
 
-  return "";
+  this->AnalysisJobs.push_back( job );
+  job->Start();
+  return job;
 }
 
 
 void vtkSlicerPerkEvaluatorLogic
-::SetupRealTimeProcessing( vtkMRMLPerkEvaluatorNode* peNode )
+::ProcessAnalysisJobs()
 {
-
-  // Check conditions
-  if ( peNode == NULL || this->GetMRMLScene()->GetNodeByID( peNode->GetID() ) == NULL )
+  // Observers may start or cancel jobs, so go over a copy
+  std::vector< vtkSmartPointer< vtkPerkEvaluatorAnalysisJob > > jobs = this->AnalysisJobs;
+  for ( unsigned int i = 0; i < jobs.size(); i++ )
   {
-    return;
-  }
+    vtkPerkEvaluatorAnalysisJob* job = jobs.at( i );
+
+    // Read the state before the progress, so a computed job always reports its final progress
+    vtkPerkEvaluatorAnalysisJob::StateEnum state = job->GetState();
+    this->PublishAnalysisJobProgress( job );
+
+    if ( state != vtkPerkEvaluatorAnalysisJob::Computed && state != vtkPerkEvaluatorAnalysisJob::Canceled )
+    {
+      continue;
+    }
+
+    job->Wait();
+    if ( state == vtkPerkEvaluatorAnalysisJob::Computed && job->GetRangeBuild() )
+    {
+      this->ApplyRangeBuildJob( job );
+      job->SetState( vtkPerkEvaluatorAnalysisJob::Applied );
+    }
+    else if ( state == vtkPerkEvaluatorAnalysisJob::Computed )
+    {
+      // The job may be canceled while its script metrics are computed
+      this->ApplyAnalysisJob( job );
+      job->SetState( job->GetCanceled() ? vtkPerkEvaluatorAnalysisJob::Canceled : vtkPerkEvaluatorAnalysisJob::Applied );
+    }
 
-  // Use the python metrics calculator module
-  this->PythonManager->executeString( "PythonMetricsCalculatorLogicRealTimeInstance = PythonMetricsCalculator.PythonMetricsCalculatorLogic()" );
-  this->PythonManager->executeString( QString( "PythonMetricsCalculatorLogicRealTimeInstance.SetupRealTimeMetricComputation( '%1' )" ).arg( peNode->GetID() ) );
+    std::vector< vtkSmartPointer< vtkPerkEvaluatorAnalysisJob > >::iterator itr = std::find( this->AnalysisJobs.begin(), this->AnalysisJobs.end(), jobs.at( i ) );
+    if ( itr != this->AnalysisJobs.end() )
+    {
+      this->AnalysisJobs.erase( itr );
+    }
+    job->InvokeEvent( vtkPerkEvaluatorAnalysisJob::FinishedEvent );
+  }
 }
 
 
-// This function is kind of akin to the old "role" system
 void vtkSlicerPerkEvaluatorLogic
-::SetMetricInstancesRolesToID( vtkMRMLPerkEvaluatorNode* peNode, std::string nodeID, std::string role, /*vtkMRMLMetricInstanceNode::RoleTypeEnum*/ int roleType )
+::ApplyAnalysisJob( vtkPerkEvaluatorAnalysisJob* job )
 {
-  if ( peNode == NULL )
+  vtkMRMLPerkEvaluatorNode* peNode = vtkMRMLPerkEvaluatorNode::SafeDownCast( this->GetMRMLScene()->GetNodeByID( job->GetPerkEvaluatorNodeID() ) );
+  if ( peNode == NULL || peNode->GetMetricsTableNode() == NULL )
   {
     return;
   }
 
-  // Iterate over all of the metric instance nodes used by the Perk Evaluator node
-  std::vector< std::string > metricInstanceIDs = peNode->GetMetricInstanceIDs();
-  for ( int i = 0; i < metricInstanceIDs.size(); i++ )
+  // Observers of the table only see the complete results
+  vtkMRMLTableNode* metricsTableNode = peNode->GetMetricsTableNode();
+  int wasModifying = metricsTableNode->StartModify();
+  vtkSmartPointer< vtkTable > previousMetricsTable = vtkSmartPointer< vtkTable >::New();
+  previousMetricsTable->DeepCopy( metricsTableNode->GetTable() );
+
+  // The application is blocked until the Python metrics calculator is done (except for the events it processes)
+  this->ApplyingAnalysisJob = job;
+  job->SetScriptMetricsNode( peNode );
+  this->ComputeScriptMetrics( peNode, job->GetScriptMetricInstanceIDs() );
+  job->SetScriptMetricsNode( NULL );
+  this->ApplyingAnalysisJob = NULL;
+
+  // Canceled in the meantime, so the table is left as it was
+  if ( job->GetCanceled() )
   {
-    vtkMRMLMetricInstanceNode* metricInstanceNode = vtkMRMLMetricInstanceNode::SafeDownCast( this->GetMRMLScene()->GetNodeByID( metricInstanceIDs.at( i ) ) );
-    if ( metricInstanceNode == NULL )
+    metricsTableNode->GetTable()->DeepCopy( previousMetricsTable );
+    metricsTableNode->EndModify( wasModifying );
+    return;
+  }
+
+  job->SetScriptProgress( 100 );
+  this->PublishAnalysisJobProgress( job );
+
+  std::vector< NativeMetricJob >& nativeJobs = job->GetNativeMetricJobs();
+  for ( unsigned int i = 0; i < nativeJobs.size(); i++ )
+  {
+    vtkMRMLMetricInstanceNode* miNode = vtkMRMLMetricInstanceNode::SafeDownCast( this->GetMRMLScene()->GetNodeByID( nativeJobs.at( i ).MetricInstanceID ) );
+    if ( miNode == NULL || ! nativeJobs.at( i ).Computed )
     {
       continue;
     }
+    this->SetMetricsTableValue( metricsTableNode, miNode, nativeJobs.at( i ).MetricValue );
+    this->AddToMetricProfile( nativeJobs.at( i ) );
+  }
+
+  metricsTableNode->Modified(); // Table has been modified
+  metricsTableNode->StorableModified(); // Make sure the metrics table is saved by default
+  metricsTableNode->EndModify( wasModifying );
+  this->UpdateProfilingTable( peNode );
+}
 
-    std::vector< std::string > allRoles = this->GetAllRoles( metricInstanceNode->GetAssociatedMetricScriptID(), roleType );
 
-    for ( int j = 0; j < allRoles.size(); j++ )
+void vtkSlicerPerkEvaluatorLogic
+::ApplyRangeBuildJob( vtkPerkEvaluatorAnalysisJob* job )
+{
+  // Only the metrics are kept, the samples and the trajectory copies are released with the job
+  std::vector< NativeMetricJob >& nativeJobs = job->GetNativeMetricJobs();
+  std::vector< std::string > keys = job->GetRangeMetricKeys();
+  std::vector< std::string > signatures = job->GetRangeMetricSignatures();
+  for ( unsigned int i = 0; i < nativeJobs.size() && i < keys.size() && i < signatures.size(); i++ )
+  {
+    if ( ! nativeJobs.at( i ).Computed )
     {
-      if ( role.compare( allRoles.at( j ) ) == 0 )
-      {
-        metricInstanceNode->SetRoleID( nodeID, role, roleType ); // Only add if this role is accepted by the metric
-      }
+      continue;
     }
-    
+    RangeMetric& rangeMetric = this->RangeMetrics[ keys.at( i ) ];
+    rangeMetric.Signature = signatures.at( i );
+    rangeMetric.Metric = nativeJobs.at( i ).Metric;
+  }
+  nativeJobs.clear();
+
+  // For the marks as they are now (this builds again whatever changed in the meantime)
+  vtkMRMLPerkEvaluatorNode* peNode = vtkMRMLPerkEvaluatorNode::SafeDownCast( this->GetMRMLScene()->GetNodeByID( job->GetPerkEvaluatorNodeID() ) );
+  if ( peNode != NULL )
+  {
+    this->ComputeMetricsOverMarkedRange( peNode );
   }
 }
 
 
 void vtkSlicerPerkEvaluatorLogic
-::CreatePervasiveMetric( vtkMRMLMetricScriptNode* msNode, vtkMRMLLinearTransformNode* transformNode, std::string transformRole )
+::PublishAnalysisJobProgress( vtkPerkEvaluatorAnalysisJob* job )
 {
-  // The assumption is that we have already established that the context of the metric script is "Pervasive"
-  if ( msNode == NULL || transformNode == NULL )
+  int progress = job->GetProgress();
+  if ( progress != job->GetLastPublishedProgress() )
   {
-    return;
+    job->SetLastPublishedProgress( progress );
+    job->InvokeEvent( vtkPerkEvaluatorAnalysisJob::ProgressEvent, &progress );
   }
+}
 
-  // Check it doesn't already exist in the scene
-  vtkCollection* metricInstanceNodes = this->GetMRMLScene()->GetNodesByClass( "vtkMRMLMetricInstanceNode" );
 
-  for ( int i = 0; i < metricInstanceNodes->GetNumberOfItems(); i++ )
+bool vtkSlicerPerkEvaluatorLogic
+::GetAnalysisJobsRunning()
+{
+  return ! this->AnalysisJobs.empty();
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::CancelAnalysisJobs()
+{
+  for ( unsigned int i = 0; i < this->AnalysisJobs.size(); i++ )
   {
-    vtkMRMLMetricInstanceNode* miNode = vtkMRMLMetricInstanceNode::SafeDownCast( metricInstanceNodes->GetItemAsObject( i ) );
-    bool scriptsEqual = miNode->GetAssociatedMetricScriptNode()->IsEqual( msNode );
-    bool oneTransformRole = this->GetAllRoles( msNode->GetID(), vtkMRMLMetricInstanceNode::TransformRole ).size() == 1;
-    bool transformRoleIDsEqual = miNode->GetRoleID( transformRole, vtkMRMLMetricInstanceNode::TransformRole ).compare( transformNode->GetID() ) == 0;
-    if ( scriptsEqual && oneTransformRole && transformRoleIDsEqual )
-    {
-      return; // Get out the the function. The metric already exists, so there is nothing to do here.
-    }
+    this->AnalysisJobs.at( i )->Cancel();
   }
+}
 
-  // Create it and add it to the scene
-  vtkMRMLMetricInstanceNode* newMINode = this->CreateMetricInstance( msNode );
-  newMINode->SetRoleID( transformNode->GetID(), transformRole, vtkMRMLMetricInstanceNode::TransformRole );
+
+// Profiling ----------------------------------------------------------------
+
+void vtkSlicerPerkEvaluatorLogic
+::AddToMetricProfile( std::string peNodeID, std::string miNodeID, MetricProfileEvaluationEnum evaluation, double wallTime, int numSamples, int numPythonCalls, unsigned long memory )
+{
+  MetricProfileMap& profiles = this->MetricProfiles[ peNodeID ];
+  std::pair< std::string, int > key( miNodeID, evaluation );
+  MetricProfileMap::iterator itr = profiles.find( key );
+  if ( itr == profiles.end() )
+  {
+    MetricProfile profile;
+    profile.WallTime = 0;
+    profile.NumberOfSamples = 0;
+    profile.NumberOfPythonCalls = 0;
+    profile.RetainedMemory = 0;
+    itr = profiles.insert( std::pair< std::pair< std::string, int >, MetricProfile >( key, profile ) ).first;
+  }
+
+  itr->second.WallTime += wallTime;
+  itr->second.NumberOfSamples += numSamples;
+  itr->second.NumberOfPythonCalls += numPythonCalls;
+  itr->second.RetainedMemory = std::max( itr->second.RetainedMemory, memory );
 }
 
 
 void vtkSlicerPerkEvaluatorLogic
-::UpdatePervasiveMetrics( vtkMRMLLinearTransformNode* transformNode )
+::AddToMetricProfile( const NativeMetricJob& job )
 {
-  if ( transformNode == NULL )
+  if ( ! job.Computed )
   {
     return;
   }
+  this->AddToMetricProfile( job.PerkEvaluatorNodeID, job.MetricInstanceID, OfflineEvaluation, job.WallTime, job.Times.size(), 0, job.RetainedMemory );
+}
 
-  // Grab all metric scripts
-  vtkCollection* metricScriptNodes = this->GetMRMLScene()->GetNodesByClass( "vtkMRMLMetricScriptNode" );
 
-  for ( int i = 0; i < metricScriptNodes->GetNumberOfItems(); i++ )
+int vtkSlicerPerkEvaluatorLogic
+::GetNumberOfRecordsBetweenMarks( vtkMRMLPerkEvaluatorNode* peNode )
+{
+  vtkMRMLTransformBufferNode* transformBuffer = peNode->GetTransformBufferNode();
+  if ( transformBuffer == NULL )
   {
-    // Assume that we want to add any metric whose only transform role in "Any" and has no anatomy roles
-    vtkMRMLMetricScriptNode* msNode = vtkMRMLMetricScriptNode::SafeDownCast( metricScriptNodes->GetItemAsObject( i ) );
-    if ( ! this->GetMetricPervasive( msNode->GetID() ) )
+    return 0;
+  }
+
+  double beginTime = peNode->GetMarkBegin() + transformBuffer->GetMinimumTime();
+  double endTime = peNode->GetMarkEnd() + transformBuffer->GetMinimumTime();
+  std::vector< std::string > recordedTransformNames = transformBuffer->GetAllRecordedTransformNames();
+  int numRecords = 0;
+  for ( unsigned int i = 0; i < recordedTransformNames.size(); i++ )
+  {
+    vtkPerkEvaluatorTrajectory* trajectory = this->GetTrajectory( transformBuffer, recordedTransformNames.at( i ) );
+    if ( trajectory == NULL || trajectory->GetNumberOfRecords() == 0 )
     {
       continue;
     }
-
-    // Create a metric instance node, with this transform serving the lone transform role    
-    std::vector< std::string > transformRoles = this->GetAllRoles( msNode->GetID(), vtkMRMLMetricInstanceNode::TransformRole );    
-    this->CreatePervasiveMetric( msNode, transformNode, transformRoles.at( 0 ) );
+    double* times = trajectory->GetTimes()->GetPointer( 0 );
+    numRecords += std::upper_bound( times, times + trajectory->GetNumberOfRecords(), endTime ) - std::lower_bound( times, times + trajectory->GetNumberOfRecords(), beginTime );
   }
-
+  return std::max( numRecords, 0 );
 }
 
 
 void vtkSlicerPerkEvaluatorLogic
-::UpdatePervasiveMetrics( vtkMRMLMetricScriptNode* msNode )
+::UpdateProfilingTable( vtkMRMLPerkEvaluatorNode* peNode )
 {
-  if ( msNode == NULL || ! this->GetMetricPervasive( msNode->GetID() ) )
+  if ( peNode == NULL || this->GetMRMLScene() == NULL )
   {
     return;
   }
-  std::vector< std::string > transformRoles = this->GetAllRoles( msNode->GetID(), vtkMRMLMetricInstanceNode::TransformRole );
+  this->LastProfilingTableUpdateTimes[ peNode->GetID() ] = vtkTimerLog::GetUniversalTime();
 
-  // Grab all transforms
-  vtkSmartPointer< vtkCollection > transformNodes = vtkSmartPointer< vtkCollection >::New();
-  this->GetSceneVisibleTransformNodes( transformNodes );
+  // Profiling is opt-in: the profile is always kept, but only written if the node was given a table
+  vtkMRMLTableNode* profilingTableNode = peNode->GetProfilingTableNode();
+  if ( profilingTableNode == NULL || profilingTableNode->GetTable() == NULL )
+  {
+    return;
+  }
 
-  for ( int i = 0; i < transformNodes->GetNumberOfItems(); i++ )
+  vtkSmartPointer< vtkStringArray > nameColumn = vtkSmartPointer< vtkStringArray >::New();
+  nameColumn->SetName( "MetricName" );
+  vtkSmartPointer< vtkStringArray > rolesColumn = vtkSmartPointer< vtkStringArray >::New();
+  rolesColumn->SetName( "MetricRoles" );
+  vtkSmartPointer< vtkStringArray > unitColumn = vtkSmartPointer< vtkStringArray >::New();
+  unitColumn->SetName( "MetricUnit" );
+  vtkSmartPointer< vtkStringArray > evaluationColumn = vtkSmartPointer< vtkStringArray >::New();
+  evaluationColumn->SetName( "Evaluation" );
+  vtkSmartPointer< vtkDoubleArray > wallTimeColumn = vtkSmartPointer< vtkDoubleArray >::New();
+  wallTimeColumn->SetName( "WallTime" );
+  vtkSmartPointer< vtkIntArray > samplesColumn = vtkSmartPointer< vtkIntArray >::New();
+  samplesColumn->SetName( "NumberOfSamples" );
+  vtkSmartPointer< vtkIntArray > pythonCallsColumn = vtkSmartPointer< vtkIntArray >::New();
+  pythonCallsColumn->SetName( "NumberOfPythonCalls" );
+  vtkSmartPointer< vtkDoubleArray > memoryColumn = vtkSmartPointer< vtkDoubleArray >::New();
+  memoryColumn->SetName( "RetainedMemory" );
+
+  MetricProfileMap& profiles = this->MetricProfiles[ peNode->GetID() ];
+  for ( MetricProfileMap::iterator itr = profiles.begin(); itr != profiles.end(); itr++ )
   {
-    vtkMRMLLinearTransformNode* transformNode = vtkMRMLLinearTransformNode::SafeDownCast( transformNodes->GetItemAsObject( i ) );
-    // Create a metric instance node, with this transform serving the lone transform role
-    this->CreatePervasiveMetric( msNode, transformNode, transformRoles.at( 0 ) ); // Must have precisely one transform role if it is pervasive 
+    if ( itr->first.first.compare( SCRIPT_METRICS_PROFILE_ID ) == 0 )
+    {
+      nameColumn->InsertNextValue( "Script metrics" );
+      rolesColumn->InsertNextValue( "" );
+      unitColumn->InsertNextValue( "" );
+    }
+    else
+    {
+      vtkMRMLMetricInstanceNode* miNode = vtkMRMLMetricInstanceNode::SafeDownCast( this->GetMRMLScene()->GetNodeByID( itr->first.first ) );
+      if ( miNode == NULL )
+      {
+        continue;
+      }
+      nameColumn->InsertNextValue( this->GetMetricName( miNode->GetAssociatedMetricScriptID() ) );
+      rolesColumn->InsertNextValue( miNode->GetCombinedRoleString() );
+      unitColumn->InsertNextValue( this->GetMetricUnit( miNode->GetAssociatedMetricScriptID() ) );
+    }
+    evaluationColumn->InsertNextValue( ( itr->first.second == RealTimeEvaluation ) ? "RealTime" : "Offline" );
+    wallTimeColumn->InsertNextValue( itr->second.WallTime );
+    samplesColumn->InsertNextValue( itr->second.NumberOfSamples );
+    pythonCallsColumn->InsertNextValue( itr->second.NumberOfPythonCalls );
+    memoryColumn->InsertNextValue( itr->second.RetainedMemory );
   }
 
+  // The profile is small, so the table is simply rebuilt
+  vtkTable* profilingTable = profilingTableNode->GetTable();
+  profilingTable->Initialize();
+  profilingTable->AddColumn( nameColumn );
+  profilingTable->AddColumn( rolesColumn );
+  profilingTable->AddColumn( unitColumn );
+  profilingTable->AddColumn( evaluationColumn );
+  profilingTable->AddColumn( wallTimeColumn );
+  profilingTable->AddColumn( samplesColumn );
+  profilingTable->AddColumn( pythonCallsColumn );
+  profilingTable->AddColumn( memoryColumn );
+  profilingTableNode->Modified();
 }
 
 
-vtkMRMLMetricInstanceNode* vtkSlicerPerkEvaluatorLogic
-::CreateMetricInstance( vtkMRMLMetricScriptNode* msNode )
+void vtkSlicerPerkEvaluatorLogic
+::ResetProfiling( vtkMRMLPerkEvaluatorNode* peNode )
 {
-  if ( msNode == NULL )
+  if ( peNode == NULL )
   {
-    return NULL; // Only work on non-pervasive metrics, the pervasive metrics need a different mechanism
+    return;
+  }
+  this->MetricProfiles.erase( peNode->GetID() );
+  if ( peNode->GetProfilingTableNode() != NULL )
+  {
+    this->UpdateProfilingTable( peNode );
   }
+}
 
-  // Create a metric instance node, with empty roles
-  vtkSmartPointer< vtkMRMLMetricInstanceNode > newMINode;
-  newMINode.TakeReference( vtkMRMLMetricInstanceNode::SafeDownCast( this->GetMRMLScene()->CreateNodeByClass( "vtkMRMLMetricInstanceNode" ) ) );
-  newMINode->SetScene( this->GetMRMLScene() );
-	this->GetMRMLScene()->AddNode( newMINode );
-  newMINode->SetName( msNode->GetName() );
-  newMINode->SetAssociatedMetricScriptID( msNode->GetID() );
-  // If it is shared, it will be added automatically to all the perk evaluator nodes
-  // If it is not shared, it must be added manually to perk evaluator nodes
 
-  return newMINode;
+// Range analysis ----------------------------------------------------------------
+
+bool vtkSlicerPerkEvaluatorLogic
+::ComputeMetricsOverMarkedRange( vtkMRMLPerkEvaluatorNode* peNode )
+{
+  if ( peNode == NULL || this->GetMRMLScene()->GetNodeByID( peNode->GetID() ) == NULL || peNode->GetTransformBufferNode() == NULL || peNode->GetMetricsTableNode() == NULL )
+  {
+    return false;
+  }
+  if ( peNode->GetMarkBegin() > peNode->GetMarkEnd() )
+  {
+    return false;
+  }
+
+  std::vector< std::string > scriptMetricInstanceIDs;
+  std::vector< std::string > nativeMetricInstanceIDs;
+  this->SplitMetricInstanceIDs( peNode, scriptMetricInstanceIDs, nativeMetricInstanceIDs );
+
+  double beginTime = peNode->GetMarkBegin() + peNode->GetTransformBufferNode()->GetMinimumTime();
+  double endTime = peNode->GetMarkEnd() + peNode->GetTransformBufferNode()->GetMinimumTime();
+
+  std::vector< std::string > recordedTransformNamesVector = peNode->GetTransformBufferNode()->GetAllRecordedTransformNames();
+  std::set< std::string > recordedTransformNames( recordedTransformNamesVector.begin(), recordedTransformNamesVector.end() );
+
+  // Find the range metric of every metric instance, and the ones which must be built (only once for those which share)
+  std::vector< vtkMRMLMetricInstanceNode* > miNodes;
+  std::vector< vtkSmartPointer< vtkPerkEvaluatorMetric > > metrics;
+  std::vector< std::string > keys;
+  std::set< std::string > usedKeys;
+  std::vector< NativeMetricJob > buildJobs;
+  std::vector< std::string > buildKeys;
+  std::vector< std::string > buildSignatures;
+  for ( unsigned int i = 0; i < nativeMetricInstanceIDs.size(); i++ )
+  {
+    vtkMRMLMetricInstanceNode* miNode = vtkMRMLMetricInstanceNode::SafeDownCast( this->GetMRMLScene()->GetNodeByID( nativeMetricInstanceIDs.at( i ) ) );
+    vtkSmartPointer< vtkPerkEvaluatorMetric > metric;
+    metric.TakeReference( this->CreateNativeMetric( peNode, miNode ) );
+    if ( metric == NULL )
+    {
+      continue;
+    }
+
+    std::string key = this->GetRangeMetricKey( peNode, miNode, metric );
+    if ( usedKeys.find( key ) == usedKeys.end() )
+    {
+      usedKeys.insert( key );
+      std::string signature = this->GetRangeMetricSignature( peNode, miNode, metric, recordedTransformNames );
+      std::map< std::string, RangeMetric >::iterator itr = this->RangeMetrics.find( key );
+      if ( itr == this->RangeMetrics.end() || itr->second.Signature.compare( signature ) != 0 )
+      {
+        NativeMetricJob job;
+        if ( ! this->PrepareNativeMetricJob( peNode, miNode, job, true ) )
+        {
+          continue;
+        }
+        job.RangeQueries = true;
+        buildJobs.push_back( job );
+        buildKeys.push_back( key );
+        buildSignatures.push_back( signature );
+      }
+    }
+
+    miNodes.push_back( miNode );
+    metrics.push_back( metric );
+    keys.push_back( key );
+  }
+
+  // Forget the range metrics of this node which are not used anymore (e.g. the roles changed)
+  std::string keyPrefix = std::string( peNode->GetID() ) + "\n";
+  std::map< std::string, RangeMetric >::iterator rangeItr = this->RangeMetrics.begin();
+  while ( rangeItr != this->RangeMetrics.end() )
+  {
+    if ( rangeItr->first.compare( 0, keyPrefix.size(), keyPrefix ) == 0 && usedKeys.find( rangeItr->first ) == usedKeys.end() )
+    {
+      this->RangeMetrics.erase( rangeItr++ );
+    }
+    else
+    {
+      rangeItr++;
+    }
+  }
+
+  // Build in the background, the table is updated when the build is applied
+  // A build which is already running is left alone (when it is applied, whatever is still missing is built)
+  if ( ! buildJobs.empty() )
+  {
+    if ( ! this->GetRangeBuildRunning( peNode ) )
+    {
+      vtkSmartPointer< vtkPerkEvaluatorAnalysisJob > job = vtkSmartPointer< vtkPerkEvaluatorAnalysisJob >::New();
+      job->SetPerkEvaluatorNodeID( peNode->GetID() );
+      job->GetNativeMetricJobs() = buildJobs;
+      job->SetRangeMetricKeys( buildKeys, buildSignatures );
+      vtkSlicerPerkEvaluatorLogic::SnapshotNativeMetricJobTrajectories( job->GetNativeMetricJobs() );
+      this->AnalysisJobs.push_back( job );
+      job->Start();
+    }
+    return false;
+  }
+
+  // Query every metric before writing any value, so the table is not left half updated
+  std::vector< double > metricValues( metrics.size(), 0 );
+  for ( unsigned int i = 0; i < metrics.size(); i++ )
+  {
+    vtkPerkEvaluatorMetric* rangeMetric = this->RangeMetrics[ keys.at( i ) ].Metric;
+    if ( rangeMetric == NULL )
+    {
+      return false;
+    }
+    if ( metrics.at( i )->GetRangeShareable() && metrics.at( i )->SetRangeSource( rangeMetric ) )
+    {
+      rangeMetric = metrics.at( i );
+    }
+    if ( ! rangeMetric->GetMetricOverRange( beginTime, endTime, metricValues.at( i ) ) )
+    {
+      return false;
+    }
+  }
+
+  bool valuesChanged = false;
+  std::set< int > nativeRows;
+  for ( unsigned int i = 0; i < miNodes.size(); i++ )
+  {
+    valuesChanged = this->SetMetricsTableValue( peNode->GetMetricsTableNode(), miNodes.at( i ), metricValues.at( i ) ) || valuesChanged;
+    nativeRows.insert( this->FindMetricsTableRow( peNode->GetMetricsTableNode(), miNodes.at( i ) ) );
+  }
+
+  // The other rows are the script metrics, which only the Python metrics calculator can compute by going over the samples again
+  // Their values are cleared until the next analysis, rather than left showing the values for the previous marks
+  vtkTable* metricsTable = peNode->GetMetricsTableNode()->GetTable();
+  for ( int row = 0; row < metricsTable->GetNumberOfRows(); row++ )
+  {
+    if ( nativeRows.find( row ) == nativeRows.end() && metricsTable->GetValueByName( row, "MetricValue" ).ToString().compare( "" ) != 0 )
+    {
+      metricsTable->SetValueByName( row, "MetricValue", vtkVariant( "" ) );
+      valuesChanged = true;
+    }
+  }
+
+  if ( valuesChanged )
+  {
+    peNode->GetMetricsTableNode()->Modified();
+    peNode->GetMetricsTableNode()->StorableModified();
+  }
+
+  return true;
+}
+
+
+std::string vtkSlicerPerkEvaluatorLogic
+::GetRangeMetricKey( vtkMRMLPerkEvaluatorNode* peNode, vtkMRMLMetricInstanceNode* miNode, vtkPerkEvaluatorMetric* metric )
+{
+  std::stringstream key;
+  key << peNode->GetID() << "\n";
+  if ( metric->GetRangeShareable() )
+  {
+    key << metric->GetClassName();
+  }
+  else
+  {
+    key << miNode->GetID();
+  }
+
+  std::vector< std::string > transformRoles = metric->GetAcceptedTransformRoles();
+  for ( unsigned int i = 0; i < transformRoles.size(); i++ )
+  {
+    vtkMRMLNode* roleNode = miNode->GetRoleNode( transformRoles.at( i ), vtkMRMLMetricInstanceNode::TransformRole );
+    key << "\n" << transformRoles.at( i ) << " = " << ( ( roleNode != NULL ) ? roleNode->GetID() : "" );
+  }
+  std::map< std::string, std::string > anatomyRoles = metric->GetRequiredAnatomyRoles();
+  for ( std::map< std::string, std::string >::iterator itr = anatomyRoles.begin(); itr != anatomyRoles.end(); itr++ )
+  {
+    vtkMRMLNode* roleNode = miNode->GetRoleNode( itr->first, vtkMRMLMetricInstanceNode::AnatomyRole );
+    key << "\n" << itr->first << " = " << ( ( roleNode != NULL ) ? roleNode->GetID() : "" );
+  }
+  return key.str();
+}
+
+
+std::string vtkSlicerPerkEvaluatorLogic
+::GetRangeMetricSignature( vtkMRMLPerkEvaluatorNode* peNode, vtkMRMLMetricInstanceNode* miNode, vtkPerkEvaluatorMetric* metric, std::set< std::string >& recordedTransformNames )
+{
+  // Not the Perk Evaluator node's modified time, because that changes with the marks
+  double needleOrientation[ 3 ] = { 0, 0, 1 };
+  peNode->GetNeedleOrientation( needleOrientation );
+
+  std::stringstream signature;
+  signature << peNode->GetTransformBufferNode()->GetID() << " " << peNode->GetTransformBufferNode()->GetMTime();
+  signature << " " << peNode->GetAnalysisInterpolation();
+  signature << " " << needleOrientation[ 0 ] << " " << needleOrientation[ 1 ] << " " << needleOrientation[ 2 ];
+  if ( ! metric->GetRangeShareable() )
+  {
+    signature << " " << miNode->GetMTime();
+  }
+
+  // The recorded transforms take their values from the buffer, any other transform in the hierarchy keeps its value from when the metric was built
+  // Not the modified time of the recorded transforms, because that changes with the playback
+  std::vector< std::string > transformRoles = metric->GetAcceptedTransformRoles();
+  for ( unsigned int i = 0; i < transformRoles.size(); i++ )
+  {
+    vtkMRMLLinearTransformNode* transformNode = vtkMRMLLinearTransformNode::SafeDownCast( miNode->GetRoleNode( transformRoles.at( i ), vtkMRMLMetricInstanceNode::TransformRole ) );
+    signature << " [";
+    for ( vtkMRMLLinearTransformNode* parent = transformNode; parent != NULL; parent = vtkMRMLLinearTransformNode::SafeDownCast( parent->GetParentTransformNode() ) )
+    {
+      signature << " " << parent->GetID();
+      if ( recordedTransformNames.find( parent->GetName() ) == recordedTransformNames.end() )
+      {
+        signature << ":" << parent->GetMTime();
+      }
+    }
+    signature << " ]";
+  }
+
+  std::map< std::string, std::string > anatomyRoles = metric->GetRequiredAnatomyRoles();
+  for ( std::map< std::string, std::string >::iterator itr = anatomyRoles.begin(); itr != anatomyRoles.end(); itr++ )
+  {
+    vtkMRMLNode* anatomyNode = miNode->GetRoleNode( itr->first, vtkMRMLMetricInstanceNode::AnatomyRole );
+    signature << " " << ( ( anatomyNode != NULL ) ? anatomyNode->GetMTime() : 0 );
+  }
+  return signature.str();
+}
+
+
+bool vtkSlicerPerkEvaluatorLogic
+::GetRangeBuildRunning( vtkMRMLPerkEvaluatorNode* peNode )
+{
+  for ( unsigned int i = 0; i < this->AnalysisJobs.size(); i++ )
+  {
+    vtkPerkEvaluatorAnalysisJob* job = this->AnalysisJobs.at( i );
+    vtkPerkEvaluatorAnalysisJob::StateEnum state = job->GetState();
+    if ( job->GetRangeBuild() && job->GetPerkEvaluatorNodeID().compare( peNode->GetID() ) == 0
+      && ( state == vtkPerkEvaluatorAnalysisJob::Pending || state == vtkPerkEvaluatorAnalysisJob::Running ) )
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+
+// Sliding window analysis ----------------------------------------------------------------
+
+void vtkSlicerPerkEvaluatorLogic
+::ComputeWindowedMetrics( vtkMRMLPerkEvaluatorNode* peNode, double windowLength, double windowStep, vtkMRMLTableNode* windowedMetricsTableNode )
+{
+  if ( peNode == NULL || peNode->GetTransformBufferNode() == NULL || windowedMetricsTableNode == NULL || windowedMetricsTableNode->GetTable() == NULL )
+  {
+    return;
+  }
+  if ( windowLength <= 0 || windowStep <= 0 || peNode->GetMarkBegin() > peNode->GetMarkEnd() )
+  {
+    return;
+  }
+
+  // Every window which fits between the marks (the begin times are multiples of the step, so rounding errors do not accumulate)
+  double beginTime = peNode->GetMarkBegin() + peNode->GetTransformBufferNode()->GetMinimumTime();
+  double endTime = peNode->GetMarkEnd() + peNode->GetTransformBufferNode()->GetMinimumTime();
+  std::vector< double > windowBegins;
+  for ( int i = 0; beginTime + i * windowStep + windowLength <= endTime; i++ )
+  {
+    windowBegins.push_back( beginTime + i * windowStep );
+  }
+
+  vtkTable* windowedMetricsTable = windowedMetricsTableNode->GetTable();
+  windowedMetricsTable->Initialize();
+  vtkSmartPointer< vtkDoubleArray > windowBeginColumn = vtkSmartPointer< vtkDoubleArray >::New();
+  windowBeginColumn->SetName( "WindowBegin" );
+  windowBeginColumn->SetNumberOfTuples( windowBegins.size() );
+  vtkSmartPointer< vtkDoubleArray > windowEndColumn = vtkSmartPointer< vtkDoubleArray >::New();
+  windowEndColumn->SetName( "WindowEnd" );
+  windowEndColumn->SetNumberOfTuples( windowBegins.size() );
+  for ( unsigned int i = 0; i < windowBegins.size(); i++ )
+  {
+    windowBeginColumn->SetValue( i, windowBegins.at( i ) - peNode->GetTransformBufferNode()->GetMinimumTime() );
+    windowEndColumn->SetValue( i, windowBegins.at( i ) + windowLength - peNode->GetTransformBufferNode()->GetMinimumTime() );
+  }
+  windowedMetricsTable->AddColumn( windowBeginColumn );
+  windowedMetricsTable->AddColumn( windowEndColumn );
+
+  std::vector< std::string > scriptMetricInstanceIDs;
+  std::vector< std::string > nativeMetricInstanceIDs;
+  this->SplitMetricInstanceIDs( peNode, scriptMetricInstanceIDs, nativeMetricInstanceIDs );
+  if ( ! scriptMetricInstanceIDs.empty() )
+  {
+    vtkWarningMacro( "vtkSlicerPerkEvaluatorLogic::ComputeWindowedMetrics: " << scriptMetricInstanceIDs.size() << " script metrics are not computed over windows." );
+  }
+
+  for ( unsigned int i = 0; i < nativeMetricInstanceIDs.size(); i++ )
+  {
+    vtkMRMLMetricInstanceNode* miNode = vtkMRMLMetricInstanceNode::SafeDownCast( this->GetMRMLScene()->GetNodeByID( nativeMetricInstanceIDs.at( i ) ) );
+    NativeMetricJob job;
+    if ( ! this->PrepareNativeMetricJob( peNode, miNode, job ) )
+    {
+      continue;
+    }
+
+    // The samples between the marks are computed once, whatever the number of windows
+    std::vector< double > windowValues;
+    vtkSlicerPerkEvaluatorLogic::RunWindowedNativeMetricJob( job, windowBegins, windowLength, windowValues );
+
+    std::stringstream columnName;
+    columnName << this->GetMetricName( miNode->GetAssociatedMetricScriptID() ) << " [" << miNode->GetCombinedRoleString() << "] (" << this->GetMetricUnit( miNode->GetAssociatedMetricScriptID() ) << ")";
+    vtkSmartPointer< vtkDoubleArray > metricColumn = vtkSmartPointer< vtkDoubleArray >::New();
+    metricColumn->SetName( columnName.str().c_str() );
+    metricColumn->SetNumberOfTuples( windowValues.size() );
+    for ( unsigned int j = 0; j < windowValues.size(); j++ )
+    {
+      metricColumn->SetValue( j, windowValues.at( j ) );
+    }
+    windowedMetricsTable->AddColumn( metricColumn );
+  }
+
+  windowedMetricsTableNode->Modified();
+  windowedMetricsTableNode->StorableModified();
+}
+
+
+// Batch analysis ----------------------------------------------------------------
+
+// Shared by the worker threads of a batch
+struct NativeMetricJobQueue
+{
+  std::vector< vtkSlicerPerkEvaluatorLogic::NativeMetricJob >* Jobs;
+  int NextJob;
+  int NumCompletedJobs;
+  vtkSimpleMutexLock* Mutex;
+  volatile bool* Canceled;
+};
+
+
+static VTK_THREAD_RETURN_TYPE NativeMetricJobsThreadFunction( void* arg )
+{
+  vtkMultiThreader::ThreadInfo* threadInfo = static_cast< vtkMultiThreader::ThreadInfo* >( arg );
+  NativeMetricJobQueue* jobQueue = static_cast< NativeMetricJobQueue* >( threadInfo->UserData );
+
+  while ( ! *jobQueue->Canceled )
+  {
+    jobQueue->Mutex->Lock();
+    unsigned int jobIndex = jobQueue->NextJob;
+    jobQueue->NextJob++;
+    jobQueue->Mutex->Unlock();
+
+    if ( jobIndex >= jobQueue->Jobs->size() )
+    {
+      break;
+    }
+
+    vtkSlicerPerkEvaluatorLogic::RunNativeMetricJob( jobQueue->Jobs->at( jobIndex ), jobQueue->Canceled );
+
+    jobQueue->Mutex->Lock();
+    jobQueue->NumCompletedJobs++;
+    jobQueue->Mutex->Unlock();
+  }
+
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+
+bool vtkSlicerPerkEvaluatorLogic
+::ComputeMetricsBatch( vtkCollection* peNodes )
+{
+  std::vector< vtkMRMLPerkEvaluatorNode* > peNodesVector;
+  for ( int i = 0; peNodes != NULL && i < peNodes->GetNumberOfItems(); i++ )
+  {
+    vtkMRMLPerkEvaluatorNode* peNode = vtkMRMLPerkEvaluatorNode::SafeDownCast( peNodes->GetItemAsObject( i ) );
+    if ( peNode != NULL )
+    {
+      peNodesVector.push_back( peNode );
+    }
+  }
+  return this->ComputeMetricsBatch( peNodesVector );
+}
+
+
+bool vtkSlicerPerkEvaluatorLogic
+::ComputeMetricsBatch( std::vector< vtkMRMLPerkEvaluatorNode* > peNodes )
+{
+  if ( this->MetricsBatchRunning )
+  {
+    vtkWarningMacro( "vtkSlicerPerkEvaluatorLogic::ComputeMetricsBatch: A batch is already running." );
+    return false;
+  }
+
+  // Check conditions (same as for a single analysis)
+  // Observers of the progress may process events, which may remove nodes from the scene, so only the IDs are kept
+  std::vector< std::string > validPENodeIDs;
+  for ( unsigned int i = 0; i < peNodes.size(); i++ )
+  {
+    vtkMRMLPerkEvaluatorNode* peNode = peNodes.at( i );
+    if ( peNode == NULL || this->GetMRMLScene()->GetNodeByID( peNode->GetID() ) == NULL || peNode->GetMetricsTableNode() == NULL || peNode->GetMarkBegin() > peNode->GetMarkEnd() )
+    {
+      continue;
+    }
+    validPENodeIDs.push_back( peNode->GetID() );
+  }
+
+  this->MetricsBatchRunning = true;
+  this->MetricsBatchCanceled = false;
+  this->MetricsBatchProgress = 0;
+  this->MetricsBatchCurrentPENodeID = "";
+
+  // Prepare all of the native metrics on this thread, since it is the only one allowed to use the scene
+  std::vector< NativeMetricJob > nativeJobs;
+  std::vector< std::vector< std::string > > scriptMetricInstanceIDs( validPENodeIDs.size() );
+  for ( unsigned int i = 0; i < validPENodeIDs.size(); i++ )
+  {
+    vtkMRMLPerkEvaluatorNode* peNode = vtkMRMLPerkEvaluatorNode::SafeDownCast( this->GetMRMLScene()->GetNodeByID( validPENodeIDs.at( i ) ) );
+    std::vector< std::string > nativeMetricInstanceIDs;
+    this->SplitMetricInstanceIDs( peNode, scriptMetricInstanceIDs.at( i ), nativeMetricInstanceIDs );
+    for ( unsigned int j = 0; j < nativeMetricInstanceIDs.size(); j++ )
+    {
+      vtkMRMLMetricInstanceNode* miNode = vtkMRMLMetricInstanceNode::SafeDownCast( this->GetMRMLScene()->GetNodeByID( nativeMetricInstanceIDs.at( j ) ) );
+      NativeMetricJob job;
+      if ( this->PrepareNativeMetricJob( peNode, miNode, job ) )
+      {
+        nativeJobs.push_back( job );
+      }
+    }
+  }
+
+  vtkSlicerPerkEvaluatorLogic::SnapshotNativeMetricJobTrajectories( nativeJobs );
+
+  int numScriptPasses = 0;
+  for ( unsigned int i = 0; i < validPENodeIDs.size(); i++ )
+  {
+    numScriptPasses += ( scriptMetricInstanceIDs.at( i ).empty() || this->PythonManager == NULL ) ? 0 : 1;
+  }
+
+  // Spread the native metrics across the cores
+  vtkSimpleMutexLock* jobMutex = vtkSimpleMutexLock::New();
+  NativeMetricJobQueue jobQueue;
+  jobQueue.Jobs = &nativeJobs;
+  jobQueue.NextJob = 0;
+  jobQueue.NumCompletedJobs = 0;
+  jobQueue.Mutex = jobMutex;
+  jobQueue.Canceled = &this->MetricsBatchCanceled;
+
+  int numThreads = ( this->NumberOfBatchThreads > 0 ) ? this->NumberOfBatchThreads : vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+  numThreads = std::max( 1, std::min< int >( numThreads, nativeJobs.size() ) );
+  vtkSmartPointer< vtkMultiThreader > threader = vtkSmartPointer< vtkMultiThreader >::New();
+  std::vector< int > threadIDs;
+  for ( int i = 0; i < numThreads && ! nativeJobs.empty(); i++ )
+  {
+    threadIDs.push_back( threader->SpawnThread( ( vtkThreadFunctionType ) &NativeMetricJobsThreadFunction, &jobQueue ) );
+  }
+
+  // Meanwhile, use the python metrics calculator module for the script metrics (this must be on the main thread)
+  int numCompletedScriptPasses = 0;
+  for ( unsigned int i = 0; i < validPENodeIDs.size() && ! this->MetricsBatchCanceled; i++ )
+  {
+    // The previous progress update may have removed the node (or its metrics table)
+    vtkMRMLPerkEvaluatorNode* peNode = vtkMRMLPerkEvaluatorNode::SafeDownCast( this->GetMRMLScene()->GetNodeByID( validPENodeIDs.at( i ) ) );
+    if ( peNode == NULL || peNode->GetMetricsTableNode() == NULL )
+    {
+      continue;
+    }
+    if ( scriptMetricInstanceIDs.at( i ).empty() || this->PythonManager == NULL )
+    {
+      this->InitializeMetricsTable( peNode->GetMetricsTableNode() );
+      continue;
+    }
+
+    this->MetricsBatchCurrentPENodeID = peNode->GetID();
+    this->ComputeScriptMetrics( peNode, scriptMetricInstanceIDs.at( i ) );
+    this->MetricsBatchCurrentPENodeID = "";
+
+    numCompletedScriptPasses++;
+    jobMutex->Lock();
+    unsigned int numCompletedJobs = jobQueue.NumCompletedJobs;
+    jobMutex->Unlock();
+    this->UpdateMetricsBatchProgress( numCompletedScriptPasses + numCompletedJobs, numScriptPasses + nativeJobs.size() );
+  }
+
+  // Wait for the native metrics, keeping the progress up to date (observers may process events, so the batch can be canceled)
+  while ( ! nativeJobs.empty() && ! this->MetricsBatchCanceled )
+  {
+    jobMutex->Lock();
+    unsigned int numCompletedJobs = jobQueue.NumCompletedJobs;
+    jobMutex->Unlock();
+    this->UpdateMetricsBatchProgress( numCompletedScriptPasses + numCompletedJobs, numScriptPasses + nativeJobs.size() );
+    if ( numCompletedJobs == nativeJobs.size() )
+    {
+      break;
+    }
+    vtksys::SystemTools::Delay( BATCH_PROGRESS_INTERVAL_MSEC );
+  }
+  for ( unsigned int i = 0; i < threadIDs.size(); i++ )
+  {
+    threader->TerminateThread( threadIDs.at( i ) ); // Joins the thread
+  }
+  jobMutex->Delete();
+
+  // Apply the results of the native metrics
+  for ( unsigned int i = 0; i < nativeJobs.size() && ! this->MetricsBatchCanceled; i++ )
+  {
+    vtkMRMLPerkEvaluatorNode* peNode = vtkMRMLPerkEvaluatorNode::SafeDownCast( this->GetMRMLScene()->GetNodeByID( nativeJobs.at( i ).PerkEvaluatorNodeID ) );
+    vtkMRMLMetricInstanceNode* miNode = vtkMRMLMetricInstanceNode::SafeDownCast( this->GetMRMLScene()->GetNodeByID( nativeJobs.at( i ).MetricInstanceID ) );
+    if ( peNode == NULL || peNode->GetMetricsTableNode() == NULL || miNode == NULL || ! nativeJobs.at( i ).Computed )
+    {
+      continue;
+    }
+    this->SetMetricsTableValue( peNode->GetMetricsTableNode(), miNode, nativeJobs.at( i ).MetricValue );
+    this->AddToMetricProfile( nativeJobs.at( i ) );
+  }
+
+  for ( unsigned int i = 0; i < validPENodeIDs.size(); i++ )
+  {
+    vtkMRMLPerkEvaluatorNode* peNode = vtkMRMLPerkEvaluatorNode::SafeDownCast( this->GetMRMLScene()->GetNodeByID( validPENodeIDs.at( i ) ) );
+    if ( peNode == NULL || peNode->GetMetricsTableNode() == NULL )
+    {
+      continue;
+    }
+    peNode->GetMetricsTableNode()->Modified(); // Table has been modified
+    peNode->GetMetricsTableNode()->StorableModified(); // Make sure the metrics table is saved by default
+    this->UpdateProfilingTable( peNode );
+  }
+
+  bool completed = ! this->MetricsBatchCanceled;
+  this->MetricsBatchRunning = false;
+  if ( completed )
+  {
+    this->UpdateMetricsBatchProgress( 1, 1 );
+  }
+  return completed;
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::CancelMetricsBatch()
+{
+  if ( ! this->MetricsBatchRunning )
+  {
+    return;
+  }
+
+  this->MetricsBatchCanceled = true;
+
+  // This halts the Python metrics calculator
+  vtkMRMLPerkEvaluatorNode* peNode = vtkMRMLPerkEvaluatorNode::SafeDownCast( this->GetMRMLScene()->GetNodeByID( this->MetricsBatchCurrentPENodeID ) );
+  if ( peNode != NULL )
+  {
+    peNode->SetAnalysisState( -1 );
+  }
+}
+
+
+bool vtkSlicerPerkEvaluatorLogic
+::GetMetricsBatchRunning()
+{
+  return this->MetricsBatchRunning;
+}
+
+
+int vtkSlicerPerkEvaluatorLogic
+::GetMetricsBatchProgress()
+{
+  return this->MetricsBatchProgress;
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::UpdateMetricsBatchProgress( int numCompleted, int numTotal )
+{
+  int newProgress = ( numTotal > 0 ) ? ( 100 * numCompleted ) / numTotal : 100;
+  if ( newProgress == this->MetricsBatchProgress )
+  {
+    return;
+  }
+
+  this->MetricsBatchProgress = newProgress;
+  this->InvokeEvent( MetricsBatchProgressEvent, &this->MetricsBatchProgress );
+}
+
+
+bool vtkSlicerPerkEvaluatorLogic
+::ComputeNativeMetric( vtkMRMLPerkEvaluatorNode* peNode, vtkMRMLMetricInstanceNode* miNode, double& metricValue )
+{
+  NativeMetricJob job;
+  if ( ! this->PrepareNativeMetricJob( peNode, miNode, job ) )
+  {
+    return false;
+  }
+
+  vtkSlicerPerkEvaluatorLogic::RunNativeMetricJob( job, NULL );
+  this->AddToMetricProfile( job );
+  metricValue = job.MetricValue;
+  return job.Computed;
+}
+
+
+bool vtkSlicerPerkEvaluatorLogic
+::PrepareNativeMetricJob( vtkMRMLPerkEvaluatorNode* peNode, vtkMRMLMetricInstanceNode* miNode, NativeMetricJob& job, bool allTimes )
+{
+  if ( peNode == NULL || peNode->GetTransformBufferNode() == NULL || miNode == NULL )
+  {
+    return false;
+  }
+
+  job.PerkEvaluatorNodeID = peNode->GetID();
+  job.MetricInstanceID = miNode->GetID();
+  job.TransformBuffer = peNode->GetTransformBufferNode();
+  job.Metric.TakeReference( this->CreateNativeMetric( peNode, miNode ) );
+  job.MetricValue = 0;
+  job.Computed = false;
+  job.WallTime = 0;
+  job.RetainedMemory = 0;
+  job.Interpolation = ( peNode->GetAnalysisInterpolation() == vtkMRMLPerkEvaluatorNode::LinearInterpolation );
+  job.RangeQueries = false;
+  if ( job.Metric == NULL )
+  {
+    return false;
+  }
+
+  // Collect the times at which any transform fulfilling one of the roles (or any of its parents) was recorded
+  vtkMRMLTransformBufferNode* transformBuffer = peNode->GetTransformBufferNode();
+  double beginTime = peNode->GetMarkBegin() + transformBuffer->GetMinimumTime();
+  double endTime = peNode->GetMarkEnd() + transformBuffer->GetMinimumTime();
+
+  std::vector< std::string > recordedTransformNamesVector = transformBuffer->GetAllRecordedTransformNames();
+  std::set< std::string > recordedTransformNames( recordedTransformNamesVector.begin(), recordedTransformNamesVector.end() );
+
+  std::vector< std::pair< double, int > > timestamps; // Pairs of times and role indices
+  std::vector< std::string > transformRoles = job.Metric->GetAcceptedTransformRoles();
+  for ( unsigned int i = 0; i < transformRoles.size(); i++ )
+  {
+    vtkMRMLLinearTransformNode* transformNode = vtkMRMLLinearTransformNode::SafeDownCast( miNode->GetRoleNode( transformRoles.at( i ), vtkMRMLMetricInstanceNode::TransformRole ) );
+    if ( transformNode == NULL )
+    {
+      continue;
+    }
+
+    // Everything about the hierarchy is resolved now, so the job does not need to touch the scene
+    int roleIndex = job.Roles.size();
+    job.Roles.push_back( transformRoles.at( i ) );
+    job.RoleChains.push_back( std::vector< TransformChainLink >() );
+    vtkSmartPointer< vtkMatrix4x4 > staticMatrix = vtkSmartPointer< vtkMatrix4x4 >::New();
+    for ( vtkMRMLLinearTransformNode* parent = transformNode; parent != NULL; parent = vtkMRMLLinearTransformNode::SafeDownCast( parent->GetParentTransformNode() ) )
+    {
+      TransformChainLink link;
+      link.TransformName = parent->GetName();
+      link.Recorded = recordedTransformNames.find( link.TransformName ) != recordedTransformNames.end();
+      parent->GetMatrixTransformToParent( staticMatrix );
+      vtkMatrix4x4::DeepCopy( link.StaticMatrix, staticMatrix );
+      link.Trajectory = link.Recorded ? this->GetTrajectory( transformBuffer, link.TransformName ) : NULL;
+      link.CurrentRecord = 0;
+      job.RoleChains.back().push_back( link );
+    }
+
+    vtkSmartPointer< vtkDoubleArray > timesArray = vtkSmartPointer< vtkDoubleArray >::New();
+    this->GetSelfAndParentTimes( peNode, transformNode, timesArray );
+    for ( int j = 0; j < timesArray->GetNumberOfTuples(); j++ )
+    {
+      if ( allTimes || ( timesArray->GetValue( j ) >= beginTime && timesArray->GetValue( j ) <= endTime ) )
+      {
+        timestamps.push_back( std::pair< double, int >( timesArray->GetValue( j ), roleIndex ) );
+      }
+    }
+  }
+  std::stable_sort( timestamps.begin(), timestamps.end() );
+
+  job.Times.resize( timestamps.size() );
+  job.RoleIndices.resize( timestamps.size() );
+  for ( unsigned int i = 0; i < timestamps.size(); i++ )
+  {
+    job.Times.at( i ) = timestamps.at( i ).first;
+    job.RoleIndices.at( i ) = timestamps.at( i ).second;
+  }
+
+  return true;
+}
+
+
+// Only reads the transform buffer, so jobs can be run on worker threads
+void vtkSlicerPerkEvaluatorLogic
+::RunNativeMetricJob( NativeMetricJob& job, volatile bool* canceled )
+{
+  vtkSmartPointer< vtkMatrix4x4 > matrix = vtkSmartPointer< vtkMatrix4x4 >::New();
+  vtkSmartPointer< vtkMatrix4x4 > parentMatrix = vtkSmartPointer< vtkMatrix4x4 >::New();
+  double startTime = vtkTimerLog::GetUniversalTime();
+
+  // Feed the metric in chronological order
+  for ( unsigned int i = 0; i < job.Times.size(); i++ )
+  {
+    if ( canceled != NULL && *canceled )
+    {
+      return;
+    }
+    vtkSlicerPerkEvaluatorLogic::AddNativeMetricJobSample( job, i, matrix, parentMatrix );
+  }
+  if ( job.RangeQueries )
+  {
+    job.Metric->UpdateRange();
+  }
+
+  job.MetricValue = job.Metric->GetMetric();
+  job.Computed = true;
+  job.WallTime = vtkTimerLog::GetUniversalTime() - startTime;
+  job.RetainedMemory = job.Metric->GetActualMemorySize();
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::RunWindowedNativeMetricJob( NativeMetricJob& job, const std::vector< double >& windowBegins, double windowLength, std::vector< double >& windowValues )
+{
+  vtkSmartPointer< vtkMatrix4x4 > matrix = vtkSmartPointer< vtkMatrix4x4 >::New();
+  vtkSmartPointer< vtkMatrix4x4 > parentMatrix = vtkSmartPointer< vtkMatrix4x4 >::New();
+
+  windowValues.resize( windowBegins.size() );
+  bool incremental = true;
+  unsigned int nextSample = 0;
+  for ( unsigned int i = 0; i < windowBegins.size(); i++ )
+  {
+    double windowEnd = windowBegins.at( i ) + windowLength;
+
+    // Add the samples which entered the window, and remove the ones which left it
+    if ( incremental )
+    {
+      while ( nextSample < job.Times.size() && job.Times.at( nextSample ) <= windowEnd )
+      {
+        vtkSlicerPerkEvaluatorLogic::AddNativeMetricJobSample( job, nextSample, matrix, parentMatrix );
+        nextSample++;
+      }
+      incremental = job.Metric->RemoveTimestampsBefore( windowBegins.at( i ) );
+    }
+
+    // Otherwise, start over for every window
+    if ( ! incremental )
+    {
+      job.Metric->Initialize();
+      unsigned int sample = std::lower_bound( job.Times.begin(), job.Times.end(), windowBegins.at( i ) ) - job.Times.begin();
+      for ( ; sample < job.Times.size() && job.Times.at( sample ) <= windowEnd; sample++ )
+      {
+        vtkSlicerPerkEvaluatorLogic::AddNativeMetricJobSample( job, sample, matrix, parentMatrix );
+      }
+    }
+
+    windowValues.at( i ) = job.Metric->GetMetric();
+  }
+
+  job.Computed = true;
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::SnapshotNativeMetricJobTrajectories( std::vector< NativeMetricJob >& jobs )
+{
+  std::map< vtkPerkEvaluatorTrajectory*, vtkSmartPointer< vtkPerkEvaluatorTrajectory > > trajectoryCopies;
+  for ( unsigned int i = 0; i < jobs.size(); i++ )
+  {
+    for ( unsigned int j = 0; j < jobs.at( i ).RoleChains.size(); j++ )
+    {
+      for ( unsigned int k = 0; k < jobs.at( i ).RoleChains.at( j ).size(); k++ )
+      {
+        TransformChainLink& link = jobs.at( i ).RoleChains.at( j ).at( k );
+        if ( link.Trajectory == NULL )
+        {
+          continue;
+        }
+        vtkSmartPointer< vtkPerkEvaluatorTrajectory >& trajectoryCopy = trajectoryCopies[ link.Trajectory.GetPointer() ];
+        if ( trajectoryCopy == NULL )
+        {
+          trajectoryCopy = vtkSmartPointer< vtkPerkEvaluatorTrajectory >::New();
+          trajectoryCopy->DeepCopy( link.Trajectory );
+        }
+        link.Trajectory = trajectoryCopy;
+      }
+    }
+    jobs.at( i ).TransformBuffer = NULL; // Not to be touched off the main thread
+  }
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::AddNativeMetricJobSample( NativeMetricJob& job, int sample, vtkMatrix4x4* matrix, vtkMatrix4x4* parentMatrix )
+{
+  double time = job.Times.at( sample );
+
+  // Recorded transforms take their value from their trajectory, any other transforms keep their value from when the job was prepared
+  matrix->Identity();
+  std::vector< TransformChainLink >& chain = job.RoleChains.at( job.RoleIndices.at( sample ) );
+  for ( unsigned int j = 0; j < chain.size(); j++ )
+  {
+    TransformChainLink& link = chain.at( j );
+    if ( link.Trajectory != NULL && link.Trajectory->GetNumberOfRecords() > 0 )
+    {
+      link.CurrentRecord = link.Trajectory->FindRecordFrom( time, link.CurrentRecord );
+      double elements[ 16 ];
+      if ( job.Interpolation )
+      {
+        link.Trajectory->GetInterpolatedMatrix( link.CurrentRecord, time, elements );
+      }
+      else
+      {
+        link.Trajectory->GetMatrix( link.Trajectory->GetNearestRecord( link.CurrentRecord, time ), elements );
+      }
+      parentMatrix->DeepCopy( elements );
+    }
+    else
+    {
+      parentMatrix->DeepCopy( link.StaticMatrix );
+    }
+    vtkMatrix4x4::Multiply4x4( parentMatrix, matrix, matrix );
+  }
+
+  double origin[ 4 ] = { 0, 0, 0, 1 };
+  double point[ 4 ] = { 0, 0, 0, 1 };
+  matrix->MultiplyPoint( origin, point );
+  job.Metric->AddTimestamp( time, matrix, point, job.Roles.at( job.RoleIndices.at( sample ) ) );
+}
+
+
+vtkPerkEvaluatorMetric* vtkSlicerPerkEvaluatorLogic
+::CreateNativeMetric( vtkMRMLPerkEvaluatorNode* peNode, vtkMRMLMetricInstanceNode* miNode )
+{
+  if ( peNode == NULL || miNode == NULL || miNode->GetAssociatedMetricScriptNode() == NULL || ! miNode->GetAssociatedMetricScriptNode()->IsNative() )
+  {
+    return NULL;
+  }
+
+  vtkPerkEvaluatorMetric* metric = vtkPerkEvaluatorMetricFactory::GetInstance()->CreateMetric( miNode->GetAssociatedMetricScriptNode()->GetNativeMetricName() );
+  if ( metric == NULL )
+  {
+    return NULL;
+  }
+
+  metric->Initialize();
+  double needleOrientation[ 3 ] = { 0, 0, 1 };
+  peNode->GetNeedleOrientation( needleOrientation );
+  metric->SetNeedleOrientation( needleOrientation );
+
+  // All of the anatomies must be available, otherwise the metric cannot be computed
+  std::map< std::string, std::string > anatomyRoles = metric->GetRequiredAnatomyRoles();
+  for ( std::map< std::string, std::string >::iterator itr = anatomyRoles.begin(); itr != anatomyRoles.end(); itr++ )
+  {
+    vtkMRMLNode* anatomyNode = miNode->GetRoleNode( itr->first, vtkMRMLMetricInstanceNode::AnatomyRole );
+    if ( anatomyNode == NULL || ! anatomyNode->IsA( itr->second.c_str() ) || ! metric->AddAnatomyRole( itr->first, anatomyNode ) )
+    {
+      metric->Delete();
+      return NULL;
+    }
+  }
+
+  return metric;
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::SplitMetricInstanceIDs( vtkMRMLPerkEvaluatorNode* peNode, std::vector< std::string >& scriptMetricInstanceIDs, std::vector< std::string >& nativeMetricInstanceIDs )
+{
+  scriptMetricInstanceIDs.clear();
+  nativeMetricInstanceIDs.clear();
+  if ( peNode == NULL )
+  {
+    return;
+  }
+
+  std::vector< std::string > metricInstanceIDs = peNode->GetMetricInstanceIDs();
+  for ( unsigned int i = 0; i < metricInstanceIDs.size(); i++ )
+  {
+    vtkMRMLMetricInstanceNode* miNode = vtkMRMLMetricInstanceNode::SafeDownCast( this->GetMRMLScene()->GetNodeByID( metricInstanceIDs.at( i ) ) );
+    vtkMRMLMetricScriptNode* msNode = ( miNode != NULL ) ? miNode->GetAssociatedMetricScriptNode() : NULL;
+    if ( msNode != NULL && msNode->IsNative() && vtkPerkEvaluatorMetricFactory::GetInstance()->IsMetricRegistered( msNode->GetNativeMetricName() ) )
+    {
+      nativeMetricInstanceIDs.push_back( metricInstanceIDs.at( i ) );
+    }
+    else
+    {
+      scriptMetricInstanceIDs.push_back( metricInstanceIDs.at( i ) );
+    }
+  }
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::GetMatrixTransformToWorldAtTime( vtkMRMLPerkEvaluatorNode* peNode, vtkMRMLLinearTransformNode* transformNode, double time, std::set< std::string >& recordedTransformNames, vtkMatrix4x4* matrix )
+{
+  matrix->Identity();
+  if ( peNode == NULL || peNode->GetTransformBufferNode() == NULL )
+  {
+    return;
+  }
+
+  // Recorded transforms take their value from the buffer, any other transforms keep their current value
+  vtkSmartPointer< vtkMatrix4x4 > parentMatrix = vtkSmartPointer< vtkMatrix4x4 >::New();
+  vtkMRMLLinearTransformNode* parent = transformNode;
+  while( parent != NULL )
+  {
+    vtkTransformRecord* record = NULL;
+    if ( recordedTransformNames.find( parent->GetName() ) != recordedTransformNames.end() )
+    {
+      record = peNode->GetTransformBufferNode()->GetTransformAtTime( time, parent->GetName() );
+    }
+
+    if ( record != NULL )
+    {
+      record->GetTransformMatrix( parentMatrix );
+    }
+    else
+    {
+      parent->GetMatrixTransformToParent( parentMatrix );
+    }
+    vtkMatrix4x4::Multiply4x4( parentMatrix, matrix, matrix );
+
+    parent = vtkMRMLLinearTransformNode::SafeDownCast( parent->GetParentTransformNode() );
+  }
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::InitializeMetricsTable( vtkMRMLTableNode* metricsTableNode )
+{
+  if ( metricsTableNode == NULL )
+  {
+    return;
+  }
+
+  // Make sure the table has all of the expected columns, but no rows
+  for ( int i = 0; i < 4; i++ )
+  {
+    if ( metricsTableNode->GetTable()->GetColumnByName( METRICS_TABLE_COLUMN_NAMES[ i ] ) == NULL )
+    {
+      vtkSmartPointer< vtkStringArray > column = vtkSmartPointer< vtkStringArray >::New();
+      column->SetName( METRICS_TABLE_COLUMN_NAMES[ i ] );
+      metricsTableNode->GetTable()->AddColumn( column );
+    }
+  }
+  metricsTableNode->GetTable()->GetRowData()->SetNumberOfTuples( 0 );
+}
+
+
+bool vtkSlicerPerkEvaluatorLogic
+::SetMetricsTableValue( vtkMRMLTableNode* metricsTableNode, vtkMRMLMetricInstanceNode* miNode, double metricValue )
+{
+  if ( metricsTableNode == NULL || miNode == NULL )
+  {
+    return false;
+  }
+  if ( this->GetMetricsTableKey( miNode ).empty() )
+  {
+    return false; // The metric script cannot be described, so the row would have no name or unit
+  }
+  if ( metricsTableNode->GetTable()->GetColumnByName( "MetricValue" ) == NULL )
+  {
+    this->InitializeMetricsTable( metricsTableNode );
+  }
+
+  vtkTable* metricsTable = metricsTableNode->GetTable();
+
+  // Update the row if the metric instance already has one, otherwise add a new row
+  int row = this->FindMetricsTableRow( metricsTableNode, miNode );
+  if ( row < 0 )
+  {
+    std::string miName = this->GetMetricName( miNode->GetAssociatedMetricScriptID() );
+    std::string miUnit = this->GetMetricUnit( miNode->GetAssociatedMetricScriptID() );
+    std::string miRoles = miNode->GetCombinedRoleString();
+    row = metricsTable->InsertNextBlankRow();
+    metricsTable->SetValueByName( row, "MetricName", vtkVariant( miName ) );
+    metricsTable->SetValueByName( row, "MetricUnit", vtkVariant( miUnit ) );
+    metricsTable->SetValueByName( row, "MetricRoles", vtkVariant( miRoles ) );
+  }
+
+  std::string valueString = vtkVariant( metricValue ).ToString();
+  bool valueChanged = valueString.compare( metricsTable->GetValueByName( row, "MetricValue" ).ToString() ) != 0;
+  metricsTable->SetValueByName( row, "MetricValue", vtkVariant( valueString ) );
+
+  // The index already knows about this change, so the indexed rows do not need to be verified again
+  if ( metricsTableNode->GetID() != NULL )
+  {
+    bool indexComplete = this->MetricsTableIndices[ metricsTableNode->GetID() ].Complete;
+    this->UpdateMetricsTableIndex( metricsTableNode, false );
+    this->MetricsTableIndices[ metricsTableNode->GetID() ].Complete = indexComplete;
+  }
+
+  return valueChanged;
+}
+
+
+std::string vtkSlicerPerkEvaluatorLogic
+::GetMetricValue( vtkMRMLMetricInstanceNode* miNode, vtkMRMLPerkEvaluatorNode* peNode )
+{
+  // Verify that the table node exists
+  if ( peNode == NULL )
+  {
+    return "";
+  }
+  vtkMRMLTableNode* metricsTableNode = peNode->GetMetricsTableNode();
+  if ( metricsTableNode == NULL )
+  {
+    return "";
+  }
+
+  int row = this->FindMetricsTableRow( metricsTableNode, miNode );
+  if ( row < 0 )
+  {
+    return "";
+  }
+
+  return metricsTableNode->GetTable()->GetValueByName( row, "MetricValue" ).ToString(); // Note: returning a string here
+}
+
+
+// Metrics table index ---------------------------------------------------------------
+
+std::string vtkSlicerPerkEvaluatorLogic
+::GetMetricsTableKey( std::string name, std::string unit, std::string roles )
+{
+  return name + "\n" + unit + "\n" + roles;
+}
+
+
+std::string vtkSlicerPerkEvaluatorLogic
+::GetMetricsTableKey( vtkTable* metricsTable, int row )
+{
+  return this->GetMetricsTableKey( metricsTable->GetValueByName( row, "MetricName" ).ToString(), metricsTable->GetValueByName( row, "MetricUnit" ).ToString(), metricsTable->GetValueByName( row, "MetricRoles" ).ToString() );
+}
+
+
+std::string vtkSlicerPerkEvaluatorLogic
+::GetMetricsTableKey( vtkMRMLMetricInstanceNode* miNode )
+{
+  // The name and unit come from the cached metric script descriptor, so this does not need the interpreter
+  // Without a descriptor, the metric instance has no row (the key is empty, which no row has)
+  MetricScriptDescriptor* descriptor = ( miNode != NULL ) ? this->GetMetricScriptDescriptor( miNode->GetAssociatedMetricScriptID() ) : NULL;
+  if ( descriptor == NULL )
+  {
+    return "";
+  }
+  return this->GetMetricsTableKey( descriptor->Name, descriptor->Unit, miNode->GetCombinedRoleString() );
+}
+
+
+unsigned long vtkSlicerPerkEvaluatorLogic
+::GetMetricsTableMTime( vtkMRMLTableNode* metricsTableNode )
+{
+  // Writing values into the table's columns does not modify the table, so whoever fills the table modifies the node
+  return std::max< unsigned long >( metricsTableNode->GetMTime(), metricsTableNode->GetTable()->GetMTime() );
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::UpdateMetricsTableIndex( vtkMRMLTableNode* metricsTableNode, bool rebuild )
+{
+  vtkTable* metricsTable = metricsTableNode->GetTable();
+  MetricsTableIndex& index = this->MetricsTableIndices[ metricsTableNode->GetID() ];
+
+  if ( metricsTable->GetColumnByName( "MetricName" ) == NULL || metricsTable->GetColumnByName( "MetricUnit" ) == NULL
+    || metricsTable->GetColumnByName( "MetricRoles" ) == NULL || metricsTable->GetColumnByName( "MetricValue" ) == NULL )
+  {
+    index.Rows.clear();
+    index.NumberOfIndexedRows = 0;
+    index.Complete = true;
+    index.IndexedMTime = this->GetMetricsTableMTime( metricsTableNode );
+    return;
+  }
+
+  // If rows were removed, then the indexed rows cannot be trusted
+  if ( rebuild || metricsTable->GetNumberOfRows() < index.NumberOfIndexedRows )
+  {
+    index.Rows.clear();
+    index.NumberOfIndexedRows = 0;
+    index.Complete = true;
+  }
+  else if ( ( index.IndexedMTime != this->GetMetricsTableMTime( metricsTableNode ) || metricsTable->GetNumberOfRows() != index.NumberOfIndexedRows )
+    && index.NumberOfIndexedRows > 0 )
+  {
+    index.Complete = false; // Most often only rows were added, the indexed rows are verified when they are looked up
+  }
+
+  for ( int i = index.NumberOfIndexedRows; i < metricsTable->GetNumberOfRows(); i++ )
+  {
+    index.Rows[ this->GetMetricsTableKey( metricsTable, i ) ] = i;
+  }
+  index.NumberOfIndexedRows = metricsTable->GetNumberOfRows();
+  index.IndexedMTime = this->GetMetricsTableMTime( metricsTableNode );
+}
+
+
+int vtkSlicerPerkEvaluatorLogic
+::FindMetricsTableRow( vtkMRMLTableNode* metricsTableNode, vtkMRMLMetricInstanceNode* miNode )
+{
+  if ( metricsTableNode == NULL || miNode == NULL || metricsTableNode->GetID() == NULL )
+  {
+    return -1;
+  }
+  std::string key = this->GetMetricsTableKey( miNode );
+  if ( key.empty() )
+  {
+    return -1;
+  }
+
+  std::map< std::string, MetricsTableIndex >::iterator indexItr = this->MetricsTableIndices.find( metricsTableNode->GetID() );
+  if ( indexItr == this->MetricsTableIndices.end() )
+  {
+    this->UpdateMetricsTableIndex( metricsTableNode, true );
+  }
+  else if ( indexItr->second.IndexedMTime != this->GetMetricsTableMTime( metricsTableNode )
+    || indexItr->second.NumberOfIndexedRows != metricsTableNode->GetTable()->GetNumberOfRows() ) // Rows may be added without modifying anything
+  {
+    this->UpdateMetricsTableIndex( metricsTableNode, false );
+  }
+  MetricsTableIndex& index = this->MetricsTableIndices[ metricsTableNode->GetID() ];
+
+  std::map< std::string, int >::iterator rowItr = index.Rows.find( key );
+  if ( rowItr != index.Rows.end() && ( index.Complete || this->GetMetricsTableKey( metricsTableNode->GetTable(), rowItr->second ).compare( key ) == 0 ) )
+  {
+    return rowItr->second;
+  }
+  if ( index.Complete )
+  {
+    return -1;
+  }
+
+  // The table was changed other than by adding rows, so index it from scratch
+  this->UpdateMetricsTableIndex( metricsTableNode, true );
+  rowItr = index.Rows.find( key );
+  if ( rowItr == index.Rows.end() )
+  {
+    return -1;
+  }
+  return rowItr->second;
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::SetupRealTimeProcessing( vtkMRMLPerkEvaluatorNode* peNode )
+{
+
+  // Check conditions
+  if ( peNode == NULL || this->GetMRMLScene()->GetNodeByID( peNode->GetID() ) == NULL )
+  {
+    return;
+  }
+
+  // Native metrics are updated directly, the Python metrics calculator only needs to see the script metrics
+  std::vector< std::string > scriptMetricInstanceIDs;
+  std::vector< std::string > nativeMetricInstanceIDs;
+  this->SplitMetricInstanceIDs( peNode, scriptMetricInstanceIDs, nativeMetricInstanceIDs );
+
+  std::vector< NativeRealTimeMetric >& nativeRealTimeMetrics = this->NativeRealTimeMetrics[ peNode->GetID() ];
+  nativeRealTimeMetrics.clear();
+  for ( unsigned int i = 0; i < nativeMetricInstanceIDs.size(); i++ )
+  {
+    vtkMRMLMetricInstanceNode* miNode = vtkMRMLMetricInstanceNode::SafeDownCast( this->GetMRMLScene()->GetNodeByID( nativeMetricInstanceIDs.at( i ) ) );
+    NativeRealTimeMetric nativeRealTimeMetric;
+    nativeRealTimeMetric.MetricInstanceID = nativeMetricInstanceIDs.at( i );
+    nativeRealTimeMetric.Metric.TakeReference( this->CreateNativeMetric( peNode, miNode ) );
+    if ( nativeRealTimeMetric.Metric != NULL )
+    {
+      nativeRealTimeMetrics.push_back( nativeRealTimeMetric );
+    }
+  }
+
+  this->RealTimeScriptMetricInstanceIDs[ peNode->GetID() ] = scriptMetricInstanceIDs;
+
+  // Use the python metrics calculator module (only for the script metric instances)
+  this->ExecutePythonString( "PythonMetricsCalculatorLogicRealTimeInstance = PythonMetricsCalculator.PythonMetricsCalculatorLogic()" );
+  this->ExecuteMetricsCalculatorString( peNode, scriptMetricInstanceIDs, QString( "PythonMetricsCalculatorLogicRealTimeInstance.SetupRealTimeMetricComputation( '%1' )" ).arg( peNode->GetID() ) );
+
+  // The instance was just replaced, so look up its update function again
+  this->ResolveRealTimeUpdateCallable();
+  this->ResetRealTimeUpdateLatency();
+  this->RealTimeQueue->ResetStatistics();
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::EnqueueRealTimeSample( vtkMRMLPerkEvaluatorNode* peNode, std::string transformName, double absTime )
+{
+  vtkPerkEvaluatorRealTimeQueue::Sample sample;
+  sample.PerkEvaluatorNodeID = peNode->GetID();
+  sample.TransformName = transformName;
+  sample.Time = absTime;
+
+  // With the blocking policy, the tracking waits for the evaluation stage to make room
+  while ( ! this->RealTimeQueue->Push( sample ) )
+  {
+    vtkPerkEvaluatorRealTimeQueue::Sample oldestSample;
+    if ( ! this->RealTimeQueue->Pop( oldestSample ) )
+    {
+      break;
+    }
+    this->EvaluateRealTimeSample( oldestSample );
+  }
+  this->FlushMetricsTableNotifications();
+}
+
+
+bool vtkSlicerPerkEvaluatorLogic
+::EvaluateRealTimeSample( const vtkPerkEvaluatorRealTimeQueue::Sample& sample )
+{
+  // The node may have been removed, or stopped processing, since the sample was queued
+  vtkMRMLPerkEvaluatorNode* peNode = vtkMRMLPerkEvaluatorNode::SafeDownCast( this->GetMRMLScene()->GetNodeByID( sample.PerkEvaluatorNodeID ) );
+  if ( peNode == NULL || ! peNode->GetRealTimeProcessing() )
+  {
+    return false;
+  }
+
+  // The Python metrics calculator does not report which values it changed, so compare the values if it matters
+  bool compareValues = peNode->GetMetricsTableNotificationPolicy() == vtkMRMLPerkEvaluatorNode::NotifyOnValueChange && this->PythonManager != NULL;
+  std::vector< std::string > previousValues;
+  if ( compareValues )
+  {
+    this->GetMetricsTableValues( peNode->GetMetricsTableNode(), previousValues );
+  }
+
+  double pythonStartTime = vtkTimerLog::GetUniversalTime();
+  this->UpdatePythonRealTimeMetrics( sample.TransformName, sample.Time );
+  double pythonWallTime = vtkTimerLog::GetUniversalTime() - pythonStartTime;
+  if ( ! this->RealTimeScriptMetricInstanceIDs[ sample.PerkEvaluatorNodeID ].empty() )
+  {
+    this->AddToMetricProfile( sample.PerkEvaluatorNodeID, SCRIPT_METRICS_PROFILE_ID, RealTimeEvaluation, pythonWallTime, 1, 1, 0 );
+  }
+
+  bool valuesChanged = this->UpdateNativeRealTimeMetrics( peNode, sample.TransformName, sample.Time );
+
+  // The profile is published at a fixed rate, not for every sample
+  double currentTime = vtkTimerLog::GetUniversalTime();
+  if ( currentTime - this->LastProfilingTableUpdateTimes[ sample.PerkEvaluatorNodeID ] >= PROFILING_TABLE_UPDATE_INTERVAL_SEC )
+  {
+    this->UpdateProfilingTable( peNode );
+  }
+
+  if ( compareValues && ! valuesChanged )
+  {
+    std::vector< std::string > currentValues;
+    this->GetMetricsTableValues( peNode->GetMetricsTableNode(), currentValues );
+    valuesChanged = ( currentValues != previousValues );
+  }
+
+  // The node decides when the observers of the table are notified
+  if ( peNode->MetricsTableUpdated( sample.Time, valuesChanged ) )
+  {
+    this->PendingMetricsTableNotifications.insert( sample.PerkEvaluatorNodeID );
+  }
+  return true;
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::GetMetricsTableValues( vtkMRMLTableNode* metricsTableNode, std::vector< std::string >& values )
+{
+  values.clear();
+  if ( metricsTableNode == NULL || metricsTableNode->GetTable()->GetColumnByName( "MetricValue" ) == NULL )
+  {
+    return;
+  }
+
+  for ( int i = 0; i < metricsTableNode->GetTable()->GetNumberOfRows(); i++ )
+  {
+    values.push_back( metricsTableNode->GetTable()->GetValueByName( i, "MetricValue" ).ToString() );
+  }
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::FlushMetricsTableNotifications()
+{
+  std::set< std::string >::iterator itr = this->PendingMetricsTableNotifications.begin();
+  while ( itr != this->PendingMetricsTableNotifications.end() )
+  {
+    vtkMRMLPerkEvaluatorNode* peNode = vtkMRMLPerkEvaluatorNode::SafeDownCast( this->GetMRMLScene()->GetNodeByID( *itr ) );
+    if ( peNode == NULL || ! peNode->FlushMetricsTableNotification() )
+    {
+      this->PendingMetricsTableNotifications.erase( itr++ );
+    }
+    else
+    {
+      itr++;
+    }
+  }
+}
+
+
+int vtkSlicerPerkEvaluatorLogic
+::ProcessRealTimeQueue( double timeBudget )
+{
+  if ( this->GetMRMLScene() == NULL )
+  {
+    return 0;
+  }
+
+  double startTime = vtkTimerLog::GetUniversalTime();
+  int numEvaluated = 0;
+
+  vtkPerkEvaluatorRealTimeQueue::Sample sample;
+  while ( vtkTimerLog::GetUniversalTime() - startTime < timeBudget && this->RealTimeQueue->Pop( sample ) )
+  {
+    if ( this->EvaluateRealTimeSample( sample ) )
+    {
+      numEvaluated++;
+    }
+  }
+
+  // Notifications held back by the Perk Evaluator nodes' policies go out once they are due (even if no samples arrived since)
+  this->FlushMetricsTableNotifications();
+
+  return numEvaluated;
+}
+
+
+vtkPerkEvaluatorRealTimeQueue* vtkSlicerPerkEvaluatorLogic
+::GetRealTimeQueue()
+{
+  return this->RealTimeQueue;
+}
+
+
+bool vtkSlicerPerkEvaluatorLogic
+::GetRealTimeProcessingActive()
+{
+  return ! this->RealTimeProcessingNodeIDs.empty();
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::SetRealTimeProcessingNodeActive( std::string peNodeID, bool active )
+{
+  bool wasActive = this->GetRealTimeProcessingActive();
+  if ( active )
+  {
+    this->RealTimeProcessingNodeIDs.insert( peNodeID );
+  }
+  else
+  {
+    this->RealTimeProcessingNodeIDs.erase( peNodeID );
+  }
+
+  if ( this->GetRealTimeProcessingActive() == wasActive )
+  {
+    return;
+  }
+  // Samples left over can no longer be evaluated
+  if ( ! this->GetRealTimeProcessingActive() )
+  {
+    this->RealTimeQueue->Clear();
+    this->FlushMetricsTableNotifications();
+  }
+  this->InvokeEvent( RealTimeProcessingChangedEvent );
+}
+
+
+bool vtkSlicerPerkEvaluatorLogic
+::ResolveRealTimeUpdateCallable()
+{
+  this->ReleaseRealTimeUpdateCallable();
+  if ( ! Py_IsInitialized() )
+  {
+    return false;
+  }
+
+  PyGILState_STATE gilState = PyGILState_Ensure();
+  PyObject* mainModule = PyImport_AddModule( "__main__" ); // Borrowed reference
+  PyObject* realTimeInstance = ( mainModule != NULL ) ? PyObject_GetAttrString( mainModule, "PythonMetricsCalculatorLogicRealTimeInstance" ) : NULL;
+  if ( realTimeInstance != NULL )
+  {
+    this->RealTimeUpdateCallable = PyObject_GetAttrString( realTimeInstance, "UpdateRealTimeMetrics" );
+    Py_DECREF( realTimeInstance );
+  }
+  if ( this->RealTimeUpdateCallable != NULL && ! PyCallable_Check( this->RealTimeUpdateCallable ) )
+  {
+    Py_DECREF( this->RealTimeUpdateCallable );
+    this->RealTimeUpdateCallable = NULL;
+  }
+  if ( this->RealTimeUpdateCallable == NULL )
+  {
+    PyErr_Clear();
+    vtkWarningMacro( "vtkSlicerPerkEvaluatorLogic::ResolveRealTimeUpdateCallable: Could not find the real-time update function. Falling back to executing strings." );
+  }
+  PyGILState_Release( gilState );
+
+  return this->RealTimeUpdateCallable != NULL;
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::ReleaseRealTimeUpdateCallable()
+{
+  // The interpreter may already be gone when the application exits
+  if ( ! Py_IsInitialized() )
+  {
+    this->RealTimeUpdateCallable = NULL;
+    this->RealTimeTransformNameObjects.clear();
+    return;
+  }
+
+  PyGILState_STATE gilState = PyGILState_Ensure();
+  Py_XDECREF( this->RealTimeUpdateCallable );
+  this->RealTimeUpdateCallable = NULL;
+  for ( std::map< std::string, PyObject* >::iterator itr = this->RealTimeTransformNameObjects.begin(); itr != this->RealTimeTransformNameObjects.end(); itr++ )
+  {
+    Py_XDECREF( itr->second );
+  }
+  this->RealTimeTransformNameObjects.clear();
+  PyGILState_Release( gilState );
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::UpdatePythonRealTimeMetrics( std::string transformName, double absTime )
+{
+  double startTime = vtkTimerLog::GetUniversalTime();
+
+  if ( ! this->UseRealTimeUpdateCallable || this->RealTimeUpdateCallable == NULL )
+  {
+    this->ExecutePythonString( QString( "PythonMetricsCalculatorLogicRealTimeInstance.UpdateRealTimeMetrics( '%1', %2 )" ).arg( transformName.c_str() ).arg( absTime ) );
+  }
+  else
+  {
+    PyGILState_STATE gilState = PyGILState_Ensure();
+
+    // The transform names are reused for every sample, so only build their Python strings once
+    std::map< std::string, PyObject* >::iterator nameItr = this->RealTimeTransformNameObjects.find( transformName );
+    if ( nameItr == this->RealTimeTransformNameObjects.end() )
+    {
+#if PY_MAJOR_VERSION >= 3
+      PyObject* transformNameObject = PyUnicode_FromString( transformName.c_str() );
+#else
+      PyObject* transformNameObject = PyString_FromString( transformName.c_str() );
+#endif
+      nameItr = this->RealTimeTransformNameObjects.insert( std::pair< std::string, PyObject* >( transformName, transformNameObject ) ).first;
+    }
+
+    PyObject* absTimeObject = PyFloat_FromDouble( absTime );
+    PyObject* result = PyObject_CallFunctionObjArgs( this->RealTimeUpdateCallable, nameItr->second, absTimeObject, NULL );
+    Py_XDECREF( absTimeObject );
+    if ( result == NULL )
+    {
+      PyErr_Print();
+    }
+    Py_XDECREF( result );
+
+    PyGILState_Release( gilState );
+  }
+
+  double latency = vtkTimerLog::GetUniversalTime() - startTime;
+  this->RealTimeUpdateCount++;
+  this->RealTimeUpdateTotalLatency += latency;
+  this->RealTimeUpdateMaximumLatency = std::max( this->RealTimeUpdateMaximumLatency, latency );
+}
+
+
+int vtkSlicerPerkEvaluatorLogic
+::GetRealTimeUpdateCount()
+{
+  return this->RealTimeUpdateCount;
+}
+
+
+double vtkSlicerPerkEvaluatorLogic
+::GetAverageRealTimeUpdateLatency()
+{
+  if ( this->RealTimeUpdateCount == 0 )
+  {
+    return 0;
+  }
+  return this->RealTimeUpdateTotalLatency / this->RealTimeUpdateCount;
+}
+
+
+double vtkSlicerPerkEvaluatorLogic
+::GetMaximumRealTimeUpdateLatency()
+{
+  return this->RealTimeUpdateMaximumLatency;
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::ResetRealTimeUpdateLatency()
+{
+  this->RealTimeUpdateCount = 0;
+  this->RealTimeUpdateTotalLatency = 0;
+  this->RealTimeUpdateMaximumLatency = 0;
+}
+
+
+bool vtkSlicerPerkEvaluatorLogic
+::UpdateNativeRealTimeMetrics( vtkMRMLPerkEvaluatorNode* peNode, std::string transformName, double absTime )
+{
+  std::map< std::string, std::vector< NativeRealTimeMetric > >::iterator peItr = this->NativeRealTimeMetrics.find( peNode->GetID() );
+  if ( peItr == this->NativeRealTimeMetrics.end() || peItr->second.empty() )
+  {
+    return false;
+  }
+
+  vtkMRMLLinearTransformNode* updatedTransformNode = vtkMRMLLinearTransformNode::SafeDownCast( this->GetMRMLScene()->GetFirstNode( transformName.c_str(), "vtkMRMLLinearTransformNode" ) );
+  if ( updatedTransformNode == NULL || peNode->GetTransformBufferNode() == NULL )
+  {
+    return false;
+  }
+
+  bool valuesChanged = false;
+
+  // The sample may have waited in the queue while newer records arrived, so the pose is taken from the records at its time
+  std::vector< std::string > recordedTransformNamesVector = peNode->GetTransformBufferNode()->GetAllRecordedTransformNames();
+  std::set< std::string > recordedTransformNames( recordedTransformNamesVector.begin(), recordedTransformNamesVector.end() );
+  vtkSmartPointer< vtkMatrix4x4 > matrix = vtkSmartPointer< vtkMatrix4x4 >::New();
+  for ( unsigned int i = 0; i < peItr->second.size(); i++ )
+  {
+    vtkMRMLMetricInstanceNode* miNode = vtkMRMLMetricInstanceNode::SafeDownCast( this->GetMRMLScene()->GetNodeByID( peItr->second.at( i ).MetricInstanceID ) );
+    vtkPerkEvaluatorMetric* metric = peItr->second.at( i ).Metric;
+    if ( miNode == NULL )
+    {
+      continue;
+    }
+
+    double startTime = vtkTimerLog::GetUniversalTime();
+    int numSamples = 0;
+    std::vector< std::string > transformRoles = metric->GetAcceptedTransformRoles();
+    for ( unsigned int j = 0; j < transformRoles.size(); j++ )
+    {
+      vtkMRMLLinearTransformNode* transformNode = vtkMRMLLinearTransformNode::SafeDownCast( miNode->GetRoleNode( transformRoles.at( j ), vtkMRMLMetricInstanceNode::TransformRole ) );
+      if ( transformNode == NULL || ! this->IsSelfOrDescendentTransformNode( updatedTransformNode, transformNode ) )
+      {
+        continue;
+      }
+      this->GetMatrixTransformToWorldAtTime( peNode, transformNode, absTime, recordedTransformNames, matrix );
+      double origin[ 4 ] = { 0, 0, 0, 1 };
+      double point[ 4 ] = { 0, 0, 0, 1 };
+      matrix->MultiplyPoint( origin, point );
+      metric->AddTimestamp( absTime, matrix, point, transformRoles.at( j ) );
+      numSamples++;
+    }
+
+    double metricValue = metric->GetMetric();
+    this->AddToMetricProfile( peNode->GetID(), miNode->GetID(), RealTimeEvaluation, vtkTimerLog::GetUniversalTime() - startTime, numSamples, 0, metric->GetActualMemorySize() );
+    valuesChanged = this->SetMetricsTableValue( peNode->GetMetricsTableNode(), miNode, metricValue ) || valuesChanged;
+  }
+
+  return valuesChanged;
+}
+
+
+// Native metrics in the scene -----------------------------------------------------------------
+
+void vtkSlicerPerkEvaluatorLogic
+::AddNativeMetricsToScene()
+{
+  if ( this->GetMRMLScene() == NULL )
+  {
+    return;
+  }
+
+  // Find the native metrics which already have a metric script node
+  std::set< std::string > nativeMetricNamesInScene;
+  vtkSmartPointer< vtkCollection > metricScriptNodes;
+  metricScriptNodes.TakeReference( this->GetMRMLScene()->GetNodesByClass( "vtkMRMLMetricScriptNode" ) );
+  for ( int i = 0; i < metricScriptNodes->GetNumberOfItems(); i++ )
+  {
+    vtkMRMLMetricScriptNode* msNode = vtkMRMLMetricScriptNode::SafeDownCast( metricScriptNodes->GetItemAsObject( i ) );
+    if ( msNode != NULL && msNode->IsNative() )
+    {
+      nativeMetricNamesInScene.insert( msNode->GetNativeMetricName() );
+    }
+  }
+
+  std::vector< std::string > nativeMetricNames = vtkPerkEvaluatorMetricFactory::GetInstance()->GetRegisteredMetricNames();
+  for ( unsigned int i = 0; i < nativeMetricNames.size(); i++ )
+  {
+    if ( nativeMetricNamesInScene.find( nativeMetricNames.at( i ) ) != nativeMetricNamesInScene.end() )
+    {
+      continue;
+    }
+
+    vtkSmartPointer< vtkPerkEvaluatorMetric > metric;
+    metric.TakeReference( vtkPerkEvaluatorMetricFactory::GetInstance()->CreateMetric( nativeMetricNames.at( i ) ) );
+    if ( metric == NULL )
+    {
+      continue;
+    }
+
+    // Adding the node takes care of creating the metric instances
+    vtkSmartPointer< vtkMRMLMetricScriptNode > msNode;
+    msNode.TakeReference( vtkMRMLMetricScriptNode::SafeDownCast( this->GetMRMLScene()->CreateNodeByClass( "vtkMRMLMetricScriptNode" ) ) );
+    msNode->SetName( metric->GetMetricName().c_str() );
+    msNode->SetNativeMetricName( nativeMetricNames.at( i ) );
+    msNode->SetPythonSourceCode( GetNativeMetricPythonStub( metric ) );
+    msNode->SetScene( this->GetMRMLScene() );
+    this->GetMRMLScene()->AddNode( msNode );
+  }
+}
+
+
+// This function is kind of akin to the old "role" system
+void vtkSlicerPerkEvaluatorLogic
+::SetMetricInstancesRolesToID( vtkMRMLPerkEvaluatorNode* peNode, std::string nodeID, std::string role, /*vtkMRMLMetricInstanceNode::RoleTypeEnum*/ int roleType )
+{
+  if ( peNode == NULL )
+  {
+    return;
+  }
+
+  // Iterate over all of the metric instance nodes used by the Perk Evaluator node
+  std::vector< std::string > metricInstanceIDs = peNode->GetMetricInstanceIDs();
+  for ( unsigned int i = 0; i < metricInstanceIDs.size(); i++ )
+  {
+    vtkMRMLMetricInstanceNode* metricInstanceNode = vtkMRMLMetricInstanceNode::SafeDownCast( this->GetMRMLScene()->GetNodeByID( metricInstanceIDs.at( i ) ) );
+    if ( metricInstanceNode == NULL )
+    {
+      continue;
+    }
+
+    std::vector< std::string > allRoles = this->GetAllRoles( metricInstanceNode->GetAssociatedMetricScriptID(), roleType );
+
+    for ( unsigned int j = 0; j < allRoles.size(); j++ )
+    {
+      if ( role.compare( allRoles.at( j ) ) == 0 )
+      {
+        metricInstanceNode->SetRoleID( nodeID, role, roleType ); // Only add if this role is accepted by the metric
+      }
+    }
+    
+  }
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::CreatePervasiveMetric( vtkMRMLMetricScriptNode* msNode, vtkMRMLLinearTransformNode* transformNode, std::string transformRole )
+{
+  // The assumption is that we have already established that the context of the metric script is "Pervasive"
+  if ( msNode == NULL || transformNode == NULL )
+  {
+    return;
+  }
+
+  // Check it doesn't already exist in the scene
+  bool oneTransformRole = this->GetAllRoles( msNode->GetID(), vtkMRMLMetricInstanceNode::TransformRole ).size() == 1;
+  if ( oneTransformRole )
+  {
+    this->UpdatePervasiveMetricIndex();
+    PervasiveMetricKey key( vtkSlicerPerkEvaluatorLogic::GetPervasiveMetricScriptKey( msNode ), transformNode->GetID() );
+    std::map< PervasiveMetricKey, std::set< std::string > >::iterator itr = this->PervasiveMetricInstanceIDs.find( key );
+    if ( itr != this->PervasiveMetricInstanceIDs.end() && ! itr->second.empty() )
+    {
+      return; // Get out the the function. The metric already exists, so there is nothing to do here.
+    }
+  }
+
+  // Create it and add it to the scene
+  vtkMRMLMetricInstanceNode* newMINode = this->CreateMetricInstance( msNode );
+  newMINode->SetRoleID( transformNode->GetID(), transformRole, vtkMRMLMetricInstanceNode::TransformRole );
+  this->IndexPervasiveMetricInstance( newMINode );
+}
+
+
+std::string vtkSlicerPerkEvaluatorLogic
+::GetPervasiveMetricScriptKey( vtkMRMLMetricScriptNode* msNode )
+{
+  return msNode->GetPythonSourceDigest() + "\n" + msNode->GetNativeMetricName();
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::UpdatePervasiveMetricIndex()
+{
+  if ( this->PervasiveMetricIndexValid )
+  {
+    return;
+  }
+
+  this->PervasiveMetricInstanceIDs.clear();
+  this->PervasiveMetricKeys.clear();
+  this->PervasiveMetricIndexValid = true;
+  if ( this->GetMRMLScene() == NULL )
+  {
+    return;
+  }
+
+  // Fill the roles of all the scripts with a single Python call (rather than one for each script)
+  this->GetAllMetricScriptDescriptors();
+
+  vtkSmartPointer< vtkCollection > metricInstanceNodes;
+  metricInstanceNodes.TakeReference( this->GetMRMLScene()->GetNodesByClass( "vtkMRMLMetricInstanceNode" ) );
+  for ( int i = 0; i < metricInstanceNodes->GetNumberOfItems(); i++ )
+  {
+    this->IndexPervasiveMetricInstance( vtkMRMLMetricInstanceNode::SafeDownCast( metricInstanceNodes->GetItemAsObject( i ) ) );
+  }
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::IndexPervasiveMetricInstance( vtkMRMLMetricInstanceNode* miNode )
+{
+  if ( ! this->PervasiveMetricIndexValid || miNode == NULL || miNode->GetID() == NULL )
+  {
+    return; // The instance will be indexed when the index is rebuilt
+  }
+
+  // Its script or roles may have changed since it was indexed
+  this->UnindexPervasiveMetricInstance( miNode->GetID() );
+
+  vtkMRMLMetricScriptNode* msNode = miNode->GetAssociatedMetricScriptNode();
+  if ( msNode == NULL )
+  {
+    return;
+  }
+  std::vector< std::string > transformRoles = this->GetAllRoles( msNode->GetID(), vtkMRMLMetricInstanceNode::TransformRole );
+  if ( transformRoles.size() != 1 )
+  {
+    return;
+  }
+  std::string transformNodeID = miNode->GetRoleID( transformRoles.at( 0 ), vtkMRMLMetricInstanceNode::TransformRole );
+  if ( transformNodeID.compare( "" ) == 0 )
+  {
+    return;
+  }
+
+  PervasiveMetricKey key( vtkSlicerPerkEvaluatorLogic::GetPervasiveMetricScriptKey( msNode ), transformNodeID );
+  this->PervasiveMetricInstanceIDs[ key ].insert( miNode->GetID() );
+  this->PervasiveMetricKeys[ miNode->GetID() ] = key;
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::UnindexPervasiveMetricInstance( std::string miNodeID )
+{
+  std::map< std::string, PervasiveMetricKey >::iterator keyItr = this->PervasiveMetricKeys.find( miNodeID );
+  if ( keyItr == this->PervasiveMetricKeys.end() )
+  {
+    return;
+  }
+
+  std::map< PervasiveMetricKey, std::set< std::string > >::iterator itr = this->PervasiveMetricInstanceIDs.find( keyItr->second );
+  if ( itr != this->PervasiveMetricInstanceIDs.end() )
+  {
+    itr->second.erase( miNodeID );
+    if ( itr->second.empty() )
+    {
+      this->PervasiveMetricInstanceIDs.erase( itr );
+    }
+  }
+  this->PervasiveMetricKeys.erase( keyItr );
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::UpdatePervasiveMetrics( vtkMRMLLinearTransformNode* transformNode )
+{
+  if ( transformNode == NULL )
+  {
+    return;
+  }
+
+  // Grab all metric scripts (with a single Python call for any whose properties are not already known)
+  std::vector< MetricScriptDescriptor > descriptors = this->GetAllMetricScriptDescriptors();
+
+  for ( unsigned int i = 0; i < descriptors.size(); i++ )
+  {
+    // Assume that we want to add any metric whose only transform role in "Any" and has no anatomy roles
+    vtkMRMLMetricScriptNode* msNode = vtkMRMLMetricScriptNode::SafeDownCast( this->GetMRMLScene()->GetNodeByID( descriptors.at( i ).MetricScriptID ) );
+    if ( msNode == NULL || ! descriptors.at( i ).Pervasive || descriptors.at( i ).TransformRoles.empty() )
+    {
+      continue;
+    }
+
+    // Create a metric instance node, with this transform serving the lone transform role
+    this->CreatePervasiveMetric( msNode, transformNode, descriptors.at( i ).TransformRoles.at( 0 ) );
+  }
+
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::UpdatePervasiveMetrics( vtkMRMLMetricScriptNode* msNode )
+{
+  if ( msNode == NULL || ! this->GetMetricPervasive( msNode->GetID() ) )
+  {
+    return;
+  }
+  std::vector< std::string > transformRoles = this->GetAllRoles( msNode->GetID(), vtkMRMLMetricInstanceNode::TransformRole );
+
+  // Grab all transforms
+  vtkSmartPointer< vtkCollection > transformNodes = vtkSmartPointer< vtkCollection >::New();
+  this->GetSceneVisibleTransformNodes( transformNodes );
+
+  for ( int i = 0; i < transformNodes->GetNumberOfItems(); i++ )
+  {
+    vtkMRMLLinearTransformNode* transformNode = vtkMRMLLinearTransformNode::SafeDownCast( transformNodes->GetItemAsObject( i ) );
+    // Create a metric instance node, with this transform serving the lone transform role
+    this->CreatePervasiveMetric( msNode, transformNode, transformRoles.at( 0 ) ); // Must have precisely one transform role if it is pervasive 
+  }
+
+}
+
+
+vtkMRMLMetricInstanceNode* vtkSlicerPerkEvaluatorLogic
+::CreateMetricInstance( vtkMRMLMetricScriptNode* msNode )
+{
+  if ( msNode == NULL )
+  {
+    return NULL; // Only work on non-pervasive metrics, the pervasive metrics need a different mechanism
+  }
+
+  // Create a metric instance node, with empty roles
+  vtkSmartPointer< vtkMRMLMetricInstanceNode > newMINode;
+  newMINode.TakeReference( vtkMRMLMetricInstanceNode::SafeDownCast( this->GetMRMLScene()->CreateNodeByClass( "vtkMRMLMetricInstanceNode" ) ) );
+  newMINode->SetScene( this->GetMRMLScene() );
+	this->GetMRMLScene()->AddNode( newMINode );
+  newMINode->SetName( msNode->GetName() );
+  newMINode->SetAssociatedMetricScriptID( msNode->GetID() );
+  // If it is shared, it will be added automatically to all the perk evaluator nodes
+  // If it is not shared, it must be added manually to perk evaluator nodes
+
+  return newMINode;
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::ShareMetricInstances( vtkMRMLPerkEvaluatorNode* peNode )
+{
+  if ( peNode == NULL )
+  {
+    return;
+  }
+
+  // Grab all metric instances
+  vtkCollection* metricInstanceNodes = this->GetMRMLScene()->GetNodesByClass( "vtkMRMLMetricInstanceNode" );
+
+  for ( int i = 0; i < metricInstanceNodes->GetNumberOfItems(); i++ )
+  {
+    // Add all metrics that are "shared"
+    vtkMRMLMetricInstanceNode* miNode = vtkMRMLMetricInstanceNode::SafeDownCast( metricInstanceNodes->GetItemAsObject( i ) );
+    if ( ! this->GetMetricShared( miNode->GetAssociatedMetricScriptID() ) )
+    {
+      continue;
+    }
+    peNode->AddMetricInstanceID( miNode->GetID() );
+  }
+
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::ShareMetricInstances( vtkMRMLMetricInstanceNode* miNode )
+{
+  if ( miNode == NULL || ! this->GetMetricShared( miNode->GetAssociatedMetricScriptID() ) )
+  {
+    return;
+  }
+
+  // Grab all Perk Evaluator nodes
+  vtkSmartPointer< vtkCollection > perkEvaluatorNodes = this->GetMRMLScene()->GetNodesByClass( "vtkMRMLPerkEvaluatorNode" );
+
+  for ( int i = 0; i < perkEvaluatorNodes->GetNumberOfItems(); i++ )
+  {
+    // Add the metric to all of the perk evaluator nodes (since it is shared)
+    vtkMRMLPerkEvaluatorNode* peNode = vtkMRMLPerkEvaluatorNode::SafeDownCast( perkEvaluatorNodes->GetItemAsObject( i ) );
+    peNode->AddMetricInstanceID( miNode->GetID() );
+  }
+
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::MergeMetricScripts( vtkMRMLMetricScriptNode* newMetricScriptNode )
+{
+  // If any metric script currently in the scene already has the same source code, then move all of its metric instances to the new node
+  if ( newMetricScriptNode == NULL || newMetricScriptNode->GetID() == NULL || this->GetMRMLScene() == NULL )
+  {
+    return;
+  }
+  if ( newMetricScriptNode->GetPythonSourceCode().compare( "" ) == 0 )
+  {
+    return; // Indexed once its source code is set
+  }
+
+  // Only the scripts with the same digest, native metric name and node name can be equal
+  this->UpdateMetricScriptMergeIndex();
+  std::string key = vtkSlicerPerkEvaluatorLogic::GetMetricScriptMergeKey( newMetricScriptNode );
+  std::vector< std::string > candidateIDs = this->MetricScriptMergeIndex[ key ];
+  std::vector< std::string > keptIDs( 1, newMetricScriptNode->GetID() );
+  bool indexValid = true;
+  for ( unsigned int i = 0; i < candidateIDs.size(); i++ )
+  {
+    vtkMRMLMetricScriptNode* currMetricScriptNode = vtkMRMLMetricScriptNode::SafeDownCast( this->GetMRMLScene()->GetNodeByID( candidateIDs.at( i ) ) );
+    if ( currMetricScriptNode == NULL || currMetricScriptNode == newMetricScriptNode )
+    {
+      continue;
+    }
+    if ( vtkSlicerPerkEvaluatorLogic::GetMetricScriptMergeKey( currMetricScriptNode ).compare( key ) != 0 )
+    {
+      indexValid = false; // E.g. renamed since it was indexed, so it may be missing under its new key
+      continue;
+    }
+
+    // The digests could collide, so the source code is compared before merging
+    if ( ! currMetricScriptNode->IsEqual( newMetricScriptNode ) )
+    {
+      keptIDs.push_back( candidateIDs.at( i ) );
+      continue;
+    }
+    this->ReplaceMetricScript( currMetricScriptNode, newMetricScriptNode );
+  }
+
+  this->MetricScriptMergeIndex[ key ] = keptIDs;
+  this->MetricScriptMergeIndexValid = this->MetricScriptMergeIndexValid && indexValid;
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::MergeAllMetricScripts()
+{
+  vtkSmartPointer< vtkCollection > metricScriptNodes;
+  metricScriptNodes.TakeReference( this->GetMRMLScene()->GetNodesByClass( "vtkMRMLMetricScriptNode" ) );
+
+  // The first of the equal scripts is kept, all later ones are merged into it
+  std::map< std::string, vtkMRMLMetricScriptNode* > keptMetricScriptNodes; // From digests, native metric names and node names
+  for ( int i = 0; i < metricScriptNodes->GetNumberOfItems(); i++ )
+  {
+    vtkMRMLMetricScriptNode* currMetricScriptNode = vtkMRMLMetricScriptNode::SafeDownCast( metricScriptNodes->GetItemAsObject( i ) );
+    if ( currMetricScriptNode == NULL || currMetricScriptNode->GetScene() == NULL || currMetricScriptNode->GetPythonSourceCode().compare( "" ) == 0 )
+    {
+      continue;
+    }
+
+    std::string key = vtkSlicerPerkEvaluatorLogic::GetMetricScriptMergeKey( currMetricScriptNode );
+    std::map< std::string, vtkMRMLMetricScriptNode* >::iterator itr = keptMetricScriptNodes.find( key );
+    if ( itr == keptMetricScriptNodes.end() )
+    {
+      keptMetricScriptNodes[ key ] = currMetricScriptNode;
+      continue;
+    }
+
+    // The digests could collide, so the source code is compared before merging
+    if ( itr->second->IsEqual( currMetricScriptNode ) )
+    {
+      this->ReplaceMetricScript( currMetricScriptNode, itr->second );
+    }
+  }
+
+  // All of the remaining scripts were gone over, so they are indexed from scratch
+  this->MetricScriptMergeIndexValid = false;
+  this->UpdateMetricScriptMergeIndex();
+}
+
+
+std::string vtkSlicerPerkEvaluatorLogic
+::GetMetricScriptMergeKey( vtkMRMLMetricScriptNode* msNode )
+{
+  return msNode->GetPythonSourceDigest() + "\n" + msNode->GetNativeMetricName() + "\n" + ( ( msNode->GetName() != NULL ) ? msNode->GetName() : "" );
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::UpdateMetricScriptMergeIndex()
+{
+  if ( this->MetricScriptMergeIndexValid )
+  {
+    return;
+  }
+
+  this->MetricScriptMergeIndex.clear();
+  this->MetricScriptMergeIndexValid = true;
+  if ( this->GetMRMLScene() == NULL )
+  {
+    return;
+  }
+
+  vtkSmartPointer< vtkCollection > metricScriptNodes;
+  metricScriptNodes.TakeReference( this->GetMRMLScene()->GetNodesByClass( "vtkMRMLMetricScriptNode" ) );
+  for ( int i = 0; i < metricScriptNodes->GetNumberOfItems(); i++ )
+  {
+    vtkMRMLMetricScriptNode* currMetricScriptNode = vtkMRMLMetricScriptNode::SafeDownCast( metricScriptNodes->GetItemAsObject( i ) );
+    if ( currMetricScriptNode == NULL || currMetricScriptNode->GetID() == NULL || currMetricScriptNode->GetPythonSourceCode().compare( "" ) == 0 )
+    {
+      continue;
+    }
+    this->MetricScriptMergeIndex[ vtkSlicerPerkEvaluatorLogic::GetMetricScriptMergeKey( currMetricScriptNode ) ].push_back( currMetricScriptNode->GetID() );
+  }
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::ReplaceMetricScript( vtkMRMLMetricScriptNode* duplicateMetricScriptNode, vtkMRMLMetricScriptNode* keptMetricScriptNode )
+{
+  if ( duplicateMetricScriptNode == NULL || keptMetricScriptNode == NULL || this->GetMRMLScene() == NULL )
+  {
+    return;
+  }
+
+  std::vector< vtkMRMLNode* > referencingNodes;
+  this->GetMRMLScene()->GetReferencingNodes( duplicateMetricScriptNode, referencingNodes );
+  for ( unsigned int i = 0; i < referencingNodes.size(); i++ )
+  {
+    referencingNodes.at( i )->UpdateReferenceID( duplicateMetricScriptNode->GetID(), keptMetricScriptNode->GetID() );
+  }
+
+  this->GetMRMLScene()->RemoveNode( duplicateMetricScriptNode );
+}
+
+
+bool vtkSlicerPerkEvaluatorLogic
+::IsSelfOrDescendentTransformNode( vtkMRMLLinearTransformNode* parent, vtkMRMLLinearTransformNode* child )
+{
+  while( child != NULL )
+  {
+    if ( strcmp( parent->GetID(), child->GetID() ) == 0 )
+    {
+      return true;
+    }
+    child = vtkMRMLLinearTransformNode::SafeDownCast( child->GetParentTransformNode() );
+  }
+
+  return false;
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::GetSelfAndParentRecordBuffer( vtkMRMLPerkEvaluatorNode* peNode, vtkMRMLLinearTransformNode* transformNode, vtkLogRecordBuffer* selfParentRecordBuffer )
+{
+  // Note: If only the times are needed, GetSelfAndParentTimes uses a cached index instead
+  selfParentRecordBuffer->Clear();
+
+  // Iterate through the parents and add to temporary transform buffer if in the selected transform buffer for analysis
+  if ( peNode == NULL || peNode->GetTransformBufferNode() == NULL )
+  {
+    return;
+  }
+
+  std::vector< std::string > recordedTransformNames = peNode->GetTransformBufferNode()->GetAllRecordedTransformNames();
+
+  vtkMRMLLinearTransformNode* parent = transformNode;
+  while( parent != NULL )
+  {
+
+    // Check if the parent's name matches one of the trajectory names
+    for ( unsigned int i = 0; i < recordedTransformNames.size(); i++ )
+    {
+      if ( recordedTransformNames.at( i ).compare( parent->GetName() ) == 0 )
+	    {
+        // Concatenate into the record buffer if so. Note: No need to deep copy - the times are really all we need
+        selfParentRecordBuffer->Concatenate( peNode->GetTransformBufferNode()->GetTransformRecordBuffer( recordedTransformNames.at( i ) ) );
+	    }
+    }
+
+	  parent = vtkMRMLLinearTransformNode::SafeDownCast( parent->GetParentTransformNode() );
+  }
+
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::GetSelfAndParentTimes( vtkMRMLPerkEvaluatorNode* peNode, vtkMRMLLinearTransformNode* transformNode, vtkDoubleArray* timesArray )
+{
+  const std::vector< double >& times = this->GetSelfAndParentTimeIndex( peNode, transformNode );
+
+  timesArray->SetNumberOfComponents( 1 );
+  timesArray->SetNumberOfTuples( times.size() );
+  for ( unsigned int i = 0; i < times.size(); i++ )
+  {
+    timesArray->SetValue( i, times.at( i ) );
+  }
+}
+
+
+vtkPerkEvaluatorTrajectory* vtkSlicerPerkEvaluatorLogic
+::GetTrajectory( vtkMRMLTransformBufferNode* transformBuffer, std::string transformName )
+{
+  if ( transformBuffer == NULL || transformBuffer->GetID() == NULL )
+  {
+    return NULL;
+  }
+
+  vtkSmartPointer< vtkPerkEvaluatorTrajectory >& trajectory = this->Trajectories[ std::string( transformBuffer->GetID() ) + "\n" + transformName ];
+  if ( trajectory == NULL )
+  {
+    trajectory = vtkSmartPointer< vtkPerkEvaluatorTrajectory >::New();
+  }
+
+  // Only the records added since the last call are converted
+  if ( ! trajectory->Update( transformBuffer, transformName ) )
+  {
+    this->Trajectories.erase( std::string( transformBuffer->GetID() ) + "\n" + transformName );
+    return NULL;
+  }
+  return trajectory;
+}
+
+
+const std::vector< double >& vtkSlicerPerkEvaluatorLogic
+::GetSelfAndParentTimeIndex( vtkMRMLPerkEvaluatorNode* peNode, vtkMRMLLinearTransformNode* transformNode )
+{
+  static const std::vector< double > NO_TIMES;
+  if ( peNode == NULL || peNode->GetTransformBufferNode() == NULL || transformNode == NULL || peNode->GetID() == NULL || transformNode->GetID() == NULL )
+  {
+    return NO_TIMES;
+  }
+  vtkMRMLTransformBufferNode* transformBuffer = peNode->GetTransformBufferNode();
+
+  // The index must be rebuilt if the hierarchy, the buffer, or the set of recorded transforms changed
+  std::vector< std::string > ancestorNames;
+  for ( vtkMRMLLinearTransformNode* parent = transformNode; parent != NULL; parent = vtkMRMLLinearTransformNode::SafeDownCast( parent->GetParentTransformNode() ) )
+  {
+    ancestorNames.push_back( parent->GetName() );
+  }
+  std::vector< std::string > recordedTransformNames = transformBuffer->GetAllRecordedTransformNames();
+
+  SelfAndParentTimeIndex& index = this->SelfAndParentTimeIndices[ std::string( peNode->GetID() ) + "\n" + transformNode->GetID() ];
+  if ( index.TransformBufferID.compare( transformBuffer->GetID() ) != 0 || index.AncestorNames != ancestorNames || index.RecordedTransformNames != recordedTransformNames )
+  {
+    index.TransformBufferID = transformBuffer->GetID();
+    index.AncestorNames = ancestorNames;
+    index.RecordedTransformNames = recordedTransformNames;
+    this->BuildSelfAndParentTimeIndex( transformBuffer, index );
+    return index.Times;
+  }
+
+  // Otherwise, usually records were only added since the index was last used
+  if ( ! this->AppendSelfAndParentTimeIndex( transformBuffer, index ) )
+  {
+    this->BuildSelfAndParentTimeIndex( transformBuffer, index );
+  }
+  return index.Times;
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::BuildSelfAndParentTimeIndex( vtkMRMLTransformBufferNode* transformBuffer, SelfAndParentTimeIndex& index )
+{
+  std::set< std::string > recordedTransformNames( index.RecordedTransformNames.begin(), index.RecordedTransformNames.end() );
+
+  index.ChainNames.clear();
+  std::vector< vtkLogRecordBuffer* > recordBuffers;
+  for ( unsigned int i = 0; i < index.AncestorNames.size(); i++ )
+  {
+    if ( recordedTransformNames.find( index.AncestorNames.at( i ) ) == recordedTransformNames.end() )
+    {
+      continue;
+    }
+    vtkLogRecordBuffer* recordBuffer = transformBuffer->GetTransformRecordBuffer( index.AncestorNames.at( i ) );
+    if ( recordBuffer != NULL )
+    {
+      index.ChainNames.push_back( index.AncestorNames.at( i ) );
+      recordBuffers.push_back( recordBuffer );
+    }
+  }
+
+  std::vector< int > beginRecords( recordBuffers.size(), 0 );
+  index.Times.clear();
+  MergeRecordTimes( recordBuffers, beginRecords, index.Times );
+
+  index.NumberOfIndexedRecords.resize( recordBuffers.size() );
+  index.LastIndexedTimes.resize( recordBuffers.size() );
+  for ( unsigned int i = 0; i < recordBuffers.size(); i++ )
+  {
+    index.NumberOfIndexedRecords.at( i ) = recordBuffers.at( i )->GetNumRecords();
+    index.LastIndexedTimes.at( i ) = ( recordBuffers.at( i )->GetNumRecords() > 0 ) ? recordBuffers.at( i )->GetRecord( recordBuffers.at( i )->GetNumRecords() - 1 )->GetTime() : 0.0;
+  }
+}
+
+
+bool vtkSlicerPerkEvaluatorLogic
+::AppendSelfAndParentTimeIndex( vtkMRMLTransformBufferNode* transformBuffer, SelfAndParentTimeIndex& index )
+{
+  std::vector< vtkLogRecordBuffer* > recordBuffers;
+  bool recordsAdded = false;
+  for ( unsigned int i = 0; i < index.ChainNames.size(); i++ )
+  {
+    vtkLogRecordBuffer* recordBuffer = transformBuffer->GetTransformRecordBuffer( index.ChainNames.at( i ) );
+    if ( recordBuffer == NULL || recordBuffer->GetNumRecords() < index.NumberOfIndexedRecords.at( i ) )
+    {
+      return false; // Records were removed
+    }
+    recordBuffers.push_back( recordBuffer );
+    if ( recordBuffer->GetNumRecords() == index.NumberOfIndexedRecords.at( i ) )
+    {
+      continue;
+    }
+    recordsAdded = true;
+
+    // The buffers are sorted, so a record added before the last indexed one shifts it, and one added earlier than the last indexed time belongs in the middle of the index
+    int numIndexedRecords = index.NumberOfIndexedRecords.at( i );
+    if ( numIndexedRecords > 0 && recordBuffer->GetRecord( numIndexedRecords - 1 )->GetTime() != index.LastIndexedTimes.at( i ) )
+    {
+      return false;
+    }
+    if ( ! index.Times.empty() && recordBuffer->GetRecord( numIndexedRecords )->GetTime() < index.Times.back() )
+    {
+      return false;
+    }
+  }
+  if ( ! recordsAdded )
+  {
+    return true;
+  }
+
+  MergeRecordTimes( recordBuffers, index.NumberOfIndexedRecords, index.Times );
+  for ( unsigned int i = 0; i < recordBuffers.size(); i++ )
+  {
+    index.NumberOfIndexedRecords.at( i ) = recordBuffers.at( i )->GetNumRecords();
+    index.LastIndexedTimes.at( i ) = ( recordBuffers.at( i )->GetNumRecords() > 0 ) ? recordBuffers.at( i )->GetRecord( recordBuffers.at( i )->GetNumRecords() - 1 )->GetTime() : 0.0;
+  }
+  return true;
+}
+
+
+// K-way merge of the times of the (individually sorted) record buffers, starting at the given record of each buffer
+void vtkSlicerPerkEvaluatorLogic
+::MergeRecordTimes( std::vector< vtkLogRecordBuffer* >& recordBuffers, std::vector< int >& beginRecords, std::vector< double >& times )
+{
+  typedef std::pair< double, std::pair< int, int > > MergeEntryType; // Time, then buffer and record index
+  std::priority_queue< MergeEntryType, std::vector< MergeEntryType >, std::greater< MergeEntryType > > mergeQueue;
+
+  int numTimes = 0;
+  for ( unsigned int i = 0; i < recordBuffers.size(); i++ )
+  {
+    if ( beginRecords.at( i ) < recordBuffers.at( i )->GetNumRecords() )
+    {
+      mergeQueue.push( MergeEntryType( recordBuffers.at( i )->GetRecord( beginRecords.at( i ) )->GetTime(), std::pair< int, int >( i, beginRecords.at( i ) ) ) );
+      numTimes += recordBuffers.at( i )->GetNumRecords() - beginRecords.at( i );
+    }
+  }
+  times.reserve( times.size() + numTimes );
+
+  while ( ! mergeQueue.empty() )
+  {
+    MergeEntryType entry = mergeQueue.top();
+    mergeQueue.pop();
+    times.push_back( entry.first );
+
+    int bufferIndex = entry.second.first;
+    int nextRecord = entry.second.second + 1;
+    if ( nextRecord < recordBuffers.at( bufferIndex )->GetNumRecords() )
+    {
+      mergeQueue.push( MergeEntryType( recordBuffers.at( bufferIndex )->GetRecord( nextRecord )->GetTime(), std::pair< int, int >( bufferIndex, nextRecord ) ) );
+    }
+  }
+}
+
+
+// Metric script descriptors ---------------------------------------------------------------
+
+vtkSlicerPerkEvaluatorLogic::MetricScriptDescriptor* vtkSlicerPerkEvaluatorLogic
+::GetMetricScriptDescriptor( std::string msNodeID )
+{
+  vtkMRMLMetricScriptNode* msNode = vtkMRMLMetricScriptNode::SafeDownCast( this->GetMRMLScene()->GetNodeByID( msNodeID ) );
+  if ( msNode == NULL )
+  {
+    return NULL;
+  }
+
+  // Use the cached descriptor if it was filled from the current source code
+  std::map< std::string, MetricScriptDescriptor >::iterator itr = this->MetricScriptDescriptorCache.find( msNodeID );
+  if ( itr != this->MetricScriptDescriptorCache.end() && itr->second.SourceDigest.compare( msNode->GetPythonSourceDigest() ) == 0 )
+  {
+    return &itr->second;
+  }
+
+  MetricScriptDescriptor descriptor;
+  if ( ! this->FillMetricScriptDescriptor( msNode, descriptor ) )
+  {
+    this->MetricScriptDescriptorCache.erase( msNodeID );
+    return NULL;
+  }
+
+  this->MetricScriptDescriptorCache[ msNodeID ] = descriptor;
+  return &this->MetricScriptDescriptorCache[ msNodeID ];
+}
+
+
+bool vtkSlicerPerkEvaluatorLogic
+::FillMetricScriptDescriptor( vtkMRMLMetricScriptNode* msNode, MetricScriptDescriptor& descriptor )
+{
+  if ( msNode == NULL )
+  {
+    return false;
+  }
+
+  // Native metrics can describe themselves
+  if ( msNode->IsNative() )
+  {
+    return this->FillNativeMetricScriptDescriptor( msNode, descriptor );
+  }
+
+  // Grab everything about the script in one go, rather than one Python call per property
+  this->ExecutePythonString( QString( "PythonMetricScriptDescriptor = %1" ).arg( this->GetMetricScriptDescriptorQuery( QString( "'%1'" ).arg( msNode->GetID() ) ) ) );
+  QVariant result = this->GetPythonVariable( "PythonMetricScriptDescriptor" );
+  this->ExecutePythonString( "del PythonMetricScriptDescriptor" );
+
+  return this->ParseMetricScriptDescriptor( msNode, result, descriptor );
+}
+
+
+bool vtkSlicerPerkEvaluatorLogic
+::FillNativeMetricScriptDescriptor( vtkMRMLMetricScriptNode* msNode, MetricScriptDescriptor& descriptor )
+{
+  vtkSmartPointer< vtkPerkEvaluatorMetric > metric;
+  metric.TakeReference( vtkPerkEvaluatorMetricFactory::GetInstance()->CreateMetric( msNode->GetNativeMetricName() ) );
+  if ( metric == NULL )
+  {
+    return false;
+  }
+
+  descriptor.MetricScriptID = msNode->GetID();
+  descriptor.SourceDigest = msNode->GetPythonSourceDigest();
+  descriptor.Name = metric->GetMetricName();
+  descriptor.Unit = metric->GetMetricUnit();
+  descriptor.Shared = metric->GetMetricShared();
+  descriptor.Pervasive = metric->GetMetricPervasive();
+  descriptor.TransformRoles = metric->GetAcceptedTransformRoles();
+  descriptor.AnatomyRoleClassNames = metric->GetRequiredAnatomyRoles();
+  descriptor.AnatomyRoles.clear();
+  for ( std::map< std::string, std::string >::iterator itr = descriptor.AnatomyRoleClassNames.begin(); itr != descriptor.AnatomyRoleClassNames.end(); itr++ )
+  {
+    descriptor.AnatomyRoles.push_back( itr->first );
+  }
+
+  return true;
+}
+
+
+QString vtkSlicerPerkEvaluatorLogic
+::GetMetricScriptDescriptorQuery( QString msNodeIDExpression )
+{
+  // A Python list expression with all of the properties of the metric script whose ID is given by the expression
+  return QString( "[ %1.GetMetricName( %2 ), %1.GetMetricUnit( %2 ), %1.GetMetricShared( %2 ), %1.GetMetricPervasive( %2 ), "
+    "%1.GetAllRoles( %2, %3 ), %1.GetAllRoles( %2, %4 ), [ %1.GetAnatomyRoleClassName( %2, role ) for role in %1.GetAllRoles( %2, %4 ) ] ]" )
+    .arg( "PythonMetricsCalculator.PythonMetricsCalculatorLogic" ).arg( msNodeIDExpression ).arg( vtkMRMLMetricInstanceNode::TransformRole ).arg( vtkMRMLMetricInstanceNode::AnatomyRole );
+}
+
+
+bool vtkSlicerPerkEvaluatorLogic
+::ParseMetricScriptDescriptor( vtkMRMLMetricScriptNode* msNode, QVariant queryResult, MetricScriptDescriptor& descriptor )
+{
+  QVariantList result = queryResult.toList();
+  if ( msNode == NULL || result.size() != 7 )
+  {
+    return false;
+  }
+
+  descriptor.MetricScriptID = msNode->GetID();
+  descriptor.SourceDigest = msNode->GetPythonSourceDigest();
+  descriptor.Name = result.at( 0 ).toString().toStdString();
+  descriptor.Unit = result.at( 1 ).toString().toStdString();
+  descriptor.Shared = result.at( 2 ).toBool();
+  descriptor.Pervasive = result.at( 3 ).toBool();
+  descriptor.TransformRoles = QVariantToVector( result.at( 4 ) );
+  descriptor.AnatomyRoles = QVariantToVector( result.at( 5 ) );
+
+  std::vector< std::string > anatomyClassNames = QVariantToVector( result.at( 6 ) );
+  descriptor.AnatomyRoleClassNames.clear();
+  for ( unsigned int i = 0; i < descriptor.AnatomyRoles.size() && i < anatomyClassNames.size(); i++ )
+  {
+    descriptor.AnatomyRoleClassNames[ descriptor.AnatomyRoles.at( i ) ] = anatomyClassNames.at( i );
+  }
+
+  // An empty name means the Python side does not know about the script (yet), so do not cache it
+  return descriptor.Name.compare( "" ) != 0;
 }
 
 
 void vtkSlicerPerkEvaluatorLogic
-::ShareMetricInstances( vtkMRMLPerkEvaluatorNode* peNode )
+::UpdateMetricScriptDescriptors()
 {
-  if ( peNode == NULL )
+  if ( this->GetMRMLScene() == NULL )
   {
     return;
   }
 
-  // Grab all metric instances
-  vtkCollection* metricInstanceNodes = this->GetMRMLScene()->GetNodesByClass( "vtkMRMLMetricInstanceNode" );
+  // Find all of the metric scripts which are not already cached
+  std::vector< vtkMRMLMetricScriptNode* > staleMetricScriptNodes;
+  QStringList staleMetricScriptIDs;
 
-  for ( int i = 0; i < metricInstanceNodes->GetNumberOfItems(); i++ )
+  vtkSmartPointer< vtkCollection > metricScriptNodes;
+  metricScriptNodes.TakeReference( this->GetMRMLScene()->GetNodesByClass( "vtkMRMLMetricScriptNode" ) );
+  for ( int i = 0; i < metricScriptNodes->GetNumberOfItems(); i++ )
   {
-    // Add all metrics that are "shared"
-    vtkMRMLMetricInstanceNode* miNode = vtkMRMLMetricInstanceNode::SafeDownCast( metricInstanceNodes->GetItemAsObject( i ) );
-    if ( ! this->GetMetricShared( miNode->GetAssociatedMetricScriptID() ) )
+    vtkMRMLMetricScriptNode* msNode = vtkMRMLMetricScriptNode::SafeDownCast( metricScriptNodes->GetItemAsObject( i ) );
+    if ( msNode == NULL )
     {
       continue;
     }
-    peNode->AddMetricInstanceID( miNode->GetID() );
+    std::map< std::string, MetricScriptDescriptor >::iterator itr = this->MetricScriptDescriptorCache.find( msNode->GetID() );
+    if ( itr != this->MetricScriptDescriptorCache.end() && itr->second.SourceDigest.compare( msNode->GetPythonSourceDigest() ) == 0 )
+    {
+      continue;
+    }
+    if ( msNode->IsNative() )
+    {
+      this->GetMetricScriptDescriptor( msNode->GetID() ); // No Python call required
+      continue;
+    }
+    staleMetricScriptNodes.push_back( msNode );
+    staleMetricScriptIDs << QString( "'%1'" ).arg( msNode->GetID() );
   }
 
-}
-
-
-void vtkSlicerPerkEvaluatorLogic
-::ShareMetricInstances( vtkMRMLMetricInstanceNode* miNode )
-{
-  if ( miNode == NULL || ! this->GetMetricShared( miNode->GetAssociatedMetricScriptID() ) )
+  if ( staleMetricScriptNodes.empty() )
   {
     return;
   }
 
-  // Grab all Perk Evaluator nodes
-  vtkSmartPointer< vtkCollection > perkEvaluatorNodes = this->GetMRMLScene()->GetNodesByClass( "vtkMRMLPerkEvaluatorNode" );
+  // Query all of them with a single Python call
+  QString queryString = QString( "PythonMetricScriptDescriptors = [ %1 for PythonMetricScriptID in [ %2 ] ]" )
+    .arg( this->GetMetricScriptDescriptorQuery( "PythonMetricScriptID" ) ).arg( staleMetricScriptIDs.join( ", " ) );
+  this->ExecutePythonString( queryString );
+  QVariantList results = this->GetPythonVariable( "PythonMetricScriptDescriptors" ).toList();
+  this->ExecutePythonString( "del PythonMetricScriptDescriptors" );
 
-  for ( int i = 0; i < perkEvaluatorNodes->GetNumberOfItems(); i++ )
+  for ( int i = 0; i < int( staleMetricScriptNodes.size() ) && i < results.size(); i++ )
   {
-    // Add the metric to all of the perk evaluator nodes (since it is shared)
-    vtkMRMLPerkEvaluatorNode* peNode = vtkMRMLPerkEvaluatorNode::SafeDownCast( perkEvaluatorNodes->GetItemAsObject( i ) );
-    peNode->AddMetricInstanceID( miNode->GetID() );
+    MetricScriptDescriptor descriptor;
+    if ( this->ParseMetricScriptDescriptor( staleMetricScriptNodes.at( i ), results.at( i ), descriptor ) )
+    {
+      this->MetricScriptDescriptorCache[ descriptor.MetricScriptID ] = descriptor;
+    }
+    else
+    {
+      this->MetricScriptDescriptorCache.erase( staleMetricScriptNodes.at( i )->GetID() );
+    }
   }
-
 }
 
 
-void vtkSlicerPerkEvaluatorLogic
-::MergeMetricScripts( vtkMRMLMetricScriptNode* newMetricScriptNode )
+std::vector< vtkSlicerPerkEvaluatorLogic::MetricScriptDescriptor > vtkSlicerPerkEvaluatorLogic
+::GetAllMetricScriptDescriptors()
 {
-  // If any metric script currently in the scene already has the same source code, then move all of its metric instances to the new node
-  if ( newMetricScriptNode == NULL )
+  std::vector< MetricScriptDescriptor > descriptors;
+  if ( this->GetMRMLScene() == NULL )
   {
-    return;
+    return descriptors;
   }
 
-  vtkCollection* metricScriptNodes = this->GetMRMLScene()->GetNodesByClass( "vtkMRMLMetricScriptNode" );
+  this->UpdateMetricScriptDescriptors(); // At most one Python call for the whole scene
 
+  vtkSmartPointer< vtkCollection > metricScriptNodes;
+  metricScriptNodes.TakeReference( this->GetMRMLScene()->GetNodesByClass( "vtkMRMLMetricScriptNode" ) );
   for ( int i = 0; i < metricScriptNodes->GetNumberOfItems(); i++ )
   {
-    // Assume that we want to add any metric whose only transform role in "Any" and has no anatomy roles
-    vtkMRMLMetricScriptNode* currMetricScriptNode = vtkMRMLMetricScriptNode::SafeDownCast( metricScriptNodes->GetItemAsObject( i ) );
-    bool sameNode = strcmp( currMetricScriptNode->GetID(), newMetricScriptNode->GetID() ) == 0;
-    bool equalSource = currMetricScriptNode->IsEqual( newMetricScriptNode );
-    bool equalName = strcmp( currMetricScriptNode->GetName(), newMetricScriptNode->GetName() ) == 0;
-    bool emptySource = currMetricScriptNode->GetPythonSourceCode().compare( "" ) == 0;
-    if ( sameNode || ! equalSource || ! equalName || emptySource )
+    vtkMRMLMetricScriptNode* msNode = vtkMRMLMetricScriptNode::SafeDownCast( metricScriptNodes->GetItemAsObject( i ) );
+    if ( msNode == NULL )
     {
       continue;
     }
-
-    std::vector< vtkMRMLNode* > referencingNodes;
-    this->GetMRMLScene()->GetReferencingNodes( currMetricScriptNode, referencingNodes );
-    for ( int j = 0; j < referencingNodes.size(); j++ )
+    std::map< std::string, MetricScriptDescriptor >::iterator itr = this->MetricScriptDescriptorCache.find( msNode->GetID() );
+    if ( itr != this->MetricScriptDescriptorCache.end() )
     {
-      referencingNodes.at( j )->UpdateReferenceID( currMetricScriptNode->GetID(), newMetricScriptNode->GetID() );
+      descriptors.push_back( itr->second );
     }
-
-    this->GetMRMLScene()->RemoveNode( currMetricScriptNode );    
   }
 
+  return descriptors;
 }
 
 
 void vtkSlicerPerkEvaluatorLogic
-::MergeAllMetricScripts()
+::InvalidateMetricScriptDescriptor( std::string msNodeID )
 {
-  vtkCollection* metricScriptNodes = this->GetMRMLScene()->GetNodesByClass( "vtkMRMLMetricScriptNode" );
+  this->MetricScriptDescriptorCache.erase( msNodeID );
+}
 
-  for ( int i = 0; i < metricScriptNodes->GetNumberOfItems(); i++ )
-  {
-    vtkMRMLMetricScriptNode* currMetricScriptNode = vtkMRMLMetricScriptNode::SafeDownCast( metricScriptNodes->GetItemAsObject( i ) );
-    if ( currMetricScriptNode->GetScene() != NULL ) // Don't look at metrics that have already been removed from the scene
-    {
-      this->MergeMetricScripts( currMetricScriptNode );
-    }
-  }
 
+void vtkSlicerPerkEvaluatorLogic
+::InvalidateAllMetricScriptDescriptors()
+{
+  this->MetricScriptDescriptorCache.clear();
 }
 
 
-bool vtkSlicerPerkEvaluatorLogic
-::IsSelfOrDescendentTransformNode( vtkMRMLLinearTransformNode* parent, vtkMRMLLinearTransformNode* child )
+void vtkSlicerPerkEvaluatorLogic
+::ExecutePythonString( QString code )
 {
-  while( child != NULL )
+  if ( this->PythonManager == NULL )
   {
-    if ( strcmp( parent->GetID(), child->GetID() ) == 0 )
-    {
-      return true;
-    }
-    child = vtkMRMLLinearTransformNode::SafeDownCast( child->GetParentTransformNode() );
+    return;
   }
-
-  return false;
+  this->PythonManager->executeString( code );
 }
 
 
 void vtkSlicerPerkEvaluatorLogic
-::GetSelfAndParentRecordBuffer( vtkMRMLPerkEvaluatorNode* peNode, vtkMRMLLinearTransformNode* transformNode, vtkLogRecordBuffer* selfParentRecordBuffer )
+::ExecuteMetricsCalculatorString( vtkMRMLPerkEvaluatorNode* peNode, std::vector< std::string > metricInstanceIDs, QString code )
 {
-  // TODO: We only care about this for times. Is there a more efficient way to do this?
-  selfParentRecordBuffer->Clear();
-
-  // Iterate through the parents and add to temporary transform buffer if in the selected transform buffer for analysis
-  if ( peNode == NULL || peNode->GetTransformBufferNode() == NULL )
+  if ( this->PythonManager == NULL || peNode == NULL )
   {
     return;
   }
 
-  std::vector< std::string > recordedTransformNames = peNode->GetTransformBufferNode()->GetAllRecordedTransformNames();
-
-  vtkMRMLLinearTransformNode* parent = transformNode;
-  while( parent != NULL )
+  // The native metric instances are left out (their stubs would only give zeros), and put back in the same order afterwards
+  // The node is reported modified once, after its references are restored
+  std::vector< std::string > allMetricInstanceIDs = peNode->GetMetricInstanceIDs();
+  bool restrictReferences = ( metricInstanceIDs != allMetricInstanceIDs );
+  int wasModifying = peNode->StartModify();
+  if ( restrictReferences )
   {
+    peNode->SetMetricInstanceIDs( metricInstanceIDs );
+  }
 
-    // Check if the parent's name matches one of the trajectory names
-    for ( int i = 0; i < recordedTransformNames.size(); i++ )
-    {
-      if ( recordedTransformNames.at( i ).compare( parent->GetName() ) == 0 )
-	    {
-        // Concatenate into the record buffer if so. Note: No need to deep copy - the times are really all we need
-        selfParentRecordBuffer->Concatenate( peNode->GetTransformBufferNode()->GetTransformRecordBuffer( recordedTransformNames.at( i ) ) );
-	    }
-    }
+  this->ExecutePythonString( code );
 
-	  parent = vtkMRMLLinearTransformNode::SafeDownCast( parent->GetParentTransformNode() );
+  if ( restrictReferences )
+  {
+    peNode->SetMetricInstanceIDs( allMetricInstanceIDs );
   }
-
+  peNode->EndModify( wasModifying );
 }
 
 
-void vtkSlicerPerkEvaluatorLogic
-::GetSelfAndParentTimes( vtkMRMLPerkEvaluatorNode* peNode, vtkMRMLLinearTransformNode* transformNode, vtkDoubleArray* timesArray )
+QVariant vtkSlicerPerkEvaluatorLogic
+::GetPythonVariable( QString name )
 {
-  // TODO: We only care about this for times. Is there a more efficient way to do this?
-  vtkSmartPointer< vtkLogRecordBuffer > selfParentRecordBuffer = vtkSmartPointer< vtkLogRecordBuffer >::New();
-  this->GetSelfAndParentRecordBuffer( peNode, transformNode, selfParentRecordBuffer );
-
-  // Now, just grab the times
-  timesArray->SetNumberOfComponents( 1 );
-  timesArray->SetNumberOfTuples( selfParentRecordBuffer->GetNumRecords() );
-  
-  for ( int i = 0; i < selfParentRecordBuffer->GetNumRecords(); i++ )
+  if ( this->PythonManager == NULL )
   {
-    timesArray->SetValue( i, selfParentRecordBuffer->GetRecord( i )->GetTime() );
+    return QVariant();
   }
+  return this->PythonManager->getVariable( name );
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::RefreshMetricModules()
+{
+  // The Python side reloads all of the scripts, so anything cached from it may be stale
+  this->ExecutePythonString( QString( "PythonMetricsCalculator.PythonMetricsCalculatorLogic.RefreshMetricModules()" ) );
+  this->InvalidateAllMetricScriptDescriptors();
 }
 
 
 std::string vtkSlicerPerkEvaluatorLogic
 ::GetMetricName( std::string msNodeID )
 {
-  if ( this->GetMRMLScene()->GetNodeByID( msNodeID ) == NULL )
+  MetricScriptDescriptor* descriptor = this->GetMetricScriptDescriptor( msNodeID );
+  if ( descriptor == NULL )
   {
     return "";
   }
 
-  // Use the python metrics calculator module
-  this->PythonManager->executeString( QString( "PythonMetricScriptMetricName = PythonMetricsCalculator.PythonMetricsCalculatorLogic.GetMetricName( '%1' )" ).arg( msNodeID.c_str() ) );
-  QVariant result = this->PythonManager->getVariable( "PythonMetricScriptMetricName" );
-  
-  return result.toString().toStdString();
+  return descriptor->Name;
 }
 
 
 std::string vtkSlicerPerkEvaluatorLogic
 ::GetMetricUnit( std::string msNodeID )
 {
-  if ( this->GetMRMLScene()->GetNodeByID( msNodeID ) == NULL )
+  MetricScriptDescriptor* descriptor = this->GetMetricScriptDescriptor( msNodeID );
+  if ( descriptor == NULL )
   {
     return "";
   }
 
-  // Use the python metrics calculator module
-  this->PythonManager->executeString( QString( "PythonMetricScriptMetricUnit = PythonMetricsCalculator.PythonMetricsCalculatorLogic.GetMetricUnit( '%1' )" ).arg( msNodeID.c_str() ) );
-  QVariant result = this->PythonManager->getVariable( "PythonMetricScriptMetricUnit" );
-  
-  return result.toString().toStdString();
+  return descriptor->Unit;
 }
 
 
 bool vtkSlicerPerkEvaluatorLogic
 ::GetMetricShared( std::string msNodeID )
 {
-  if ( this->GetMRMLScene()->GetNodeByID( msNodeID ) == NULL )
+  MetricScriptDescriptor* descriptor = this->GetMetricScriptDescriptor( msNodeID );
+  if ( descriptor == NULL )
   {
-    return "";
+    return false;
   }
 
-  // Use the python metrics calculator module
-  this->PythonManager->executeString( QString( "PythonMetricScriptMetricShared = PythonMetricsCalculator.PythonMetricsCalculatorLogic.GetMetricShared( '%1' )" ).arg( msNodeID.c_str() ) );
-  QVariant result = this->PythonManager->getVariable( "PythonMetricScriptMetricShared" );
-  
-  return result.toBool();
+  return descriptor->Shared;
 }
 
 
 bool vtkSlicerPerkEvaluatorLogic
 ::GetMetricPervasive( std::string msNodeID )
 {
-  if ( this->GetMRMLScene()->GetNodeByID( msNodeID ) == NULL )
+  MetricScriptDescriptor* descriptor = this->GetMetricScriptDescriptor( msNodeID );
+  if ( descriptor == NULL )
   {
-    return "";
+    return false;
   }
 
-  // Use the python metrics calculator module
-  this->PythonManager->executeString( QString( "PythonMetricScriptMetricPervasive = PythonMetricsCalculator.PythonMetricsCalculatorLogic.GetMetricPervasive( '%1' )" ).arg( msNodeID.c_str() ) );
-  QVariant result = this->PythonManager->getVariable( "PythonMetricScriptMetricPervasive" );
-  
-  return result.toBool();
+  return descriptor->Pervasive;
 }
 
 
 std::vector< std::string > vtkSlicerPerkEvaluatorLogic
 ::GetAllRoles( std::string msNodeID, /*vtkMRMLMetricInstanceNode::RoleTypeEnum*/ int roleType )
 {
-  if ( this->GetMRMLScene()->GetNodeByID( msNodeID ) == NULL )
+  MetricScriptDescriptor* descriptor = this->GetMetricScriptDescriptor( msNodeID );
+  if ( descriptor == NULL )
   {
     return std::vector< std::string >();
   }
 
-  // Use the python metrics calculator module
-  this->PythonManager->executeString( QString( "PythonMetricScriptRoles = PythonMetricsCalculator.PythonMetricsCalculatorLogic.GetAllRoles( '%1', %2 )" ).arg( msNodeID.c_str() ).arg( roleType ) );
-  QVariant result = this->PythonManager->getVariable( "PythonMetricScriptRoles" );
+  if ( roleType == vtkMRMLMetricInstanceNode::TransformRole )
+  {
+    return descriptor->TransformRoles;
+  }
+  if ( roleType == vtkMRMLMetricInstanceNode::AnatomyRole )
+  {
+    return descriptor->AnatomyRoles;
+  }
 
-  return QVariantToVector( result );
+  return std::vector< std::string >();
 }
 
 
 std::string vtkSlicerPerkEvaluatorLogic
 ::GetAnatomyRoleClassName( std::string msNodeID, std::string role )
 {
-  if ( this->GetMRMLScene()->GetNodeByID( msNodeID ) == NULL )
+  MetricScriptDescriptor* descriptor = this->GetMetricScriptDescriptor( msNodeID );
+  if ( descriptor == NULL )
   {
     return "";
   }
 
-  // Use the python metrics calculator module
-  this->PythonManager->executeString( QString( "PythonMetricScriptAnatomyClassName = PythonMetricsCalculator.PythonMetricsCalculatorLogic.GetAnatomyRoleClassName( '%1', '%2' )" ).arg( msNodeID.c_str() ).arg( role.c_str() ) );
-  QVariant result = this->PythonManager->getVariable( "PythonMetricScriptAnatomyClassName" );
-  
-  return result.toString().toStdString();
+  std::map< std::string, std::string >::iterator itr = descriptor->AnatomyRoleClassNames.find( role );
+  if ( itr == descriptor->AnatomyRoleClassNames.end() )
+  {
+    return "";
+  }
+
+  return itr->second;
 }
 
 
@@ -654,41 +3431,51 @@ void vtkSlicerPerkEvaluatorLogic
 void vtkSlicerPerkEvaluatorLogic
 ::UpdateSceneToPlaybackTime( vtkMRMLPerkEvaluatorNode* peNode, std::string transformName )
 {
-  if ( peNode == NULL || peNode->GetTransformBufferNode() == NULL )
+  vtkPerkEvaluatorPlaybackEngine* playbackEngine = this->GetPlaybackEngine( peNode );
+  if ( playbackEngine == NULL )
   {
     return;
   }
-  
-  std::vector< std::string > transformNames;
-  if ( transformName.compare( "" ) == 0 )
+
+  playbackEngine->SetInterpolation( peNode->GetPlaybackInterpolation() == vtkMRMLPerkEvaluatorNode::LinearInterpolation );
+  // Each transform's cursor moves on from the record shown last, so nodes are not looked up and records are not searched on every tick
+  playbackEngine->UpdateToTime( peNode->GetPlaybackTime(), transformName );
+}
+
+
+vtkPerkEvaluatorPlaybackEngine* vtkSlicerPerkEvaluatorLogic
+::GetPlaybackEngine( vtkMRMLPerkEvaluatorNode* peNode )
+{
+  if ( peNode == NULL || peNode->GetID() == NULL || peNode->GetTransformBufferNode() == NULL || this->GetMRMLScene() == NULL )
   {
-    transformNames = peNode->GetTransformBufferNode()->GetAllRecordedTransformNames();
+    return NULL;
   }
-  else
+
+  vtkSmartPointer< vtkPerkEvaluatorPlaybackEngine >& playbackEngine = this->PlaybackEngines[ peNode->GetID() ];
+  if ( playbackEngine == NULL )
+  {
+    playbackEngine = vtkSmartPointer< vtkPerkEvaluatorPlaybackEngine >::New();
+  }
+  if ( playbackEngine->IsBound( peNode->GetTransformBufferNode() ) )
   {
-    transformNames = std::vector< std::string >( 1, transformName );
+    return playbackEngine;
   }
 
-  for ( int i = 0; i < transformNames.size(); i++ )
-  {	
-    // Find the linear transform node assicated with the transform name
+  // Bind each recorded transform to the linear transform node with the same name
+  vtkMRMLTransformBufferNode* transformBuffer = peNode->GetTransformBufferNode();
+  playbackEngine->ClearBindings( transformBuffer );
+  std::vector< std::string > transformNames = transformBuffer->GetAllRecordedTransformNames();
+  for ( unsigned int i = 0; i < transformNames.size(); i++ )
+  {
     vtkMRMLLinearTransformNode* linearTransformNode = vtkMRMLLinearTransformNode::SafeDownCast( this->GetMRMLScene()->GetFirstNode( transformNames.at( i ).c_str(), "vtkMRMLLinearTransformNode" ) );
     if ( linearTransformNode == NULL )
     {
       continue;
     }
-
-    vtkTransformRecord* currentRecord = peNode->GetTransformBufferNode()->GetTransformAtTime( peNode->GetPlaybackTime(), transformNames.at( i ) );
-    if ( currentRecord == NULL )
-    {
-      continue;
-    }
-
-    vtkSmartPointer< vtkMatrix4x4 > transformMatrix = vtkSmartPointer< vtkMatrix4x4 >::New();
-    currentRecord->GetTransformMatrix( transformMatrix );
-    linearTransformNode->SetMatrixTransformToParent( transformMatrix );
+    playbackEngine->AddBinding( linearTransformNode, this->GetTrajectory( transformBuffer, transformNames.at( i ) ) );
   }
 
+  return playbackEngine;
 }
 
 
@@ -750,12 +3537,41 @@ void vtkSlicerPerkEvaluatorLogic
   vtkMRMLPerkEvaluatorNode* peNode = vtkMRMLPerkEvaluatorNode::SafeDownCast( caller );
   vtkMRMLMetricScriptNode* msNode = vtkMRMLMetricScriptNode::SafeDownCast( caller );
 
+  // Metric Script Node
+  // The cached descriptor no longer reflects the script
+  if ( msNode != NULL && event == vtkMRMLMetricScriptNode::PythonSourceCodeChangedEvent )
+  {
+    this->InvalidateMetricScriptDescriptor( msNode->GetID() );
+    this->PervasiveMetricIndexValid = false; // The digest of the script changed
+    this->MetricScriptMergeIndexValid = false;
+  }
+
+  // Metric Instance Node
+  // The script or the roles may have changed
+  vtkMRMLMetricInstanceNode* miNode = vtkMRMLMetricInstanceNode::SafeDownCast( caller );
+  if ( miNode != NULL && ( event == vtkMRMLNode::ReferenceAddedEvent || event == vtkMRMLNode::ReferenceModifiedEvent || event == vtkMRMLNode::ReferenceRemovedEvent ) )
+  {
+    this->IndexPervasiveMetricInstance( miNode );
+  }
 
   // Perk Evaluator Node
   // Setup the real-time processing
   if ( peNode != NULL && event == vtkMRMLPerkEvaluatorNode::RealTimeProcessingStartedEvent )
   {
     this->SetupRealTimeProcessing( peNode );
+    this->SetRealTimeProcessingNodeActive( peNode->GetID(), true );
+  }
+  if ( peNode != NULL && event == vtkMRMLPerkEvaluatorNode::RealTimeProcessingStoppedEvent )
+  {
+    this->SetRealTimeProcessingNodeActive( peNode->GetID(), false );
+  }
+
+  // Pass on the progress of the Python metrics calculator to the job whose script metrics it is computing
+  if ( peNode != NULL && event == vtkMRMLPerkEvaluatorNode::AnalysisStateUpdatedEvent && this->ApplyingAnalysisJob != NULL
+    && this->ApplyingAnalysisJob->GetPerkEvaluatorNodeID().compare( peNode->GetID() ) == 0 && peNode->GetAnalysisState() >= 0 )
+  {
+    this->ApplyingAnalysisJob->SetScriptProgress( peNode->GetAnalysisState() );
+    this->PublishAnalysisJobProgress( this->ApplyingAnalysisJob );
   }
 
   // Handle an event in the real-time processing
@@ -765,10 +3581,8 @@ void vtkSlicerPerkEvaluatorLogic
     std::string* transformName = reinterpret_cast< std::string* >( callData );
     // The time
     double absTime = peNode->GetTransformBufferNode()->GetTransformRecordBuffer( *transformName )->GetCurrentRecord()->GetTime();
-    // Call the metrics update function
-    this->PythonManager->executeString( QString( "PythonMetricsCalculatorLogicRealTimeInstance.UpdateRealTimeMetrics( '%1', %2 )" ).arg( transformName->c_str() ).arg( absTime ) );
-    // Make sure the widget is updated to reflect the updated metric values
-    peNode->GetMetricsTableNode()->Modified();
+    // Queue the sample for the evaluation stage, so the tracking is not held up by slow metrics
+    this->EnqueueRealTimeSample( peNode, *transformName, absTime );
   }
 
 }
@@ -787,6 +3601,81 @@ void vtkSlicerPerkEvaluatorLogic
     // Observe if a real-time transform event is added
     peNode->AddObserver( vtkMRMLPerkEvaluatorNode::TransformRealTimeAddedEvent, ( vtkCommand* ) this->GetMRMLNodesCallbackCommand() );
     peNode->AddObserver( vtkMRMLPerkEvaluatorNode::RealTimeProcessingStartedEvent, ( vtkCommand* ) this->GetMRMLNodesCallbackCommand() );
+    peNode->AddObserver( vtkMRMLPerkEvaluatorNode::RealTimeProcessingStoppedEvent, ( vtkCommand* ) this->GetMRMLNodesCallbackCommand() );
+    peNode->AddObserver( vtkMRMLPerkEvaluatorNode::AnalysisStateUpdatedEvent, ( vtkCommand* ) this->GetMRMLNodesCallbackCommand() );
+  }
+  if ( event == vtkMRMLScene::NodeRemovedEvent && peNode != NULL && peNode->GetID() != NULL )
+  {
+    this->SetRealTimeProcessingNodeActive( peNode->GetID(), false );
+  }
+
+  // If the added node was a metric script node then observe it (so cached information about the script can be invalidated)
+  vtkMRMLMetricScriptNode* eventMSNode = vtkMRMLMetricScriptNode::SafeDownCast( addedNode );
+  if ( event == vtkMRMLScene::NodeAddedEvent && eventMSNode != NULL )
+  {
+    eventMSNode->AddObserver( vtkMRMLMetricScriptNode::PythonSourceCodeChangedEvent, ( vtkCommand* ) this->GetMRMLNodesCallbackCommand() );
+  }
+  // The time indices are checked against the hierarchy when they are used, so only drop them to free memory
+  if ( event == vtkMRMLScene::NodeRemovedEvent && ( peNode != NULL || vtkMRMLLinearTransformNode::SafeDownCast( addedNode ) != NULL ) )
+  {
+    this->SelfAndParentTimeIndices.clear();
+  }
+
+  if ( event == vtkMRMLScene::NodeRemovedEvent && vtkMRMLTransformBufferNode::SafeDownCast( addedNode ) != NULL )
+  {
+    this->Trajectories.clear();
+  }
+
+  // A transform node with a recorded name may have been added or removed, so the transforms are bound again on the next playback update
+  if ( ( event == vtkMRMLScene::NodeAddedEvent || event == vtkMRMLScene::NodeRemovedEvent )
+    && ( peNode != NULL || vtkMRMLLinearTransformNode::SafeDownCast( addedNode ) != NULL || vtkMRMLTransformBufferNode::SafeDownCast( addedNode ) != NULL ) )
+  {
+    this->PlaybackEngines.clear();
+    this->RangeMetrics.clear();
+  }
+  if ( event == vtkMRMLScene::NodeRemovedEvent && vtkMRMLMetricInstanceNode::SafeDownCast( addedNode ) != NULL )
+  {
+    this->RangeMetrics.clear();
+  }
+
+  vtkMRMLTableNode* eventTableNode = vtkMRMLTableNode::SafeDownCast( addedNode );
+  if ( event == vtkMRMLScene::NodeRemovedEvent && eventTableNode != NULL && eventTableNode->GetID() != NULL )
+  {
+    this->MetricsTableIndices.erase( eventTableNode->GetID() );
+  }
+  if ( event == vtkMRMLScene::NodeRemovedEvent && eventMSNode != NULL )
+  {
+    eventMSNode->RemoveObservers( vtkMRMLMetricScriptNode::PythonSourceCodeChangedEvent, ( vtkCommand* ) this->GetMRMLNodesCallbackCommand() );
+    this->InvalidateMetricScriptDescriptor( eventMSNode->GetID() );
+    this->PervasiveMetricIndexValid = false; // Its instances no longer have a script
+  }
+
+  // Keep the pervasive metric index up to date with the metric instances
+  // While importing, the scripts may not be read yet, so the index is rebuilt afterwards instead
+  vtkMRMLMetricInstanceNode* eventMINode = vtkMRMLMetricInstanceNode::SafeDownCast( addedNode );
+  if ( event == vtkMRMLScene::NodeAddedEvent && eventMINode != NULL )
+  {
+    eventMINode->AddObserver( vtkMRMLNode::ReferenceAddedEvent, ( vtkCommand* ) this->GetMRMLNodesCallbackCommand() );
+    eventMINode->AddObserver( vtkMRMLNode::ReferenceModifiedEvent, ( vtkCommand* ) this->GetMRMLNodesCallbackCommand() );
+    eventMINode->AddObserver( vtkMRMLNode::ReferenceRemovedEvent, ( vtkCommand* ) this->GetMRMLNodesCallbackCommand() );
+    if ( this->GetMRMLScene() != NULL && this->GetMRMLScene()->IsImporting() )
+    {
+      this->PervasiveMetricIndexValid = false;
+    }
+    else
+    {
+      this->IndexPervasiveMetricInstance( eventMINode );
+    }
+  }
+  if ( event == vtkMRMLScene::NodeRemovedEvent && eventMINode != NULL )
+  {
+    eventMINode->RemoveObservers( vtkMRMLNode::ReferenceAddedEvent, ( vtkCommand* ) this->GetMRMLNodesCallbackCommand() );
+    eventMINode->RemoveObservers( vtkMRMLNode::ReferenceModifiedEvent, ( vtkCommand* ) this->GetMRMLNodesCallbackCommand() );
+    eventMINode->RemoveObservers( vtkMRMLNode::ReferenceRemovedEvent, ( vtkCommand* ) this->GetMRMLNodesCallbackCommand() );
+    if ( eventMINode->GetID() != NULL )
+    {
+      this->UnindexPervasiveMetricInstance( eventMINode->GetID() );
+    }
   }
 
   // If a scene is being imported, ignore everything below (because the references should already be set in the scene)
@@ -796,9 +3685,21 @@ void vtkSlicerPerkEvaluatorLogic
   }
   if ( event == vtkMRMLScene::EndImportEvent )
   {
+    this->PervasiveMetricIndexValid = false; // Node IDs may have been changed by the import
     this->FixOldStyleScene();
     this->MergeAllMetricScripts();
-    this->PythonManager->executeString( QString( "PythonMetricsCalculator.PythonMetricsCalculatorLogic.RefreshMetricModules()" ) );
+    this->RefreshMetricModules();
+  }
+
+  // Added nodes are reconciled all at once after batch processing
+  if ( event == vtkMRMLScene::EndBatchProcessEvent )
+  {
+    this->ReconcileDeferredNodes();
+  }
+  if ( event == vtkMRMLScene::NodeAddedEvent && this->GetDeferringAddedNodes() )
+  {
+    this->DeferAddedNode( addedNode );
+    return;
   }
 
   // If a transform or metric script was added to the scene, make sure all transforms have all pervasive metric instances
@@ -811,7 +3712,7 @@ void vtkSlicerPerkEvaluatorLogic
   if ( event == vtkMRMLScene::NodeAddedEvent && msNode != NULL )
   {
     this->MergeMetricScripts( msNode );
-    this->PythonManager->executeString( QString( "PythonMetricsCalculator.PythonMetricsCalculatorLogic.RefreshMetricModules()" ) );
+    this->RefreshMetricModules();
     if ( this->GetMetricPervasive( msNode->GetID() ) )
     {
       this->UpdatePervasiveMetrics( msNode );
@@ -836,6 +3737,152 @@ void vtkSlicerPerkEvaluatorLogic
 }
 
 
+// Batch processing ----------------------------------------------------------
+
+bool vtkSlicerPerkEvaluatorLogic
+::GetDeferringAddedNodes()
+{
+  return this->ReconcilingDeferredNodes || ( this->GetMRMLScene() != NULL && this->GetMRMLScene()->IsBatchProcessing() );
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::DeferAddedNode( vtkMRMLNode* addedNode )
+{
+  if ( addedNode == NULL || addedNode->GetID() == NULL )
+  {
+    return;
+  }
+
+  if ( vtkMRMLLinearTransformNode::SafeDownCast( addedNode ) != NULL )
+  {
+    this->DeferredTransformNodeIDs.insert( addedNode->GetID() );
+  }
+  if ( vtkMRMLMetricScriptNode::SafeDownCast( addedNode ) != NULL )
+  {
+    this->DeferredMetricScriptIDs.insert( addedNode->GetID() );
+  }
+  if ( vtkMRMLMetricInstanceNode::SafeDownCast( addedNode ) != NULL )
+  {
+    this->DeferredMetricInstanceIDs.insert( addedNode->GetID() );
+  }
+  if ( vtkMRMLPerkEvaluatorNode::SafeDownCast( addedNode ) != NULL )
+  {
+    this->DeferredPerkEvaluatorNodeIDs.insert( addedNode->GetID() );
+  }
+}
+
+
+void vtkSlicerPerkEvaluatorLogic
+::ReconcileDeferredNodes()
+{
+  if ( this->ReconcilingDeferredNodes || this->GetMRMLScene() == NULL )
+  {
+    return;
+  }
+  this->ReconcilingDeferredNodes = true;
+
+  std::set< std::string > transformNodeIDs;
+  transformNodeIDs.swap( this->DeferredTransformNodeIDs );
+  std::set< std::string > metricScriptIDs;
+  metricScriptIDs.swap( this->DeferredMetricScriptIDs );
+
+  // Merge the new scripts with any equal scripts in one pass (some of the new scripts may be removed)
+  if ( ! metricScriptIDs.empty() )
+  {
+    this->MergeAllMetricScripts();
+    this->RefreshMetricModules();
+  }
+
+  // Only one instance is created for each new script that is not pervasive
+  std::vector< MetricScriptDescriptor > descriptors = this->GetAllMetricScriptDescriptors();
+  std::map< std::string, std::string > pervasiveTransformRoles; // From metric script IDs
+  for ( unsigned int i = 0; i < descriptors.size(); i++ )
+  {
+    bool newScript = metricScriptIDs.find( descriptors.at( i ).MetricScriptID ) != metricScriptIDs.end();
+    if ( descriptors.at( i ).Pervasive && ! descriptors.at( i ).TransformRoles.empty() )
+    {
+      pervasiveTransformRoles[ descriptors.at( i ).MetricScriptID ] = descriptors.at( i ).TransformRoles.at( 0 );
+    }
+    else if ( newScript )
+    {
+      this->CreateMetricInstance( vtkMRMLMetricScriptNode::SafeDownCast( this->GetMRMLScene()->GetNodeByID( descriptors.at( i ).MetricScriptID ) ) );
+    }
+  }
+
+  // The pervasive metric instances which may be missing: the new transforms with all pervasive scripts, and the new pervasive scripts with all transforms
+  std::set< std::pair< std::string, std::string > > pervasivePairs; // Metric script IDs and transform node IDs
+  for ( std::set< std::string >::iterator transformItr = transformNodeIDs.begin(); transformItr != transformNodeIDs.end(); transformItr++ )
+  {
+    for ( std::map< std::string, std::string >::iterator scriptItr = pervasiveTransformRoles.begin(); scriptItr != pervasiveTransformRoles.end(); scriptItr++ )
+    {
+      pervasivePairs.insert( std::pair< std::string, std::string >( scriptItr->first, *transformItr ) );
+    }
+  }
+  vtkSmartPointer< vtkCollection > visibleTransformNodes = vtkSmartPointer< vtkCollection >::New();
+  this->GetSceneVisibleTransformNodes( visibleTransformNodes );
+  for ( std::set< std::string >::iterator scriptItr = metricScriptIDs.begin(); scriptItr != metricScriptIDs.end(); scriptItr++ )
+  {
+    if ( pervasiveTransformRoles.find( *scriptItr ) == pervasiveTransformRoles.end() )
+    {
+      continue;
+    }
+    for ( int i = 0; i < visibleTransformNodes->GetNumberOfItems(); i++ )
+    {
+      vtkMRMLNode* transformNode = vtkMRMLNode::SafeDownCast( visibleTransformNodes->GetItemAsObject( i ) );
+      pervasivePairs.insert( std::pair< std::string, std::string >( *scriptItr, transformNode->GetID() ) );
+    }
+  }
+
+  for ( std::set< std::pair< std::string, std::string > >::iterator itr = pervasivePairs.begin(); itr != pervasivePairs.end(); itr++ )
+  {
+    vtkMRMLMetricScriptNode* msNode = vtkMRMLMetricScriptNode::SafeDownCast( this->GetMRMLScene()->GetNodeByID( itr->first ) );
+    vtkMRMLLinearTransformNode* transformNode = vtkMRMLLinearTransformNode::SafeDownCast( this->GetMRMLScene()->GetNodeByID( itr->second ) );
+    this->CreatePervasiveMetric( msNode, transformNode, pervasiveTransformRoles[ itr->first ] ); // Nothing to do if it already exists
+  }
+
+  // The instances created above were deferred too, so everything is shared at once
+  std::set< std::string > metricInstanceIDs;
+  metricInstanceIDs.swap( this->DeferredMetricInstanceIDs );
+  std::set< std::string > perkEvaluatorNodeIDs;
+  perkEvaluatorNodeIDs.swap( this->DeferredPerkEvaluatorNodeIDs );
+
+  std::vector< std::string > newSharedMetricInstanceIDs;
+  std::vector< std::string > allSharedMetricInstanceIDs;
+  vtkSmartPointer< vtkCollection > metricInstanceNodes;
+  metricInstanceNodes.TakeReference( this->GetMRMLScene()->GetNodesByClass( "vtkMRMLMetricInstanceNode" ) );
+  for ( int i = 0; i < metricInstanceNodes->GetNumberOfItems(); i++ )
+  {
+    vtkMRMLMetricInstanceNode* miNode = vtkMRMLMetricInstanceNode::SafeDownCast( metricInstanceNodes->GetItemAsObject( i ) );
+    if ( miNode == NULL || ! this->GetMetricShared( miNode->GetAssociatedMetricScriptID() ) )
+    {
+      continue;
+    }
+    allSharedMetricInstanceIDs.push_back( miNode->GetID() );
+    if ( metricInstanceIDs.find( miNode->GetID() ) != metricInstanceIDs.end() )
+    {
+      newSharedMetricInstanceIDs.push_back( miNode->GetID() );
+    }
+  }
+
+  // New Perk Evaluator nodes get all the shared instances, the others only get the new ones
+  vtkSmartPointer< vtkCollection > peNodes;
+  peNodes.TakeReference( this->GetMRMLScene()->GetNodesByClass( "vtkMRMLPerkEvaluatorNode" ) );
+  for ( int i = 0; i < peNodes->GetNumberOfItems(); i++ )
+  {
+    vtkMRMLPerkEvaluatorNode* peNode = vtkMRMLPerkEvaluatorNode::SafeDownCast( peNodes->GetItemAsObject( i ) );
+    if ( peNode == NULL )
+    {
+      continue;
+    }
+    bool newPENode = perkEvaluatorNodeIDs.find( peNode->GetID() ) != perkEvaluatorNodeIDs.end();
+    peNode->AddMetricInstanceIDs( newPENode ? allSharedMetricInstanceIDs : newSharedMetricInstanceIDs );
+  }
+
+  this->ReconcilingDeferredNodes = false;
+}
+
+
 // This function is only for supporting reading of "old-style" scenes
 void vtkSlicerPerkEvaluatorLogic
 ::FixOldStyleScene()
@@ -854,7 +3901,7 @@ void vtkSlicerPerkEvaluatorLogic
     }
     if ( peNode->MetricsDirectory.compare( "" ) != 0 ) // Metrics directory
     {
-      this->PythonManager->executeString( QString( "PythonMetricsCalculator.PythonMetricsCalculatorLogic.AddMetricsFromDirectoryToScene( '%1' )" ).arg( peNode->MetricsDirectory.c_str() ) );
+      this->ExecutePythonString( QString( "PythonMetricsCalculator.PythonMetricsCalculatorLogic.AddMetricsFromDirectoryToScene( '%1' )" ).arg( peNode->MetricsDirectory.c_str() ) );
       isOldStyleScene = true;
     }
     for ( std::map< std::string, std::string >::iterator itr = peNode->TransformRoleMap.begin(); itr != peNode->TransformRoleMap.end(); itr++ ) // Transform roles
@@ -25,16 +25,32 @@
 
 // STD includes
 #include <cstdlib>
+#include <map>
+#include <set>
+#include <vector>
 
 #include "qSlicerApplication.h"
 #include "qSlicerPythonManager.h"
 
 #include "vtkSmartPointer.h"
+#include "vtkWeakPointer.h"
 #include "vtkXMLDataParser.h"
 #include "vtkDoubleArray.h"
 
 #include "vtkSlicerPerkEvaluatorModuleLogicExport.h"
 #include "vtkSlicerTransformRecorderLogic.h"
+#include "vtkPerkEvaluatorMetric.h"
+#include "vtkPerkEvaluatorRealTimeQueue.h"
+#include "vtkPerkEvaluatorTrajectory.h"
+#include "vtkPerkEvaluatorPlaybackEngine.h"
+
+class vtkPerkEvaluatorAnalysisJob;
+
+// Forward declaration, so Python.h is only needed in the implementation
+#ifndef PyObject_HEAD
+struct _object;
+typedef _object PyObject;
+#endif
 
 
 
@@ -48,6 +64,12 @@ public:
   static vtkSlicerPerkEvaluatorLogic *New();
   vtkTypeMacro(vtkSlicerPerkEvaluatorLogic, vtkSlicerModuleLogic);
   void PrintSelf(ostream& os, vtkIndent indent);
+
+  enum
+  {
+    MetricsBatchProgressEvent = vtkCommand::UserEvent + 1,
+    RealTimeProcessingChangedEvent
+  };
   
   virtual void OnMRMLSceneEndClose();
 
@@ -63,7 +85,273 @@ protected:
   virtual void OnMRMLSceneNodeAdded( vtkMRMLNode* node );
   virtual void OnMRMLSceneNodeRemoved( vtkMRMLNode* node );
 
-  qSlicerPythonManager* PythonManager;
+  qSlicerPythonManager* PythonManager; // NULL if there is no application (then, Python metrics are unavailable)
+
+  void ExecutePythonString( QString code );
+  QVariant GetPythonVariable( QString name );
+  // The Python metrics calculator evaluates every metric instance the node references, so only the given ones are referenced while it runs
+  void ExecuteMetricsCalculatorString( vtkMRMLPerkEvaluatorNode* peNode, std::vector< std::string > metricInstanceIDs, QString code );
+
+public:
+
+  // Everything the logic needs to know about a metric script, as reported by the Python metrics calculator
+  struct MetricScriptDescriptor
+  {
+    std::string MetricScriptID;
+    std::string SourceDigest; // Digest of the source code when the descriptor was filled
+    std::string Name;
+    std::string Unit;
+    bool Shared;
+    bool Pervasive;
+    std::vector< std::string > TransformRoles;
+    std::vector< std::string > AnatomyRoles;
+    std::map< std::string, std::string > AnatomyRoleClassNames; // From anatomy roles to class names
+  };
+
+protected:
+
+  // Cache of descriptors from metric script node IDs, so the getters do not need to call into Python
+  std::map< std::string, MetricScriptDescriptor > MetricScriptDescriptorCache;
+
+  MetricScriptDescriptor* GetMetricScriptDescriptor( std::string msNodeID );
+  bool FillMetricScriptDescriptor( vtkMRMLMetricScriptNode* msNode, MetricScriptDescriptor& descriptor );
+  QString GetMetricScriptDescriptorQuery( QString msNodeIDExpression );
+  bool ParseMetricScriptDescriptor( vtkMRMLMetricScriptNode* msNode, QVariant queryResult, MetricScriptDescriptor& descriptor );
+  void InvalidateMetricScriptDescriptor( std::string msNodeID );
+  void InvalidateAllMetricScriptDescriptors();
+  void RefreshMetricModules();
+
+  bool FillNativeMetricScriptDescriptor( vtkMRMLMetricScriptNode* msNode, MetricScriptDescriptor& descriptor );
+
+  // Index of the metric instances which could be pervasive metric instances (their script has a single transform role, and it is filled),
+  // so CreatePervasiveMetric does not need to go over all the metric instances in the scene.
+  // Instances are indexed when they are added or their references change, and the index is rebuilt (when it is next used)
+  // whenever that is simpler: after an import, or when a script is removed or its source code changes.
+  typedef std::pair< std::string, std::string > PervasiveMetricKey; // Script digest (and native metric name), transform node ID
+  std::map< PervasiveMetricKey, std::set< std::string > > PervasiveMetricInstanceIDs;
+  std::map< std::string, PervasiveMetricKey > PervasiveMetricKeys; // From metric instance IDs, for removing them from the index
+  bool PervasiveMetricIndexValid;
+
+  static std::string GetPervasiveMetricScriptKey( vtkMRMLMetricScriptNode* msNode );
+
+  // Index of the metric scripts by their digest, native metric name and node name, so MergeMetricScripts does not compare a new script
+  // with every script in the scene. Scripts are indexed when they are merged, entries are checked against their scripts when they are used,
+  // and the index is rebuilt (when it is next used) after an import, when an entry was out of date, or when the source code of a script changes.
+  std::map< std::string, std::vector< std::string > > MetricScriptMergeIndex; // From merge keys to metric script IDs
+  bool MetricScriptMergeIndexValid;
+
+  static std::string GetMetricScriptMergeKey( vtkMRMLMetricScriptNode* msNode );
+  void UpdateMetricScriptMergeIndex();
+  void UpdatePervasiveMetricIndex();
+  void IndexPervasiveMetricInstance( vtkMRMLMetricInstanceNode* miNode );
+  void UnindexPervasiveMetricInstance( std::string miNodeID );
+
+  // While the scene is batch processing, the transforms, metric scripts, metric instances and Perk Evaluator nodes added to it
+  // are only queued. When the batch processing ends, the pervasive metric instances are created and the shared metric instances
+  // are shared for all of them at once.
+  std::set< std::string > DeferredTransformNodeIDs;
+  std::set< std::string > DeferredMetricScriptIDs;
+  std::set< std::string > DeferredMetricInstanceIDs;
+  std::set< std::string > DeferredPerkEvaluatorNodeIDs;
+  bool ReconcilingDeferredNodes; // Nodes added while reconciling are deferred too, so they are shared at once
+
+  bool GetDeferringAddedNodes();
+  void DeferAddedNode( vtkMRMLNode* addedNode );
+  void ReconcileDeferredNodes();
+
+  // Native metrics are computed directly, rather than by the Python metrics calculator
+  struct NativeRealTimeMetric
+  {
+    std::string MetricInstanceID;
+    vtkSmartPointer< vtkPerkEvaluatorMetric > Metric;
+  };
+  std::map< std::string, std::vector< NativeRealTimeMetric > > NativeRealTimeMetrics; // From Perk Evaluator node IDs
+
+public:
+
+  // Everything needed to compute a native metric, resolved from the scene in advance, so it can be computed on any thread
+  struct TransformChainLink
+  {
+    std::string TransformName;
+    bool Recorded;
+    double StaticMatrix[ 16 ]; // Used if the transform is not recorded
+    vtkSmartPointer< vtkPerkEvaluatorTrajectory > Trajectory; // Used if the transform is recorded
+    int CurrentRecord; // The record used for the previous time (the times only increase)
+  };
+  struct NativeMetricJob
+  {
+    std::string PerkEvaluatorNodeID;
+    std::string MetricInstanceID;
+    vtkSmartPointer< vtkPerkEvaluatorMetric > Metric;
+    vtkWeakPointer< vtkMRMLTransformBufferNode > TransformBuffer; // Only for the main thread (NULL once the job is handed to workers)
+    std::vector< std::string > Roles;
+    std::vector< std::vector< TransformChainLink > > RoleChains; // From each role's transform up to the root
+    std::vector< double > Times;
+    std::vector< int > RoleIndices;
+    bool Interpolation; // Interpolate the recorded transforms between their records
+    bool RangeQueries; // Also build what the metric needs for range queries, so it is not built on the main thread
+    double MetricValue;
+    bool Computed;
+    double WallTime; // Time taken to compute the metric (in seconds)
+    unsigned long RetainedMemory; // Memory held by the metric once all samples were added (in kibibytes)
+  };
+
+  static void RunNativeMetricJob( NativeMetricJob& job, volatile bool* canceled );
+  // One value for each window (from its begin time, for the given length)
+  static void RunWindowedNativeMetricJob( NativeMetricJob& job, const std::vector< double >& windowBegins, double windowLength, std::vector< double >& windowValues );
+
+protected:
+
+  // Only the times between the marks are collected, unless all times in the buffer are requested
+  bool PrepareNativeMetricJob( vtkMRMLPerkEvaluatorNode* peNode, vtkMRMLMetricInstanceNode* miNode, NativeMetricJob& job, bool allTimes = false );
+  static void AddNativeMetricJobSample( NativeMetricJob& job, int sample, vtkMatrix4x4* matrix, vtkMatrix4x4* parentMatrix );
+  // Give the jobs their own copies of the trajectories (shared between the jobs), since the logic's trajectories keep being updated
+  // by playback and recording on the main thread. This must be done before the jobs are run on other threads.
+  static void SnapshotNativeMetricJobTrajectories( std::vector< NativeMetricJob >& jobs );
+
+  // State of the batch analysis
+  int NumberOfBatchThreads;
+  bool MetricsBatchRunning;
+  volatile bool MetricsBatchCanceled;
+  int MetricsBatchProgress;
+  std::string MetricsBatchCurrentPENodeID;
+
+  void UpdateMetricsBatchProgress( int numCompleted, int numTotal );
+
+  // Background analyses, until their results are applied
+  std::vector< vtkSmartPointer< vtkPerkEvaluatorAnalysisJob > > AnalysisJobs;
+
+  vtkPerkEvaluatorAnalysisJob* ApplyingAnalysisJob; // While its script metrics are computed, so the Python progress is passed on to it
+
+  void ApplyAnalysisJob( vtkPerkEvaluatorAnalysisJob* job );
+  void ApplyRangeBuildJob( vtkPerkEvaluatorAnalysisJob* job );
+  void PublishAnalysisJobProgress( vtkPerkEvaluatorAnalysisJob* job );
+  // Initializes the metrics table if there are none
+  // If the node has a profiling table, the Python metrics calculator is called once per metric instance, so each is timed separately
+  void ComputeScriptMetrics( vtkMRMLPerkEvaluatorNode* peNode, std::vector< std::string > scriptMetricInstanceIDs );
+
+  // Profile of each metric instance's computations, kept separately for offline analyses and real-time processing.
+  // In real time, the Python metrics calculator updates all script metrics in the same call, so they share a single profile.
+  // The retained memory is what is still held once the samples were added: by the metric itself for native metrics, or the
+  // growth of the process over the call for script metrics (Python cannot tell which metric holds what). It is not a peak.
+  enum MetricProfileEvaluationEnum
+  {
+    OfflineEvaluation,
+    RealTimeEvaluation
+  };
+  struct MetricProfile
+  {
+    double WallTime; // s
+    int NumberOfSamples;
+    int NumberOfPythonCalls;
+    unsigned long RetainedMemory; // KiB, the largest of the calls
+  };
+  typedef std::map< std::pair< std::string, int >, MetricProfile > MetricProfileMap; // From metric instance IDs (empty for all script metrics in real time) and evaluations
+  std::map< std::string, MetricProfileMap > MetricProfiles; // From Perk Evaluator node IDs
+  std::map< std::string, double > LastProfilingTableUpdateTimes; // Wall clock time, from Perk Evaluator node IDs
+  std::map< std::string, std::vector< std::string > > RealTimeScriptMetricInstanceIDs; // From Perk Evaluator node IDs
+
+  void AddToMetricProfile( std::string peNodeID, std::string miNodeID, MetricProfileEvaluationEnum evaluation, double wallTime, int numSamples, int numPythonCalls, unsigned long memory );
+  void AddToMetricProfile( const NativeMetricJob& job );
+  int GetNumberOfRecordsBetweenMarks( vtkMRMLPerkEvaluatorNode* peNode );
+
+  void SplitMetricInstanceIDs( vtkMRMLPerkEvaluatorNode* peNode, std::vector< std::string >& scriptMetricInstanceIDs, std::vector< std::string >& nativeMetricInstanceIDs );
+  vtkPerkEvaluatorMetric* CreateNativeMetric( vtkMRMLPerkEvaluatorNode* peNode, vtkMRMLMetricInstanceNode* miNode ); // The caller is responsible for deleting the metric
+  bool ComputeNativeMetric( vtkMRMLPerkEvaluatorNode* peNode, vtkMRMLMetricInstanceNode* miNode, double& metricValue );
+  bool UpdateNativeRealTimeMetrics( vtkMRMLPerkEvaluatorNode* peNode, std::string transformName, double absTime ); // Returns true if any value changed
+  void GetMatrixTransformToWorldAtTime( vtkMRMLPerkEvaluatorNode* peNode, vtkMRMLLinearTransformNode* transformNode, double time, std::set< std::string >& recordedTransformNames, vtkMatrix4x4* matrix );
+
+  // The real-time update function of the Python metrics calculator, resolved once when real-time processing is set up
+  PyObject* RealTimeUpdateCallable;
+  std::map< std::string, PyObject* > RealTimeTransformNameObjects; // Prebuilt Python strings for the transform names
+  bool UseRealTimeUpdateCallable;
+
+  bool ResolveRealTimeUpdateCallable();
+  void ReleaseRealTimeUpdateCallable();
+  void UpdatePythonRealTimeMetrics( std::string transformName, double absTime );
+
+  // Real-time samples waiting to be evaluated
+  vtkSmartPointer< vtkPerkEvaluatorRealTimeQueue > RealTimeQueue;
+
+  void EnqueueRealTimeSample( vtkMRMLPerkEvaluatorNode* peNode, std::string transformName, double absTime );
+  bool EvaluateRealTimeSample( const vtkPerkEvaluatorRealTimeQueue::Sample& sample );
+
+  // Perk Evaluator nodes which are processing in real-time (the queue only needs to be drained while there are any)
+  std::set< std::string > RealTimeProcessingNodeIDs;
+
+  void SetRealTimeProcessingNodeActive( std::string peNodeID, bool active );
+
+  // Perk Evaluator nodes whose metrics table notification was held back by their notification policy
+  std::set< std::string > PendingMetricsTableNotifications;
+
+  void FlushMetricsTableNotifications();
+  void GetMetricsTableValues( vtkMRMLTableNode* metricsTableNode, std::vector< std::string >& values );
+
+  // Latency of the real-time metric updates (in seconds)
+  int RealTimeUpdateCount;
+  double RealTimeUpdateTotalLatency;
+  double RealTimeUpdateMaximumLatency;
+
+  void InitializeMetricsTable( vtkMRMLTableNode* metricsTableNode );
+  bool SetMetricsTableValue( vtkMRMLTableNode* metricsTableNode, vtkMRMLMetricInstanceNode* miNode, double metricValue ); // Returns true if the value changed
+
+  // Index of the rows in a metrics table, by metric name, unit and roles (i.e. by metric script and role string).
+  // The index is caught up with the table whenever the table or its node is modified, or its number of rows changed, so looking up a row does not scan the table.
+  struct MetricsTableIndex
+  {
+    unsigned long IndexedMTime; // Modified time of the table when it was last indexed
+    int NumberOfIndexedRows;
+    bool Complete; // False if rows indexed earlier might have been changed since
+    std::map< std::string, int > Rows;
+  };
+  std::map< std::string, MetricsTableIndex > MetricsTableIndices; // From metrics table node IDs
+
+  // Columnar views of the recorded transforms, from transform buffer node IDs and transform names
+  std::map< std::string, vtkSmartPointer< vtkPerkEvaluatorTrajectory > > Trajectories;
+
+  // Transform nodes and trajectories bound for playback, from Perk Evaluator node IDs
+  std::map< std::string, vtkSmartPointer< vtkPerkEvaluatorPlaybackEngine > > PlaybackEngines;
+
+  // Native metrics fed with every time in the buffer (on a worker thread), so they can be queried for any range of times (e.g. between the marks).
+  // Metrics which can share their range structures (e.g. the statistics of the same transform) share one range metric.
+  // A range metric is built again if the buffer, the hierarchy of its transforms, or the Perk Evaluator node's analysis settings changed.
+  struct RangeMetric
+  {
+    std::string Signature;
+    vtkSmartPointer< vtkPerkEvaluatorMetric > Metric;
+  };
+  std::map< std::string, RangeMetric > RangeMetrics; // From range keys
+
+  // From the Perk Evaluator node, the metric (its class if it can share, otherwise its metric instance) and the nodes fulfilling its roles
+  std::string GetRangeMetricKey( vtkMRMLPerkEvaluatorNode* peNode, vtkMRMLMetricInstanceNode* miNode, vtkPerkEvaluatorMetric* metric );
+  std::string GetRangeMetricSignature( vtkMRMLPerkEvaluatorNode* peNode, vtkMRMLMetricInstanceNode* miNode, vtkPerkEvaluatorMetric* metric, std::set< std::string >& recordedTransformNames );
+  bool GetRangeBuildRunning( vtkMRMLPerkEvaluatorNode* peNode );
+
+  std::string GetMetricsTableKey( std::string name, std::string unit, std::string roles );
+  std::string GetMetricsTableKey( vtkTable* metricsTable, int row );
+  std::string GetMetricsTableKey( vtkMRMLMetricInstanceNode* miNode ); // Empty if the metric script cannot be described
+  unsigned long GetMetricsTableMTime( vtkMRMLTableNode* metricsTableNode );
+  void UpdateMetricsTableIndex( vtkMRMLTableNode* metricsTableNode, bool rebuild );
+  int FindMetricsTableRow( vtkMRMLTableNode* metricsTableNode, vtkMRMLMetricInstanceNode* miNode ); // Returns -1 if the metric instance has no row
+
+  // Merged, sorted times at which a transform or any of its parents was recorded, for each Perk Evaluator node and transform.
+  // An index is checked against the hierarchy and the buffer whenever it is used: new records are merged onto the end, anything else rebuilds it.
+  struct SelfAndParentTimeIndex
+  {
+    std::string TransformBufferID;
+    std::vector< std::string > AncestorNames; // The transform and all of its parents, recorded or not
+    std::vector< std::string > RecordedTransformNames; // All transforms recorded in the buffer when the index was built
+    std::vector< std::string > ChainNames; // The recorded transforms among the ancestors
+    std::vector< int > NumberOfIndexedRecords; // For each recorded transform among the ancestors
+    std::vector< double > LastIndexedTimes; // For each recorded transform among the ancestors (if it has any indexed records)
+    std::vector< double > Times;
+  };
+  std::map< std::string, SelfAndParentTimeIndex > SelfAndParentTimeIndices; // From Perk Evaluator node and transform node IDs
+
+  const std::vector< double >& GetSelfAndParentTimeIndex( vtkMRMLPerkEvaluatorNode* peNode, vtkMRMLLinearTransformNode* transformNode );
+  void BuildSelfAndParentTimeIndex( vtkMRMLTransformBufferNode* transformBuffer, SelfAndParentTimeIndex& index );
+  bool AppendSelfAndParentTimeIndex( vtkMRMLTransformBufferNode* transformBuffer, SelfAndParentTimeIndex& index ); // Returns false (and leaves the index) if the new records are not all later than the indexed ones
+  static void MergeRecordTimes( std::vector< vtkLogRecordBuffer* >& recordBuffers, std::vector< int >& beginRecords, std::vector< double >& times );
 
 public:
   
@@ -72,6 +360,10 @@ public:
   void GetSelfAndParentRecordBuffer( vtkMRMLPerkEvaluatorNode* peNode, vtkMRMLLinearTransformNode* transform, vtkLogRecordBuffer* selfParentRecordBuffer );
   void GetSelfAndParentTimes( vtkMRMLPerkEvaluatorNode* peNode, vtkMRMLLinearTransformNode* transform, vtkDoubleArray* timesArray );
 
+  // The times and matrices of a recorded transform as arrays, brought up to date with the buffer (NULL if the transform is not recorded)
+  // The arrays are shared, not copied, so Python metric scripts can view them with numpy directly
+  vtkPerkEvaluatorTrajectory* GetTrajectory( vtkMRMLTransformBufferNode* transformBuffer, std::string transformName );
+
   std::string GetMetricName( std::string msNodeID );
   std::string GetMetricUnit( std::string msNodeID );
   bool GetMetricShared( std::string msNodeID );
@@ -79,21 +371,88 @@ public:
 
   std::vector< std::string > GetAllRoles( std::string msNodeID, /*vtkMRMLMetricInstanceNode::RoleTypeEnum*/ int roleType ); // For Python wrapping. Pass an enum in c++.
   std::string GetAnatomyRoleClassName( std::string msNodeID, std::string role );
+
+  // Query the properties of all metric scripts in the scene at once (only scripts which are not already cached are sent to Python)
+  void UpdateMetricScriptDescriptors();
+  std::vector< MetricScriptDescriptor > GetAllMetricScriptDescriptors();
   
 
   void GetSceneVisibleTransformNodes( vtkCollection* visibleTransformNodes );
 
   void UpdateSceneToPlaybackTime( vtkMRMLPerkEvaluatorNode* peNode, std::string transformName = "" );
+  // The transforms are only bound to their nodes again if the buffer or the transform nodes changed
+  vtkPerkEvaluatorPlaybackEngine* GetPlaybackEngine( vtkMRMLPerkEvaluatorNode* peNode );
 
   double GetRelativePlaybackTime( vtkMRMLPerkEvaluatorNode* peNode );
   void SetRelativePlaybackTime( vtkMRMLPerkEvaluatorNode* peNode, double time );
   double GetMaximumRelativePlaybackTime( vtkMRMLPerkEvaluatorNode* peNode );
 
   void ComputeMetrics( vtkMRMLPerkEvaluatorNode* peNode );
+
+  // Update the metrics table for the current marks without going over the samples again, e.g. while a mark is dragged.
+  // Every sample in the buffer is added once, then each metric value between the marks takes O(log N).
+  // Adding the samples is a background analysis job (see ProcessAnalysisJobs), which updates the table for the marks as they are when it is done.
+  // The script metrics cannot be queried over a range, so their values are cleared (left empty until the next analysis).
+  // Returns false (and leaves the table unchanged for now) if the range metrics are being built.
+  bool ComputeMetricsOverMarkedRange( vtkMRMLPerkEvaluatorNode* peNode );
+
+  // Write the profile of the metric computations to the node's profiling table (one row per native metric instance and evaluation,
+  // and one "Script metrics" row for all script metrics together in real time), with the columns:
+  // MetricName, MetricRoles, MetricUnit, Evaluation, WallTime (s), NumberOfSamples, NumberOfPythonCalls, RetainedMemory (KiB).
+  // Profiling is opt-in: nothing is written unless the node was given a profiling table (see vtkMRMLPerkEvaluatorNode::SetProfilingTableID).
+  void UpdateProfilingTable( vtkMRMLPerkEvaluatorNode* peNode );
+  void ResetProfiling( vtkMRMLPerkEvaluatorNode* peNode );
+
+  // Analyze in the background: the native metrics are computed on a worker thread while the scene can still be used.
+  // The logic keeps the job until it is done, and starting a job cancels any earlier job for the same Perk Evaluator node.
+  // Script metrics are computed through Python when the results are applied, because Python must stay on the main thread,
+  // so they still block the scene for as long as they take (their progress is reported by the job).
+  vtkPerkEvaluatorAnalysisJob* StartAnalysisJob( vtkMRMLPerkEvaluatorNode* peNode );
+  // Publish the progress of the jobs and apply the results of finished ones (must be called regularly from the main thread)
+  void ProcessAnalysisJobs();
+  bool GetAnalysisJobsRunning();
+  void CancelAnalysisJobs();
+
+  // Compute the selected metrics over a sliding window (length and step in seconds) between the marked begin and end.
+  // The table gets one row per window (with its relative begin and end times) and one column per metric instance.
+  // Metrics which can forget samples are updated incrementally as the window slides, others are computed for each window.
+  // Only native metrics are computed, because the Python metric scripts cannot forget samples (the script metrics get no
+  // column, and a warning is issued if there are any).
+  void ComputeWindowedMetrics( vtkMRMLPerkEvaluatorNode* peNode, double windowLength, double windowStep, vtkMRMLTableNode* windowedMetricsTableNode );
+
+  // Analyze many Perk Evaluator nodes at once. Native metrics are spread across threads while the script metrics are computed.
+  // Progress (in percent) is reported with the MetricsBatchProgressEvent. Returns false if the batch was canceled.
+  bool ComputeMetricsBatch( std::vector< vtkMRMLPerkEvaluatorNode* > peNodes );
+  bool ComputeMetricsBatch( vtkCollection* peNodes ); // For Python wrapping
+  void CancelMetricsBatch();
+  bool GetMetricsBatchRunning();
+  int GetMetricsBatchProgress();
+  vtkGetMacro( NumberOfBatchThreads, int ); // Zero means as many as there are cores
+  vtkSetMacro( NumberOfBatchThreads, int );
   std::string GetMetricValue( vtkMRMLMetricInstanceNode* miNode, vtkMRMLPerkEvaluatorNode* peNode );
 
   void SetupRealTimeProcessing( vtkMRMLPerkEvaluatorNode* peNode );
 
+  // Call the Python real-time update function directly, rather than compiling a string for every sample
+  vtkGetMacro( UseRealTimeUpdateCallable, bool );
+  vtkSetMacro( UseRealTimeUpdateCallable, bool );
+
+  // The tracking events only queue their samples, the evaluation stage must drain the queue regularly.
+  // Evaluates queued samples until the queue is empty or the time budget (in seconds) is used up, and returns the number evaluated.
+  int ProcessRealTimeQueue( double timeBudget );
+  vtkPerkEvaluatorRealTimeQueue* GetRealTimeQueue();
+  // Whether any Perk Evaluator node is processing in real-time (changes are reported with the RealTimeProcessingChangedEvent)
+  bool GetRealTimeProcessingActive();
+
+  // Statistics since real-time processing was last set up
+  int GetRealTimeUpdateCount();
+  double GetAverageRealTimeUpdateLatency();
+  double GetMaximumRealTimeUpdateLatency();
+  void ResetRealTimeUpdateLatency();
+
+  // Add a metric script node for each registered native metric not already in the scene (the module does this when a Perk Evaluator node is created)
+  void AddNativeMetricsToScene();
+
   void SetMetricInstancesRolesToID( vtkMRMLPerkEvaluatorNode* peNode, std::string nodeID, std::string role, /*vtkMRMLMetricInstanceNode::RoleTypeEnum*/ int roleType ); // For Python wrapping. Pass an enum in c++.
   void UpdatePervasiveMetrics( vtkMRMLLinearTransformNode* transformNode );
   void UpdatePervasiveMetrics( vtkMRMLMetricScriptNode* msNode );
@@ -102,7 +461,8 @@ public:
   void ShareMetricInstances( vtkMRMLPerkEvaluatorNode* peNode );
   void ShareMetricInstances( vtkMRMLMetricInstanceNode* miNode );
   void MergeMetricScripts( vtkMRMLMetricScriptNode* newMetricScriptNode );
-  void MergeAllMetricScripts();
+  void MergeAllMetricScripts(); // Scripts are grouped by their digests, so the scene is only gone over once
+  void ReplaceMetricScript( vtkMRMLMetricScriptNode* duplicateMetricScriptNode, vtkMRMLMetricScriptNode* keptMetricScriptNode ); // Removes the duplicate
 
   // Fix "old-style" scenes
   void FixOldStyleScene();
@@ -2,6 +2,8 @@
 
 #include "vtkMRMLMetricScriptNode.h"
 
+#include <iomanip>
+
 // Constants -----------------------------------------------------------------------------
 
 static const char* ASSOCIATED_METRIC_INSTANCE_REFERENCE_ROLE = "AssociatedMetricInstance";
@@ -49,7 +51,16 @@ void vtkMRMLMetricScriptNode
 ::WriteXML( ostream& of, int nIndent )
 {
   Superclass::WriteXML(of, nIndent);
-  // Nothing to do - the superclass method takes care of the storage
+  // The superclass method takes care of the storage
+
+  vtkIndent indent(nIndent);
+
+  // The digest lets scripts be told apart before (or without) their source code being read
+  of << indent << "PythonSourceDigest=\"" << this->PythonSourceDigest << "\"";
+  if ( this->IsNative() )
+  {
+    of << indent << "NativeMetricName=\"" << this->NativeMetricName << "\"";
+  }
 }
 
 
@@ -57,7 +68,26 @@ void vtkMRMLMetricScriptNode
 ::ReadXMLAttributes( const char** atts )
 {
   Superclass::ReadXMLAttributes(atts);
-  // Nothing to do - the superclass method takes care of the storage
+  // The superclass method takes care of the storage
+
+  // Read all MRML node attributes from two arrays of names and values
+  const char* attName;
+  const char* attValue;
+
+  while (*atts != NULL)
+  {
+    attName  = *(atts++);
+    attValue = *(atts++);
+
+    if ( ! strcmp( attName, "NativeMetricName" ) )
+    {
+      this->NativeMetricName = std::string( attValue );
+    }
+    if ( ! strcmp( attName, "PythonSourceDigest" ) )
+    {
+      this->PythonSourceDigest = std::string( attValue ); // Replaced when the source code is read
+    }
+  }
 }
 
 
@@ -65,8 +95,11 @@ void vtkMRMLMetricScriptNode
 ::Copy( vtkMRMLNode *anode )
 {
   Superclass::Copy( anode );
+  vtkMRMLMetricScriptNode *node = ( vtkMRMLMetricScriptNode* ) anode;
   
-  // Nothing to do - the superclass method takes care of the storage
+  // The superclass method takes care of the storage
+  this->NativeMetricName = node->NativeMetricName;
+  this->PythonSourceDigest = node->PythonSourceDigest;
 }
 
 
@@ -77,6 +110,8 @@ vtkMRMLMetricScriptNode
 ::vtkMRMLMetricScriptNode()
 {
   this->PythonSourceCode = "";
+  this->PythonSourceDigest = vtkMRMLMetricScriptNode::ComputeDigest( this->PythonSourceCode );
+  this->NativeMetricName = "";
 }
 
 
@@ -99,19 +134,81 @@ void vtkMRMLMetricScriptNode
 ::SetPythonSourceCode( std::string newPythonSourceCode )
 {
   this->PythonSourceCode = newPythonSourceCode;
+  this->PythonSourceDigest = vtkMRMLMetricScriptNode::ComputeDigest( this->PythonSourceCode );
   this->InvokeEvent( PythonSourceCodeChangedEvent );
 }
 
 
+std::string vtkMRMLMetricScriptNode
+::GetPythonSourceDigest()
+{
+  return this->PythonSourceDigest;
+}
+
+
+// 64-bit FNV-1a hash of the source code, as a hex string
+// This is not cryptographic - it is only used to quickly tell scripts apart
+std::string vtkMRMLMetricScriptNode
+::ComputeDigest( std::string sourceCode )
+{
+  unsigned long long hash = 14695981039346656037ULL;
+  for ( unsigned int i = 0; i < sourceCode.size(); i++ )
+  {
+    hash ^= ( unsigned char ) sourceCode.at( i );
+    hash *= 1099511628211ULL;
+  }
+
+  std::stringstream digestStream;
+  digestStream << std::hex << std::setw( 16 ) << std::setfill( '0' ) << hash;
+  return digestStream.str();
+}
+
+
+// Native metrics -----------------------------------------------------------------------------
+
+std::string vtkMRMLMetricScriptNode
+::GetNativeMetricName()
+{
+  return this->NativeMetricName;
+}
+
+
+void vtkMRMLMetricScriptNode
+::SetNativeMetricName( std::string newNativeMetricName )
+{
+  if ( newNativeMetricName.compare( this->NativeMetricName ) != 0 )
+  {
+    this->NativeMetricName = newNativeMetricName;
+    this->Modified();
+  }
+}
+
+
+bool vtkMRMLMetricScriptNode
+::IsNative()
+{
+  return this->NativeMetricName.compare( "" ) != 0;
+}
+
+
 // Comparison -----------------------------------------------------------------------------
 
 bool vtkMRMLMetricScriptNode
 ::IsEqual( vtkMRMLMetricScriptNode* msNode )
 {
+  // Different digests mean different source code, without comparing the whole source code
+  if ( this->GetPythonSourceDigest().compare( msNode->GetPythonSourceDigest() ) != 0 )
+  {
+    return false;
+  }
   if ( this->GetPythonSourceCode().compare( msNode->GetPythonSourceCode() ) != 0 )
   {
     return false;
   }
+  if ( this->GetNativeMetricName().compare( msNode->GetNativeMetricName() ) != 0 )
+  {
+    return false;
+  }
   return true;
 }
 
@@ -86,6 +86,14 @@ public:
   std::string GetPythonSourceCode();
   void SetPythonSourceCode( std::string newPythonSourceCode );
 
+  // Digest of the source code (computed whenever the source code is set)
+  std::string GetPythonSourceDigest();
+
+  // Name of the native metric computed in place of the script (empty if the metric is computed by the Python script)
+  std::string GetNativeMetricName();
+  void SetNativeMetricName( std::string newNativeMetricName );
+  bool IsNative();
+
   // Compare metric scripts
   bool IsEqual( vtkMRMLMetricScriptNode* msNode );
 
@@ -101,6 +109,10 @@ public:
 protected:
 
   std::string PythonSourceCode;
+  std::string PythonSourceDigest;
+  std::string NativeMetricName;
+
+  static std::string ComputeDigest( std::string sourceCode );
  
 };  
 
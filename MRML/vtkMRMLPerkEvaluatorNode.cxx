@@ -2,9 +2,14 @@
 
 #include "vtkMRMLPerkEvaluatorNode.h"
 
+#include "vtkTimerLog.h"
+
+#include <set>
+
 // Constants ------------------------------------------------------------------
 static const char* TRANSFORM_BUFFER_REFERENCE_ROLE = "TransformBuffer";
 static const char* METRICS_TABLE_REFERENCE_ROLE = "MetricsTable";
+static const char* PROFILING_TABLE_REFERENCE_ROLE = "ProfilingTable";
 static const char* METRIC_INSTANCE_REFERENCE_ROLE = "MetricInstance";
 
 
@@ -58,7 +63,11 @@ void vtkMRMLPerkEvaluatorNode
   of << indent << "MarkEnd=\"" << this->MarkEnd << "\"";
   of << indent << "NeedleOrientation=\"" << this->NeedleOrientation << "\"";
   of << indent << "PlaybackTime=\"" << this->PlaybackTime << "\"";
+  of << indent << "PlaybackInterpolation=\"" << this->PlaybackInterpolation << "\"";
+  of << indent << "AnalysisInterpolation=\"" << this->AnalysisInterpolation << "\"";
   of << indent << "RealTimeProcessing=\"" << this->RealTimeProcessing << "\"";
+  of << indent << "MetricsTableNotificationPolicy=\"" << this->MetricsTableNotificationPolicy << "\"";
+  of << indent << "MetricsTableMaximumNotificationRate=\"" << this->MetricsTableMaximumNotificationRate << "\"";
 }
 
 
@@ -100,10 +109,26 @@ void vtkMRMLPerkEvaluatorNode
     {
       this->PlaybackTime = atof( attValue );
     }
+    if ( ! strcmp( attName, "PlaybackInterpolation" ) )
+    {
+      this->PlaybackInterpolation = ( InterpolationEnum ) atoi( attValue );
+    }
+    if ( ! strcmp( attName, "AnalysisInterpolation" ) )
+    {
+      this->AnalysisInterpolation = ( InterpolationEnum ) atoi( attValue );
+    }
     if ( ! strcmp( attName, "RealTimeProcessing" ) )
     {
       this->RealTimeProcessing = atof( attValue );
     }
+    if ( ! strcmp( attName, "MetricsTableNotificationPolicy" ) )
+    {
+      this->MetricsTableNotificationPolicy = ( MetricsTableNotificationPolicyEnum ) atoi( attValue );
+    }
+    if ( ! strcmp( attName, "MetricsTableMaximumNotificationRate" ) )
+    {
+      this->MetricsTableMaximumNotificationRate = atof( attValue );
+    }
 
     // Read attributes from "old-style" scene
     if ( ! strcmp( attName, "MetricsDirectory" ) )
@@ -142,8 +167,12 @@ void vtkMRMLPerkEvaluatorNode
   this->MarkEnd = node->MarkEnd;
   this->NeedleOrientation = node->NeedleOrientation;
   this->PlaybackTime = node->PlaybackTime;
+  this->PlaybackInterpolation = node->PlaybackInterpolation;
+  this->AnalysisInterpolation = node->AnalysisInterpolation;
   this->AnalysisState = node->AnalysisState;
   this->RealTimeProcessing = node->RealTimeProcessing;
+  this->MetricsTableNotificationPolicy = node->MetricsTableNotificationPolicy;
+  this->MetricsTableMaximumNotificationRate = node->MetricsTableMaximumNotificationRate;
 }
 
 
@@ -161,12 +190,21 @@ vtkMRMLPerkEvaluatorNode
   this->NeedleOrientation = vtkMRMLPerkEvaluatorNode::PlusZ; // Default needle orientation protocol
 
   this->PlaybackTime = 0.0;
+  this->PlaybackInterpolation = vtkMRMLPerkEvaluatorNode::NoInterpolation;
+  this->AnalysisInterpolation = vtkMRMLPerkEvaluatorNode::NoInterpolation;
   this->AnalysisState = -1;
 
   this->RealTimeProcessing = false;
 
+  this->MetricsTableNotificationPolicy = vtkMRMLPerkEvaluatorNode::NotifyOncePerFrame;
+  this->MetricsTableMaximumNotificationRate = 20.0;
+  this->MetricsTableNotificationPending = false;
+  this->PendingNotificationFrameTime = 0.0;
+  this->LastMetricsTableNotificationTime = 0.0;
+
   this->AddNodeReferenceRole( TRANSFORM_BUFFER_REFERENCE_ROLE );
   this->AddNodeReferenceRole( METRICS_TABLE_REFERENCE_ROLE );
+  this->AddNodeReferenceRole( PROFILING_TABLE_REFERENCE_ROLE );
   this->AddNodeReferenceRole( METRIC_INSTANCE_REFERENCE_ROLE );
 
   // Setup for "old-style" attributes
@@ -345,10 +383,138 @@ void vtkMRMLPerkEvaluatorNode
     {
       this->InvokeEvent( RealTimeProcessingStartedEvent );
     }
+    else
+    {
+      this->InvokeEvent( RealTimeProcessingStoppedEvent );
+    }
+  }
+}
+
+
+vtkMRMLPerkEvaluatorNode::InterpolationEnum vtkMRMLPerkEvaluatorNode
+::GetPlaybackInterpolation()
+{
+  return this->PlaybackInterpolation;
+}
+
+
+void vtkMRMLPerkEvaluatorNode
+::SetPlaybackInterpolation( InterpolationEnum newInterpolation )
+{
+  if ( newInterpolation != this->PlaybackInterpolation )
+  {
+    this->PlaybackInterpolation = newInterpolation;
+    this->Modified();
+  }
+}
+
+
+vtkMRMLPerkEvaluatorNode::InterpolationEnum vtkMRMLPerkEvaluatorNode
+::GetAnalysisInterpolation()
+{
+  return this->AnalysisInterpolation;
+}
+
+
+void vtkMRMLPerkEvaluatorNode
+::SetAnalysisInterpolation( InterpolationEnum newInterpolation )
+{
+  if ( newInterpolation != this->AnalysisInterpolation )
+  {
+    this->AnalysisInterpolation = newInterpolation;
+    this->Modified();
   }
 }
 
 
+vtkMRMLPerkEvaluatorNode::MetricsTableNotificationPolicyEnum vtkMRMLPerkEvaluatorNode
+::GetMetricsTableNotificationPolicy()
+{
+  return this->MetricsTableNotificationPolicy;
+}
+
+
+void vtkMRMLPerkEvaluatorNode
+::SetMetricsTableNotificationPolicy( MetricsTableNotificationPolicyEnum newPolicy )
+{
+  if ( newPolicy != this->MetricsTableNotificationPolicy )
+  {
+    this->MetricsTableNotificationPolicy = newPolicy;
+    this->Modified();
+  }
+}
+
+
+double vtkMRMLPerkEvaluatorNode
+::GetMetricsTableMaximumNotificationRate()
+{
+  return this->MetricsTableMaximumNotificationRate;
+}
+
+
+void vtkMRMLPerkEvaluatorNode
+::SetMetricsTableMaximumNotificationRate( double newRate )
+{
+  if ( newRate != this->MetricsTableMaximumNotificationRate )
+  {
+    this->MetricsTableMaximumNotificationRate = newRate;
+    this->Modified();
+  }
+}
+
+
+bool vtkMRMLPerkEvaluatorNode
+::MetricsTableUpdated( double frameTime, bool valuesChanged )
+{
+  if ( this->MetricsTableNotificationPolicy == vtkMRMLPerkEvaluatorNode::NotifyOnValueChange && ! valuesChanged )
+  {
+    return this->MetricsTableNotificationPending;
+  }
+
+  // A sample from a new frame completes the previous frame
+  if ( this->MetricsTableNotificationPolicy == vtkMRMLPerkEvaluatorNode::NotifyOncePerFrame
+    && this->MetricsTableNotificationPending && frameTime != this->PendingNotificationFrameTime )
+  {
+    this->FlushMetricsTableNotification();
+  }
+
+  this->MetricsTableNotificationPending = true;
+  this->PendingNotificationFrameTime = frameTime;
+
+  if ( this->MetricsTableNotificationPolicy != vtkMRMLPerkEvaluatorNode::NotifyOncePerFrame )
+  {
+    return this->FlushMetricsTableNotification();
+  }
+  return true; // More samples from this frame may follow
+}
+
+
+bool vtkMRMLPerkEvaluatorNode
+::FlushMetricsTableNotification()
+{
+  if ( ! this->MetricsTableNotificationPending )
+  {
+    return false;
+  }
+
+  // Too soon after the last notification, so leave it pending (further updates are merged into it)
+  double currentTime = vtkTimerLog::GetUniversalTime();
+  if ( this->MetricsTableMaximumNotificationRate > 0
+    && currentTime - this->LastMetricsTableNotificationTime < 1.0 / this->MetricsTableMaximumNotificationRate )
+  {
+    return true;
+  }
+
+  this->MetricsTableNotificationPending = false;
+  this->LastMetricsTableNotificationTime = currentTime;
+  if ( this->GetMetricsTableNode() != NULL )
+  {
+    this->GetMetricsTableNode()->Modified();
+  }
+  return false;
+}
+
+
 // Metric scripts ------------------------------------------------------------------------------------------------
 
 
@@ -362,6 +528,22 @@ void vtkMRMLPerkEvaluatorNode
 }
 
 
+void vtkMRMLPerkEvaluatorNode
+::AddMetricInstanceIDs( std::vector< std::string > metricInstanceIDs )
+{
+  std::vector< std::string > currentMetricInstanceIDs = this->GetMetricInstanceIDs();
+  std::set< std::string > referencedMetricInstanceIDs( currentMetricInstanceIDs.begin(), currentMetricInstanceIDs.end() );
+
+  for ( unsigned int i = 0; i < metricInstanceIDs.size(); i++ )
+  {
+    if ( referencedMetricInstanceIDs.insert( metricInstanceIDs.at( i ) ).second )
+    {
+      this->AddAndObserveNodeReferenceID( METRIC_INSTANCE_REFERENCE_ROLE, metricInstanceIDs.at( i ).c_str() );
+    }
+  }
+}
+
+
 void vtkMRMLPerkEvaluatorNode
 ::RemoveMetricInstanceID( std::string transformID )
 {
@@ -505,6 +687,28 @@ void vtkMRMLPerkEvaluatorNode
 }
 
 
+vtkMRMLTableNode* vtkMRMLPerkEvaluatorNode
+::GetProfilingTableNode()
+{
+  return vtkMRMLTableNode::SafeDownCast( this->GetNodeReference( PROFILING_TABLE_REFERENCE_ROLE ) );
+}
+
+
+std::string vtkMRMLPerkEvaluatorNode
+::GetProfilingTableID()
+{
+  return this->GetNodeReferenceIDString( PROFILING_TABLE_REFERENCE_ROLE );
+}
+
+
+// Not observed, the profile is only written by the logic
+void vtkMRMLPerkEvaluatorNode
+::SetProfilingTableID( std::string newProfilingTableID )
+{
+  this->SetNodeReferenceID( PROFILING_TABLE_REFERENCE_ROLE, newProfilingTableID.c_str() );
+}
+
+
 // MRML node event processing -----------------------------------------------------------------
 
 void vtkMRMLPerkEvaluatorNode
@@ -93,6 +93,7 @@ public:
   
   // Metric nodes
   void AddMetricInstanceID( std::string metricInstanceID );
+  void AddMetricInstanceIDs( std::vector< std::string > metricInstanceIDs ); // Only the ones not already referenced, checked all at once
   void RemoveMetricInstanceID( std::string metricInstanceID );
   std::vector< std::string > GetMetricInstanceIDs();
   bool IsMetricInstanceID( std::string metricInstanceID );
@@ -102,9 +103,33 @@ public:
   double GetPlaybackTime();
   void SetPlaybackTime( double newPlaybackTime, bool analysis = false );
 
+  // How transforms are sampled between their records: the record nearest to the time, or
+  // interpolated between the surrounding records (linearly for positions, SLERP for orientations)
+  enum InterpolationEnum{ NoInterpolation, LinearInterpolation };
+  // For moving the transforms in the scene during playback
+  InterpolationEnum GetPlaybackInterpolation();
+  void SetPlaybackInterpolation( InterpolationEnum newInterpolation );
+  // For the transforms passed to the native metrics when analyzing (the Python metrics calculator samples the records itself)
+  InterpolationEnum GetAnalysisInterpolation();
+  void SetAnalysisInterpolation( InterpolationEnum newInterpolation );
+
   bool GetRealTimeProcessing();
   void SetRealTimeProcessing( bool newRealTimeProcessing );
 
+  // How the metrics table is notified (i.e. modified) when real-time processing updates its values
+  // Every sample, once per tracker frame (i.e. per timestamp), or only for samples which changed a value
+  enum MetricsTableNotificationPolicyEnum{ NotifyEverySample, NotifyOncePerFrame, NotifyOnValueChange };
+  MetricsTableNotificationPolicyEnum GetMetricsTableNotificationPolicy();
+  void SetMetricsTableNotificationPolicy( MetricsTableNotificationPolicyEnum newPolicy );
+  // At most this many notifications per second, regardless of the policy (zero means no limit)
+  double GetMetricsTableMaximumNotificationRate();
+  void SetMetricsTableMaximumNotificationRate( double newRate );
+
+  // Report that real-time processing updated the metrics table for the sample at the given (tracker) time
+  // Returns true if a notification is still pending (then, FlushMetricsTableNotification must be called later)
+  bool MetricsTableUpdated( double frameTime, bool valuesChanged );
+  bool FlushMetricsTableNotification();
+
   // Analysis state
   // -1 means analysis is halted
   // Other values indicate the progress of the analysis (on 0%-100%)
@@ -123,6 +148,11 @@ public:
   std::string GetMetricsTableID();
   void SetMetricsTableID( std::string newMetricsTableID );
 
+  // Profile of the metric computations (time, samples, Python calls, memory), only written if a table is set (profiling is opt-in)
+  vtkMRMLTableNode* GetProfilingTableNode();
+  std::string GetProfilingTableID();
+  void SetProfilingTableID( std::string newProfilingTableID );
+
   // Pass along transform buffer events
   void ProcessMRMLEvents( vtkObject *caller, unsigned long event, void *callData );
   enum
@@ -130,6 +160,7 @@ public:
     TransformRealTimeAddedEvent = vtkCommand::UserEvent + 1,
     RealTimeProcessingStartedEvent,
     AnalysisStateUpdatedEvent,
+    RealTimeProcessingStoppedEvent,
   };
   
   
@@ -150,11 +181,19 @@ protected:
   NeedleOrientationEnum NeedleOrientation;
 
   double PlaybackTime;
+  InterpolationEnum PlaybackInterpolation;
+  InterpolationEnum AnalysisInterpolation;
 
   int AnalysisState;
 
   bool RealTimeProcessing;
 
+  MetricsTableNotificationPolicyEnum MetricsTableNotificationPolicy;
+  double MetricsTableMaximumNotificationRate;
+  bool MetricsTableNotificationPending;
+  double PendingNotificationFrameTime;
+  double LastMetricsTableNotificationTime; // Wall clock time
+
 };  
 
 #endif
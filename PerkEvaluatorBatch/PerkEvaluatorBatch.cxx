@@ -0,0 +1,457 @@
+
+// Computes the native Perk Evaluator metrics for transform buffer files without the Slicer application.
+// This builds the same scene the module would (transforms and their hierarchy, metric scripts, metric instances, Perk Evaluator nodes),
+// and computes the native metrics with the same logic as the module's analysis. Only the native metrics are computed:
+// the Python metric scripts require the Slicer application. If the metrics directory has any, this fails rather than
+// writing tables without them, unless --native-only is given (then, the tables have no rows for them).
+
+// PerkEvaluator includes
+#include "vtkSlicerPerkEvaluatorLogic.h"
+#include "vtkPerkEvaluatorMetricFactory.h"
+
+// TransformRecorder includes
+#include "vtkSlicerTransformRecorderLogic.h"
+#include "vtkMRMLTransformBufferNode.h"
+
+// MRML includes
+#include "vtkMRMLScene.h"
+#include "vtkMRMLTransformNode.h"
+#include "vtkMRMLLinearTransformNode.h"
+#include "vtkMRMLModelNode.h"
+#include "vtkMRMLModelStorageNode.h"
+#include "vtkMRMLTableNode.h"
+
+// VTK includes
+#include <vtkMatrix4x4.h>
+#include <vtkSmartPointer.h>
+#include <vtkTable.h>
+#include <vtksys/Directory.hxx>
+#include <vtksys/SystemTools.hxx>
+
+// STD includes
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "PerkEvaluatorBatchCLP.h"
+
+
+// Configuration ----------------------------------------------
+
+struct BatchConfiguration
+{
+  std::map< std::string, std::string > TransformRoles; // From transform names to roles
+  std::map< std::string, std::string > TransformParents; // From transform names to their parents' names
+  std::map< std::string, std::vector< double > > StaticTransforms; // Transforms which are not recorded, from names to their matrices to parent
+  std::map< std::string, std::string > AnatomyFiles; // From roles to model files
+  vtkMRMLPerkEvaluatorNode::NeedleOrientationEnum NeedleOrientation;
+  bool NeedleOrientationSet;
+  double MarkBegin;
+  bool MarkBeginSet;
+  double MarkEnd;
+  bool MarkEndSet;
+};
+
+
+bool ReadNeedleOrientation( std::string name, vtkMRMLPerkEvaluatorNode::NeedleOrientationEnum& needleOrientation )
+{
+  const char* names[] = { "PlusX", "MinusX", "PlusY", "MinusY", "PlusZ", "MinusZ" };
+  for ( int i = 0; i < 6; i++ )
+  {
+    if ( name.compare( names[ i ] ) == 0 )
+    {
+      needleOrientation = vtkMRMLPerkEvaluatorNode::NeedleOrientationEnum( i );
+      return true;
+    }
+  }
+  return false;
+}
+
+
+bool ReadConfiguration( std::string fileName, BatchConfiguration& config )
+{
+  config.NeedleOrientationSet = false;
+  config.MarkBeginSet = false;
+  config.MarkEndSet = false;
+
+  if ( fileName.empty() )
+  {
+    return true; // Nothing to configure
+  }
+
+  std::ifstream configFile( fileName.c_str() );
+  if ( ! configFile.is_open() )
+  {
+    std::cerr << "Could not open configuration file: " << fileName << std::endl;
+    return false;
+  }
+
+  std::string line;
+  int lineNumber = 0;
+  while ( std::getline( configFile, line ) )
+  {
+    lineNumber++;
+    std::stringstream lineStream( line );
+    std::string key;
+    if ( ! ( lineStream >> key ) || key.at( 0 ) == '#' )
+    {
+      continue; // Blank line or comment
+    }
+
+    bool valid = false;
+    if ( key.compare( "TransformRole" ) == 0 )
+    {
+      std::string transformName, role;
+      valid = static_cast< bool >( lineStream >> transformName >> role );
+      config.TransformRoles[ transformName ] = role;
+    }
+    else if ( key.compare( "TransformParent" ) == 0 )
+    {
+      std::string transformName, parentName;
+      valid = static_cast< bool >( lineStream >> transformName >> parentName );
+      config.TransformParents[ transformName ] = parentName;
+    }
+    else if ( key.compare( "StaticTransform" ) == 0 )
+    {
+      std::string transformName;
+      std::vector< double > matrixElements( 16 );
+      valid = static_cast< bool >( lineStream >> transformName );
+      for ( unsigned int i = 0; i < matrixElements.size() && valid; i++ )
+      {
+        valid = static_cast< bool >( lineStream >> matrixElements.at( i ) );
+      }
+      config.StaticTransforms[ transformName ] = matrixElements;
+    }
+    else if ( key.compare( "AnatomyRole" ) == 0 )
+    {
+      std::string role, modelFileName;
+      valid = static_cast< bool >( lineStream >> role >> modelFileName );
+      config.AnatomyFiles[ role ] = modelFileName;
+    }
+    else if ( key.compare( "NeedleOrientation" ) == 0 )
+    {
+      std::string orientationName;
+      valid = ( lineStream >> orientationName ) && ReadNeedleOrientation( orientationName, config.NeedleOrientation );
+      config.NeedleOrientationSet = valid;
+    }
+    else if ( key.compare( "MarkBegin" ) == 0 )
+    {
+      valid = static_cast< bool >( lineStream >> config.MarkBegin );
+      config.MarkBeginSet = valid;
+    }
+    else if ( key.compare( "MarkEnd" ) == 0 )
+    {
+      valid = static_cast< bool >( lineStream >> config.MarkEnd );
+      config.MarkEndSet = valid;
+    }
+
+    if ( ! valid )
+    {
+      std::cerr << "Invalid line " << lineNumber << " in configuration file: " << line << std::endl;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+// Scene setup ----------------------------------------------
+
+// The recorded transforms must be in the scene for the roles to refer to them
+void AddRecordedTransformsToScene( vtkMRMLScene* scene, vtkMRMLTransformBufferNode* bufferNode )
+{
+  std::vector< std::string > recordedTransformNames = bufferNode->GetAllRecordedTransformNames();
+  for ( unsigned int i = 0; i < recordedTransformNames.size(); i++ )
+  {
+    if ( scene->GetFirstNodeByName( recordedTransformNames.at( i ).c_str() ) != NULL )
+    {
+      continue;
+    }
+
+    vtkSmartPointer< vtkMRMLLinearTransformNode > transformNode = vtkSmartPointer< vtkMRMLLinearTransformNode >::New();
+    transformNode->SetName( recordedTransformNames.at( i ).c_str() );
+    scene->AddNode( transformNode );
+  }
+}
+
+
+// The transforms which are not recorded, with their matrices (row-major)
+void AddStaticTransformsToScene( vtkMRMLScene* scene, std::map< std::string, std::vector< double > >& staticTransforms )
+{
+  for ( std::map< std::string, std::vector< double > >::iterator itr = staticTransforms.begin(); itr != staticTransforms.end(); itr++ )
+  {
+    vtkMRMLLinearTransformNode* transformNode = vtkMRMLLinearTransformNode::SafeDownCast( scene->GetFirstNodeByName( itr->first.c_str() ) );
+    if ( transformNode != NULL )
+    {
+      std::cerr << "Transform " << itr->first << " is recorded, so its static matrix is ignored." << std::endl;
+      continue;
+    }
+
+    vtkSmartPointer< vtkMatrix4x4 > matrix = vtkSmartPointer< vtkMatrix4x4 >::New();
+    matrix->DeepCopy( &itr->second.at( 0 ) );
+    vtkSmartPointer< vtkMRMLLinearTransformNode > newTransformNode = vtkSmartPointer< vtkMRMLLinearTransformNode >::New();
+    newTransformNode->SetName( itr->first.c_str() );
+    scene->AddNode( newTransformNode );
+    newTransformNode->SetMatrixTransformToParent( matrix );
+  }
+}
+
+
+// Same hierarchy as in the scene the procedures were recorded in, so the metrics are computed in the same coordinate system
+bool BuildTransformHierarchy( vtkMRMLScene* scene, std::map< std::string, std::string >& transformParents )
+{
+  for ( std::map< std::string, std::string >::iterator itr = transformParents.begin(); itr != transformParents.end(); itr++ )
+  {
+    vtkMRMLLinearTransformNode* transformNode = vtkMRMLLinearTransformNode::SafeDownCast( scene->GetFirstNodeByName( itr->first.c_str() ) );
+    vtkMRMLLinearTransformNode* parentNode = vtkMRMLLinearTransformNode::SafeDownCast( scene->GetFirstNodeByName( itr->second.c_str() ) );
+    if ( transformNode == NULL || parentNode == NULL )
+    {
+      std::cerr << "Transform " << ( ( transformNode == NULL ) ? itr->first : itr->second ) << " is neither recorded nor static, so the parent of " << itr->first << " cannot be set." << std::endl;
+      return false;
+    }
+    transformNode->SetAndObserveTransformNodeID( parentNode->GetID() );
+  }
+
+  // A cycle would make the hierarchy endless
+  for ( std::map< std::string, std::string >::iterator itr = transformParents.begin(); itr != transformParents.end(); itr++ )
+  {
+    vtkMRMLLinearTransformNode* transformNode = vtkMRMLLinearTransformNode::SafeDownCast( scene->GetFirstNodeByName( itr->first.c_str() ) );
+    unsigned int depth = 0;
+    for ( vtkMRMLTransformNode* parent = transformNode->GetParentTransformNode(); parent != NULL; parent = parent->GetParentTransformNode() )
+    {
+      if ( ++depth > transformParents.size() )
+      {
+        std::cerr << "The parent of transform " << itr->first << " is its own descendant." << std::endl;
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+
+vtkMRMLModelNode* AddAnatomyToScene( vtkMRMLScene* scene, std::string role, std::string modelFileName )
+{
+  vtkSmartPointer< vtkMRMLModelNode > modelNode = vtkSmartPointer< vtkMRMLModelNode >::New();
+  modelNode->SetName( role.c_str() );
+  scene->AddNode( modelNode );
+
+  vtkSmartPointer< vtkMRMLModelStorageNode > modelStorageNode = vtkSmartPointer< vtkMRMLModelStorageNode >::New();
+  modelStorageNode->SetFileName( modelFileName.c_str() );
+  scene->AddNode( modelStorageNode );
+  modelNode->SetAndObserveStorageNodeID( modelStorageNode->GetID() );
+
+  if ( ! modelStorageNode->ReadData( modelNode ) )
+  {
+    std::cerr << "Could not read model file: " << modelFileName << std::endl;
+    return NULL;
+  }
+
+  return modelNode;
+}
+
+
+// Output ----------------------------------------------
+
+std::string GetCSVField( std::string value )
+{
+  if ( value.find_first_of( ",\"\n" ) == std::string::npos )
+  {
+    return value;
+  }
+
+  std::string quotedValue = "\"";
+  for ( unsigned int i = 0; i < value.size(); i++ )
+  {
+    quotedValue += ( value.at( i ) == '"' ) ? std::string( "\"\"" ) : std::string( 1, value.at( i ) );
+  }
+  return quotedValue + "\"";
+}
+
+
+bool WriteMetricsTable( vtkMRMLTableNode* metricsTableNode, std::string fileName )
+{
+  std::ofstream outputFile( fileName.c_str() );
+  if ( ! outputFile.is_open() )
+  {
+    std::cerr << "Could not write metrics table: " << fileName << std::endl;
+    return false;
+  }
+
+  vtkTable* table = metricsTableNode->GetTable();
+  for ( int j = 0; j < table->GetNumberOfColumns(); j++ )
+  {
+    outputFile << ( j > 0 ? "," : "" ) << GetCSVField( table->GetColumnName( j ) );
+  }
+  outputFile << std::endl;
+
+  for ( int i = 0; i < table->GetNumberOfRows(); i++ )
+  {
+    for ( int j = 0; j < table->GetNumberOfColumns(); j++ )
+    {
+      outputFile << ( j > 0 ? "," : "" ) << GetCSVField( table->GetValue( i, j ).ToString() );
+    }
+    outputFile << std::endl;
+  }
+
+  return true;
+}
+
+
+// Main ----------------------------------------------
+
+int main( int argc, char* argv[] )
+{
+  PARSE_ARGS;
+
+  if ( transformBufferFiles.empty() )
+  {
+    std::cerr << "No transform buffer files to analyze." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  BatchConfiguration config;
+  if ( ! ReadConfiguration( configFile, config ) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  if ( ! vtksys::SystemTools::MakeDirectory( outputDirectory.c_str() ) )
+  {
+    std::cerr << "Could not create output directory: " << outputDirectory << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  vtkSmartPointer< vtkMRMLScene > scene = vtkSmartPointer< vtkMRMLScene >::New();
+
+  vtkSmartPointer< vtkSlicerTransformRecorderLogic > trLogic = vtkSmartPointer< vtkSlicerTransformRecorderLogic >::New();
+  trLogic->SetMRMLScene( scene );
+  vtkSmartPointer< vtkSlicerPerkEvaluatorLogic > peLogic = vtkSmartPointer< vtkSlicerPerkEvaluatorLogic >::New();
+  peLogic->SetMRMLScene( scene );
+  peLogic->SetNumberOfBatchThreads( numberOfThreads );
+
+  // Native metrics only, since there is no Python outside the application
+  if ( ! metricsDirectory.empty() )
+  {
+    vtkPerkEvaluatorMetricFactory::GetInstance()->LoadPluginsFromDirectory( metricsDirectory );
+
+    int numPythonMetrics = 0;
+    vtksys::Directory metricsDirectoryContents;
+    metricsDirectoryContents.Load( metricsDirectory.c_str() );
+    for ( unsigned long i = 0; i < metricsDirectoryContents.GetNumberOfFiles(); i++ )
+    {
+      numPythonMetrics += ( vtksys::SystemTools::GetFilenameLastExtension( metricsDirectoryContents.GetFile( i ) ).compare( ".py" ) == 0 ) ? 1 : 0;
+    }
+    if ( numPythonMetrics > 0 && ! nativeOnly )
+    {
+      std::cerr << "Found " << numPythonMetrics << " Python metric script(s) in " << metricsDirectory << ", which require the Slicer application." << std::endl;
+      std::cerr << "Compute them with the Perk Evaluator module, or pass --native-only to compute only the native metrics." << std::endl;
+      return EXIT_FAILURE;
+    }
+    if ( numPythonMetrics > 0 )
+    {
+      std::cerr << "Skipping " << numPythonMetrics << " Python metric script(s) in " << metricsDirectory << " (native metrics only)." << std::endl;
+    }
+  }
+
+  // Read all the buffers first, so the pervasive metrics are created for the transforms in any of them
+  std::vector< vtkMRMLTransformBufferNode* > bufferNodes;
+  for ( unsigned int i = 0; i < transformBufferFiles.size(); i++ )
+  {
+    vtkSmartPointer< vtkMRMLTransformBufferNode > bufferNode = vtkSmartPointer< vtkMRMLTransformBufferNode >::New();
+    bufferNode->SetName( vtksys::SystemTools::GetFilenameWithoutLastExtension( transformBufferFiles.at( i ) ).c_str() );
+    scene->AddNode( bufferNode );
+    trLogic->ImportFromFile( bufferNode, transformBufferFiles.at( i ) );
+    if ( bufferNode->GetAllRecordedTransformNames().empty() )
+    {
+      std::cerr << "No transforms recorded in transform buffer file: " << transformBufferFiles.at( i ) << std::endl;
+    }
+
+    AddRecordedTransformsToScene( scene, bufferNode );
+    bufferNodes.push_back( bufferNode );
+  }
+
+  AddStaticTransformsToScene( scene, config.StaticTransforms );
+  if ( ! BuildTransformHierarchy( scene, config.TransformParents ) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  std::map< std::string, std::string > anatomyNodeIDs; // From roles
+  for ( std::map< std::string, std::string >::iterator itr = config.AnatomyFiles.begin(); itr != config.AnatomyFiles.end(); itr++ )
+  {
+    vtkMRMLModelNode* modelNode = AddAnatomyToScene( scene, itr->first, itr->second );
+    if ( modelNode == NULL )
+    {
+      return EXIT_FAILURE;
+    }
+    anatomyNodeIDs[ itr->first ] = modelNode->GetID();
+  }
+
+  peLogic->AddNativeMetricsToScene();
+
+  // One Perk Evaluator node (with its own metrics table) per buffer, all with the same roles
+  std::vector< vtkMRMLPerkEvaluatorNode* > peNodes;
+  for ( unsigned int i = 0; i < bufferNodes.size(); i++ )
+  {
+    vtkSmartPointer< vtkMRMLTableNode > metricsTableNode = vtkSmartPointer< vtkMRMLTableNode >::New();
+    metricsTableNode->SetName( ( std::string( bufferNodes.at( i )->GetName() ) + "Metrics" ).c_str() );
+    scene->AddNode( metricsTableNode );
+
+    vtkSmartPointer< vtkMRMLPerkEvaluatorNode > peNode = vtkSmartPointer< vtkMRMLPerkEvaluatorNode >::New();
+    peNode->SetName( ( std::string( bufferNodes.at( i )->GetName() ) + "PerkEvaluator" ).c_str() );
+    peNode->SetScene( scene );
+    scene->AddNode( peNode );
+    peNode->SetTransformBufferID( bufferNodes.at( i )->GetID() );
+    peNode->SetMetricsTableID( metricsTableNode->GetID() );
+
+    for ( std::map< std::string, std::string >::iterator itr = config.TransformRoles.begin(); itr != config.TransformRoles.end(); itr++ )
+    {
+      vtkMRMLLinearTransformNode* transformNode = vtkMRMLLinearTransformNode::SafeDownCast( scene->GetFirstNodeByName( itr->first.c_str() ) );
+      if ( transformNode == NULL )
+      {
+        std::cerr << "Transform " << itr->first << " is not recorded in any transform buffer, so it cannot fill the role " << itr->second << "." << std::endl;
+        continue;
+      }
+      peLogic->SetMetricInstancesRolesToID( peNode, transformNode->GetID(), itr->second, vtkMRMLMetricInstanceNode::TransformRole );
+    }
+    for ( std::map< std::string, std::string >::iterator itr = anatomyNodeIDs.begin(); itr != anatomyNodeIDs.end(); itr++ )
+    {
+      peLogic->SetMetricInstancesRolesToID( peNode, itr->second, itr->first, vtkMRMLMetricInstanceNode::AnatomyRole );
+    }
+
+    if ( config.NeedleOrientationSet )
+    {
+      peNode->SetNeedleOrientation( config.NeedleOrientation );
+    }
+    if ( config.MarkBeginSet )
+    {
+      peNode->SetMarkBegin( config.MarkBegin );
+    }
+    if ( config.MarkEndSet )
+    {
+      peNode->SetMarkEnd( config.MarkEnd );
+    }
+
+    peNodes.push_back( peNode );
+  }
+
+  peLogic->ComputeMetricsBatch( peNodes );
+
+  int returnValue = EXIT_SUCCESS;
+  for ( unsigned int i = 0; i < peNodes.size(); i++ )
+  {
+    std::string fileName = outputDirectory + "/" + bufferNodes.at( i )->GetName() + "Metrics.csv";
+    if ( ! WriteMetricsTable( peNodes.at( i )->GetMetricsTableNode(), fileName ) )
+    {
+      returnValue = EXIT_FAILURE;
+    }
+  }
+
+  return returnValue;
+}
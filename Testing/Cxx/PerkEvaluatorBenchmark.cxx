@@ -0,0 +1,295 @@
+
+// Times the Perk Evaluator logic on synthetic procedures, without the Slicer application.
+// Each configuration (number of records, number of tools) builds its own scene, like the batch module does, with one
+// transform buffer, one Perk Evaluator node and all the native metrics. The results are written as comma-separated
+// values (one row per benchmark and configuration), so runs before and after an upgrade can be compared directly.
+
+// PerkEvaluator includes
+#include "vtkSlicerPerkEvaluatorLogic.h"
+#include "vtkPerkEvaluatorProcedureGenerator.h"
+#include "vtkMRMLPerkEvaluatorNode.h"
+
+// TransformRecorder includes
+#include "vtkSlicerTransformRecorderLogic.h"
+#include "vtkMRMLTransformBufferNode.h"
+
+// MRML includes
+#include "vtkMRMLScene.h"
+#include "vtkMRMLLinearTransformNode.h"
+#include "vtkMRMLTableNode.h"
+
+// VTK includes
+#include <vtkCollection.h>
+#include <vtkDoubleArray.h>
+#include <vtkSmartPointer.h>
+#include <vtkTimerLog.h>
+
+// STD includes
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+// Constants ----------------------------------------------
+
+static const double SAMPLING_RATE = 60.0; // Hz
+static const int HIERARCHY_DEPTH = 2;
+static const int NUMBER_OF_MESSAGES = 10;
+static const int NUMBER_OF_PLAYBACK_STEPS = 1000;
+static const int NUMBER_OF_REPETITIONS = 5;
+static const int DEFAULT_MINIMUM_RECORDS = 10000;
+static const int DEFAULT_MAXIMUM_RECORDS = 10000000;
+
+
+// Configuration ----------------------------------------------
+
+struct BenchmarkConfiguration
+{
+  std::string OutputFileName; // Standard output if empty
+  int MinimumRecords;
+  int MaximumRecords;
+  std::vector< int > NumbersOfTools;
+};
+
+
+bool ReadArguments( int argc, char* argv[], BenchmarkConfiguration& config )
+{
+  config.OutputFileName = "";
+  config.MinimumRecords = DEFAULT_MINIMUM_RECORDS;
+  config.MaximumRecords = DEFAULT_MAXIMUM_RECORDS;
+  config.NumbersOfTools.clear();
+
+  for ( int i = 1; i < argc; i++ )
+  {
+    std::string argument = argv[ i ];
+    if ( i + 1 >= argc )
+    {
+      std::cerr << "Missing value for argument: " << argument << std::endl;
+      return false;
+    }
+
+    std::stringstream value( argv[ ++i ] );
+    bool valid = false;
+    if ( argument.compare( "--output" ) == 0 )
+    {
+      valid = static_cast< bool >( value >> config.OutputFileName );
+    }
+    else if ( argument.compare( "--minimum-records" ) == 0 )
+    {
+      valid = ( value >> config.MinimumRecords ) && config.MinimumRecords > 0;
+    }
+    else if ( argument.compare( "--maximum-records" ) == 0 )
+    {
+      valid = ( value >> config.MaximumRecords ) && config.MaximumRecords > 0;
+    }
+    else if ( argument.compare( "--tools" ) == 0 )
+    {
+      int numTools = 0;
+      valid = ( value >> numTools ) && numTools > 0;
+      config.NumbersOfTools.push_back( numTools );
+    }
+
+    if ( ! valid )
+    {
+      std::cerr << "Invalid argument: " << argument << " " << argv[ i ] << std::endl;
+      std::cerr << "Usage: " << argv[ 0 ] << " [--output file.csv] [--minimum-records n] [--maximum-records n] [--tools n]..." << std::endl;
+      return false;
+    }
+  }
+
+  if ( config.NumbersOfTools.empty() )
+  {
+    config.NumbersOfTools.push_back( 1 );
+    config.NumbersOfTools.push_back( 5 );
+    config.NumbersOfTools.push_back( 20 );
+  }
+
+  return true;
+}
+
+
+// Scene setup ----------------------------------------------
+
+vtkMRMLPerkEvaluatorNode* AddPerkEvaluatorToScene( vtkMRMLScene* scene, vtkMRMLTransformBufferNode* bufferNode )
+{
+  vtkSmartPointer< vtkMRMLTableNode > metricsTableNode = vtkSmartPointer< vtkMRMLTableNode >::New();
+  metricsTableNode->SetName( "BenchmarkMetrics" );
+  scene->AddNode( metricsTableNode );
+
+  vtkSmartPointer< vtkMRMLPerkEvaluatorNode > peNode = vtkSmartPointer< vtkMRMLPerkEvaluatorNode >::New();
+  peNode->SetName( "BenchmarkPerkEvaluator" );
+  peNode->SetScene( scene );
+  scene->AddNode( peNode );
+  peNode->SetTransformBufferID( bufferNode->GetID() );
+  peNode->SetMetricsTableID( metricsTableNode->GetID() );
+  peNode->SetMarkBegin( 0.0 );
+  peNode->SetMarkEnd( bufferNode->GetTotalTime() );
+
+  return peNode;
+}
+
+
+// Output ----------------------------------------------
+
+class BenchmarkResults
+{
+public:
+
+  BenchmarkResults( std::ostream& output )
+    : Output( output )
+  {
+    this->Output << "Benchmark,NumberOfRecords,NumberOfTools,NumberOfRepetitions,TotalTime,TimePerRepetition" << std::endl;
+  }
+
+  void Add( std::string benchmark, int numRecords, int numTools, int numRepetitions, double totalTime )
+  {
+    this->Output << benchmark << "," << numRecords << "," << numTools << "," << numRepetitions << ","
+      << totalTime << "," << ( totalTime / std::max( numRepetitions, 1 ) ) << std::endl;
+  }
+
+protected:
+
+  std::ostream& Output;
+};
+
+
+// Benchmarks ----------------------------------------------
+
+void RunBenchmarks( int numRecords, int numTools, BenchmarkResults& results )
+{
+  vtkSmartPointer< vtkMRMLScene > scene = vtkSmartPointer< vtkMRMLScene >::New();
+  vtkSmartPointer< vtkSlicerTransformRecorderLogic > trLogic = vtkSmartPointer< vtkSlicerTransformRecorderLogic >::New();
+  trLogic->SetMRMLScene( scene );
+  vtkSmartPointer< vtkSlicerPerkEvaluatorLogic > peLogic = vtkSmartPointer< vtkSlicerPerkEvaluatorLogic >::New();
+  peLogic->SetMRMLScene( scene );
+
+  // No dropouts, so the buffer has the requested number of records
+  vtkSmartPointer< vtkPerkEvaluatorProcedureGenerator > generator = vtkSmartPointer< vtkPerkEvaluatorProcedureGenerator >::New();
+  generator->SetNumberOfTools( numTools );
+  generator->SetHierarchyDepth( HIERARCHY_DEPTH );
+  generator->SetSamplingRate( SAMPLING_RATE );
+  generator->SetDuration( numRecords / ( numTools * SAMPLING_RATE ) );
+  generator->SetDropoutRate( 0.0 );
+  generator->SetNumberOfMessages( NUMBER_OF_MESSAGES );
+  generator->CreateToolNodes( scene );
+
+  vtkSmartPointer< vtkMRMLTransformBufferNode > bufferNode = vtkSmartPointer< vtkMRMLTransformBufferNode >::New();
+  bufferNode->SetName( "BenchmarkBuffer" );
+  scene->AddNode( bufferNode );
+  generator->Generate( bufferNode );
+  vtkMRMLPerkEvaluatorNode* peNode = AddPerkEvaluatorToScene( scene, bufferNode );
+
+  // The native metrics are all pervasive: an instance of every one for every tool, shared with the Perk Evaluator node
+  double startTime = vtkTimerLog::GetUniversalTime();
+  peLogic->AddNativeMetricsToScene();
+  results.Add( "PervasiveMetricCreation", numRecords, numTools, 1, vtkTimerLog::GetUniversalTime() - startTime );
+
+  // Only native metrics are in the scene (there is no Python here), so this does not time the script metrics
+  startTime = vtkTimerLog::GetUniversalTime();
+  for ( int i = 0; i < NUMBER_OF_REPETITIONS; i++ )
+  {
+    peLogic->ComputeMetrics( peNode );
+  }
+  results.Add( "ComputeMetricsNativeOnly", numRecords, numTools, NUMBER_OF_REPETITIONS, vtkTimerLog::GetUniversalTime() - startTime );
+
+  std::vector< std::string > metricInstanceIDs = peNode->GetMetricInstanceIDs();
+  startTime = vtkTimerLog::GetUniversalTime();
+  for ( int i = 0; i < NUMBER_OF_REPETITIONS; i++ )
+  {
+    for ( unsigned int j = 0; j < metricInstanceIDs.size(); j++ )
+    {
+      peLogic->GetMetricValue( vtkMRMLMetricInstanceNode::SafeDownCast( scene->GetNodeByID( metricInstanceIDs.at( j ) ) ), peNode );
+    }
+  }
+  results.Add( "GetMetricValue", numRecords, numTools, NUMBER_OF_REPETITIONS * metricInstanceIDs.size(), vtkTimerLog::GetUniversalTime() - startTime );
+
+  // Playback forwards through the whole procedure, then scrubbing to arbitrary times
+  double minimumTime = bufferNode->GetMinimumTime();
+  double totalTime = bufferNode->GetTotalTime();
+  startTime = vtkTimerLog::GetUniversalTime();
+  for ( int i = 0; i < NUMBER_OF_PLAYBACK_STEPS; i++ )
+  {
+    peNode->SetPlaybackTime( minimumTime + totalTime * i / NUMBER_OF_PLAYBACK_STEPS );
+    peLogic->UpdateSceneToPlaybackTime( peNode );
+  }
+  results.Add( "UpdateSceneToPlaybackTimeSequential", numRecords, numTools, NUMBER_OF_PLAYBACK_STEPS, vtkTimerLog::GetUniversalTime() - startTime );
+
+  srand( 0 );
+  startTime = vtkTimerLog::GetUniversalTime();
+  for ( int i = 0; i < NUMBER_OF_PLAYBACK_STEPS; i++ )
+  {
+    peNode->SetPlaybackTime( minimumTime + totalTime * rand() / RAND_MAX );
+    peLogic->UpdateSceneToPlaybackTime( peNode );
+  }
+  results.Add( "UpdateSceneToPlaybackTimeScrubbing", numRecords, numTools, NUMBER_OF_PLAYBACK_STEPS, vtkTimerLog::GetUniversalTime() - startTime );
+
+  // The first call for each tool builds its time index, the others reuse it
+  vtkSmartPointer< vtkDoubleArray > timesArray = vtkSmartPointer< vtkDoubleArray >::New();
+  for ( int repetition = 0; repetition < 2; repetition++ )
+  {
+    startTime = vtkTimerLog::GetUniversalTime();
+    for ( int i = 0; i < numTools; i++ )
+    {
+      vtkMRMLLinearTransformNode* transformNode = vtkMRMLLinearTransformNode::SafeDownCast( scene->GetFirstNodeByName( generator->GetToolName( i ).c_str() ) );
+      peLogic->GetSelfAndParentTimes( peNode, transformNode, timesArray );
+    }
+    results.Add( ( repetition == 0 ) ? "GetSelfAndParentTimesFirst" : "GetSelfAndParentTimesRepeated", numRecords, numTools, numTools, vtkTimerLog::GetUniversalTime() - startTime );
+  }
+
+  // Import the nodes into a new scene
+  // The records themselves are in the buffer's storage, which is not written here, so this does not time reading the records
+  scene->SetSaveToXMLString( 1 );
+  scene->Commit();
+  std::string sceneXML = scene->GetSceneXMLString();
+
+  vtkSmartPointer< vtkMRMLScene > importScene = vtkSmartPointer< vtkMRMLScene >::New();
+  vtkSmartPointer< vtkSlicerTransformRecorderLogic > importTRLogic = vtkSmartPointer< vtkSlicerTransformRecorderLogic >::New();
+  importTRLogic->SetMRMLScene( importScene );
+  vtkSmartPointer< vtkSlicerPerkEvaluatorLogic > importPELogic = vtkSmartPointer< vtkSlicerPerkEvaluatorLogic >::New();
+  importPELogic->SetMRMLScene( importScene );
+  importScene->SetLoadFromXMLString( 1 );
+  importScene->SetSceneXMLString( sceneXML );
+
+  startTime = vtkTimerLog::GetUniversalTime();
+  importScene->Import();
+  results.Add( "SceneImportWithoutRecords", numRecords, numTools, 1, vtkTimerLog::GetUniversalTime() - startTime );
+}
+
+
+// Main ----------------------------------------------
+
+int main( int argc, char* argv[] )
+{
+  BenchmarkConfiguration config;
+  if ( ! ReadArguments( argc, argv, config ) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  std::ofstream outputFile;
+  if ( ! config.OutputFileName.empty() )
+  {
+    outputFile.open( config.OutputFileName.c_str() );
+    if ( ! outputFile.is_open() )
+    {
+      std::cerr << "Could not write benchmark results: " << config.OutputFileName << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  BenchmarkResults results( config.OutputFileName.empty() ? std::cout : outputFile );
+
+  for ( int numRecords = config.MinimumRecords; numRecords <= config.MaximumRecords; numRecords *= 10 )
+  {
+    for ( unsigned int i = 0; i < config.NumbersOfTools.size(); i++ )
+    {
+      std::cerr << "Benchmarking " << numRecords << " records of " << config.NumbersOfTools.at( i ) << " tool(s)..." << std::endl;
+      RunBenchmarks( numRecords, config.NumbersOfTools.at( i ), results );
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
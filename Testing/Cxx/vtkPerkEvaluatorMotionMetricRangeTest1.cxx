@@ -0,0 +1,186 @@
+// Checks that the motion metrics give the same values over arbitrary ranges of a procedure (also as it grows, and when
+// answered by another metric's samples) as a new metric given only the samples in the range.
+
+// PerkEvaluator includes
+#include "vtkPerkEvaluatorMotionMetric.h"
+
+// VTK includes
+#include <vtkMatrix4x4.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+
+// Constants ----------------------------------------------
+
+static const int NUMBER_OF_SAMPLES = 400;
+static const int NUMBER_OF_QUERIES = 200;
+static const double TOLERANCE = 1e-9;
+
+
+// Helpers ----------------------------------------------
+
+// A tool which moves in bursts (the y motion pauses), rotates steadily, and sometimes has several samples at the same time
+struct Procedure
+{
+  std::vector< double > Times;
+  std::vector< double > Positions[ 3 ];
+};
+
+
+static void GenerateProcedure( Procedure& procedure )
+{
+  srand( 3 );
+  double time = 0;
+  double position[ 3 ] = { 0, 0, 0 };
+  for ( int i = 0; i < NUMBER_OF_SAMPLES; i++ )
+  {
+    time += ( rand() % 5 == 0 ) ? 0 : 0.05 * ( rand() % 3 + 1 );
+    position[ 0 ] += rand() % 7 - 3;
+    position[ 1 ] += ( rand() % 11 - 5 ) * ( ( i / 40 ) % 2 );
+    position[ 2 ] += 0.5;
+    procedure.Times.push_back( time );
+    for ( int j = 0; j < 3; j++ )
+    {
+      procedure.Positions[ j ].push_back( position[ j ] );
+    }
+  }
+}
+
+
+static vtkSmartPointer< vtkPerkEvaluatorMotionMetric > CreateMetric( int motionStatistic )
+{
+  vtkSmartPointer< vtkPerkEvaluatorMotionMetric > metric = vtkSmartPointer< vtkPerkEvaluatorMotionMetric >::New();
+  metric->SetMotionStatistic( vtkPerkEvaluatorMotionMetric::MotionStatisticEnum( motionStatistic ) );
+  metric->Initialize();
+  double needleOrientation[ 3 ] = { 0, 0, 1 };
+  metric->SetNeedleOrientation( needleOrientation );
+  return metric;
+}
+
+
+static void AddSample( vtkPerkEvaluatorMetric* metric, const Procedure& procedure, int sample )
+{
+  double angle = 0.01 * sample;
+  vtkSmartPointer< vtkMatrix4x4 > matrix = vtkSmartPointer< vtkMatrix4x4 >::New();
+  matrix->Identity();
+  matrix->SetElement( 0, 0, cos( angle ) );
+  matrix->SetElement( 0, 2, sin( angle ) );
+  matrix->SetElement( 2, 0, - sin( angle ) );
+  matrix->SetElement( 2, 2, cos( angle ) );
+  double point[ 4 ] = { 0, 0, 0, 1 };
+  for ( int j = 0; j < 3; j++ )
+  {
+    matrix->SetElement( j, 3, procedure.Positions[ j ].at( sample ) );
+    point[ j ] = procedure.Positions[ j ].at( sample );
+  }
+  metric->AddTimestamp( procedure.Times.at( sample ), matrix, point, "Any" );
+}
+
+
+// The value of a new metric given only the samples between the times (inclusive), out of the first samples of the procedure
+static double GetExpectedValue( int motionStatistic, const Procedure& procedure, int numSamples, double beginTime, double endTime )
+{
+  vtkSmartPointer< vtkPerkEvaluatorMotionMetric > metric = CreateMetric( motionStatistic );
+  for ( int i = 0; i < numSamples; i++ )
+  {
+    if ( procedure.Times.at( i ) >= beginTime && procedure.Times.at( i ) <= endTime )
+    {
+      AddSample( metric, procedure, i );
+    }
+  }
+  return metric->GetMetric();
+}
+
+
+static bool CheckValue( double actual, double expected, int motionStatistic, double beginTime, double endTime )
+{
+  if ( fabs( actual - expected ) > TOLERANCE * ( 1 + fabs( expected ) ) )
+  {
+    std::cerr << "Wrong value of motion statistic " << motionStatistic << " from " << beginTime << " to " << endTime << ": "
+      << actual << " (expected " << expected << ")." << std::endl;
+    return false;
+  }
+  return true;
+}
+
+
+// Tests ----------------------------------------------
+
+static bool TestRanges( int motionStatistic, const Procedure& procedure )
+{
+  // Another statistic, which answers its range queries from the samples of the first
+  vtkSmartPointer< vtkPerkEvaluatorMotionMetric > rangeMetric = CreateMetric( motionStatistic );
+  int sharingStatistic = ( motionStatistic + 1 ) % vtkPerkEvaluatorMotionMetric::NumberOfMotionStatistics;
+  vtkSmartPointer< vtkPerkEvaluatorMotionMetric > sharingMetric = CreateMetric( sharingStatistic );
+  if ( ! rangeMetric->GetRangeShareable() || ! sharingMetric->SetRangeSource( rangeMetric ) )
+  {
+    std::cerr << "Motion statistic " << motionStatistic << " cannot share its samples." << std::endl;
+    return false;
+  }
+
+  // Half the procedure first, then the rest (so the range structures are extended after they were built)
+  int numSamples = procedure.Times.size() / 2;
+  for ( int i = 0; i < numSamples; i++ )
+  {
+    AddSample( rangeMetric, procedure, i );
+  }
+  rangeMetric->UpdateRange();
+
+  double totalTime = procedure.Times.at( procedure.Times.size() - 1 );
+  for ( int i = 0; i < NUMBER_OF_QUERIES; i++ )
+  {
+    if ( i == NUMBER_OF_QUERIES / 2 )
+    {
+      for ( ; numSamples < int( procedure.Times.size() ); numSamples++ )
+      {
+        AddSample( rangeMetric, procedure, numSamples );
+      }
+    }
+
+    double beginTime = totalTime * ( rand() % 1000 ) / 1000.0;
+    double endTime = totalTime * ( rand() % 1000 ) / 1000.0;
+    if ( beginTime > endTime )
+    {
+      std::swap( beginTime, endTime );
+    }
+
+    double value = 0;
+    if ( ! rangeMetric->GetMetricOverRange( beginTime, endTime, value )
+      || ! CheckValue( value, GetExpectedValue( motionStatistic, procedure, numSamples, beginTime, endTime ), motionStatistic, beginTime, endTime ) )
+    {
+      return false;
+    }
+    if ( ! sharingMetric->GetMetricOverRange( beginTime, endTime, value )
+      || ! CheckValue( value, GetExpectedValue( sharingStatistic, procedure, numSamples, beginTime, endTime ), sharingStatistic, beginTime, endTime ) )
+    {
+      std::cerr << "Shared range query failed." << std::endl;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+int vtkPerkEvaluatorMotionMetricRangeTest1( int vtkNotUsed( argc ), char* vtkNotUsed( argv )[] )
+{
+  Procedure procedure;
+  GenerateProcedure( procedure );
+
+  for ( int i = 0; i < vtkPerkEvaluatorMotionMetric::NumberOfMotionStatistics; i++ )
+  {
+    if ( ! TestRanges( i, procedure ) )
+    {
+      std::cerr << "Range queries failed." << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,216 @@
+// Checks the built-in motion metrics on a procedure whose values are known: the tool moves along x, pauses, then moves
+// along y while turning by 90 degrees. The metrics are registered and created through the factory, like the logic does,
+// and the fused kernel gives the same statistics whether the samples are processed at once or as they are appended.
+
+// PerkEvaluator includes
+#include "vtkPerkEvaluatorMotionMetric.h"
+#include "vtkPerkEvaluatorMetricFactory.h"
+
+// VTK includes
+#include <vtkMatrix4x4.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+// Constants ----------------------------------------------
+
+static const double TOLERANCE = 1e-9;
+static const double PI = 3.14159265358979323846;
+static const double SAMPLING_INTERVAL = 0.1; // s
+static const double SPEED = 50.0; // mm/s, above the motion threshold
+
+
+// Helpers ----------------------------------------------
+
+// 2 s along x, 1 s still, then 1 s along y while turning about z (so the needle, along x, turns by 90 degrees)
+struct Procedure
+{
+  std::vector< double > Times;
+  std::vector< double > Positions[ 3 ];
+  std::vector< double > Angles;
+};
+
+
+static void AddProcedureSample( Procedure& procedure, double time, double x, double y, double angle )
+{
+  procedure.Times.push_back( time );
+  procedure.Positions[ 0 ].push_back( x );
+  procedure.Positions[ 1 ].push_back( y );
+  procedure.Positions[ 2 ].push_back( 0.0 );
+  procedure.Angles.push_back( angle );
+}
+
+
+static void GenerateProcedure( Procedure& procedure )
+{
+  for ( int i = 0; i <= 20; i++ )
+  {
+    AddProcedureSample( procedure, i * SAMPLING_INTERVAL, SPEED * i * SAMPLING_INTERVAL, 0.0, 0.0 );
+  }
+  for ( int i = 1; i <= 10; i++ )
+  {
+    AddProcedureSample( procedure, 2.0 + i * SAMPLING_INTERVAL, 2.0 * SPEED, 0.0, 0.0 );
+  }
+  for ( int i = 1; i <= 10; i++ )
+  {
+    AddProcedureSample( procedure, 3.0 + i * SAMPLING_INTERVAL, 2.0 * SPEED, SPEED * i * SAMPLING_INTERVAL, ( PI / 2 ) * i / 10.0 );
+  }
+}
+
+
+static void AddSample( vtkPerkEvaluatorMetric* metric, const Procedure& procedure, int sample )
+{
+  double angle = procedure.Angles.at( sample );
+  vtkSmartPointer< vtkMatrix4x4 > matrix = vtkSmartPointer< vtkMatrix4x4 >::New();
+  matrix->Identity();
+  matrix->SetElement( 0, 0, cos( angle ) );
+  matrix->SetElement( 0, 1, - sin( angle ) );
+  matrix->SetElement( 1, 0, sin( angle ) );
+  matrix->SetElement( 1, 1, cos( angle ) );
+  double point[ 4 ] = { 0, 0, 0, 1 };
+  for ( int j = 0; j < 3; j++ )
+  {
+    matrix->SetElement( j, 3, procedure.Positions[ j ].at( sample ) );
+    point[ j ] = procedure.Positions[ j ].at( sample );
+  }
+  metric->AddTimestamp( procedure.Times.at( sample ), matrix, point, "Any" );
+}
+
+
+static bool CheckValue( double actual, double expected, std::string description )
+{
+  if ( fabs( actual - expected ) > TOLERANCE * ( 1 + fabs( expected ) ) )
+  {
+    std::cerr << "Wrong " << description << ": " << actual << " (expected " << expected << ")." << std::endl;
+    return false;
+  }
+  return true;
+}
+
+
+// Tests ----------------------------------------------
+
+static bool TestKnownValues( const Procedure& procedure )
+{
+  // Only the statistics with simple closed forms on this procedure
+  std::vector< std::string > metricNames;
+  std::vector< double > expectedValues;
+  metricNames.push_back( "Elapsed Time" );
+  expectedValues.push_back( 4.0 );
+  metricNames.push_back( "Path Length" );
+  expectedValues.push_back( 3.0 * SPEED );
+  metricNames.push_back( "Average Velocity" );
+  expectedValues.push_back( 3.0 * SPEED / 4.0 );
+  metricNames.push_back( "Peak Velocity" );
+  expectedValues.push_back( SPEED );
+  metricNames.push_back( "Angular Path" );
+  expectedValues.push_back( 90.0 );
+  metricNames.push_back( "Number of Motions" );
+  expectedValues.push_back( 2.0 );
+
+  for ( int i = 0; i < int( metricNames.size() ); i++ )
+  {
+    vtkSmartPointer< vtkPerkEvaluatorMetric > metric;
+    metric.TakeReference( vtkPerkEvaluatorMetricFactory::GetInstance()->CreateMetric( metricNames.at( i ) ) );
+    if ( metric == NULL )
+    {
+      std::cerr << "Metric not registered: " << metricNames.at( i ) << "." << std::endl;
+      return false;
+    }
+    metric->Initialize();
+    double needleOrientation[ 3 ] = { 1, 0, 0 };
+    metric->SetNeedleOrientation( needleOrientation );
+
+    for ( int j = 0; j < int( procedure.Times.size() ); j++ )
+    {
+      AddSample( metric, procedure, j );
+    }
+    if ( ! CheckValue( metric->GetMetric(), expectedValues.at( i ), metricNames.at( i ) ) )
+    {
+      return false;
+    }
+
+    // Initializing forgets the samples
+    metric->Initialize();
+    if ( ! CheckValue( metric->GetMetric(), 0.0, metricNames.at( i ) + " after initializing" ) )
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+static bool TestIncrementalKernel( const Procedure& procedure )
+{
+  int numSamples = procedure.Times.size();
+  std::vector< double > directions[ 3 ];
+  for ( int i = 0; i < numSamples; i++ )
+  {
+    directions[ 0 ].push_back( cos( procedure.Angles.at( i ) ) );
+    directions[ 1 ].push_back( sin( procedure.Angles.at( i ) ) );
+    directions[ 2 ].push_back( 0.0 );
+  }
+
+  vtkPerkEvaluatorMotionMetric::MotionStatistics expectedStatistics;
+  vtkPerkEvaluatorMotionMetric::ComputeMotionStatistics( numSamples, &procedure.Times[ 0 ],
+    &procedure.Positions[ 0 ][ 0 ], &procedure.Positions[ 1 ][ 0 ], &procedure.Positions[ 2 ][ 0 ],
+    &directions[ 0 ][ 0 ], &directions[ 1 ][ 0 ], &directions[ 2 ][ 0 ], expectedStatistics );
+
+  // The same arrays, but the kernel sees only a few more samples at a time
+  vtkPerkEvaluatorMotionMetric::MotionKernelState state;
+  vtkPerkEvaluatorMotionMetric::InitializeMotionKernelState( state );
+  for ( int processedSamples = 1; processedSamples <= numSamples; processedSamples += 3 )
+  {
+    vtkPerkEvaluatorMotionMetric::UpdateMotionKernelState( processedSamples, &procedure.Times[ 0 ],
+      &procedure.Positions[ 0 ][ 0 ], &procedure.Positions[ 1 ][ 0 ], &procedure.Positions[ 2 ][ 0 ],
+      &directions[ 0 ][ 0 ], &directions[ 1 ][ 0 ], &directions[ 2 ][ 0 ], state );
+  }
+  vtkPerkEvaluatorMotionMetric::UpdateMotionKernelState( numSamples, &procedure.Times[ 0 ],
+    &procedure.Positions[ 0 ][ 0 ], &procedure.Positions[ 1 ][ 0 ], &procedure.Positions[ 2 ][ 0 ],
+    &directions[ 0 ][ 0 ], &directions[ 1 ][ 0 ], &directions[ 2 ][ 0 ], state );
+  vtkPerkEvaluatorMotionMetric::MotionStatistics incrementalStatistics;
+  vtkPerkEvaluatorMotionMetric::GetMotionStatistics( numSamples, &procedure.Times[ 0 ], state, incrementalStatistics );
+
+  for ( int i = 0; i < vtkPerkEvaluatorMotionMetric::NumberOfMotionStatistics; i++ )
+  {
+    vtkPerkEvaluatorMotionMetric::MotionStatisticEnum motionStatistic = vtkPerkEvaluatorMotionMetric::MotionStatisticEnum( i );
+    if ( ! CheckValue( vtkPerkEvaluatorMotionMetric::GetMotionStatistic( incrementalStatistics, motionStatistic ),
+      vtkPerkEvaluatorMotionMetric::GetMotionStatistic( expectedStatistics, motionStatistic ), "incremental kernel statistic" ) )
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+int vtkPerkEvaluatorMotionMetricTest1( int vtkNotUsed( argc ), char* vtkNotUsed( argv )[] )
+{
+  vtkPerkEvaluatorMotionMetric::RegisterMetrics( vtkPerkEvaluatorMetricFactory::GetInstance() );
+
+  Procedure procedure;
+  GenerateProcedure( procedure );
+
+  if ( ! TestKnownValues( procedure ) )
+  {
+    std::cerr << "Motion metric values failed." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if ( ! TestIncrementalKernel( procedure ) )
+  {
+    std::cerr << "Incremental kernel failed." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,162 @@
+// Checks that the motion metrics give the same values over a sliding window (forgetting the samples before it) as a new
+// metric given only the samples in the window.
+
+// PerkEvaluator includes
+#include "vtkPerkEvaluatorMotionMetric.h"
+
+// VTK includes
+#include <vtkMatrix4x4.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+
+// Constants ----------------------------------------------
+
+static const int NUMBER_OF_SAMPLES = 400;
+static const double WINDOW_LENGTH = 3.0;
+static const double WINDOW_STEP = 0.7;
+static const double TOLERANCE = 1e-9;
+
+
+// Helpers ----------------------------------------------
+
+// A tool which moves in bursts (the y motion pauses), rotates steadily, and sometimes has several samples at the same time
+struct Procedure
+{
+  std::vector< double > Times;
+  std::vector< double > Positions[ 3 ];
+};
+
+
+static void GenerateProcedure( Procedure& procedure )
+{
+  srand( 3 );
+  double time = 0;
+  double position[ 3 ] = { 0, 0, 0 };
+  for ( int i = 0; i < NUMBER_OF_SAMPLES; i++ )
+  {
+    time += ( rand() % 5 == 0 ) ? 0 : 0.05 * ( rand() % 3 + 1 );
+    position[ 0 ] += rand() % 7 - 3;
+    position[ 1 ] += ( rand() % 11 - 5 ) * ( ( i / 40 ) % 2 );
+    position[ 2 ] += 0.5;
+    procedure.Times.push_back( time );
+    for ( int j = 0; j < 3; j++ )
+    {
+      procedure.Positions[ j ].push_back( position[ j ] );
+    }
+  }
+}
+
+
+static vtkSmartPointer< vtkPerkEvaluatorMotionMetric > CreateMetric( int motionStatistic )
+{
+  vtkSmartPointer< vtkPerkEvaluatorMotionMetric > metric = vtkSmartPointer< vtkPerkEvaluatorMotionMetric >::New();
+  metric->SetMotionStatistic( vtkPerkEvaluatorMotionMetric::MotionStatisticEnum( motionStatistic ) );
+  metric->Initialize();
+  double needleOrientation[ 3 ] = { 0, 0, 1 };
+  metric->SetNeedleOrientation( needleOrientation );
+  return metric;
+}
+
+
+static void AddSample( vtkPerkEvaluatorMetric* metric, const Procedure& procedure, int sample )
+{
+  double angle = 0.01 * sample;
+  vtkSmartPointer< vtkMatrix4x4 > matrix = vtkSmartPointer< vtkMatrix4x4 >::New();
+  matrix->Identity();
+  matrix->SetElement( 0, 0, cos( angle ) );
+  matrix->SetElement( 0, 2, sin( angle ) );
+  matrix->SetElement( 2, 0, - sin( angle ) );
+  matrix->SetElement( 2, 2, cos( angle ) );
+  double point[ 4 ] = { 0, 0, 0, 1 };
+  for ( int j = 0; j < 3; j++ )
+  {
+    matrix->SetElement( j, 3, procedure.Positions[ j ].at( sample ) );
+    point[ j ] = procedure.Positions[ j ].at( sample );
+  }
+  metric->AddTimestamp( procedure.Times.at( sample ), matrix, point, "Any" );
+}
+
+
+// The value of a new metric given only the samples between the times (inclusive), out of the first samples of the procedure
+static double GetExpectedValue( int motionStatistic, const Procedure& procedure, int numSamples, double beginTime, double endTime )
+{
+  vtkSmartPointer< vtkPerkEvaluatorMotionMetric > metric = CreateMetric( motionStatistic );
+  for ( int i = 0; i < numSamples; i++ )
+  {
+    if ( procedure.Times.at( i ) >= beginTime && procedure.Times.at( i ) <= endTime )
+    {
+      AddSample( metric, procedure, i );
+    }
+  }
+  return metric->GetMetric();
+}
+
+
+static bool CheckValue( double actual, double expected, int motionStatistic, double beginTime, double endTime )
+{
+  if ( fabs( actual - expected ) > TOLERANCE * ( 1 + fabs( expected ) ) )
+  {
+    std::cerr << "Wrong value of motion statistic " << motionStatistic << " from " << beginTime << " to " << endTime << ": "
+      << actual << " (expected " << expected << ")." << std::endl;
+    return false;
+  }
+  return true;
+}
+
+
+// Tests ----------------------------------------------
+
+static bool TestWindows( int motionStatistic, const Procedure& procedure )
+{
+  vtkSmartPointer< vtkPerkEvaluatorMotionMetric > windowedMetric = CreateMetric( motionStatistic );
+  int numSamples = procedure.Times.size();
+  double totalTime = procedure.Times.at( numSamples - 1 );
+
+  int nextSample = 0;
+  for ( double windowBegin = 0; windowBegin + WINDOW_LENGTH <= totalTime; windowBegin += WINDOW_STEP )
+  {
+    double windowEnd = windowBegin + WINDOW_LENGTH;
+    while ( nextSample < numSamples && procedure.Times.at( nextSample ) <= windowEnd )
+    {
+      AddSample( windowedMetric, procedure, nextSample );
+      nextSample++;
+    }
+    if ( ! windowedMetric->RemoveTimestampsBefore( windowBegin ) )
+    {
+      std::cerr << "Motion statistic " << motionStatistic << " cannot forget samples." << std::endl;
+      return false;
+    }
+
+    double expected = GetExpectedValue( motionStatistic, procedure, numSamples, windowBegin, windowEnd );
+    if ( ! CheckValue( windowedMetric->GetMetric(), expected, motionStatistic, windowBegin, windowEnd ) )
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+int vtkPerkEvaluatorMotionMetricWindowTest1( int vtkNotUsed( argc ), char* vtkNotUsed( argv )[] )
+{
+  Procedure procedure;
+  GenerateProcedure( procedure );
+
+  for ( int i = 0; i < vtkPerkEvaluatorMotionMetric::NumberOfMotionStatistics; i++ )
+  {
+    if ( ! TestWindows( i, procedure ) )
+    {
+      std::cerr << "Sliding window failed." << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,246 @@
+// Checks that the real-time queue keeps every sample in order until it is full (also when the ring buffer wraps around),
+// and that only then the backpressure policy coalesces, drops or refuses samples.
+
+// PerkEvaluator includes
+#include "vtkPerkEvaluatorRealTimeQueue.h"
+
+// VTK includes
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+
+// Constants ----------------------------------------------
+
+static const int CAPACITY = 4;
+static const char* PERK_EVALUATOR_NODE_ID = "vtkMRMLPerkEvaluatorNode1";
+
+
+// Helpers ----------------------------------------------
+
+static bool PushSample( vtkPerkEvaluatorRealTimeQueue* queue, std::string transformName, double time )
+{
+  vtkPerkEvaluatorRealTimeQueue::Sample sample;
+  sample.PerkEvaluatorNodeID = PERK_EVALUATOR_NODE_ID;
+  sample.TransformName = transformName;
+  sample.Time = time;
+  return queue->Push( sample );
+}
+
+
+static bool CheckPop( vtkPerkEvaluatorRealTimeQueue* queue, std::string transformName, double time )
+{
+  vtkPerkEvaluatorRealTimeQueue::Sample sample;
+  if ( ! queue->Pop( sample ) )
+  {
+    std::cerr << "Queue is empty, expected " << transformName << " at " << time << "." << std::endl;
+    return false;
+  }
+  if ( sample.TransformName.compare( transformName ) != 0 || sample.Time != time || sample.PerkEvaluatorNodeID.compare( PERK_EVALUATOR_NODE_ID ) != 0 )
+  {
+    std::cerr << "Popped " << sample.TransformName << " at " << sample.Time << ", expected " << transformName << " at " << time << "." << std::endl;
+    return false;
+  }
+  return true;
+}
+
+
+static bool CheckStatistics( vtkPerkEvaluatorRealTimeQueue* queue, int depth, int dropped, int coalesced, int refused )
+{
+  if ( queue->GetDepth() != depth || queue->GetNumberOfDroppedSamples() != dropped
+    || queue->GetNumberOfCoalescedSamples() != coalesced || queue->GetNumberOfRefusedSamples() != refused )
+  {
+    std::cerr << "Wrong statistics: depth " << queue->GetDepth() << " (expected " << depth << ")"
+      << ", dropped " << queue->GetNumberOfDroppedSamples() << " (expected " << dropped << ")"
+      << ", coalesced " << queue->GetNumberOfCoalescedSamples() << " (expected " << coalesced << ")"
+      << ", refused " << queue->GetNumberOfRefusedSamples() << " (expected " << refused << ")." << std::endl;
+    return false;
+  }
+  return true;
+}
+
+
+static vtkSmartPointer< vtkPerkEvaluatorRealTimeQueue > CreateQueue( vtkPerkEvaluatorRealTimeQueue::BackpressurePolicyEnum policy )
+{
+  vtkSmartPointer< vtkPerkEvaluatorRealTimeQueue > queue = vtkSmartPointer< vtkPerkEvaluatorRealTimeQueue >::New();
+  queue->SetCapacity( CAPACITY );
+  queue->SetBackpressurePolicy( policy );
+  queue->ResetStatistics();
+  return queue;
+}
+
+
+// Tests ----------------------------------------------
+
+// Samples of the same transform are all kept while there is room, whatever the policy
+static bool TestLosslessUntilFull( vtkPerkEvaluatorRealTimeQueue::BackpressurePolicyEnum policy )
+{
+  vtkSmartPointer< vtkPerkEvaluatorRealTimeQueue > queue = CreateQueue( policy );
+
+  // Keep the queue partly full while pushing several times its capacity, so the ring buffer wraps around
+  double pushTime = 0;
+  double popTime = 0;
+  for ( int i = 0; i < 5 * CAPACITY; i++ )
+  {
+    if ( ! PushSample( queue, "Needle", pushTime++ ) || ! PushSample( queue, "Needle", pushTime++ ) )
+    {
+      std::cerr << "Sample refused before the queue was full." << std::endl;
+      return false;
+    }
+    if ( ! CheckPop( queue, "Needle", popTime++ ) )
+    {
+      return false;
+    }
+    if ( queue->GetDepth() == CAPACITY - 1 )
+    {
+      while ( popTime < pushTime )
+      {
+        if ( ! CheckPop( queue, "Needle", popTime++ ) )
+        {
+          return false;
+        }
+      }
+    }
+  }
+  while ( popTime < pushTime )
+  {
+    if ( ! CheckPop( queue, "Needle", popTime++ ) )
+    {
+      return false;
+    }
+  }
+
+  vtkPerkEvaluatorRealTimeQueue::Sample sample;
+  if ( queue->Pop( sample ) )
+  {
+    std::cerr << "Queue is not empty after popping every sample." << std::endl;
+    return false;
+  }
+  return CheckStatistics( queue, 0, 0, 0, 0 );
+}
+
+
+static bool TestCoalescePerTransform()
+{
+  vtkSmartPointer< vtkPerkEvaluatorRealTimeQueue > queue = CreateQueue( vtkPerkEvaluatorRealTimeQueue::CoalescePerTransform );
+
+  // When full, the newest queued sample of the same transform takes the new time, in its place in the queue
+  PushSample( queue, "Needle", 0 );
+  PushSample( queue, "Probe", 1 );
+  PushSample( queue, "Needle", 2 );
+  PushSample( queue, "Probe", 3 );
+  if ( ! PushSample( queue, "Needle", 4 ) || ! CheckStatistics( queue, CAPACITY, 0, 1, 0 ) )
+  {
+    return false;
+  }
+  if ( ! CheckPop( queue, "Needle", 0 ) || ! CheckPop( queue, "Probe", 1 ) || ! CheckPop( queue, "Needle", 4 ) || ! CheckPop( queue, "Probe", 3 ) )
+  {
+    return false;
+  }
+
+  // A transform with nothing queued drops the oldest sample instead
+  PushSample( queue, "Needle", 5 );
+  PushSample( queue, "Needle", 6 );
+  PushSample( queue, "Needle", 7 );
+  PushSample( queue, "Needle", 8 );
+  if ( ! PushSample( queue, "Probe", 9 ) || ! CheckStatistics( queue, CAPACITY, 1, 1, 0 ) )
+  {
+    return false;
+  }
+  if ( ! CheckPop( queue, "Needle", 6 ) || ! CheckPop( queue, "Needle", 7 ) || ! CheckPop( queue, "Needle", 8 ) || ! CheckPop( queue, "Probe", 9 ) )
+  {
+    return false;
+  }
+
+  return CheckStatistics( queue, 0, 1, 1, 0 );
+}
+
+
+static bool TestDropOldest()
+{
+  vtkSmartPointer< vtkPerkEvaluatorRealTimeQueue > queue = CreateQueue( vtkPerkEvaluatorRealTimeQueue::DropOldest );
+
+  for ( int i = 0; i <= CAPACITY; i++ )
+  {
+    PushSample( queue, "Needle", i );
+  }
+  if ( ! CheckStatistics( queue, CAPACITY, 1, 0, 0 ) )
+  {
+    return false;
+  }
+  for ( int i = 1; i <= CAPACITY; i++ )
+  {
+    if ( ! CheckPop( queue, "Needle", i ) )
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+static bool TestBlock()
+{
+  vtkSmartPointer< vtkPerkEvaluatorRealTimeQueue > queue = CreateQueue( vtkPerkEvaluatorRealTimeQueue::Block );
+
+  for ( int i = 0; i < CAPACITY; i++ )
+  {
+    PushSample( queue, "Needle", i );
+  }
+  if ( PushSample( queue, "Needle", CAPACITY ) || ! CheckStatistics( queue, CAPACITY, 0, 0, 1 ) )
+  {
+    std::cerr << "Sample not refused when the queue was full." << std::endl;
+    return false;
+  }
+
+  // Once there is room again, the sample is accepted after the others
+  if ( ! CheckPop( queue, "Needle", 0 ) || ! PushSample( queue, "Needle", CAPACITY ) )
+  {
+    return false;
+  }
+  for ( int i = 1; i <= CAPACITY; i++ )
+  {
+    if ( ! CheckPop( queue, "Needle", i ) )
+    {
+      return false;
+    }
+  }
+
+  return CheckStatistics( queue, 0, 0, 0, 1 );
+}
+
+
+int vtkPerkEvaluatorRealTimeQueueTest1( int vtkNotUsed( argc ), char* vtkNotUsed( argv )[] )
+{
+  if ( ! TestLosslessUntilFull( vtkPerkEvaluatorRealTimeQueue::DropOldest )
+    || ! TestLosslessUntilFull( vtkPerkEvaluatorRealTimeQueue::CoalescePerTransform )
+    || ! TestLosslessUntilFull( vtkPerkEvaluatorRealTimeQueue::Block ) )
+  {
+    std::cerr << "Samples lost before the queue was full." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if ( ! TestCoalescePerTransform() )
+  {
+    std::cerr << "Coalescing per transform failed." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if ( ! TestDropOldest() )
+  {
+    std::cerr << "Dropping the oldest sample failed." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if ( ! TestBlock() )
+  {
+    std::cerr << "Blocking failed." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,137 @@
+// Checks the segment tree's range aggregates against a direct scan of the values, for trees which were built at once,
+// grown by appending, or both (so ranges start and end inside blocks, on block boundaries, and outside the values).
+
+// PerkEvaluator includes
+#include "vtkPerkEvaluatorSegmentTree.h"
+
+// VTK includes
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+
+// Constants ----------------------------------------------
+
+static const int NUMBER_OF_VALUES = 300;
+static const int NUMBER_OF_BUILT_VALUES = 70; // Part way through the second block, when building then appending
+static const int NUMBER_OF_QUERIES = 5000;
+
+
+// Helpers ----------------------------------------------
+
+static bool CheckQuery( vtkPerkEvaluatorSegmentTree* tree, const std::vector< double >& values, int begin, int end )
+{
+  vtkPerkEvaluatorSegmentTree::Aggregate expected;
+  vtkPerkEvaluatorSegmentTree::InitializeAggregate( expected );
+  for ( int i = std::max( begin, 0 ); i <= std::min( end, int( values.size() ) - 1 ); i++ )
+  {
+    vtkPerkEvaluatorSegmentTree::Aggregate value;
+    value.Sum = values.at( i );
+    value.Minimum = values.at( i );
+    value.Maximum = values.at( i );
+    value.Count = 1;
+    vtkPerkEvaluatorSegmentTree::CombineAggregates( expected, value, expected );
+  }
+
+  vtkPerkEvaluatorSegmentTree::Aggregate actual = tree->Query( begin, end );
+  if ( actual.Count != expected.Count || actual.Sum != expected.Sum
+    || ( expected.Count > 0 && ( actual.Minimum != expected.Minimum || actual.Maximum != expected.Maximum ) ) )
+  {
+    std::cerr << "Wrong aggregate for values " << begin << " to " << end << ": count " << actual.Count << " (expected " << expected.Count << ")"
+      << ", sum " << actual.Sum << " (expected " << expected.Sum << ")" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+
+static bool CheckTree( vtkPerkEvaluatorSegmentTree* tree, const std::vector< double >& values )
+{
+  if ( tree->GetNumberOfValues() != int( values.size() ) )
+  {
+    std::cerr << "Wrong number of values: " << tree->GetNumberOfValues() << " (expected " << values.size() << ")" << std::endl;
+    return false;
+  }
+
+  // Every range around the block boundaries, then random ranges (including ones outside the values, and empty ones)
+  int blockSize = vtkPerkEvaluatorSegmentTree::BLOCK_SIZE;
+  for ( int begin = blockSize - 2; begin <= blockSize + 1; begin++ )
+  {
+    for ( int end = begin - 1; end < int( values.size() ); end++ )
+    {
+      if ( ! CheckQuery( tree, values, begin, end ) )
+      {
+        return false;
+      }
+    }
+  }
+
+  for ( int i = 0; i < NUMBER_OF_QUERIES; i++ )
+  {
+    int begin = rand() % ( NUMBER_OF_VALUES + 20 ) - 10;
+    int end = rand() % ( NUMBER_OF_VALUES + 20 ) - 10;
+    if ( ! CheckQuery( tree, values, begin, end ) )
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+// Test ----------------------------------------------
+
+int vtkPerkEvaluatorSegmentTreeTest1( int vtkNotUsed( argc ), char* vtkNotUsed( argv )[] )
+{
+  srand( 0 );
+  std::vector< double > values;
+  for ( int i = 0; i < NUMBER_OF_VALUES; i++ )
+  {
+    values.push_back( rand() % 100 - 50 );
+  }
+
+  vtkSmartPointer< vtkPerkEvaluatorSegmentTree > builtTree = vtkSmartPointer< vtkPerkEvaluatorSegmentTree >::New();
+  builtTree->Build( values );
+  if ( ! CheckTree( builtTree, values ) )
+  {
+    std::cerr << "Built tree failed." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  vtkSmartPointer< vtkPerkEvaluatorSegmentTree > appendedTree = vtkSmartPointer< vtkPerkEvaluatorSegmentTree >::New();
+  for ( int i = 0; i < NUMBER_OF_VALUES; i++ )
+  {
+    appendedTree->Append( values.at( i ) );
+  }
+  if ( ! CheckTree( appendedTree, values ) )
+  {
+    std::cerr << "Appended tree failed." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  vtkSmartPointer< vtkPerkEvaluatorSegmentTree > grownTree = vtkSmartPointer< vtkPerkEvaluatorSegmentTree >::New();
+  grownTree->Build( std::vector< double >( values.begin(), values.begin() + NUMBER_OF_BUILT_VALUES ) );
+  for ( int i = NUMBER_OF_BUILT_VALUES; i < NUMBER_OF_VALUES; i++ )
+  {
+    grownTree->Append( values.at( i ) );
+  }
+  if ( ! CheckTree( grownTree, values ) )
+  {
+    std::cerr << "Built then appended tree failed." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  grownTree->Clear();
+  if ( ! CheckTree( grownTree, std::vector< double >() ) )
+  {
+    std::cerr << "Cleared tree failed." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
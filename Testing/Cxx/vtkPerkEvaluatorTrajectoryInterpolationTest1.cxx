@@ -0,0 +1,154 @@
+// Checks the interpolated poses a trajectory gives between the records of a transform buffer: the orientation is SLERPed
+// and the position interpolated linearly, while any scale of the matrices is kept.
+
+// PerkEvaluator includes
+#include "vtkPerkEvaluatorTrajectory.h"
+
+// TransformRecorder includes
+#include "vtkMRMLTransformBufferNode.h"
+
+// MRML includes
+#include "vtkMRMLScene.h"
+
+// VTK includes
+#include <vtkMatrix4x4.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+
+// Constants ----------------------------------------------
+
+static const double TOLERANCE = 1e-9;
+static const double PI = 3.14159265358979323846;
+
+
+// Helpers ----------------------------------------------
+
+// Rotation about the z axis, then scale along the axes, then translation along x
+static void SetPose( vtkMatrix4x4* matrix, double angle, double scale[ 3 ], double translation )
+{
+  matrix->Identity();
+  matrix->SetElement( 0, 0, cos( angle ) * scale[ 0 ] );
+  matrix->SetElement( 0, 1, - sin( angle ) * scale[ 1 ] );
+  matrix->SetElement( 1, 0, sin( angle ) * scale[ 0 ] );
+  matrix->SetElement( 1, 1, cos( angle ) * scale[ 1 ] );
+  matrix->SetElement( 2, 2, scale[ 2 ] );
+  matrix->SetElement( 0, 3, translation );
+}
+
+
+static void AddRecord( vtkMRMLTransformBufferNode* bufferNode, std::string transformName, double time, double angle, double scale[ 3 ], double translation )
+{
+  vtkSmartPointer< vtkMatrix4x4 > matrix = vtkSmartPointer< vtkMatrix4x4 >::New();
+  SetPose( matrix, angle, scale, translation );
+
+  vtkSmartPointer< vtkTransformRecord > record = vtkSmartPointer< vtkTransformRecord >::New();
+  record->SetTransformName( transformName );
+  record->SetTransformMatrix( matrix );
+  record->SetTime( time );
+  bufferNode->AddTransform( record );
+}
+
+
+static bool CheckMatrix( vtkMatrix4x4* actual, vtkMatrix4x4* expected, std::string description )
+{
+  for ( int row = 0; row < 4; row++ )
+  {
+    for ( int column = 0; column < 4; column++ )
+    {
+      if ( fabs( actual->GetElement( row, column ) - expected->GetElement( row, column ) ) > TOLERANCE )
+      {
+        std::cerr << "Wrong " << description << " matrix element (" << row << ", " << column << "): " << actual->GetElement( row, column )
+          << " (expected " << expected->GetElement( row, column ) << ")." << std::endl;
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+
+static bool CheckInterpolatedMatrix( vtkPerkEvaluatorTrajectory* trajectory, double time, double angle, double scale[ 3 ], double translation )
+{
+  vtkSmartPointer< vtkMatrix4x4 > expectedMatrix = vtkSmartPointer< vtkMatrix4x4 >::New();
+  SetPose( expectedMatrix, angle, scale, translation );
+
+  vtkSmartPointer< vtkMatrix4x4 > interpolatedMatrix = vtkSmartPointer< vtkMatrix4x4 >::New();
+  trajectory->GetInterpolatedMatrix( trajectory->FindRecord( time ), time, interpolatedMatrix );
+  if ( ! CheckMatrix( interpolatedMatrix, expectedMatrix, "interpolated" ) )
+  {
+    std::cerr << "Wrong interpolated matrix at " << time << "." << std::endl;
+    return false;
+  }
+
+  // Without a record, the same pose is found by searching
+  double elements[ 16 ];
+  trajectory->GetInterpolatedMatrix( time, elements );
+  interpolatedMatrix->DeepCopy( elements );
+  if ( ! CheckMatrix( interpolatedMatrix, expectedMatrix, "interpolated (searched)" ) )
+  {
+    std::cerr << "Wrong searched interpolated matrix at " << time << "." << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+
+// Test ----------------------------------------------
+
+int vtkPerkEvaluatorTrajectoryInterpolationTest1( int vtkNotUsed( argc ), char* vtkNotUsed( argv )[] )
+{
+  vtkSmartPointer< vtkMRMLScene > scene = vtkSmartPointer< vtkMRMLScene >::New();
+  vtkSmartPointer< vtkMRMLTransformBufferNode > bufferNode = vtkSmartPointer< vtkMRMLTransformBufferNode >::New();
+  scene->AddNode( bufferNode );
+
+  // The needle is uniformly scaled, the probe's scale changes along one axis
+  double uniformScale[ 3 ] = { 2.0, 2.0, 2.0 };
+  double identityScale[ 3 ] = { 1.0, 1.0, 1.0 };
+  double stretchedScale[ 3 ] = { 1.0, 3.0, 1.0 };
+  double halfStretchedScale[ 3 ] = { 1.0, 2.0, 1.0 };
+  AddRecord( bufferNode, "Needle", 0.0, 0.0, uniformScale, 0.0 );
+  AddRecord( bufferNode, "Needle", 1.0, PI / 2, uniformScale, 10.0 );
+  AddRecord( bufferNode, "Needle", 2.0, PI, uniformScale, 20.0 );
+  AddRecord( bufferNode, "Probe", 0.0, 0.0, identityScale, 0.0 );
+  AddRecord( bufferNode, "Probe", 2.0, PI / 2, stretchedScale, 0.0 );
+
+  vtkSmartPointer< vtkPerkEvaluatorTrajectory > needleTrajectory = vtkSmartPointer< vtkPerkEvaluatorTrajectory >::New();
+  if ( ! needleTrajectory->Update( bufferNode, "Needle" ) || needleTrajectory->GetNumberOfRecords() != 3 )
+  {
+    std::cerr << "Needle trajectory not updated from the buffer." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // The records' own matrices at their times and outside the trajectory, half way round (with the scale kept) in between
+  if ( ! CheckInterpolatedMatrix( needleTrajectory, -1.0, 0.0, uniformScale, 0.0 )
+    || ! CheckInterpolatedMatrix( needleTrajectory, 0.0, 0.0, uniformScale, 0.0 )
+    || ! CheckInterpolatedMatrix( needleTrajectory, 0.5, PI / 4, uniformScale, 5.0 )
+    || ! CheckInterpolatedMatrix( needleTrajectory, 1.0, PI / 2, uniformScale, 10.0 )
+    || ! CheckInterpolatedMatrix( needleTrajectory, 1.25, 5 * PI / 8, uniformScale, 12.5 )
+    || ! CheckInterpolatedMatrix( needleTrajectory, 5.0, PI, uniformScale, 20.0 ) )
+  {
+    std::cerr << "Needle interpolation failed." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  vtkSmartPointer< vtkPerkEvaluatorTrajectory > probeTrajectory = vtkSmartPointer< vtkPerkEvaluatorTrajectory >::New();
+  if ( ! probeTrajectory->Update( bufferNode, "Probe" ) || probeTrajectory->GetNumberOfRecords() != 2 )
+  {
+    std::cerr << "Probe trajectory not updated from the buffer." << std::endl;
+    return EXIT_FAILURE;
+  }
+  if ( ! CheckInterpolatedMatrix( probeTrajectory, 1.0, PI / 4, halfStretchedScale, 0.0 ) )
+  {
+    std::cerr << "Probe interpolation failed." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
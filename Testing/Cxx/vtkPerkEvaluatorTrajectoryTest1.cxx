@@ -0,0 +1,123 @@
+// Checks that a trajectory holds the records of one transform from a transform buffer, catches up with records added
+// later, finds the nearest record to a time, and stays empty for a transform which is not recorded.
+
+// PerkEvaluator includes
+#include "vtkPerkEvaluatorTrajectory.h"
+
+// TransformRecorder includes
+#include "vtkMRMLTransformBufferNode.h"
+
+// MRML includes
+#include "vtkMRMLScene.h"
+
+// VTK includes
+#include <vtkMatrix4x4.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+
+// Constants ----------------------------------------------
+
+static const double TOLERANCE = 1e-9;
+static const double PI = 3.14159265358979323846;
+
+
+// Helpers ----------------------------------------------
+
+// Rotation about the z axis, then scale along the axes, then translation along x
+static void SetPose( vtkMatrix4x4* matrix, double angle, double scale[ 3 ], double translation )
+{
+  matrix->Identity();
+  matrix->SetElement( 0, 0, cos( angle ) * scale[ 0 ] );
+  matrix->SetElement( 0, 1, - sin( angle ) * scale[ 1 ] );
+  matrix->SetElement( 1, 0, sin( angle ) * scale[ 0 ] );
+  matrix->SetElement( 1, 1, cos( angle ) * scale[ 1 ] );
+  matrix->SetElement( 2, 2, scale[ 2 ] );
+  matrix->SetElement( 0, 3, translation );
+}
+
+
+static void AddRecord( vtkMRMLTransformBufferNode* bufferNode, std::string transformName, double time, double angle, double scale[ 3 ], double translation )
+{
+  vtkSmartPointer< vtkMatrix4x4 > matrix = vtkSmartPointer< vtkMatrix4x4 >::New();
+  SetPose( matrix, angle, scale, translation );
+
+  vtkSmartPointer< vtkTransformRecord > record = vtkSmartPointer< vtkTransformRecord >::New();
+  record->SetTransformName( transformName );
+  record->SetTransformMatrix( matrix );
+  record->SetTime( time );
+  bufferNode->AddTransform( record );
+}
+
+
+static bool CheckNearestRecord( vtkPerkEvaluatorTrajectory* trajectory, double time, int expectedRecord )
+{
+  int nearestRecord = trajectory->FindNearestRecord( time );
+  if ( nearestRecord != expectedRecord || trajectory->GetNearestRecord( trajectory->FindRecord( time ), time ) != expectedRecord )
+  {
+    std::cerr << "Wrong nearest record at " << time << ": " << nearestRecord << " (expected " << expectedRecord << ")." << std::endl;
+    return false;
+  }
+  return true;
+}
+
+
+// Test ----------------------------------------------
+
+int vtkPerkEvaluatorTrajectoryTest1( int vtkNotUsed( argc ), char* vtkNotUsed( argv )[] )
+{
+  vtkSmartPointer< vtkMRMLScene > scene = vtkSmartPointer< vtkMRMLScene >::New();
+  vtkSmartPointer< vtkMRMLTransformBufferNode > bufferNode = vtkSmartPointer< vtkMRMLTransformBufferNode >::New();
+  scene->AddNode( bufferNode );
+
+  // Another transform's records are interleaved with the needle's
+  double scale[ 3 ] = { 1.0, 1.0, 1.0 };
+  AddRecord( bufferNode, "Needle", 0.0, 0.0, scale, 0.0 );
+  AddRecord( bufferNode, "Probe", 0.0, 0.0, scale, 0.0 );
+  AddRecord( bufferNode, "Needle", 1.0, PI / 2, scale, 10.0 );
+  AddRecord( bufferNode, "Probe", 2.0, PI / 2, scale, 0.0 );
+
+  vtkSmartPointer< vtkPerkEvaluatorTrajectory > needleTrajectory = vtkSmartPointer< vtkPerkEvaluatorTrajectory >::New();
+  if ( ! needleTrajectory->Update( bufferNode, "Needle" ) || needleTrajectory->GetNumberOfRecords() != 2 )
+  {
+    std::cerr << "Needle trajectory not updated from the buffer." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Only the new records are added when updating again
+  AddRecord( bufferNode, "Needle", 2.0, PI, scale, 20.0 );
+  if ( ! needleTrajectory->Update( bufferNode, "Needle" ) || needleTrajectory->GetNumberOfRecords() != 3 )
+  {
+    std::cerr << "Needle trajectory not caught up with the buffer." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // The earlier record on a tie, the first or last record outside the trajectory
+  if ( ! CheckNearestRecord( needleTrajectory, -1.0, 0 ) || ! CheckNearestRecord( needleTrajectory, 0.4, 0 )
+    || ! CheckNearestRecord( needleTrajectory, 0.5, 0 ) || ! CheckNearestRecord( needleTrajectory, 0.6, 1 )
+    || ! CheckNearestRecord( needleTrajectory, 1.5, 1 ) || ! CheckNearestRecord( needleTrajectory, 5.0, 2 ) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  // The columns hold the records' times and matrices
+  if ( needleTrajectory->GetTimes()->GetValue( 1 ) != 1.0 || fabs( needleTrajectory->GetMatrixComponent( 0, 3 )->GetValue( 2 ) - 20.0 ) > TOLERANCE )
+  {
+    std::cerr << "Wrong needle trajectory columns." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  vtkSmartPointer< vtkPerkEvaluatorTrajectory > missingTrajectory = vtkSmartPointer< vtkPerkEvaluatorTrajectory >::New();
+  if ( missingTrajectory->Update( bufferNode, "Missing" ) || missingTrajectory->GetNumberOfRecords() != 0 || missingTrajectory->FindNearestRecord( 0.0 ) != -1 )
+  {
+    std::cerr << "Trajectory of a transform which is not recorded is not empty." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,147 @@
+// Checks that a metric script added to the scene is merged with an equal script already in the scene (found by its digest,
+// native metric name and node name): the metric instances move to the new script and the old one is removed,
+// while scripts which differ in name or source code are both kept.
+
+// PerkEvaluator includes
+#include "vtkSlicerPerkEvaluatorLogic.h"
+#include "vtkPerkEvaluatorMetricFactory.h"
+#include "vtkMRMLMetricInstanceNode.h"
+#include "vtkMRMLMetricScriptNode.h"
+
+// MRML includes
+#include "vtkMRMLScene.h"
+#include "vtkMRMLLinearTransformNode.h"
+
+// VTK includes
+#include <vtkCollection.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+// Helpers ----------------------------------------------
+
+static std::vector< vtkMRMLMetricScriptNode* > GetMetricScriptNodes( vtkMRMLScene* scene, std::string nativeMetricName )
+{
+  std::vector< vtkMRMLMetricScriptNode* > msNodes;
+  vtkSmartPointer< vtkCollection > metricScriptNodes;
+  metricScriptNodes.TakeReference( scene->GetNodesByClass( "vtkMRMLMetricScriptNode" ) );
+  for ( int i = 0; i < metricScriptNodes->GetNumberOfItems(); i++ )
+  {
+    vtkMRMLMetricScriptNode* msNode = vtkMRMLMetricScriptNode::SafeDownCast( metricScriptNodes->GetItemAsObject( i ) );
+    if ( msNode != NULL && msNode->GetNativeMetricName().compare( nativeMetricName ) == 0 )
+    {
+      msNodes.push_back( msNode );
+    }
+  }
+  return msNodes;
+}
+
+
+static int GetNumberOfMetricInstances( vtkMRMLScene* scene, std::string metricScriptID )
+{
+  int numInstances = 0;
+  vtkSmartPointer< vtkCollection > metricInstanceNodes;
+  metricInstanceNodes.TakeReference( scene->GetNodesByClass( "vtkMRMLMetricInstanceNode" ) );
+  for ( int i = 0; i < metricInstanceNodes->GetNumberOfItems(); i++ )
+  {
+    vtkMRMLMetricInstanceNode* miNode = vtkMRMLMetricInstanceNode::SafeDownCast( metricInstanceNodes->GetItemAsObject( i ) );
+    if ( miNode != NULL && miNode->GetAssociatedMetricScriptID().compare( metricScriptID ) == 0 )
+    {
+      numInstances++;
+    }
+  }
+  return numInstances;
+}
+
+
+static vtkMRMLMetricScriptNode* AddMetricScript( vtkMRMLScene* scene, std::string name, std::string nativeMetricName, std::string pythonSourceCode )
+{
+  vtkSmartPointer< vtkMRMLMetricScriptNode > msNode;
+  msNode.TakeReference( vtkMRMLMetricScriptNode::SafeDownCast( scene->CreateNodeByClass( "vtkMRMLMetricScriptNode" ) ) );
+  msNode->SetName( name.c_str() );
+  msNode->SetNativeMetricName( nativeMetricName );
+  msNode->SetPythonSourceCode( pythonSourceCode );
+  msNode->SetScene( scene );
+  scene->AddNode( msNode );
+  return msNode;
+}
+
+
+// Test ----------------------------------------------
+
+int vtkSlicerPerkEvaluatorLogicMergeTest1( int vtkNotUsed( argc ), char* vtkNotUsed( argv )[] )
+{
+  vtkSmartPointer< vtkMRMLScene > scene = vtkSmartPointer< vtkMRMLScene >::New();
+  vtkSmartPointer< vtkSlicerPerkEvaluatorLogic > peLogic = vtkSmartPointer< vtkSlicerPerkEvaluatorLogic >::New();
+  peLogic->SetMRMLScene( scene );
+
+  // A transform, so the pervasive native metrics have instances
+  vtkSmartPointer< vtkMRMLLinearTransformNode > transformNode = vtkSmartPointer< vtkMRMLLinearTransformNode >::New();
+  transformNode->SetName( "Needle" );
+  scene->AddNode( transformNode );
+  peLogic->AddNativeMetricsToScene();
+
+  std::vector< std::string > nativeMetricNames = vtkPerkEvaluatorMetricFactory::GetInstance()->GetRegisteredMetricNames();
+  if ( nativeMetricNames.empty() )
+  {
+    std::cerr << "No native metrics are registered." << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::string nativeMetricName = nativeMetricNames.at( 0 );
+
+  std::vector< vtkMRMLMetricScriptNode* > msNodes = GetMetricScriptNodes( scene, nativeMetricName );
+  if ( msNodes.size() != 1 )
+  {
+    std::cerr << "Wrong number of scripts for " << nativeMetricName << " after adding the native metrics: " << msNodes.size() << " (expected 1)." << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::string originalID = msNodes.at( 0 )->GetID();
+  std::string originalName = msNodes.at( 0 )->GetName();
+  std::string originalSourceCode = msNodes.at( 0 )->GetPythonSourceCode();
+  int numInstances = GetNumberOfMetricInstances( scene, originalID );
+  if ( numInstances == 0 )
+  {
+    std::cerr << "No instances of " << nativeMetricName << " for the transform." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // An equal script replaces the original, which keeps its instances
+  vtkMRMLMetricScriptNode* equalNode = AddMetricScript( scene, originalName, nativeMetricName, originalSourceCode );
+  msNodes = GetMetricScriptNodes( scene, nativeMetricName );
+  if ( msNodes.size() != 1 || msNodes.at( 0 ) != equalNode || scene->GetNodeByID( originalID ) != NULL )
+  {
+    std::cerr << "Equal script not merged: " << msNodes.size() << " scripts for " << nativeMetricName << " (expected 1, the new one)." << std::endl;
+    return EXIT_FAILURE;
+  }
+  if ( GetNumberOfMetricInstances( scene, originalID ) != 0 || GetNumberOfMetricInstances( scene, equalNode->GetID() ) != numInstances )
+  {
+    std::cerr << "Metric instances not moved to the merged script." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // The same source code under another name, or other source code under the same name, is a different script
+  AddMetricScript( scene, originalName + " Copy", nativeMetricName, originalSourceCode );
+  AddMetricScript( scene, originalName, nativeMetricName, originalSourceCode + "\n# Changed\n" );
+  msNodes = GetMetricScriptNodes( scene, nativeMetricName );
+  if ( msNodes.size() != 3 || scene->GetNodeByID( equalNode->GetID() ) != equalNode )
+  {
+    std::cerr << "Different scripts merged: " << msNodes.size() << " scripts for " << nativeMetricName << " (expected 3)." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Merging everything at once keeps them all too
+  peLogic->MergeAllMetricScripts();
+  msNodes = GetMetricScriptNodes( scene, nativeMetricName );
+  if ( msNodes.size() != 3 )
+  {
+    std::cerr << "Different scripts merged when merging all: " << msNodes.size() << " scripts for " << nativeMetricName << " (expected 3)." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
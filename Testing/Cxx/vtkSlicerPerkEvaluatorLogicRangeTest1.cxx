@@ -0,0 +1,184 @@
+// Checks that moving the marks updates the native metric values from the range metrics, also when the Perk Evaluator node
+// has script metrics too: the native values are the same as a full analysis between the marks gives, and the script
+// metric values (which only a full analysis can compute) are cleared rather than left for the previous marks.
+
+// PerkEvaluator includes
+#include "vtkSlicerPerkEvaluatorLogic.h"
+#include "vtkPerkEvaluatorProcedureGenerator.h"
+#include "vtkMRMLMetricInstanceNode.h"
+#include "vtkMRMLMetricScriptNode.h"
+#include "vtkMRMLPerkEvaluatorNode.h"
+
+// TransformRecorder includes
+#include "vtkSlicerTransformRecorderLogic.h"
+#include "vtkMRMLTransformBufferNode.h"
+
+// MRML includes
+#include "vtkMRMLScene.h"
+#include "vtkMRMLLinearTransformNode.h"
+#include "vtkMRMLTableNode.h"
+
+// VTK includes
+#include <vtkSmartPointer.h>
+#include <vtkTable.h>
+#include <vtksys/SystemTools.hxx>
+
+// STD includes
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+
+
+// Constants ----------------------------------------------
+
+static const int NUMBER_OF_TOOLS = 2;
+static const double SAMPLING_RATE = 20.0; // Hz
+static const double DURATION = 10.0; // s
+static const double TOLERANCE = 1e-6; // Relative
+static const int JOB_POLLING_INTERVAL = 10; // ms
+static const char* SCRIPT_METRIC_NAME = "Script Metric";
+
+
+// Helpers ----------------------------------------------
+
+static std::string GetRowKey( vtkTable* metricsTable, int row )
+{
+  return metricsTable->GetValueByName( row, "MetricName" ).ToString() + "\n"
+    + metricsTable->GetValueByName( row, "MetricUnit" ).ToString() + "\n"
+    + metricsTable->GetValueByName( row, "MetricRoles" ).ToString();
+}
+
+
+static std::map< std::string, std::string > GetMetricsTableValues( vtkMRMLPerkEvaluatorNode* peNode )
+{
+  std::map< std::string, std::string > values;
+  vtkTable* metricsTable = peNode->GetMetricsTableNode()->GetTable();
+  for ( int i = 0; i < metricsTable->GetNumberOfRows(); i++ )
+  {
+    values[ GetRowKey( metricsTable, i ) ] = metricsTable->GetValueByName( i, "MetricValue" ).ToString();
+  }
+  return values;
+}
+
+
+static void WaitForAnalysisJobs( vtkSlicerPerkEvaluatorLogic* peLogic )
+{
+  while ( peLogic->GetAnalysisJobsRunning() )
+  {
+    vtksys::SystemTools::Delay( JOB_POLLING_INTERVAL );
+    peLogic->ProcessAnalysisJobs();
+  }
+}
+
+
+static vtkMRMLMetricInstanceNode* AddScriptMetricInstance( vtkMRMLScene* scene, vtkSlicerPerkEvaluatorLogic* peLogic, vtkMRMLPerkEvaluatorNode* peNode, std::string transformNodeID )
+{
+  vtkSmartPointer< vtkMRMLMetricScriptNode > msNode;
+  msNode.TakeReference( vtkMRMLMetricScriptNode::SafeDownCast( scene->CreateNodeByClass( "vtkMRMLMetricScriptNode" ) ) );
+  msNode->SetName( SCRIPT_METRIC_NAME );
+  msNode->SetPythonSourceCode( "class PerkEvaluatorMetric:\n  pass\n" );
+  msNode->SetScene( scene );
+  scene->AddNode( msNode );
+
+  vtkMRMLMetricInstanceNode* miNode = peLogic->CreateMetricInstance( msNode );
+  miNode->SetRoleID( transformNodeID, "Any", vtkMRMLMetricInstanceNode::TransformRole );
+  peNode->AddMetricInstanceID( miNode->GetID() );
+  return miNode;
+}
+
+
+// Test ----------------------------------------------
+
+int vtkSlicerPerkEvaluatorLogicRangeTest1( int vtkNotUsed( argc ), char* vtkNotUsed( argv )[] )
+{
+  vtkSmartPointer< vtkMRMLScene > scene = vtkSmartPointer< vtkMRMLScene >::New();
+  vtkSmartPointer< vtkSlicerTransformRecorderLogic > trLogic = vtkSmartPointer< vtkSlicerTransformRecorderLogic >::New();
+  trLogic->SetMRMLScene( scene );
+  vtkSmartPointer< vtkSlicerPerkEvaluatorLogic > peLogic = vtkSmartPointer< vtkSlicerPerkEvaluatorLogic >::New();
+  peLogic->SetMRMLScene( scene );
+
+  vtkSmartPointer< vtkPerkEvaluatorProcedureGenerator > generator = vtkSmartPointer< vtkPerkEvaluatorProcedureGenerator >::New();
+  generator->SetNumberOfTools( NUMBER_OF_TOOLS );
+  generator->SetSamplingRate( SAMPLING_RATE );
+  generator->SetDuration( DURATION );
+  generator->CreateToolNodes( scene );
+
+  vtkSmartPointer< vtkMRMLTransformBufferNode > bufferNode = vtkSmartPointer< vtkMRMLTransformBufferNode >::New();
+  scene->AddNode( bufferNode );
+  generator->Generate( bufferNode );
+
+  vtkSmartPointer< vtkMRMLTableNode > metricsTableNode = vtkSmartPointer< vtkMRMLTableNode >::New();
+  scene->AddNode( metricsTableNode );
+  vtkSmartPointer< vtkMRMLPerkEvaluatorNode > peNode = vtkSmartPointer< vtkMRMLPerkEvaluatorNode >::New();
+  peNode->SetScene( scene );
+  scene->AddNode( peNode );
+  peNode->SetTransformBufferID( bufferNode->GetID() );
+  peNode->SetMetricsTableID( metricsTableNode->GetID() );
+
+  // The native metrics for every tool, and a script metric
+  peLogic->AddNativeMetricsToScene();
+  vtkMRMLLinearTransformNode* toolNode = vtkMRMLLinearTransformNode::SafeDownCast( scene->GetFirstNodeByName( generator->GetToolName( 0 ).c_str() ) );
+  vtkMRMLMetricInstanceNode* scriptMINode = AddScriptMetricInstance( scene, peLogic, peNode, toolNode->GetID() );
+
+  // The values of a full analysis between the marks (there is no Python here, so the script metric has no row)
+  double totalTime = bufferNode->GetTotalTime();
+  peNode->SetMarkBegin( 0.25 * totalTime );
+  peNode->SetMarkEnd( 0.75 * totalTime );
+  peLogic->ComputeMetrics( peNode );
+  std::map< std::string, std::string > expectedValues = GetMetricsTableValues( peNode );
+  if ( expectedValues.empty() )
+  {
+    std::cerr << "No native metric values computed." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // As if the Python metrics calculator had computed the script metric
+  vtkTable* metricsTable = metricsTableNode->GetTable();
+  int scriptRow = metricsTable->InsertNextBlankRow();
+  metricsTable->SetValueByName( scriptRow, "MetricName", vtkVariant( SCRIPT_METRIC_NAME ) );
+  metricsTable->SetValueByName( scriptRow, "MetricUnit", vtkVariant( "" ) );
+  metricsTable->SetValueByName( scriptRow, "MetricRoles", vtkVariant( scriptMINode->GetCombinedRoleString() ) );
+  metricsTable->SetValueByName( scriptRow, "MetricValue", vtkVariant( "1" ) );
+  std::string scriptKey = GetRowKey( metricsTable, scriptRow );
+
+  // Drag the marks away (this builds the range metrics in the background), then back
+  peNode->SetMarkBegin( 0.0 );
+  peNode->SetMarkEnd( totalTime );
+  peLogic->ComputeMetricsOverMarkedRange( peNode );
+  WaitForAnalysisJobs( peLogic );
+
+  peNode->SetMarkBegin( 0.25 * totalTime );
+  peNode->SetMarkEnd( 0.75 * totalTime );
+  if ( ! peLogic->ComputeMetricsOverMarkedRange( peNode ) )
+  {
+    std::cerr << "Metrics not updated from the range metrics with a script metric selected." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::map< std::string, std::string > values = GetMetricsTableValues( peNode );
+  if ( values.size() != expectedValues.size() + 1 || values.find( scriptKey ) == values.end() )
+  {
+    std::cerr << "Wrong number of metrics table rows: " << values.size() << " (expected " << expectedValues.size() + 1 << ")." << std::endl;
+    return EXIT_FAILURE;
+  }
+  if ( values[ scriptKey ].compare( "" ) != 0 )
+  {
+    std::cerr << "Script metric value not cleared when the marks moved: " << values[ scriptKey ] << "." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  for ( std::map< std::string, std::string >::iterator itr = expectedValues.begin(); itr != expectedValues.end(); itr++ )
+  {
+    double expected = atof( itr->second.c_str() );
+    double actual = atof( values[ itr->first ].c_str() );
+    if ( values[ itr->first ].compare( "" ) == 0 || fabs( actual - expected ) > TOLERANCE * ( 1 + fabs( expected ) ) )
+    {
+      std::cerr << "Wrong native metric value over the marks for " << itr->first << ": " << values[ itr->first ] << " (expected " << itr->second << ")." << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
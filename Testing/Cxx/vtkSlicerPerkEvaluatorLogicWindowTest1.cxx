@@ -0,0 +1,160 @@
+// Checks the windowed metrics of a Perk Evaluator node which has both native and script metrics: every window gets the
+// native values a full analysis between its begin and end gives, and the script metrics (which cannot forget samples,
+// so are not computed over windows) get no column.
+
+// PerkEvaluator includes
+#include "vtkSlicerPerkEvaluatorLogic.h"
+#include "vtkPerkEvaluatorProcedureGenerator.h"
+#include "vtkMRMLMetricInstanceNode.h"
+#include "vtkMRMLMetricScriptNode.h"
+#include "vtkMRMLPerkEvaluatorNode.h"
+
+// TransformRecorder includes
+#include "vtkSlicerTransformRecorderLogic.h"
+#include "vtkMRMLTransformBufferNode.h"
+
+// MRML includes
+#include "vtkMRMLScene.h"
+#include "vtkMRMLLinearTransformNode.h"
+#include "vtkMRMLTableNode.h"
+
+// VTK includes
+#include <vtkSmartPointer.h>
+#include <vtkTable.h>
+
+// STD includes
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+
+
+// Constants ----------------------------------------------
+
+static const int NUMBER_OF_TOOLS = 2;
+static const double SAMPLING_RATE = 20.0; // Hz
+static const double DURATION = 10.0; // s
+static const double TOLERANCE = 1e-5; // Relative (the metrics table has the values as strings, with 6 significant digits)
+static const char* SCRIPT_METRIC_NAME = "Script Metric";
+
+
+// Helpers ----------------------------------------------
+
+// The same as the windowed metrics column names
+static std::map< std::string, std::string > GetMetricsTableValues( vtkMRMLPerkEvaluatorNode* peNode )
+{
+  std::map< std::string, std::string > values;
+  vtkTable* metricsTable = peNode->GetMetricsTableNode()->GetTable();
+  for ( int i = 0; i < metricsTable->GetNumberOfRows(); i++ )
+  {
+    std::string columnName = metricsTable->GetValueByName( i, "MetricName" ).ToString()
+      + " [" + metricsTable->GetValueByName( i, "MetricRoles" ).ToString() + "]"
+      + " (" + metricsTable->GetValueByName( i, "MetricUnit" ).ToString() + ")";
+    values[ columnName ] = metricsTable->GetValueByName( i, "MetricValue" ).ToString();
+  }
+  return values;
+}
+
+
+static void AddScriptMetricInstance( vtkMRMLScene* scene, vtkSlicerPerkEvaluatorLogic* peLogic, vtkMRMLPerkEvaluatorNode* peNode, std::string transformNodeID )
+{
+  vtkSmartPointer< vtkMRMLMetricScriptNode > msNode;
+  msNode.TakeReference( vtkMRMLMetricScriptNode::SafeDownCast( scene->CreateNodeByClass( "vtkMRMLMetricScriptNode" ) ) );
+  msNode->SetName( SCRIPT_METRIC_NAME );
+  msNode->SetPythonSourceCode( "class PerkEvaluatorMetric:\n  pass\n" );
+  msNode->SetScene( scene );
+  scene->AddNode( msNode );
+
+  vtkMRMLMetricInstanceNode* miNode = peLogic->CreateMetricInstance( msNode );
+  miNode->SetRoleID( transformNodeID, "Any", vtkMRMLMetricInstanceNode::TransformRole );
+  peNode->AddMetricInstanceID( miNode->GetID() );
+}
+
+
+// Test ----------------------------------------------
+
+int vtkSlicerPerkEvaluatorLogicWindowTest1( int vtkNotUsed( argc ), char* vtkNotUsed( argv )[] )
+{
+  vtkSmartPointer< vtkMRMLScene > scene = vtkSmartPointer< vtkMRMLScene >::New();
+  vtkSmartPointer< vtkSlicerTransformRecorderLogic > trLogic = vtkSmartPointer< vtkSlicerTransformRecorderLogic >::New();
+  trLogic->SetMRMLScene( scene );
+  vtkSmartPointer< vtkSlicerPerkEvaluatorLogic > peLogic = vtkSmartPointer< vtkSlicerPerkEvaluatorLogic >::New();
+  peLogic->SetMRMLScene( scene );
+
+  vtkSmartPointer< vtkPerkEvaluatorProcedureGenerator > generator = vtkSmartPointer< vtkPerkEvaluatorProcedureGenerator >::New();
+  generator->SetNumberOfTools( NUMBER_OF_TOOLS );
+  generator->SetSamplingRate( SAMPLING_RATE );
+  generator->SetDuration( DURATION );
+  generator->CreateToolNodes( scene );
+
+  vtkSmartPointer< vtkMRMLTransformBufferNode > bufferNode = vtkSmartPointer< vtkMRMLTransformBufferNode >::New();
+  scene->AddNode( bufferNode );
+  generator->Generate( bufferNode );
+
+  vtkSmartPointer< vtkMRMLTableNode > metricsTableNode = vtkSmartPointer< vtkMRMLTableNode >::New();
+  scene->AddNode( metricsTableNode );
+  vtkSmartPointer< vtkMRMLTableNode > windowedMetricsTableNode = vtkSmartPointer< vtkMRMLTableNode >::New();
+  scene->AddNode( windowedMetricsTableNode );
+  vtkSmartPointer< vtkMRMLPerkEvaluatorNode > peNode = vtkSmartPointer< vtkMRMLPerkEvaluatorNode >::New();
+  peNode->SetScene( scene );
+  scene->AddNode( peNode );
+  peNode->SetTransformBufferID( bufferNode->GetID() );
+  peNode->SetMetricsTableID( metricsTableNode->GetID() );
+
+  // The native metrics for every tool, and a script metric
+  peLogic->AddNativeMetricsToScene();
+  vtkMRMLLinearTransformNode* toolNode = vtkMRMLLinearTransformNode::SafeDownCast( scene->GetFirstNodeByName( generator->GetToolName( 0 ).c_str() ) );
+  AddScriptMetricInstance( scene, peLogic, peNode, toolNode->GetID() );
+
+  // Overlapping windows over the whole procedure
+  double totalTime = bufferNode->GetTotalTime();
+  peNode->SetMarkBegin( 0.0 );
+  peNode->SetMarkEnd( totalTime );
+  peLogic->ComputeWindowedMetrics( peNode, 0.5 * totalTime, 0.25 * totalTime, windowedMetricsTableNode );
+  vtkTable* windowedMetricsTable = windowedMetricsTableNode->GetTable();
+  if ( windowedMetricsTable->GetNumberOfRows() < 2 )
+  {
+    std::cerr << "Wrong number of windows: " << windowedMetricsTable->GetNumberOfRows() << "." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  for ( int i = 0; i < windowedMetricsTable->GetNumberOfRows(); i++ )
+  {
+    // The values of a full analysis over the window (there is no Python here, so the script metric has no row)
+    peNode->SetMarkBegin( windowedMetricsTable->GetValueByName( i, "WindowBegin" ).ToDouble() );
+    peNode->SetMarkEnd( windowedMetricsTable->GetValueByName( i, "WindowEnd" ).ToDouble() );
+    peLogic->ComputeMetrics( peNode );
+    std::map< std::string, std::string > expectedValues = GetMetricsTableValues( peNode );
+    if ( expectedValues.empty() )
+    {
+      std::cerr << "No native metric values computed." << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // Only the window times and the native metrics
+    if ( windowedMetricsTable->GetNumberOfColumns() != int( expectedValues.size() ) + 2 )
+    {
+      std::cerr << "Wrong number of windowed metrics columns: " << windowedMetricsTable->GetNumberOfColumns() << " (expected " << expectedValues.size() + 2 << ")." << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    for ( std::map< std::string, std::string >::iterator itr = expectedValues.begin(); itr != expectedValues.end(); itr++ )
+    {
+      if ( windowedMetricsTable->GetColumnByName( itr->first.c_str() ) == NULL )
+      {
+        std::cerr << "No windowed metrics column for " << itr->first << "." << std::endl;
+        return EXIT_FAILURE;
+      }
+      double expected = atof( itr->second.c_str() );
+      double actual = windowedMetricsTable->GetValueByName( i, itr->first.c_str() ).ToDouble();
+      if ( fabs( actual - expected ) > TOLERANCE * ( 1 + fabs( expected ) ) )
+      {
+        std::cerr << "Wrong native metric value in window " << i << " for " << itr->first << ": " << actual << " (expected " << expected << ")." << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
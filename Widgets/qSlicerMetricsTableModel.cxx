@@ -0,0 +1,191 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Jean-Christophe Fillion-Robin, Kitware Inc.
+  and was partially funded by NIH grant 3P41RR013218-12S1
+
+==============================================================================*/
+
+// FooBar Widgets includes
+#include "qSlicerMetricsTableModel.h"
+
+// VTK includes
+#include <vtkTable.h>
+
+// STD includes
+#include <algorithm>
+
+
+//-----------------------------------------------------------------------------
+// qSlicerMetricsTableModel methods
+
+//-----------------------------------------------------------------------------
+qSlicerMetricsTableModel
+::qSlicerMetricsTableModel( QObject* parent ) : Superclass( parent )
+{
+  this->MetricsTableNode = NULL;
+}
+
+
+qSlicerMetricsTableModel
+::~qSlicerMetricsTableModel()
+{
+}
+
+
+void qSlicerMetricsTableModel
+::setMetricsTableNode( vtkMRMLTableNode* newMetricsTableNode )
+{
+  this->MetricsTableNode = newMetricsTableNode;
+  this->updateFromMetricsTableNode();
+}
+
+
+vtkMRMLTableNode* qSlicerMetricsTableModel
+::getMetricsTableNode()
+{
+  return this->MetricsTableNode;
+}
+
+
+int qSlicerMetricsTableModel
+::rowCount( const QModelIndex& parent ) const
+{
+  if ( parent.isValid() )
+  {
+    return 0;
+  }
+  return this->MetricStrings.size();
+}
+
+
+int qSlicerMetricsTableModel
+::columnCount( const QModelIndex& parent ) const
+{
+  if ( parent.isValid() )
+  {
+    return 0;
+  }
+  return NumberOfColumns;
+}
+
+
+QVariant qSlicerMetricsTableModel
+::data( const QModelIndex& index, int role ) const
+{
+  if ( ! index.isValid() || index.row() >= int( this->MetricStrings.size() ) || role != Qt::DisplayRole )
+  {
+    return QVariant();
+  }
+
+  if ( index.column() == MetricColumn )
+  {
+    return this->MetricStrings.at( index.row() );
+  }
+  if ( index.column() == ValueColumn )
+  {
+    return this->ValueStrings.at( index.row() );
+  }
+  return QVariant();
+}
+
+
+QVariant qSlicerMetricsTableModel
+::headerData( int section, Qt::Orientation orientation, int role ) const
+{
+  if ( orientation != Qt::Horizontal || role != Qt::DisplayRole )
+  {
+    return Superclass::headerData( section, orientation, role );
+  }
+
+  if ( section == MetricColumn )
+  {
+    return QString( "Metric" );
+  }
+  if ( section == ValueColumn )
+  {
+    return QString( "Value" );
+  }
+  return QVariant();
+}
+
+
+void qSlicerMetricsTableModel
+::readRow( int row, QString& metricString, QString& valueString )
+{
+  vtkTable* metricsTable = this->MetricsTableNode->GetTable();
+
+  metricString.clear();
+  metricString.append( metricsTable->GetValueByName( row, "MetricName" ).ToString().c_str() );
+  metricString.append( " [" );
+  metricString.append( metricsTable->GetValueByName( row, "MetricRoles" ).ToString().c_str() );
+  metricString.append( "] (" );
+  metricString.append( metricsTable->GetValueByName( row, "MetricUnit" ).ToString().c_str() );
+  metricString.append( ")" );
+
+  valueString = QString( metricsTable->GetValueByName( row, "MetricValue" ).ToString().c_str() );
+}
+
+
+bool qSlicerMetricsTableModel
+::updateFromMetricsTableNode()
+{
+  int oldNumberOfRows = this->MetricStrings.size();
+  int newNumberOfRows = 0;
+  if ( this->MetricsTableNode != NULL && this->MetricsTableNode->GetTable() != NULL )
+  {
+    newNumberOfRows = this->MetricsTableNode->GetTable()->GetNumberOfRows();
+  }
+
+  // Add or remove rows at the end, so the views keep their selection and scrolling for the other rows
+  if ( newNumberOfRows < oldNumberOfRows )
+  {
+    this->beginRemoveRows( QModelIndex(), newNumberOfRows, oldNumberOfRows - 1 );
+    this->MetricStrings.resize( newNumberOfRows );
+    this->ValueStrings.resize( newNumberOfRows );
+    this->endRemoveRows();
+  }
+  if ( newNumberOfRows > oldNumberOfRows )
+  {
+    this->beginInsertRows( QModelIndex(), oldNumberOfRows, newNumberOfRows - 1 );
+    this->MetricStrings.resize( newNumberOfRows );
+    this->ValueStrings.resize( newNumberOfRows );
+    for ( int i = oldNumberOfRows; i < newNumberOfRows; i++ )
+    {
+      this->readRow( i, this->MetricStrings.at( i ), this->ValueStrings.at( i ) );
+    }
+    this->endInsertRows();
+  }
+
+  // Only report the cells which actually changed (typically, only values change during real-time processing)
+  QString metricString;
+  QString valueString;
+  for ( int i = 0; i < std::min( oldNumberOfRows, newNumberOfRows ); i++ )
+  {
+    this->readRow( i, metricString, valueString );
+    if ( metricString.compare( this->MetricStrings.at( i ) ) != 0 )
+    {
+      this->MetricStrings.at( i ) = metricString;
+      emit dataChanged( this->index( i, MetricColumn ), this->index( i, MetricColumn ) );
+    }
+    if ( valueString.compare( this->ValueStrings.at( i ) ) != 0 )
+    {
+      this->ValueStrings.at( i ) = valueString;
+      emit dataChanged( this->index( i, ValueColumn ), this->index( i, ValueColumn ) );
+    }
+  }
+
+  return newNumberOfRows != oldNumberOfRows;
+}
@@ -0,0 +1,83 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Jean-Christophe Fillion-Robin, Kitware Inc.
+  and was partially funded by NIH grant 3P41RR013218-12S1
+
+==============================================================================*/
+
+#ifndef __qSlicerMetricsTableModel_h
+#define __qSlicerMetricsTableModel_h
+
+// Qt includes
+#include <QAbstractTableModel>
+#include <QString>
+
+// STD includes
+#include <vector>
+
+#include "vtkMRMLTableNode.h"
+
+// FooBar Widgets includes
+#include "qSlicerPerkEvaluatorModuleWidgetsExport.h"
+
+/// \ingroup Slicer_QtModules_CreateModels
+/// Presents a metrics table node as two columns (the metric with its roles and unit, and its value).
+/// The displayed strings are kept, so when the table node changes only the rows and cells that differ are reported to the views.
+class Q_SLICER_MODULE_PERKEVALUATOR_WIDGETS_EXPORT
+qSlicerMetricsTableModel : public QAbstractTableModel
+{
+  Q_OBJECT
+public:
+  typedef QAbstractTableModel Superclass;
+  qSlicerMetricsTableModel( QObject *parent=0 );
+  virtual ~qSlicerMetricsTableModel();
+
+  enum ColumnEnum
+  {
+    MetricColumn,
+    ValueColumn,
+    NumberOfColumns
+  };
+
+  void setMetricsTableNode( vtkMRMLTableNode* newMetricsTableNode );
+  vtkMRMLTableNode* getMetricsTableNode();
+
+  virtual int rowCount( const QModelIndex& parent = QModelIndex() ) const;
+  virtual int columnCount( const QModelIndex& parent = QModelIndex() ) const;
+  virtual QVariant data( const QModelIndex& index, int role = Qt::DisplayRole ) const;
+  virtual QVariant headerData( int section, Qt::Orientation orientation, int role = Qt::DisplayRole ) const;
+
+public slots:
+
+  // Compare the table node to what is displayed, and report only the differences
+  // Returns true if rows were added or removed
+  bool updateFromMetricsTableNode();
+
+protected:
+
+  vtkMRMLTableNode* MetricsTableNode;
+
+  std::vector< QString > MetricStrings;
+  std::vector< QString > ValueStrings;
+
+  void readRow( int row, QString& metricString, QString& valueString );
+
+private:
+  Q_DISABLE_COPY(qSlicerMetricsTableModel);
+
+};
+
+#endif
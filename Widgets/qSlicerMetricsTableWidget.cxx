@@ -69,6 +69,7 @@ qSlicerMetricsTableWidget
   this->ExpandHeightToContents = false;
   this->PerkEvaluatorLogic = vtkSlicerPerkEvaluatorLogic::SafeDownCast( vtkSlicerTransformRecorderLogic::GetSlicerModuleLogic( "PerkEvaluator" ) );
   this->ExpandHeightToContents = true;
+  this->MaximumRefreshRate = 10; // Refreshes per second
   this->setup();
 }
 
@@ -86,6 +87,18 @@ void qSlicerMetricsTableWidget
 
   d->setupUi(this);
 
+  // The view only repaints the cells the model reports as changed
+  this->MetricsTableModel = new qSlicerMetricsTableModel( this );
+  this->MetricsTableSortModel = new QSortFilterProxyModel( this );
+  this->MetricsTableSortModel->setSourceModel( this->MetricsTableModel );
+  this->MetricsTableSortModel->setDynamicSortFilter( true ); // Stay sorted when the values change
+  d->MetricsTable->setModel( this->MetricsTableSortModel );
+  d->MetricsTable->horizontalHeader()->setResizeMode( QHeaderView::Stretch );
+
+  this->RefreshTimer = new QTimer( this );
+  this->RefreshTimer->setSingleShot( true );
+  connect( this->RefreshTimer, SIGNAL( timeout() ), this, SLOT( refreshMetricsTable() ) );
+
   connect( d->MetricsTableNodeComboBox, SIGNAL( currentNodeChanged( vtkMRMLNode* ) ), this, SLOT( onMetricsTableNodeChanged( vtkMRMLNode* ) ) );
   
   connect( d->ClipboardButton, SIGNAL( clicked() ), this, SLOT( onClipboardButtonClicked() ) );
@@ -152,7 +165,7 @@ int qSlicerMetricsTableWidget
   Q_D(qSlicerMetricsTableWidget);
 
   int contentHeight = d->MetricsTable->horizontalHeader()->height() + 4; // This "magic" number makes it so there is no scroll bar
-  for ( int i = 0; i < d->MetricsTable->rowCount(); i++ )
+  for ( int i = 0; i < d->MetricsTable->model()->rowCount(); i++ )
   {
     contentHeight += d->MetricsTable->rowHeight( i );
   }
@@ -171,6 +184,20 @@ void qSlicerMetricsTableWidget
 }
 
 
+void qSlicerMetricsTableWidget
+::setMaximumRefreshRate( double refreshesPerSecond )
+{
+  this->MaximumRefreshRate = refreshesPerSecond;
+}
+
+
+double qSlicerMetricsTableWidget
+::getMaximumRefreshRate()
+{
+  return this->MaximumRefreshRate;
+}
+
+
 
 void qSlicerMetricsTableWidget
 ::onMetricsTableNodeChanged( vtkMRMLNode* newMetricsTableNode )
@@ -183,6 +210,8 @@ void qSlicerMetricsTableWidget
 
   this->qvtkConnect( this->MetricsTableNode, vtkCommand::ModifiedEvent, this, SLOT( onMetricsTableNodeModified() ) );
 
+  this->RefreshTimer->stop();
+  this->MetricsTableModel->setMetricsTableNode( this->MetricsTableNode );
   this->updateWidget();
 
   emit metricsTableNodeChanged( this->MetricsTableNode );
@@ -192,6 +221,32 @@ void qSlicerMetricsTableWidget
 void qSlicerMetricsTableWidget
 ::onMetricsTableNodeModified()
 {
+  // During real-time processing, the table is modified for every tracker sample, so limit how often the widget is refreshed
+  if ( this->MaximumRefreshRate <= 0 || ! this->LastRefreshTime.isValid() )
+  {
+    this->refreshMetricsTable();
+    return;
+  }
+
+  int refreshIntervalMsec = 1000 / this->MaximumRefreshRate;
+  int remainingMsec = refreshIntervalMsec - this->LastRefreshTime.elapsed();
+  if ( remainingMsec <= 0 )
+  {
+    this->refreshMetricsTable();
+  }
+  else if ( ! this->RefreshTimer->isActive() )
+  {
+    this->RefreshTimer->start( remainingMsec ); // Make sure the last modification is eventually shown
+  }
+}
+
+
+void qSlicerMetricsTableWidget
+::refreshMetricsTable()
+{
+  this->RefreshTimer->stop();
+  this->LastRefreshTime.start();
+
   this->updateWidget();
   emit metricsTableNodeModified(); // This should allows parent widgets to update themselves
 }
@@ -208,7 +263,7 @@ void qSlicerMetricsTableWidget
   }
   
   // Add all rows to the clipboard vector
-  std::vector<bool> copyRow = std::vector<bool>( this->MetricsTableNode->GetTable()->GetNumberOfRows(), true );
+  std::vector<bool> copyRow = std::vector<bool>( d->MetricsTable->model()->rowCount(), true );
   this->copyMetricsTableToClipboard( copyRow );
 }
 
@@ -227,17 +282,18 @@ void qSlicerMetricsTableWidget
   // Note that we copy from the table widget, not directly from the table node
   // This is because the user expects what they copied to be what was on the table widget
   // In the case of sorting the table widget, the underlying table node would have different order than the user, causing the copied text to be unexpectedly different from what is displayed on the table widget
+  QAbstractItemModel* displayedModel = d->MetricsTable->model();
   QString clipString = QString( "" );
-  for ( int i = 0; i < this->MetricsTableNode->GetTable()->GetNumberOfRows(); i++ )
+  for ( int i = 0; i < displayedModel->rowCount() && i < int( copyRow.size() ); i++ )
   {
     if ( ! copyRow.at( i ) )
     {
       continue;
     }
 
-    clipString.append( d->MetricsTable->item( i, 0 )->text() ); // The metric name column
+    clipString.append( displayedModel->index( i, qSlicerMetricsTableModel::MetricColumn ).data().toString() ); // The metric name column
     clipString.append( "\t" );
-    clipString.append( d->MetricsTable->item( i, 1 )->text() ); // The metric value column
+    clipString.append( displayedModel->index( i, qSlicerMetricsTableModel::ValueColumn ).data().toString() ); // The metric value column
     clipString.append( "\n" );
   }
 
@@ -262,7 +318,7 @@ bool qSlicerMetricsTableWidget
   }
   
   QModelIndexList modelIndexList = d->MetricsTable->selectionModel()->selectedIndexes();
-  std::vector<bool> copyRow = std::vector<bool>( this->MetricsTableNode->GetTable()->GetNumberOfRows(), false );
+  std::vector<bool> copyRow = std::vector<bool>( d->MetricsTable->model()->rowCount(), false );
   for ( QModelIndexList::iterator index = modelIndexList.begin(); index != modelIndexList.end(); index++ )
   {
     copyRow.at( ( *index ).row() ) = true;
@@ -280,7 +336,7 @@ void qSlicerMetricsTableWidget
   Q_D( qSlicerMetricsTableWidget );
 
   // Sort the column, and then reset the table sizing
-  d->MetricsTable->sortItems( column );
+  this->MetricsTableSortModel->sort( column );
   d->MetricsTable->resizeRowsToContents();
 
   if ( this->ExpandHeightToContents )
@@ -297,55 +353,16 @@ void qSlicerMetricsTableWidget
 
   d->MetricsTableNodeComboBox->setCurrentNode( this->MetricsTableNode );
 
-  // Check what the current row and column are
-  int currentRow = d->MetricsTable->currentRow();
-  int currentColumn = d->MetricsTable->currentColumn();
-  int scrollPosition = d->MetricsTable->verticalScrollBar()->value();
-
-  // Set up the table
-  d->MetricsTable->clear();
-  d->MetricsTable->setRowCount( 0 );
-
-  if ( this->MetricsTableNode == NULL )
+  // Only the changed cells are updated, so the current cell and scrolling are kept by the view
+  bool rowsChanged = this->MetricsTableModel->updateFromMetricsTableNode();
+  if ( rowsChanged )
   {
-    return;
+    d->MetricsTable->resizeRowsToContents();
   }
 
-  QStringList MetricsTableHeaders;
-  MetricsTableHeaders << "Metric" << "Value";
-  d->MetricsTable->setRowCount( this->MetricsTableNode->GetTable()->GetNumberOfRows() );
-  d->MetricsTable->setColumnCount( 2 );
-  d->MetricsTable->setHorizontalHeaderLabels( MetricsTableHeaders );
-  d->MetricsTable->horizontalHeader()->setResizeMode( QHeaderView::Stretch );
-  
-  // Add the computed values to the table
-  for ( int i = 0; i < this->MetricsTableNode->GetTable()->GetNumberOfRows(); i++ )
-  {
-    QString nameString;
-    nameString.append( this->MetricsTableNode->GetTable()->GetValueByName( i, "MetricName" ).ToString() );
-    nameString.append( " [" );
-    nameString.append( this->MetricsTableNode->GetTable()->GetValueByName( i, "MetricRoles" ).ToString() );
-    nameString.append( "] (" );
-    nameString.append( this->MetricsTableNode->GetTable()->GetValueByName( i, "MetricUnit" ).ToString() );
-    nameString.append( ")" );
-    QTableWidgetItem* nameItem = new QTableWidgetItem( nameString );
-    d->MetricsTable->setItem( i, 0, nameItem );
-
-    QString valueString;
-    valueString.append( this->MetricsTableNode->GetTable()->GetValueByName( i, "MetricValue" ).ToString() );
-    QTableWidgetItem* valueItem = new QTableWidgetItem( valueString );    
-    d->MetricsTable->setItem( i, 1, valueItem );
-  }
-
-  d->MetricsTable->resizeRowsToContents();
-
   // Make sure the table widget is large enough so that no scroll bar is needed to see all of the data
   if ( this->ExpandHeightToContents )
   {
     d->MetricsTable->setMinimumHeight( this->getContentHeight() );
   }
-
-  // Reset the current row and column to what they were
-  d->MetricsTable->setCurrentCell( currentRow, currentColumn );
-  d->MetricsTable->verticalScrollBar()->setValue( scrollPosition );
 }
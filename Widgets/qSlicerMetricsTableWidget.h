@@ -23,6 +23,9 @@
 
 // Qt includes
 #include "qSlicerWidget.h"
+#include <QSortFilterProxyModel>
+#include <QTime>
+#include <QTimer>
 
 // VTK includes
 #include <vtkTable.h>
@@ -34,6 +37,7 @@
 // FooBar Widgets includes
 #include "qSlicerPerkEvaluatorModuleWidgetsExport.h"
 #include "ui_qSlicerMetricsTableWidget.h"
+#include "qSlicerMetricsTableModel.h"
 
 class qSlicerMetricsTableWidgetPrivate;
 
@@ -56,6 +60,10 @@ public:
 
   Q_INVOKABLE void setMetricsTableSelectionRowVisible( bool visible );
 
+  // Modifications of the table node faster than this are collected into one refresh (zero means refresh on every modification)
+  Q_INVOKABLE void setMaximumRefreshRate( double refreshesPerSecond );
+  Q_INVOKABLE double getMaximumRefreshRate();
+
   void setExpandHeightToContents( bool expand );
   bool getExpandHeightToContents();
   int getContentHeight();
@@ -71,6 +79,7 @@ protected slots:
   void onHeaderDoubleClicked( int column );
 
   void updateWidget();
+  void refreshMetricsTable();
 
   virtual bool eventFilter( QObject * watched, QEvent * event );
 
@@ -88,6 +97,13 @@ protected:
 
   bool ExpandHeightToContents;
 
+  qSlicerMetricsTableModel* MetricsTableModel;
+  QSortFilterProxyModel* MetricsTableSortModel;
+
+  double MaximumRefreshRate;
+  QTimer* RefreshTimer; // Pending refresh, if the last refresh was too recent
+  QTime LastRefreshTime;
+
   virtual void setup();
 
 private:
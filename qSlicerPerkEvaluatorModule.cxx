@@ -17,6 +17,7 @@
 
 // Qt includes
 #include <QtPlugin>
+#include <QTimer>
 
 // ExtensionTemplate Logic includes
 #include "vtkSlicerPerkEvaluatorLogic.h"
@@ -31,6 +32,10 @@
 #include "qSlicerCoreIOManager.h"
 #include "qSlicerCoreApplication.h"
 
+//-----------------------------------------------------------------------------
+static const int REAL_TIME_QUEUE_INTERVAL_MSEC = 10;
+static const double REAL_TIME_QUEUE_BUDGET_SEC = 0.008; // Leave some of each interval for tracking and rendering
+
 //-----------------------------------------------------------------------------
 Q_EXPORT_PLUGIN2(qSlicerPerkEvaluatorModule, qSlicerPerkEvaluatorModule);
 
@@ -40,6 +45,8 @@ class qSlicerPerkEvaluatorModulePrivate
 {
 public:
   qSlicerPerkEvaluatorModulePrivate();
+
+  QTimer* RealTimeQueueTimer;
 };
 
 //-----------------------------------------------------------------------------
@@ -48,6 +55,7 @@ public:
 //-----------------------------------------------------------------------------
 qSlicerPerkEvaluatorModulePrivate::qSlicerPerkEvaluatorModulePrivate()
 {
+  this->RealTimeQueueTimer = NULL;
 }
 
 //-----------------------------------------------------------------------------
@@ -117,6 +125,40 @@ void qSlicerPerkEvaluatorModule::setup()
   app->coreIOManager()->registerIO( new qSlicerMetricScriptReader( PerkEvaluatorLogic, this ) );
   app->coreIOManager()->registerIO( new qSlicerNodeWriter( "Python Metric Script", QString( "Python MetricScript" ), QStringList() << "vtkMRMLMetricScriptNode", true, this ) );
 
+  // The evaluation stage for real-time processing: drain the logic's queue in between tracking and rendering
+  Q_D(qSlicerPerkEvaluatorModule);
+  d->RealTimeQueueTimer = new QTimer( this );
+  connect( d->RealTimeQueueTimer, SIGNAL( timeout() ), this, SLOT( processRealTimeQueue() ) );
+  qvtkConnect( PerkEvaluatorLogic, vtkSlicerPerkEvaluatorLogic::RealTimeProcessingChangedEvent, this, SLOT( onRealTimeProcessingChanged() ) );
+
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerPerkEvaluatorModule::processRealTimeQueue()
+{
+  vtkSlicerPerkEvaluatorLogic* PerkEvaluatorLogic = vtkSlicerPerkEvaluatorLogic::SafeDownCast( this->logic() );
+  if ( PerkEvaluatorLogic == NULL )
+  {
+    return;
+  }
+
+  PerkEvaluatorLogic->ProcessRealTimeQueue( REAL_TIME_QUEUE_BUDGET_SEC );
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerPerkEvaluatorModule::onRealTimeProcessingChanged()
+{
+  Q_D(qSlicerPerkEvaluatorModule);
+
+  vtkSlicerPerkEvaluatorLogic* PerkEvaluatorLogic = vtkSlicerPerkEvaluatorLogic::SafeDownCast( this->logic() );
+  if ( PerkEvaluatorLogic != NULL && PerkEvaluatorLogic->GetRealTimeProcessingActive() )
+  {
+    d->RealTimeQueueTimer->start( REAL_TIME_QUEUE_INTERVAL_MSEC );
+  }
+  else
+  {
+    d->RealTimeQueueTimer->stop();
+  }
 }
 
 //-----------------------------------------------------------------------------
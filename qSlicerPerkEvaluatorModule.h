@@ -23,6 +23,9 @@
 #include "qSlicerCoreApplication.h"
 #include "qSlicerModuleManager.h"
 
+// CTK includes
+#include <ctkVTKObject.h>
+
 #include "qSlicerPerkEvaluatorModuleExport.h"
 
 class qSlicerPerkEvaluatorModulePrivate;
@@ -32,6 +35,7 @@ class Q_SLICER_QTMODULES_PERKEVALUATOR_EXPORT qSlicerPerkEvaluatorModule :
   public qSlicerLoadableModule
 {
   Q_OBJECT
+  QVTK_OBJECT
   Q_INTERFACES(qSlicerLoadableModule);
 
 public:
@@ -63,6 +67,14 @@ protected:
   /// Create and return the logic associated to this module
   virtual vtkMRMLAbstractLogic* createLogic();
 
+protected slots:
+
+  /// Evaluate the real-time samples queued by the logic
+  void processRealTimeQueue();
+
+  /// Only drain the queue while a Perk Evaluator node is processing in real-time
+  void onRealTimeProcessingChanged();
+
 protected:
   QScopedPointer<qSlicerPerkEvaluatorModulePrivate> d_ptr;
 
@@ -1,7 +1,6 @@
 
 // Standard includes 
-#include <ctime>
-#include <fstream>
+#include <algorithm>
 #include <sstream>
 #include <string>
 
@@ -23,20 +22,17 @@
 #include <qSlicerCoreApplication.h>
 
 #include "vtkSlicerPerkEvaluatorLogic.h"
+#include "vtkPerkEvaluatorAnalysisJob.h"
 #include "vtkMRMLPerkEvaluatorNode.h"
 
 #include "vtkMRMLModelNode.h"
 #include "vtkMRMLNode.h"
 
 
-// Debug
-void PrintToFile( std::string str )
-{
-  ofstream o( "PerkEvaluatorLog.txt", std::ios_base::app );
-  int c = clock();
-  o << std::fixed << setprecision( 2 ) << ( c / (double)CLOCKS_PER_SEC ) << " : " << str << std::endl;
-  o.close();
-}
+// Constants
+static const double MINIMUM_PLAYBACK_SPEED = 0.25;
+static const double MAXIMUM_PLAYBACK_SPEED = 16.0;
+static const int ANALYSIS_JOB_INTERVAL_MSEC = 100;
 
 
 
@@ -61,6 +57,7 @@ public:
   qSlicerPerkEvaluatorAnatomyRolesWidget* AnatomyRolesWidget;
 
   QProgressDialog* AnalysisStateDialog;
+  vtkSmartPointer< vtkPerkEvaluatorAnalysisJob > AnalysisJob; // The background analysis shown in the dialog
 };
 
 
@@ -100,8 +97,15 @@ qSlicerPerkEvaluatorModuleWidget::qSlicerPerkEvaluatorModuleWidget(QWidget* _par
   , d_ptr( new qSlicerPerkEvaluatorModuleWidgetPrivate( *this ) )
 {
   this->PlaybackTimer = new QTimer( this );
-  this->PlaybackTimerIntervalSec = 0.1; // seconds
+  this->AnalysisJobTimer = new QTimer( this );
+  this->PlaybackTimerIntervalSec = 1.0 / 30.0; // seconds (the target frame rate, the playback time itself follows the wall clock)
   this->FrameStepSec = 0.1; // seconds
+
+  this->PlaybackClockStartTime = 0.0;
+  this->LastPlaybackTime = 0.0;
+  this->PlaybackSpeed = 1.0;
+  this->PlaybackFrameCount = 0;
+  this->AchievedPlaybackFrameRate = 0.0;
 }
 
 
@@ -109,6 +113,7 @@ qSlicerPerkEvaluatorModuleWidget::qSlicerPerkEvaluatorModuleWidget(QWidget* _par
 qSlicerPerkEvaluatorModuleWidget::~qSlicerPerkEvaluatorModuleWidget()
 {
   delete this->PlaybackTimer;
+  delete this->AnalysisJobTimer;
 }
 
 
@@ -176,6 +181,9 @@ void qSlicerPerkEvaluatorModuleWidget
 void qSlicerPerkEvaluatorModuleWidget
 ::OnPlaybackPlayClicked()
 {
+  this->restartPlaybackClock();
+  this->PlaybackFrameRateClock.start();
+  this->PlaybackFrameCount = 0;
   this->PlaybackTimer->start( int( this->PlaybackTimerIntervalSec * 1000 ) ); // convert to milliseconds
 }
 
@@ -189,20 +197,92 @@ void qSlicerPerkEvaluatorModuleWidget
 
 
 
+void qSlicerPerkEvaluatorModuleWidget
+::OnPlaybackSpeedChanged( int index )
+{
+  Q_D( qSlicerPerkEvaluatorModuleWidget );
+
+  // The items are like "0.25x"
+  QString speedText = d->PlaybackSpeedComboBox->itemText( index );
+  speedText.remove( "x" );
+  bool valid = false;
+  double newPlaybackSpeed = speedText.toDouble( &valid );
+  if ( valid )
+  {
+    this->setPlaybackSpeed( newPlaybackSpeed );
+  }
+}
+
+
+void qSlicerPerkEvaluatorModuleWidget
+::setPlaybackSpeed( double newPlaybackSpeed )
+{
+  newPlaybackSpeed = std::max( MINIMUM_PLAYBACK_SPEED, std::min( newPlaybackSpeed, MAXIMUM_PLAYBACK_SPEED ) );
+  if ( newPlaybackSpeed == this->PlaybackSpeed )
+  {
+    return;
+  }
+
+  // Continue from the current time at the new speed
+  this->restartPlaybackClock();
+  this->PlaybackSpeed = newPlaybackSpeed;
+}
+
+
+double qSlicerPerkEvaluatorModuleWidget
+::getPlaybackSpeed()
+{
+  return this->PlaybackSpeed;
+}
+
+
+double qSlicerPerkEvaluatorModuleWidget
+::getAchievedPlaybackFrameRate()
+{
+  return this->AchievedPlaybackFrameRate;
+}
+
+
+void qSlicerPerkEvaluatorModuleWidget
+::restartPlaybackClock()
+{
+  Q_D( qSlicerPerkEvaluatorModuleWidget );
+
+  vtkMRMLPerkEvaluatorNode* peNode = vtkMRMLPerkEvaluatorNode::SafeDownCast( d->PerkEvaluatorNodeComboBox->currentNode() );
+
+  this->PlaybackClockStartTime = d->logic()->GetRelativePlaybackTime( peNode );
+  this->LastPlaybackTime = this->PlaybackClockStartTime;
+  this->PlaybackClock.start();
+}
+
+
 void qSlicerPerkEvaluatorModuleWidget
 ::OnTimeout()
 {
   Q_D( qSlicerPerkEvaluatorModuleWidget );
 
   vtkMRMLPerkEvaluatorNode* peNode = vtkMRMLPerkEvaluatorNode::SafeDownCast( d->PerkEvaluatorNodeComboBox->currentNode() );
+  if ( peNode == NULL )
+  {
+    this->PlaybackTimer->stop();
+    return;
+  }
+
+  // If the playback time was moved since the last tick (e.g. with the slider), continue from there
+  if ( d->logic()->GetRelativePlaybackTime( peNode ) != this->LastPlaybackTime )
+  {
+    this->restartPlaybackClock();
+  }
 
-  double newRelativePlaybackTime = d->logic()->GetRelativePlaybackTime( peNode ) + this->PlaybackTimerIntervalSec;
+  // Go straight to the time on the wall clock, however many ticks were missed (i.e. skip the frames which could not be shown)
+  double newRelativePlaybackTime = this->PlaybackClockStartTime + this->PlaybackSpeed * this->PlaybackClock.elapsed() / 1000.0;
 
   if ( newRelativePlaybackTime >= d->logic()->GetMaximumRelativePlaybackTime( peNode ) )
   {
     if ( d->PlaybackRepeatCheckBox->checkState() == Qt::Checked )
     {
       d->logic()->SetRelativePlaybackTime( peNode, 0 );
+      this->restartPlaybackClock();
     }
     else
     {
@@ -214,7 +294,18 @@ void qSlicerPerkEvaluatorModuleWidget
   {
     d->logic()->SetRelativePlaybackTime( peNode, newRelativePlaybackTime );
   }
+  this->LastPlaybackTime = d->logic()->GetRelativePlaybackTime( peNode );
 
+  // Count the frames actually shown
+  this->PlaybackFrameCount++;
+  int frameRateElapsed = this->PlaybackFrameRateClock.elapsed();
+  if ( frameRateElapsed >= 1000 )
+  {
+    this->AchievedPlaybackFrameRate = 1000.0 * this->PlaybackFrameCount / frameRateElapsed;
+    d->PlaybackFrameRateLabel->setText( QString( "%1 fps" ).arg( this->AchievedPlaybackFrameRate, 0, 'f', 1 ) );
+    this->PlaybackFrameRateClock.start();
+    this->PlaybackFrameCount = 0;
+  }
 }
 
 void qSlicerPerkEvaluatorModuleWidget
@@ -235,14 +326,65 @@ void qSlicerPerkEvaluatorModuleWidget
     return;
   }
 
-  d->AnalysisStateDialog->setLabelText( "Please wait while analyzing procedure..." );
-  d->AnalysisStateDialog->show();
+  // Only one analysis is shown at a time
+  if ( d->AnalysisJob != NULL )
+  {
+    d->AnalysisJob->Cancel();
+    this->OnAnalysisJobFinished();
+  }
+
+  // The analysis runs in the background, so the dialog does not need to block playback
+  d->AnalysisJob = d->logic()->StartAnalysisJob( peNode ); // This will populate the metrics table node with computed metrics when it is done
+  if ( d->AnalysisJob == NULL )
+  {
+    return;
+  }
+  this->qvtkConnect( d->AnalysisJob, vtkPerkEvaluatorAnalysisJob::ProgressEvent, this, SLOT( OnAnalysisStateUpdated( vtkObject*, void* ) ) );
+  this->qvtkConnect( d->AnalysisJob, vtkPerkEvaluatorAnalysisJob::FinishedEvent, this, SLOT( OnAnalysisJobFinished() ) );
+
+  // Only the native metrics are computed in the background, the script metrics are computed through Python on the main thread
+  if ( d->AnalysisJob->GetScriptMetricInstanceIDs().empty() )
+  {
+    d->AnalysisStateDialog->setLabelText( "Analyzing procedure..." );
+  }
+  else
+  {
+    d->AnalysisStateDialog->setLabelText( "Analyzing procedure...\nThe application may not respond while the script metrics are computed." );
+  }
+  d->AnalysisStateDialog->setModal( false );
   d->AnalysisStateDialog->setValue( 0 );
-  this->qvtkConnect( peNode, vtkMRMLPerkEvaluatorNode::AnalysisStateUpdatedEvent, this, SLOT( OnAnalysisStateUpdated( vtkObject*, void* ) ) );
+  d->AnalysisStateDialog->show();
+  this->AnalysisJobTimer->start( ANALYSIS_JOB_INTERVAL_MSEC );
+}
+
+
+void qSlicerPerkEvaluatorModuleWidget
+::OnAnalysisJobTimeout()
+{
+  Q_D( qSlicerPerkEvaluatorModuleWidget );
+
+  // Progress and results are only passed on to the scene here, on the main thread
+  d->logic()->ProcessAnalysisJobs();
+  if ( ! d->logic()->GetAnalysisJobsRunning() )
+  {
+    this->AnalysisJobTimer->stop();
+  }
+}
+
+
+void qSlicerPerkEvaluatorModuleWidget
+::OnAnalysisJobFinished()
+{
+  Q_D( qSlicerPerkEvaluatorModuleWidget );
 
-  d->logic()->ComputeMetrics( peNode ); // This will populate the metrics table node with computed metrics
+  if ( d->AnalysisJob == NULL )
+  {
+    return;
+  }
 
-  this->qvtkDisconnect( peNode, vtkMRMLPerkEvaluatorNode::AnalysisStateUpdatedEvent, this, SLOT( OnAnalysisStateUpdated( vtkObject*, void* ) ) );
+  this->qvtkDisconnect( d->AnalysisJob, vtkPerkEvaluatorAnalysisJob::ProgressEvent, this, SLOT( OnAnalysisStateUpdated( vtkObject*, void* ) ) );
+  this->qvtkDisconnect( d->AnalysisJob, vtkPerkEvaluatorAnalysisJob::FinishedEvent, this, SLOT( OnAnalysisJobFinished() ) );
+  d->AnalysisJob = NULL;
   d->AnalysisStateDialog->hide();
 }
 
@@ -263,6 +405,12 @@ void qSlicerPerkEvaluatorModuleWidget
 {
   Q_D( qSlicerPerkEvaluatorModuleWidget );
   
+  d->logic()->CancelMetricsBatch();
+  if ( d->AnalysisJob != NULL )
+  {
+    d->AnalysisJob->Cancel();
+  }
+
   // Cancel all analyses (even though only one should be going on at a given time)
   vtkCollection* nodes = d->logic()->GetMRMLScene()->GetNodesByClass( "vtkMRMLPerkEvaluatorNode" );
   for ( int i = 0; i < nodes->GetNumberOfItems(); i++ )
@@ -286,8 +434,9 @@ void qSlicerPerkEvaluatorModuleWidget
   // Remember the original Perk Evaluator node
   vtkMRMLNode* originalPerkEvaluatorNode = d->PerkEvaluatorNodeComboBox->currentNode();
 
-  // Iterate over all nodes and calculate
+  // Collect all of the nodes to calculate
   QList< vtkMRMLNode* > peNodeBatch = d->BatchPerkEvaluatorNodeComboBox->checkedNodes();
+  std::vector< vtkMRMLPerkEvaluatorNode* > peNodes;
 
   for ( int i = 0; i < peNodeBatch.size(); i++ )
   {
@@ -308,23 +457,55 @@ void qSlicerPerkEvaluatorModuleWidget
       d->TransformBufferWidget->setTransformBufferNode( transformBuffer );
     }
 
-    std::stringstream labelText;
-    labelText << "Please wait while analyzing procedure (" << i + 1 << "/" << peNodeBatch.size() << ")..."; // Use i + 1 to be human-readable
-    d->AnalysisStateDialog->setLabelText( labelText.str().c_str() );
-    d->AnalysisStateDialog->setValue( 0 );
-    d->AnalysisStateDialog->show();
-    this->qvtkConnect( peNode, vtkMRMLPerkEvaluatorNode::AnalysisStateUpdatedEvent, this, SLOT( OnAnalysisStateUpdated( vtkObject*, void* ) ) );
+    peNodes.push_back( peNode );
+  }
+
+  // Analyze them all at once, with one progress dialog for the whole batch
+  std::stringstream labelText;
+  labelText << "Please wait while analyzing procedures (" << peNodes.size() << ")...";
+  d->AnalysisStateDialog->setLabelText( labelText.str().c_str() );
+  d->AnalysisStateDialog->setModal( true );
+  d->AnalysisStateDialog->setValue( 0 );
+  d->AnalysisStateDialog->show();
+  this->qvtkConnect( d->logic(), vtkSlicerPerkEvaluatorLogic::MetricsBatchProgressEvent, this, SLOT( OnAnalysisStateUpdated( vtkObject*, void* ) ) );
 
-    d->logic()->ComputeMetrics( peNode ); // This will populate the metrics table node with computed metrics
+  d->logic()->ComputeMetricsBatch( peNodes ); // This will populate the metrics table nodes with computed metrics
 
-    this->qvtkDisconnect( peNode, vtkMRMLPerkEvaluatorNode::AnalysisStateUpdatedEvent, this, SLOT( OnAnalysisStateUpdated( vtkObject*, void* ) ) );
-    d->AnalysisStateDialog->hide();
-  }
+  this->qvtkDisconnect( d->logic(), vtkSlicerPerkEvaluatorLogic::MetricsBatchProgressEvent, this, SLOT( OnAnalysisStateUpdated( vtkObject*, void* ) ) );
+  d->AnalysisStateDialog->hide();
 
   d->PerkEvaluatorNodeComboBox->setCurrentNode( originalPerkEvaluatorNode );
 }
 
 
+void qSlicerPerkEvaluatorModuleWidget
+::OnComputeWindowedMetricsClicked()
+{
+  Q_D( qSlicerPerkEvaluatorModuleWidget );
+
+  vtkMRMLPerkEvaluatorNode* peNode = vtkMRMLPerkEvaluatorNode::SafeDownCast( d->PerkEvaluatorNodeComboBox->currentNode() );
+  if ( peNode == NULL )
+  {
+    return;
+  }
+
+  // Create a table for the results if none is selected
+  vtkMRMLTableNode* windowedMetricsTableNode = vtkMRMLTableNode::SafeDownCast( d->WindowedMetricsTableNodeComboBox->currentNode() );
+  if ( windowedMetricsTableNode == NULL )
+  {
+    windowedMetricsTableNode = vtkMRMLTableNode::SafeDownCast( d->WindowedMetricsTableNodeComboBox->addNode() );
+  }
+  if ( windowedMetricsTableNode == NULL )
+  {
+    return;
+  }
+
+  QApplication::setOverrideCursor( Qt::WaitCursor );
+  d->logic()->ComputeWindowedMetrics( peNode, d->WindowLengthSpinBox->value(), d->WindowStepSpinBox->value(), windowedMetricsTableNode );
+  QApplication::restoreOverrideCursor();
+}
+
+
 void qSlicerPerkEvaluatorModuleWidget
 ::OnMarkBeginChanged()
 {
@@ -337,6 +518,7 @@ void qSlicerPerkEvaluatorModuleWidget
   }
 
   peNode->SetMarkBegin( d->BeginSpinBox->value() );
+  this->updateMetricsOverMarkedRange( peNode );
 }
 
 
@@ -352,6 +534,7 @@ void qSlicerPerkEvaluatorModuleWidget
   }
 
   peNode->SetMarkBegin( d->logic()->GetRelativePlaybackTime( peNode ) );
+  this->updateMetricsOverMarkedRange( peNode );
 }
 
 
@@ -367,6 +550,7 @@ void qSlicerPerkEvaluatorModuleWidget
   }
 
   peNode->SetMarkEnd( d->EndSpinBox->value() );
+  this->updateMetricsOverMarkedRange( peNode );
 }
 
 
@@ -382,6 +566,28 @@ void qSlicerPerkEvaluatorModuleWidget
   }
 
   peNode->SetMarkEnd( d->logic()->GetRelativePlaybackTime( peNode ) );
+  this->updateMetricsOverMarkedRange( peNode );
+}
+
+
+void qSlicerPerkEvaluatorModuleWidget
+::updateMetricsOverMarkedRange( vtkMRMLPerkEvaluatorNode* peNode )
+{
+  Q_D( qSlicerPerkEvaluatorModuleWidget );
+
+  // Only refresh values which were already computed, so moving the marks does not start an analysis
+  if ( peNode->GetMetricsTableNode() == NULL || peNode->GetMetricsTableNode()->GetTable() == NULL
+    || peNode->GetMetricsTableNode()->GetTable()->GetNumberOfRows() == 0 )
+  {
+    return;
+  }
+
+  // The script metric values are cleared, they are only computed again by the next analysis
+  // If the range metrics are being built in the background, the values are updated once they are applied
+  if ( ! d->logic()->ComputeMetricsOverMarkedRange( peNode ) && d->logic()->GetAnalysisJobsRunning() && ! this->AnalysisJobTimer->isActive() )
+  {
+    this->AnalysisJobTimer->start( ANALYSIS_JOB_INTERVAL_MSEC );
+  }
 }
 
 
@@ -476,6 +682,50 @@ void qSlicerPerkEvaluatorModuleWidget
 }
 
 
+void qSlicerPerkEvaluatorModuleWidget
+::OnPlaybackInterpolationToggled()
+{
+  Q_D( qSlicerPerkEvaluatorModuleWidget );
+
+  vtkMRMLPerkEvaluatorNode* peNode = vtkMRMLPerkEvaluatorNode::SafeDownCast( d->PerkEvaluatorNodeComboBox->currentNode() );
+  if ( peNode == NULL )
+  {
+    return;
+  }
+
+  if ( d->PlaybackInterpolationCheckBox->isChecked() )
+  {
+    peNode->SetPlaybackInterpolation( vtkMRMLPerkEvaluatorNode::LinearInterpolation );
+  }
+  else
+  {
+    peNode->SetPlaybackInterpolation( vtkMRMLPerkEvaluatorNode::NoInterpolation );
+  }
+}
+
+
+void qSlicerPerkEvaluatorModuleWidget
+::OnAnalysisInterpolationToggled()
+{
+  Q_D( qSlicerPerkEvaluatorModuleWidget );
+
+  vtkMRMLPerkEvaluatorNode* peNode = vtkMRMLPerkEvaluatorNode::SafeDownCast( d->PerkEvaluatorNodeComboBox->currentNode() );
+  if ( peNode == NULL )
+  {
+    return;
+  }
+
+  if ( d->AnalysisInterpolationCheckBox->isChecked() )
+  {
+    peNode->SetAnalysisInterpolation( vtkMRMLPerkEvaluatorNode::LinearInterpolation );
+  }
+  else
+  {
+    peNode->SetAnalysisInterpolation( vtkMRMLPerkEvaluatorNode::NoInterpolation );
+  }
+}
+
+
 void qSlicerPerkEvaluatorModuleWidget
 ::OnMetricInstanceNodesChanged()
 {
@@ -634,7 +884,11 @@ qSlicerPerkEvaluatorModuleWidget
   d->EndButton->setIcon( QApplication::style()->standardIcon( QStyle::SP_MediaSkipForward ) );
 
 
+  connect( d->PlaybackInterpolationCheckBox, SIGNAL( toggled( bool ) ), this, SLOT( OnPlaybackInterpolationToggled() ) );
+  connect( d->PlaybackSpeedComboBox, SIGNAL( currentIndexChanged( int ) ), this, SLOT( OnPlaybackSpeedChanged( int ) ) );
+
   connect( this->PlaybackTimer, SIGNAL( timeout() ), this, SLOT( OnTimeout() ) );
+  connect( this->AnalysisJobTimer, SIGNAL( timeout() ), this, SLOT( OnAnalysisJobTimeout() ) );
 
   // If the transform buffer node is changed, update everything
   connect( d->TransformBufferWidget, SIGNAL( transformBufferNodeChanged( vtkMRMLNode* ) ), this, SLOT( onTransformBufferChanged( vtkMRMLNode* ) ) );
@@ -658,6 +912,8 @@ qSlicerPerkEvaluatorModuleWidget
   connect( d->AnalyzeButton, SIGNAL( clicked() ), this, SLOT( OnAnalyzeClicked() ) );
 
   connect( d->BatchProcessButton, SIGNAL( clicked() ), this, SLOT( OnBatchProcessButtonClicked() ) );
+
+  connect( d->ComputeWindowedMetricsButton, SIGNAL( clicked() ), this, SLOT( OnComputeWindowedMetricsClicked() ) );
   d->BatchProcessButton->setIcon( QIcon( ":/Icons/Go.png" ) );
 
   connect( d->AnalysisStateDialog, SIGNAL( canceled() ), this, SLOT( OnAnalysisCanceled() ) );
@@ -672,6 +928,7 @@ qSlicerPerkEvaluatorModuleWidget
   connect( d->EditMetricInstanceNodeComboBox, SIGNAL( currentNodeChanged( vtkMRMLNode* ) ), this, SLOT( OnEditMetricInstanceNodeChanged() ) );
   connect( d->MetricInstanceComboBox, SIGNAL( checkedNodesChanged() ), this, SLOT( OnMetricInstanceNodesChanged() ) );
   connect( d->AutoUpdateMeasurementRangeCheckBox, SIGNAL( toggled( bool ) ), this, SLOT( OnAutoUpdateMeasurementRangeToggled() ) );
+  connect( d->AnalysisInterpolationCheckBox, SIGNAL( toggled( bool ) ), this, SLOT( OnAnalysisInterpolationToggled() ) );
   connect( d->NeedleOrientationButtonGroup, SIGNAL( buttonClicked( QAbstractButton* ) ), this, SLOT( onNeedleOrientationChanged( QAbstractButton* ) ) );
 
 
@@ -771,6 +1028,8 @@ void qSlicerPerkEvaluatorModuleWidget
   }
   
   // d->logic()->CreateLocalMetrics( peNode );
+  // Make the native metrics available, only once the scene is used for an analysis
+  d->logic()->AddNativeMetricsToScene();
   // Everything else is taken care of by the mrmlNodeChanged function
 }
 
@@ -827,6 +1086,8 @@ void qSlicerPerkEvaluatorModuleWidget
 
 
   d->AutoUpdateMeasurementRangeCheckBox->setChecked( peNode->GetAutoUpdateMeasurementRange() ); 
+  d->PlaybackInterpolationCheckBox->setChecked( peNode->GetPlaybackInterpolation() == vtkMRMLPerkEvaluatorNode::LinearInterpolation );
+  d->AnalysisInterpolationCheckBox->setChecked( peNode->GetAnalysisInterpolation() == vtkMRMLPerkEvaluatorNode::LinearInterpolation );
 
   if ( peNode->GetNeedleOrientation() == vtkMRMLPerkEvaluatorNode::PlusX )
   {
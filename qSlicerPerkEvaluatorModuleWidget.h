@@ -16,6 +16,7 @@
 
 class qSlicerPerkEvaluatorModuleWidgetPrivate;
 class vtkMRMLNode;
+class vtkMRMLPerkEvaluatorNode;
 
 /// \ingroup Slicer_QtModules_ExtensionTemplate
 class Q_SLICER_QTMODULES_PERKEVALUATOR_EXPORT qSlicerPerkEvaluatorModuleWidget :
@@ -29,6 +30,12 @@ public:
   qSlicerPerkEvaluatorModuleWidget(QWidget *parent=0);
   virtual ~qSlicerPerkEvaluatorModuleWidget();
 
+  // Playback runs at this multiple of real time (clamped to 0.25-16)
+  void setPlaybackSpeed( double newPlaybackSpeed );
+  double getPlaybackSpeed();
+  // Scene updates per second during the last second of playback
+  double getAchievedPlaybackFrameRate();
+
 public slots:
 
   void OnPlaybackSliderChanged( double value );
@@ -39,15 +46,21 @@ public slots:
   void OnPlaybackPlayClicked();
   void OnPlaybackStopClicked();
 
+  void OnPlaybackSpeedChanged( int index );
+
   void OnTimeout();
 
   void OnAnalyzeClicked();
 
   void OnAnalysisStateUpdated( vtkObject* caller, void* value );
   void OnAnalysisCanceled();
+  void OnAnalysisJobTimeout();
+  void OnAnalysisJobFinished();
 
   void OnBatchProcessButtonClicked();
 
+  void OnComputeWindowedMetricsClicked();
+
   void OnMarkBeginChanged();
   void OnMarkBeginClicked();
   void OnMarkEndChanged();
@@ -59,6 +72,8 @@ public slots:
   void OnEditMetricInstanceNodeChanged();
 
   void OnAutoUpdateMeasurementRangeToggled();
+  void OnPlaybackInterpolationToggled();
+  void OnAnalysisInterpolationToggled();
 
   void onTissueModelChanged( vtkMRMLNode* node );
   void onNeedleTransformChanged( vtkMRMLNode* node );
@@ -78,10 +93,25 @@ protected:
   virtual void enter();
 
   QTimer* PlaybackTimer;
+  QTimer* AnalysisJobTimer; // Polls the background analysis while it runs
   // TODO: Should these be moved to the PerkEvaluator node? Should these be changeable by the user?
   double PlaybackTimerIntervalSec;
   double FrameStepSec;
 
+  // Refresh the metric values for the current marks, if the metrics can be queried over a range
+  void updateMetricsOverMarkedRange( vtkMRMLPerkEvaluatorNode* peNode );
+
+  // The playback time follows the wall clock from where playback was (re)started, so slow scene updates skip frames instead of falling behind
+  void restartPlaybackClock();
+  QTime PlaybackClock;
+  double PlaybackClockStartTime; // Relative playback time when the clock was started
+  double LastPlaybackTime; // Relative playback time set on the last tick (if it changed since, playback was moved by the user)
+  double PlaybackSpeed;
+
+  QTime PlaybackFrameRateClock;
+  int PlaybackFrameCount;
+  double AchievedPlaybackFrameRate;
+
 private:
   Q_DECLARE_PRIVATE(qSlicerPerkEvaluatorModuleWidget);
   Q_DISABLE_COPY(qSlicerPerkEvaluatorModuleWidget);